@@ -30,6 +30,11 @@ AC_DEFUN([AC_FUNC_PPOLL], [
 			[Define to 1 if you need the ppoll() function.]))
 ])
 
+AC_DEFUN([AC_FUNC_SENDMMSG], [
+	AC_CHECK_FUNC(sendmmsg, AC_DEFINE(HAVE_SENDMMSG, 1,
+			[Define to 1 if you have the sendmmsg() function.]))
+])
+
 AC_DEFUN([AC_INIT_BLUEZ], [
 	AC_PREFIX_DEFAULT(/usr/local)
 
@@ -114,7 +119,7 @@ AC_DEFUN([AC_PATH_GLIB], [
 ])
 
 AC_DEFUN([AC_PATH_GSTREAMER], [
-	PKG_CHECK_MODULES(GSTREAMER, gstreamer-0.10 gstreamer-plugins-base-0.10, gstreamer_found=yes, gstreamer_found=no)
+	PKG_CHECK_MODULES(GSTREAMER, gstreamer-0.10 >= 0.10.24 gstreamer-plugins-base-0.10 >= 0.10.24, gstreamer_found=yes, gstreamer_found=no)
 	AC_SUBST(GSTREAMER_CFLAGS)
 	AC_SUBST(GSTREAMER_LIBS)
 	GSTREAMER_PLUGINSDIR=`$PKG_CONFIG --variable=pluginsdir gstreamer-0.10`
@@ -105,6 +105,10 @@ struct a2dp_server {
 };
 
 static GSList *servers = NULL;
+
+/* Records are built once and copied for every further adapter */
+static sdp_record_t *source_template = NULL;
+static sdp_record_t *sink_template = NULL;
 static GSList *setups = NULL;
 static unsigned int cb_id = 0;
 
@@ -1048,7 +1052,7 @@ static struct a2dp_sep *a2dp_add_sep(struct a2dp_server *server, uint8_t type,
 	struct a2dp_sep *sep;
 	GSList **l;
 	uint32_t *record_id;
-	sdp_record_t *record;
+	sdp_record_t *record, **tmpl;
 	struct avdtp_sep_ind *ind;
 
 	sep = g_new0(struct a2dp_sep, 1);
@@ -1077,7 +1081,15 @@ static struct a2dp_sep *a2dp_add_sep(struct a2dp_server *server, uint8_t type,
 	if (*record_id != 0)
 		goto add;
 
-	record = a2dp_record(type, server->version);
+	if (type == AVDTP_SEP_TYPE_SOURCE)
+		tmpl = &source_template;
+	else
+		tmpl = &sink_template;
+
+	if (*tmpl == NULL)
+		*tmpl = a2dp_record(type, server->version);
+
+	record = *tmpl ? sdp_record_from_template(*tmpl, 0, 0) : NULL;
 	if (!record) {
 		error("Unable to allocate new service record");
 		avdtp_unregister_sep(sep->sep);
@@ -1275,6 +1287,16 @@ void a2dp_unregister(const bdaddr_t *src)
 	if (servers)
 		return;
 
+	if (source_template) {
+		sdp_record_free(source_template);
+		source_template = NULL;
+	}
+
+	if (sink_template) {
+		sdp_record_free(sink_template);
+		sink_template = NULL;
+	}
+
 	dbus_connection_unref(connection);
 	connection = NULL;
 }
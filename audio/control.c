@@ -49,6 +49,7 @@
 #include "log.h"
 #include "error.h"
 #include "uinput.h"
+#include "uinput-batch.h"
 #include "adapter.h"
 #include "../src/device.h"
 #include "device.h"
@@ -72,6 +73,9 @@
 #define AVCTP_PACKET_CONTINUE	2
 #define AVCTP_PACKET_END	3
 
+/* Largest AV/C frame, metadata responses above it are fragmented */
+#define AVC_MTU			512
+
 /* ctype entries */
 #define CTYPE_CONTROL		0x0
 #define CTYPE_STATUS		0x1
@@ -126,6 +130,8 @@
 #define INFORM_BATT_STATUS_OF_CT		0x18
 #define GET_ELEMENT_ATTRIBUTES			0x20
 #define GET_PLAY_STATUS				0x30
+#define REQUEST_CONTINUING_RESPONSE		0x40
+#define ABORT_CONTINUING_RESPONSE		0x41
 
 /* Capabilities */
 #define CAP_COMPANY_ID		0x2
@@ -196,6 +202,10 @@ static DBusConnection *connection = NULL;
 
 static GSList *servers = NULL;
 
+/* Records are built once and copied for every further adapter */
+static sdp_record_t *tg_template = NULL;
+static sdp_record_t *ct_template = NULL;
+
 #if __BYTE_ORDER == __LITTLE_ENDIAN
 
 struct avctp_header {
@@ -275,11 +285,16 @@ struct control {
 	avctp_state_t state;
 
 	int uinput;
+	struct uinput_batch *batch;
 
 	GIOChannel *io;
 	guint io_id;
 
 	uint16_t mtu;
+	uint16_t omtu;
+
+	unsigned char *buf;
+	size_t buf_len;
 
 	gboolean target;
 
@@ -297,6 +312,18 @@ struct control {
 	char *mpris_number;
 	char *mpris_genre;
 	uint32_t mpris_total;
+
+	/* GetElementAttributes response for all attributes, encoded once
+	 * per metadata change, with the offset of every attribute in it */
+	uint8_t *element_attrs;
+	size_t element_attrs_len;
+	size_t element_offset[METADATA_PLAY_TIME + 1];
+
+	/* Rest of a fragmented response, sent on RequestContinuingResponse */
+	uint8_t *pending_rsp;
+	size_t pending_len;
+	size_t pending_offset;
+	uint8_t pending_pdu;
 };
 
 static struct {
@@ -452,27 +479,6 @@ static sdp_record_t *avrcp_tg_record()
 	return record;
 }
 
-static int send_event(int fd, uint16_t type, uint16_t code, int32_t value)
-{
-	struct uinput_event event;
-
-	memset(&event, 0, sizeof(event));
-	event.type	= type;
-	event.code	= code;
-	event.value	= value;
-
-	return write(fd, &event, sizeof(event));
-}
-
-static void send_key(int fd, uint16_t key, int pressed)
-{
-	if (fd < 0)
-		return;
-
-	send_event(fd, EV_KEY, key, pressed);
-	send_event(fd, EV_SYN, SYN_REPORT, 0);
-}
-
 static void handle_panel_passthrough(struct control *control,
 					const unsigned char *operands,
 					int operand_count)
@@ -480,9 +486,12 @@ static void handle_panel_passthrough(struct control *control,
 	const char *status;
 	int pressed, i;
 
-	if (operand_count == 0)
+	if (operand_count == 0 || control->batch == NULL)
 		return;
 
+	uinput_batch_report(control->batch,
+				g_io_channel_unix_get_fd(control->io));
+
 	if (operands[0] & 0x80) {
 		status = "released";
 		pressed = 0;
@@ -508,20 +517,30 @@ static void handle_panel_passthrough(struct control *control,
 			}
 
 			DBG("AVRCP: treating key press as press + release");
-			send_key(control->uinput, key_map[i].uinput, 1);
-			send_key(control->uinput, key_map[i].uinput, 0);
+			uinput_batch_key(control->batch, key_map[i].uinput, 1);
+			uinput_batch_key(control->batch, key_map[i].uinput, 0);
 			break;
 		}
 
-		send_key(control->uinput, key_map[i].uinput, pressed);
+		uinput_batch_key(control->batch, key_map[i].uinput, pressed);
 		break;
 	}
 
+	uinput_batch_flush(control->batch);
+
 	if (key_map[i].name == NULL)
 		DBG("AVRCP: unknown button 0x%02X %s",
 						operands[0] & 0x7F, status);
 }
 
+static void metadata_pending_free(struct control *control)
+{
+	g_free(control->pending_rsp);
+	control->pending_rsp = NULL;
+	control->pending_len = 0;
+	control->pending_offset = 0;
+}
+
 static void avctp_disconnected(struct audio_device *dev)
 {
 	struct control *control = dev->control;
@@ -529,6 +548,12 @@ static void avctp_disconnected(struct audio_device *dev)
 	if (!control)
 		return;
 
+	metadata_pending_free(control);
+
+	g_free(control->buf);
+	control->buf = NULL;
+	control->buf_len = 0;
+
 	if (control->io) {
 		g_io_channel_shutdown(control->io, TRUE, NULL);
 		g_io_channel_unref(control->io);
@@ -550,6 +575,9 @@ static void avctp_disconnected(struct audio_device *dev)
 		ba2str(&dev->dst, address);
 		DBG("AVRCP: closing uinput for %s", address);
 
+		uinput_batch_free(control->batch);
+		control->batch = NULL;
+
 		ioctl(control->uinput, UI_DEV_DESTROY);
 		close(control->uinput);
 		control->uinput = -1;
@@ -610,25 +638,225 @@ static void avctp_set_state(struct control *control, avctp_state_t new_state)
 	}
 }
 
-static void handle_metadata_pdu(struct control *control,
+static const char *element_attr_value(struct control *control,
+						uint32_t id, char *buf)
+{
+	switch (id) {
+	case METADATA_TITLE:
+		return control->mpris_title;
+	case METADATA_ARTIST:
+		return control->mpris_artist;
+	case METADATA_ALBUM:
+		return control->mpris_album;
+	case METADATA_NUMBER:
+		return control->mpris_number;
+	case METADATA_GENRE:
+		return control->mpris_genre;
+	case METADATA_PLAY_TIME:
+		if (!control->mpris_total)
+			return NULL;
+		sprintf(buf, "%u", control->mpris_total);
+		return buf;
+	default:
+		return NULL;
+	}
+}
+
+static void element_attrs_update(struct control *control)
+{
+	char play_time[11];
+	const char *value;
+	size_t size = 1, len;
+	uint8_t *ptr;
+	uint32_t id;
+
+	for (id = METADATA_TITLE; id <= METADATA_PLAY_TIME; id++) {
+		value = element_attr_value(control, id, play_time);
+		if (value)
+			size += 8 + MIN(strlen(value), G_MAXUINT16);
+	}
+
+	g_free(control->element_attrs);
+	control->element_attrs = g_malloc(size);
+	control->element_attrs_len = size;
+
+	ptr = control->element_attrs;
+	*ptr++ = 0;
+
+	for (id = METADATA_TITLE; id <= METADATA_PLAY_TIME; id++) {
+		value = element_attr_value(control, id, play_time);
+		if (!value) {
+			control->element_offset[id] = 0;
+			continue;
+		}
+
+		len = MIN(strlen(value), G_MAXUINT16);
+
+		control->element_offset[id] = ptr - control->element_attrs;
+
+		*ptr++ = id >> 24;
+		*ptr++ = id >> 16;
+		*ptr++ = id >> 8;
+		*ptr++ = id;
+		*ptr++ = CHARSET_UTF8 >> 8;
+		*ptr++ = CHARSET_UTF8 & 0xff;
+		*ptr++ = len >> 8;
+		*ptr++ = len & 0xff;
+		memcpy(ptr, value, len);
+		ptr += len;
+
+		control->element_attrs[0]++;
+	}
+}
+
+/* Rebuilt by the next GetElementAttributes */
+static void element_attrs_invalidate(struct control *control)
+{
+	g_free(control->element_attrs);
+	control->element_attrs = NULL;
+}
+
+static size_t metadata_max_params(struct control *control)
+{
+	size_t frame = AVC_MTU;
+
+	if (control->omtu && control->omtu - AVCTP_HEADER_LENGTH < AVC_MTU)
+		frame = control->omtu - AVCTP_HEADER_LENGTH;
+
+	return frame - AVRCP_HEADER_LENGTH - 3 - METADATA_HEADER_LENGTH;
+}
+
+/* Puts the next fragment of the pending response into params */
+static void metadata_fragment(struct control *control,
+				struct metadata_header *metadata,
+				uint8_t *params)
+{
+	size_t left = control->pending_len - control->pending_offset;
+	size_t max = metadata_max_params(control);
+	size_t len;
+
+	if (left > max) {
+		metadata->packet_type = control->pending_offset ?
+				AVCTP_PACKET_CONTINUE : AVCTP_PACKET_START;
+		len = max;
+	} else {
+		metadata->packet_type = control->pending_offset ?
+				AVCTP_PACKET_END : AVCTP_PACKET_SINGLE;
+		len = left;
+	}
+
+	memcpy(params, control->pending_rsp + control->pending_offset, len);
+	metadata->parameter_length = len;
+
+	control->pending_offset += len;
+	if (control->pending_offset == control->pending_len)
+		metadata_pending_free(control);
+}
+
+static void metadata_respond(struct control *control,
+				struct metadata_header *metadata,
+				uint8_t *params, const uint8_t *rsp, size_t len)
+{
+	if (len <= metadata_max_params(control)) {
+		memcpy(params, rsp, len);
+		metadata->parameter_length = len;
+		return;
+	}
+
+	control->pending_rsp = g_memdup(rsp, len);
+	control->pending_len = len;
+	control->pending_offset = 0;
+	control->pending_pdu = metadata->pdu_id;
+
+	metadata_fragment(control, metadata, params);
+}
+
+static void get_element_attributes(struct control *control,
+					struct metadata_header *metadata,
+					uint8_t *params)
+{
+	uint8_t count = params[8], *rsp, *ptr;
+	const uint8_t *attr;
+	unsigned int seen = 0;
+	uint32_t id;
+	size_t len;
+	int i;
+
+	if (!control->element_attrs)
+		element_attrs_update(control);
+
+	/* All attributes requested, the cached response is all it takes */
+	if (count == 0) {
+		metadata_respond(control, metadata, params,
+						control->element_attrs,
+						control->element_attrs_len);
+		return;
+	}
+
+	/* Unknown and repeated attributes are left out, so the selection
+	 * never gets larger than the cached response */
+	rsp = g_malloc(control->element_attrs_len);
+	ptr = rsp + 1;
+	rsp[0] = 0;
+
+	for (i = 0; i < count; i++) {
+		const uint8_t *req = params + 9 + 4 * i;
+
+		id = (req[0] << 24) | (req[1] << 16) | (req[2] << 8) | req[3];
+
+		if (id > METADATA_PLAY_TIME || (seen & (1 << id)) ||
+					!control->element_offset[id])
+			continue;
+
+		seen |= 1 << id;
+
+		attr = control->element_attrs + control->element_offset[id];
+		len = 8 + ((attr[6] << 8) | attr[7]);
+
+		memcpy(ptr, attr, len);
+		ptr += len;
+		rsp[0]++;
+	}
+
+	metadata_respond(control, metadata, params, rsp, ptr - rsp);
+
+	g_free(rsp);
+}
+
+/* Returns the number of operands of the response */
+static int handle_metadata_pdu(struct control *control,
 				struct avrcp_header *avrcp, int operand_count)
 {
 	uint8_t i, rsp_i = 0;
-	size_t metadata_length = operand_count - 3;
-	size_t params_count = metadata_length - METADATA_HEADER_LENGTH;
 	struct metadata_header *metadata;
-	uint8_t *metadata_params, rsp[params_count];
-	uint32_t element_id;
+	uint8_t *metadata_params, rsp[AVC_MTU];
 
-	metadata = (struct metadata_header *) avrcp + AVRCP_HEADER_LENGTH + 3;
+	if (operand_count < 3 + METADATA_HEADER_LENGTH) {
+		avrcp->code = CTYPE_REJECTED;
+		return operand_count;
+	}
+
+	metadata = (void *) ((uint8_t *) avrcp + AVRCP_HEADER_LENGTH + 3);
 	metadata_params = (unsigned char *) metadata + METADATA_HEADER_LENGTH;
 
+	metadata->parameter_length = ntohs(metadata->parameter_length);
+
+	if (metadata->parameter_length >
+			operand_count - 3 - METADATA_HEADER_LENGTH)
+		metadata->parameter_length =
+				operand_count - 3 - METADATA_HEADER_LENGTH;
+
 	/* metadata segmentation */
 	if (metadata->packet_type != AVCTP_PACKET_SINGLE) {
 		avrcp->code = CTYPE_NOT_IMPLEMENTED;
-		return;
+		goto done;
 	}
 
+	/* Any other command ends a fragmented response */
+	if (control->pending_rsp &&
+			metadata->pdu_id != REQUEST_CONTINUING_RESPONSE)
+		metadata_pending_free(control);
+
 	switch (metadata->pdu_id) {
 	case GET_CAPABILITIES:
 		if (metadata->parameter_length < 1) {
@@ -918,126 +1146,70 @@ static void handle_metadata_pdu(struct control *control,
 		avrcp->code = CTYPE_NOT_IMPLEMENTED;
 		break;
 	case GET_ELEMENT_ATTRIBUTES:
-		element_id = (metadata_params[0] << 24) |
-				(metadata_params[1] << 16) |
-				(metadata_params[2] << 8) |
-				metadata_params[3];
-		if (element_id != ELEMENT_PLAYING) {
+		/* 8 octets identifier, only PLAYING is valid, and the
+		 * number of attributes followed by their 4 octets ids */
+		for (i = 0; i < 8 && metadata->parameter_length >= 9; i++)
+			if (metadata_params[i] != ELEMENT_PLAYING)
+				break;
+
+		if (i < 8 || metadata->parameter_length <
+						9 + 4 * metadata_params[8]) {
 			avrcp->code = CTYPE_REJECTED;
 			metadata->parameter_length = 1;
 			metadata_params[0] = E_INVALID_PARAM;
 			break;
 		}
+
 		avrcp->code = CTYPE_STABLE;
-		rsp[rsp_i++] = metadata_params[4];
-		for (i = 0; i < metadata_params[4]; i++) {
-			char metainfo[65536];
-			uint16_t attribute_id = (metadata_params[i*2+5] << 8) |
-						metadata_params[i*2+5+1];
-			switch (attribute_id) {
-			case METADATA_TITLE:
-				rsp[rsp_i++] = (uint8_t) METADATA_TITLE &
-						0xFF00;
-				rsp[rsp_i++] = (uint8_t) METADATA_TITLE &
-						0x00FF;
-				snprintf(metainfo, 65536, "%s", "Get title from MPRIS");
-				rsp[rsp_i++] = strlen(metainfo);
-				memcpy(rsp + rsp_i, metainfo, rsp[rsp_i-1]);
-				rsp_i += rsp[rsp_i-1];
-				break;
-			case METADATA_ARTIST:
-				rsp[rsp_i++] = (uint8_t) METADATA_ARTIST &
-						0xFF00;
-				rsp[rsp_i++] = (uint8_t) METADATA_ARTIST &
-						0x00FF;
-				snprintf(metainfo, 65536, "%s", "Get artist from MPRIS");
-				rsp[rsp_i++] = strlen(metainfo);
-				memcpy(rsp + rsp_i, metainfo, rsp[rsp_i-1]);
-				rsp_i += rsp[rsp_i-1];
-				break;
-			case METADATA_ALBUM:
-				rsp[rsp_i++] = (uint8_t) METADATA_ALBUM &
-						0xFF00;
-				rsp[rsp_i++] = (uint8_t) METADATA_ALBUM &
-						0x00FF;
-				snprintf(metainfo, 65536, "%s", "Get album from MPRIS");
-				rsp[rsp_i++] = strlen(metainfo);
-				memcpy(rsp + rsp_i, metainfo, rsp[rsp_i-1]);
-				rsp_i += rsp[rsp_i-1];
-				break;
-			case METADATA_NUMBER:
-				rsp[rsp_i++] = (uint8_t) METADATA_NUMBER &
-						0xFF00;
-				rsp[rsp_i++] = (uint8_t) METADATA_NUMBER &
-						0x00FF;
-				snprintf(metainfo, 65536, "%s", "Get number from MPRIS");
-				rsp[rsp_i++] = strlen(metainfo);
-				memcpy(rsp + rsp_i, metainfo, rsp[rsp_i-1]);
-				rsp_i += rsp[rsp_i-1];
-				break;
-			case METADATA_TOTAL:
-				rsp[rsp_i++] = (uint8_t) METADATA_TOTAL &
-						0xFF00;
-				rsp[rsp_i++] = (uint8_t) METADATA_TOTAL &
-						0x00FF;
-				snprintf(metainfo, 65536, "%s", "Get total from MPRIS");
-				rsp[rsp_i++] = strlen(metainfo);
-				memcpy(rsp + rsp_i, metainfo, rsp[rsp_i-1]);
-				rsp_i += rsp[rsp_i-1];
-				break;
-			case METADATA_GENRE:
-				rsp[rsp_i++] = (uint8_t) METADATA_GENRE &
-						0xFF00;
-				rsp[rsp_i++] = (uint8_t) METADATA_GENRE &
-						0x00FF;
-				snprintf(metainfo, 65536, "%s", "Get genre from MPRIS");
-				rsp[rsp_i++] = strlen(metainfo);
-				memcpy(rsp + rsp_i, metainfo, rsp[rsp_i-1]);
-				rsp_i += rsp[rsp_i-1];
-				break;
-			case METADATA_PLAY_TIME:
-				rsp[rsp_i++] = (uint8_t) METADATA_PLAY_TIME &
-						0xFF00;
-				rsp[rsp_i++] = (uint8_t) METADATA_PLAY_TIME &
-						0x00FF;
-				snprintf(metainfo, 65536, "%s", "Get time from MPRIS");
-				rsp[rsp_i++] = strlen(metainfo);
-				memcpy(rsp + rsp_i, metainfo, rsp[rsp_i-1]);
-				rsp_i += rsp[rsp_i-1];
-				break;
-			default:
-				avrcp->code = CTYPE_REJECTED;
-				metadata->parameter_length = 1;
-				metadata_params[0] = E_INVALID_PARAM;
-				return;
-			}
-			rsp[rsp_i++] = (uint8_t) CHARSET_UTF8 & 0xFF00;
-			rsp[rsp_i++] = (uint8_t) CHARSET_UTF8 & 0x00FF;
-			/* Attribute value length (2 bytes) */
-			rsp[rsp_i++] = 0;
-			rsp[rsp_i++] = 0;
-			memcpy(metadata_params, rsp, rsp_i);
-		}
+		get_element_attributes(control, metadata, metadata_params);
+		break;
 	case GET_PLAY_STATUS:
 		avrcp->code = CTYPE_STABLE;
 		/* get song length, position and player status from MPRIS */
+		metadata->parameter_length = 9;
 		for (i = 0; i < 8; i++)
 			metadata_params[i] = 0xFF;
 		metadata_params[8] = PLAY_STOPPED;
 		break;
+	case REQUEST_CONTINUING_RESPONSE:
+		if (metadata->parameter_length < 1 || !control->pending_rsp ||
+				control->pending_pdu != metadata_params[0]) {
+			avrcp->code = CTYPE_REJECTED;
+			metadata->parameter_length = 1;
+			metadata_params[0] = E_INVALID_PARAM;
+			break;
+		}
+
+		avrcp->code = CTYPE_STABLE;
+		metadata->pdu_id = control->pending_pdu;
+		metadata_fragment(control, metadata, metadata_params);
+		break;
+	case ABORT_CONTINUING_RESPONSE:
+		metadata_pending_free(control);
+		avrcp->code = CTYPE_ACCEPTED;
+		metadata->parameter_length = 0;
+		break;
 	default:
 		avrcp->code = CTYPE_REJECTED;
 		metadata->parameter_length = 1;
 		metadata_params[0] = E_INVALID_COMMAND;
 		break;
 	}
+
+done:
+	operand_count = 3 + METADATA_HEADER_LENGTH +
+					metadata->parameter_length;
+
+	metadata->parameter_length = htons(metadata->parameter_length);
+
+	return operand_count;
 }
 
 static gboolean control_cb(GIOChannel *chan, GIOCondition cond,
 				gpointer data)
 {
 	struct control *control = data;
-	unsigned char buf[1024], *operands;
+	unsigned char *buf = control->buf, *operands;
 	struct avctp_header *avctp;
 	struct avrcp_header *avrcp;
 	int ret, packet_size, operand_count, sock;
@@ -1047,7 +1219,7 @@ static gboolean control_cb(GIOChannel *chan, GIOCondition cond,
 
 	sock = g_io_channel_unix_get_fd(control->io);
 
-	ret = read(sock, buf, sizeof(buf));
+	ret = read(sock, buf, control->buf_len);
 	if (ret <= 0)
 		goto failed;
 
@@ -1129,7 +1301,11 @@ static gboolean control_cb(GIOChannel *chan, GIOCondition cond,
 		if (company_id == IEEEID_BTSIG) {
 			DBG("AVRCP metadata PDU");
 			avctp->cr = AVCTP_RESPONSE;
-			handle_metadata_pdu(control, avrcp, operand_count);
+			operand_count = handle_metadata_pdu(control, avrcp,
+								operand_count);
+			packet_size = sizeof(struct avctp_header) +
+					sizeof(struct avrcp_header) +
+					operand_count;
 		} else {
 			avctp->cr = AVCTP_RESPONSE;
 			avrcp->code = CTYPE_NOT_IMPLEMENTED;
@@ -1226,17 +1402,21 @@ static void init_uinput(struct control *control)
 	ba2str(&dev->dst, address);
 
 	control->uinput = uinput_create(address);
-	if (control->uinput < 0)
+	if (control->uinput < 0) {
 		error("AVRCP: failed to init uinput for %s", address);
-	else
-		DBG("AVRCP: uinput initialized for %s", address);
+		return;
+	}
+
+	control->batch = uinput_batch_new(control->uinput, address);
+
+	DBG("AVRCP: uinput initialized for %s", address);
 }
 
 static void avctp_connect_cb(GIOChannel *chan, GError *err, gpointer data)
 {
 	struct control *control = data;
 	char address[18];
-	uint16_t imtu;
+	uint16_t imtu, omtu;
 	GError *gerr = NULL;
 
 	if (err) {
@@ -1248,6 +1428,7 @@ static void avctp_connect_cb(GIOChannel *chan, GError *err, gpointer data)
 	bt_io_get(chan, BT_IO_L2CAP, &gerr,
 			BT_IO_OPT_DEST, &address,
 			BT_IO_OPT_IMTU, &imtu,
+			BT_IO_OPT_OMTU, &omtu,
 			BT_IO_OPT_INVALID);
 	if (gerr) {
 		avctp_set_state(control, AVCTP_STATE_DISCONNECTED);
@@ -1265,6 +1446,11 @@ static void avctp_connect_cb(GIOChannel *chan, GError *err, gpointer data)
 
 	avctp_set_state(control, AVCTP_STATE_CONNECTED);
 	control->mtu = imtu;
+	control->omtu = omtu;
+
+	/* Whole incoming packets, and room for the largest response */
+	control->buf_len = MAX(imtu, AVCTP_HEADER_LENGTH + AVC_MTU);
+	control->buf = g_malloc0(control->buf_len);
 	control->io_id = g_io_add_watch(chan,
 				G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
 				(GIOFunc) control_cb, control);
@@ -1433,7 +1619,11 @@ int avrcp_register(DBusConnection *conn, const bdaddr_t *src, GKeyFile *config)
 	if (!connection)
 		connection = dbus_connection_ref(conn);
 
-	record = avrcp_tg_record();
+	if (!tg_template)
+		tg_template = avrcp_tg_record();
+
+	record = tg_template ? sdp_record_from_template(tg_template, 0, 0) :
+									NULL;
 	if (!record) {
 		error("Unable to allocate new service record");
 		g_free(server);
@@ -1448,7 +1638,11 @@ int avrcp_register(DBusConnection *conn, const bdaddr_t *src, GKeyFile *config)
 	}
 	server->tg_record_id = record->handle;
 
-	record = avrcp_ct_record();
+	if (!ct_template)
+		ct_template = avrcp_ct_record();
+
+	record = ct_template ? sdp_record_from_template(ct_template, 0, 0) :
+									NULL;
 	if (!record) {
 		error("Unable to allocate new service record");
 		g_free(server);
@@ -1512,6 +1706,16 @@ void avrcp_unregister(const bdaddr_t *src)
 	if (servers)
 		return;
 
+	if (tg_template) {
+		sdp_record_free(tg_template);
+		tg_template = NULL;
+	}
+
+	if (ct_template) {
+		sdp_record_free(ct_template);
+		ct_template = NULL;
+	}
+
 	dbus_connection_unref(connection);
 	connection = NULL;
 }
@@ -1753,8 +1957,10 @@ static DBusMessage *control_set_property(DBusConnection *conn,
 			control->mpris_caps = value;
 		else if (g_str_equal("PlayState", property))
 			control->mpris_play_state = value;
-		else if (g_str_equal("MediaLength", property))
+		else if (g_str_equal("MediaLength", property)) {
 			control->mpris_total = value;
+			element_attrs_invalidate(control);
+		}
 
 		emit_property_changed(conn, dbus_message_get_path(msg),
 					AUDIO_CONTROL_INTERFACE, property,
@@ -1789,30 +1995,28 @@ static DBusMessage *control_set_property(DBusConnection *conn,
 			g_str_equal("MediaNumber", property) ||
 			g_str_equal("MediaGenre", property)) {
 		const char *value;
-		int size;
+		char **field;
 
 		if (dbus_message_iter_get_arg_type(&sub) != DBUS_TYPE_STRING)
 			return invalid_args(msg);
 
 		dbus_message_iter_get_basic(&sub, &value);
-		size = strlen(value) + 1;
-
-		if (g_str_equal("MediaTitle", property)) {
-			control->mpris_title = malloc(size * sizeof(char));
-			strncpy(control->mpris_title, value, size);
-		} else if (g_str_equal("MediaArtist", property)) {
-			control->mpris_artist = malloc(size * sizeof(char));
-			strncpy(control->mpris_artist, value, size);
-		} else if (g_str_equal("MediaAlbum", property)) {
-			control->mpris_album = malloc(size * sizeof(char));
-			strncpy(control->mpris_album, value, size);
-		} else if (g_str_equal("MediaNumber", property)) {
-			control->mpris_number = malloc(size * sizeof(char));
-			strncpy(control->mpris_number, value, size);
-		} else if (g_str_equal("MediaGenre", property)) {
-			control->mpris_genre = malloc(size * sizeof(char));
-			strncpy(control->mpris_genre, value, size);
-		}
+
+		if (g_str_equal("MediaTitle", property))
+			field = &control->mpris_title;
+		else if (g_str_equal("MediaArtist", property))
+			field = &control->mpris_artist;
+		else if (g_str_equal("MediaAlbum", property))
+			field = &control->mpris_album;
+		else if (g_str_equal("MediaNumber", property))
+			field = &control->mpris_number;
+		else
+			field = &control->mpris_genre;
+
+		g_free(*field);
+		*field = g_strdup(value);
+
+		element_attrs_invalidate(control);
 
 		emit_property_changed(conn, dbus_message_get_path(msg),
 					AUDIO_CONTROL_INTERFACE, property,
@@ -1856,6 +2060,12 @@ static void path_unregister(void *data)
 	if (control->state != AVCTP_STATE_DISCONNECTED)
 		avctp_disconnected(dev);
 
+	g_free(control->mpris_title);
+	g_free(control->mpris_artist);
+	g_free(control->mpris_album);
+	g_free(control->mpris_number);
+	g_free(control->mpris_genre);
+	g_free(control->element_attrs);
 	g_free(control);
 	dev->control = NULL;
 }
@@ -31,6 +31,7 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/param.h>
+#include <sys/time.h>
 #include <netinet/in.h>
 
 #include <bluetooth/bluetooth.h>
@@ -59,6 +60,7 @@
 #include "gateway.h"
 #include "sink.h"
 #include "source.h"
+#include "manager.h"
 
 #define AUDIO_INTERFACE "org.bluez.Audio"
 
@@ -91,6 +93,10 @@ struct dev_priv {
 	guint control_timer;
 	guint avdtp_timer;
 	guint headset_timer;
+	guint connect_id;
+
+	/* When the first profile started connecting */
+	struct timeval connect_start;
 
 	gboolean authorized;
 	guint auth_idle_id;
@@ -117,6 +123,8 @@ static void device_free(struct audio_device *dev)
 			g_source_remove(priv->avdtp_timer);
 		if (priv->headset_timer)
 			g_source_remove(priv->headset_timer);
+		if (priv->connect_id)
+			g_source_remove(priv->connect_id);
 		if (priv->dc_req)
 			dbus_message_unref(priv->dc_req);
 		if (priv->conn_req)
@@ -143,6 +151,26 @@ static const char *state2str(audio_state_t state)
 	}
 }
 
+static long connect_elapsed(struct audio_device *dev)
+{
+	struct dev_priv *priv = dev->priv;
+	struct timeval now;
+
+	if (!timerisset(&priv->connect_start))
+		return 0;
+
+	gettimeofday(&now, NULL);
+
+	return (now.tv_sec - priv->connect_start.tv_sec) * 1000 +
+			(now.tv_usec - priv->connect_start.tv_usec) / 1000;
+}
+
+static void connect_stage_done(struct audio_device *dev, const char *stage)
+{
+	DBG("%s: %s connected after %ld ms", dev->path, stage,
+							connect_elapsed(dev));
+}
+
 static void device_set_state(struct audio_device *dev, audio_state_t new_state)
 {
 	struct dev_priv *priv = dev->priv;
@@ -162,6 +190,20 @@ static void device_set_state(struct audio_device *dev, audio_state_t new_state)
 		return;
 	}
 
+	if (priv->state == AUDIO_STATE_DISCONNECTED)
+		gettimeofday(&priv->connect_start, NULL);
+
+	if (new_state == AUDIO_STATE_CONNECTED)
+		DBG("%s: all profiles connected after %ld ms", dev->path,
+							connect_elapsed(dev));
+	else if (new_state == AUDIO_STATE_DISCONNECTED) {
+		if (priv->connect_id) {
+			g_source_remove(priv->connect_id);
+			priv->connect_id = 0;
+		}
+		timerclear(&priv->connect_start);
+	}
+
 	dev->priv->state = new_state;
 
 	if (priv->dc_req && new_state == AUDIO_STATE_DISCONNECTED) {
@@ -311,6 +353,68 @@ static void device_remove_headset_timer(struct audio_device *dev)
 	dev->priv->headset_timer = 0;
 }
 
+static gboolean connect_profiles(gpointer user_data)
+{
+	struct audio_device *dev = user_data;
+	struct dev_priv *priv = dev->priv;
+
+	priv->connect_id = 0;
+
+	if (priv->dc_req || priv->state == AUDIO_STATE_DISCONNECTED)
+		return FALSE;
+
+	DBG("%s: connecting remaining profiles", dev->path);
+
+	if (dev->headset && priv->hs_state == HEADSET_STATE_DISCONNECTED) {
+		if (headset_config_stream(dev, FALSE, NULL, NULL) == 0 &&
+				priv->state != AUDIO_STATE_CONNECTED &&
+				(priv->sink_state == SINK_STATE_CONNECTED ||
+				priv->sink_state == SINK_STATE_PLAYING))
+			device_set_state(dev, AUDIO_STATE_CONNECTED);
+	}
+
+	if (dev->sink && priv->sink_state == SINK_STATE_DISCONNECTED) {
+		struct avdtp *session = avdtp_get(&dev->src, &dev->dst);
+
+		if (session) {
+			sink_setup_stream(dev->sink, session);
+			avdtp_unref(session);
+		}
+	}
+
+	/* AVRCP only once the AVDTP signalling channel is up */
+	if (dev->control && priv->avctp_state == AVCTP_STATE_DISCONNECTED &&
+				(priv->sink_state == SINK_STATE_CONNECTED ||
+				priv->sink_state == SINK_STATE_PLAYING))
+		avrcp_connect(dev);
+
+	return FALSE;
+}
+
+/*
+ * With the parallel connect policy all profiles still missing are
+ * started right away instead of through the per profile timers.
+ */
+static gboolean device_connect_profiles(struct audio_device *dev)
+{
+	struct dev_priv *priv = dev->priv;
+
+	if (manager_get_connect_policy() != CONNECT_POLICY_PARALLEL)
+		return FALSE;
+
+	if (!dev->auto_connect)
+		return FALSE;
+
+	device_remove_headset_timer(dev);
+	device_remove_avdtp_timer(dev);
+	device_remove_control_timer(dev);
+
+	if (!priv->connect_id)
+		priv->connect_id = g_idle_add(connect_profiles, dev);
+
+	return TRUE;
+}
+
 static void device_avdtp_cb(struct audio_device *dev, struct avdtp *session,
 				avdtp_session_state_t old_state,
 				avdtp_session_state_t new_state,
@@ -320,7 +424,9 @@ static void device_avdtp_cb(struct audio_device *dev, struct avdtp *session,
 		return;
 
 	if (new_state == AVDTP_SESSION_STATE_CONNECTED) {
-		if (avdtp_stream_setup_active(session))
+		if (manager_get_connect_policy() == CONNECT_POLICY_PARALLEL)
+			avrcp_connect(dev);
+		else if (avdtp_stream_setup_active(session))
 			device_set_control_timer(dev);
 		else
 			avrcp_connect(dev);
@@ -371,11 +477,14 @@ static void device_sink_cb(struct audio_device *dev,
 	case SINK_STATE_CONNECTED:
 		if (old_state == SINK_STATE_PLAYING)
 			break;
+		connect_stage_done(dev, "A2DP");
 		if (dev->auto_connect) {
 			if (!dev->headset)
 				device_set_state(dev, AUDIO_STATE_CONNECTED);
-			else if (priv->hs_state == HEADSET_STATE_DISCONNECTED)
-				device_set_headset_timer(dev);
+			else if (priv->hs_state == HEADSET_STATE_DISCONNECTED) {
+				if (!device_connect_profiles(dev))
+					device_set_headset_timer(dev);
+			}
 			else if (priv->hs_state == HEADSET_STATE_CONNECTED ||
 					priv->hs_state == HEADSET_STATE_PLAY_IN_PROGRESS ||
 					priv->hs_state == HEADSET_STATE_PLAYING)
@@ -406,6 +515,7 @@ static void device_avctp_cb(struct audio_device *dev,
 		device_remove_control_timer(dev);
 		break;
 	case AVCTP_STATE_CONNECTED:
+		connect_stage_done(dev, "AVRCP");
 		break;
 	}
 }
@@ -447,11 +557,14 @@ static void device_headset_cb(struct audio_device *dev,
 				old_state == HEADSET_STATE_PLAY_IN_PROGRESS ||
 				old_state == HEADSET_STATE_PLAYING)
 			break;
+		connect_stage_done(dev, "HFP/HSP");
 		if (dev->auto_connect) {
 			if (!dev->sink)
 				device_set_state(dev, AUDIO_STATE_CONNECTED);
-			else if (priv->sink_state == SINK_STATE_DISCONNECTED)
-				device_set_avdtp_timer(dev);
+			else if (priv->sink_state == SINK_STATE_DISCONNECTED) {
+				if (!device_connect_profiles(dev))
+					device_set_avdtp_timer(dev);
+			}
 			else if (priv->sink_state == SINK_STATE_CONNECTED ||
 					priv->sink_state == SINK_STATE_PLAYING)
 				device_set_state(dev, AUDIO_STATE_CONNECTED);
@@ -524,6 +637,11 @@ static DBusMessage *dev_disconnect(DBusConnection *conn, DBusMessage *msg,
 
 	priv->dc_req = dbus_message_ref(msg);
 
+	if (priv->connect_id) {
+		g_source_remove(priv->connect_id);
+		priv->connect_id = 0;
+	}
+
 	if (dev->control) {
 		device_remove_control_timer(dev);
 		avrcp_disconnect(dev);
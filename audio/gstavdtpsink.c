@@ -25,8 +25,11 @@
 #include <config.h>
 #endif
 
+#define _GNU_SOURCE
+#include <errno.h>
 #include <unistd.h>
 #include <sys/un.h>
+#include <sys/uio.h>
 #include <sys/socket.h>
 #include <fcntl.h>
 #include <pthread.h>
@@ -53,6 +56,11 @@ GST_DEBUG_CATEGORY_STATIC(avdtp_sink_debug);
 
 #define DEFAULT_AUTOCONNECT TRUE
 
+/* Packets sent with one system call, and buffers per packet: the RTP
+ * header plus up to 15 SBC frames, the most a payload header counts */
+#define RENDER_LIST_PACKETS 16
+#define RENDER_LIST_IOVECS 16
+
 #define GST_AVDTP_SINK_MUTEX_LOCK(s) G_STMT_START {	\
 		g_mutex_lock(s->sink_lock);		\
 	} G_STMT_END
@@ -1165,6 +1173,124 @@ static GstFlowReturn gst_avdtp_sink_render(GstBaseSink *basesink,
 	return GST_FLOW_OK;
 }
 
+struct render_packets {
+#ifdef HAVE_SENDMMSG
+	struct mmsghdr msg[RENDER_LIST_PACKETS];
+#else
+	struct msghdr msg[RENDER_LIST_PACKETS];
+#endif
+	struct iovec iov[RENDER_LIST_PACKETS][RENDER_LIST_IOVECS];
+	unsigned int count;
+};
+
+static int render_packets_send(int fd, struct render_packets *pkts)
+{
+	unsigned int i = 0;
+	int err;
+
+#ifdef HAVE_SENDMMSG
+	while (i < pkts->count) {
+		err = sendmmsg(fd, pkts->msg + i, pkts->count - i, 0);
+		if (err < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		i += err;
+	}
+#else
+	while (i < pkts->count) {
+		err = sendmsg(fd, &pkts->msg[i], 0);
+		if (err < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		i++;
+	}
+#endif
+
+	pkts->count = 0;
+
+	return 0;
+}
+
+/*
+ * Every group of the list is one RTP packet, sent straight from the
+ * buffers of the group without merging them first.
+ */
+static GstFlowReturn gst_avdtp_sink_render_list(GstBaseSink *basesink,
+							GstBufferList *list)
+{
+	GstAvdtpSink *self = GST_AVDTP_SINK(basesink);
+	GstBufferListIterator *it;
+	struct render_packets pkts;
+	int fd, err;
+
+	fd = g_io_channel_unix_get_fd(self->stream);
+
+	memset(&pkts, 0, sizeof(pkts));
+
+	it = gst_buffer_list_iterate(list);
+
+	while (gst_buffer_list_iterator_next_group(it)) {
+		struct msghdr *msg;
+		struct iovec *iov;
+		GstBuffer *buf;
+		guint n = 0;
+
+#ifdef HAVE_SENDMMSG
+		msg = &pkts.msg[pkts.count].msg_hdr;
+#else
+		msg = &pkts.msg[pkts.count];
+#endif
+		iov = pkts.iov[pkts.count];
+
+		while ((buf = gst_buffer_list_iterator_next(it)) != NULL) {
+			if (n == RENDER_LIST_IOVECS) {
+				GST_ERROR_OBJECT(self, "Too many buffers "
+							"in RTP packet");
+				gst_buffer_list_iterator_free(it);
+				return GST_FLOW_ERROR;
+			}
+
+			iov[n].iov_base = GST_BUFFER_DATA(buf);
+			iov[n].iov_len = GST_BUFFER_SIZE(buf);
+			n++;
+		}
+
+		if (n == 0)
+			continue;
+
+		memset(msg, 0, sizeof(*msg));
+		msg->msg_iov = iov;
+		msg->msg_iovlen = n;
+
+		if (++pkts.count < RENDER_LIST_PACKETS)
+			continue;
+
+		err = render_packets_send(fd, &pkts);
+		if (err < 0)
+			goto failed;
+	}
+
+	err = render_packets_send(fd, &pkts);
+	if (err < 0)
+		goto failed;
+
+	gst_buffer_list_iterator_free(it);
+
+	return GST_FLOW_OK;
+
+failed:
+	gst_buffer_list_iterator_free(it);
+	GST_ERROR_OBJECT(self, "Error while writting to socket: %d %s",
+							-err, strerror(-err));
+	return GST_FLOW_ERROR;
+}
+
 static gboolean gst_avdtp_sink_unlock(GstBaseSink *basesink)
 {
 	GstAvdtpSink *self = GST_AVDTP_SINK(basesink);
@@ -1212,6 +1338,8 @@ static void gst_avdtp_sink_class_init(GstAvdtpSinkClass *klass)
 	basesink_class->stop = GST_DEBUG_FUNCPTR(gst_avdtp_sink_stop);
 	basesink_class->render = GST_DEBUG_FUNCPTR(
 					gst_avdtp_sink_render);
+	basesink_class->render_list = GST_DEBUG_FUNCPTR(
+					gst_avdtp_sink_render_list);
 	basesink_class->preroll = GST_DEBUG_FUNCPTR(
 					gst_avdtp_sink_preroll);
 	basesink_class->unlock = GST_DEBUG_FUNCPTR(
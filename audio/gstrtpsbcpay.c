@@ -33,6 +33,7 @@
 #define RTP_SBC_PAYLOAD_HEADER_SIZE 1
 #define DEFAULT_MIN_FRAMES 0
 #define RTP_SBC_HEADER_TOTAL (12 + RTP_SBC_PAYLOAD_HEADER_SIZE)
+#define RTP_SBC_MAX_FRAMES 15 /* Limit of the 4 bit frame count */
 
 #if __BYTE_ORDER == __LITTLE_ENDIAN
 
@@ -165,9 +166,10 @@ static GstFlowReturn gst_rtp_sbc_pay_flush_buffers(GstRtpSBCPay *sbcpay)
 {
 	guint available;
 	guint max_payload;
-	GstBuffer *outbuf;
-	guint8 *payload_data;
-	guint frame_count;
+	GstBuffer *header;
+	GstBufferList *list;
+	GstBufferListIterator *it;
+	guint frame_count, i;
 	guint payload_length;
 	struct rtp_payload *payload;
 
@@ -183,30 +185,42 @@ static GstFlowReturn gst_rtp_sbc_pay_flush_buffers(GstRtpSBCPay *sbcpay)
 		0, 0);
 
 	max_payload = MIN(max_payload, available);
-	frame_count = max_payload / sbcpay->frame_length;
+	frame_count = MIN(max_payload / sbcpay->frame_length,
+							RTP_SBC_MAX_FRAMES);
 	payload_length = frame_count * sbcpay->frame_length;
 	if (payload_length == 0) /* Nothing to send */
 		return GST_FLOW_OK;
 
-	outbuf = gst_rtp_buffer_new_allocate(payload_length +
-			RTP_SBC_PAYLOAD_HEADER_SIZE, 0, 0);
+	/* Only the RTP and SBC payload headers get allocated here */
+	header = gst_rtp_buffer_new_allocate(RTP_SBC_PAYLOAD_HEADER_SIZE,
+									0, 0);
 
-	gst_rtp_buffer_set_payload_type(outbuf,
+	gst_rtp_buffer_set_payload_type(header,
 			GST_BASE_RTP_PAYLOAD_PT(sbcpay));
 
-	payload_data = gst_rtp_buffer_get_payload(outbuf);
-	payload = (struct rtp_payload *) payload_data;
+	payload = (struct rtp_payload *) gst_rtp_buffer_get_payload(header);
 	memset(payload, 0, sizeof(struct rtp_payload));
 	payload->frame_count = frame_count;
 
-	gst_adapter_copy(sbcpay->adapter, payload_data +
-			RTP_SBC_PAYLOAD_HEADER_SIZE, 0, payload_length);
-	gst_adapter_flush(sbcpay->adapter, payload_length);
+	GST_BUFFER_TIMESTAMP(header) = sbcpay->timestamp;
+
+	list = gst_buffer_list_new();
+	it = gst_buffer_list_iterate(list);
+	gst_buffer_list_iterator_add_group(it);
+	gst_buffer_list_iterator_add(it, header);
+
+	/* The encoder pushes one frame per buffer, taking them one by one
+	 * hands out those buffers instead of merging them into a copy */
+	for (i = 0; i < frame_count; i++)
+		gst_buffer_list_iterator_add(it, gst_adapter_take_buffer(
+				sbcpay->adapter, sbcpay->frame_length));
+
+	gst_buffer_list_iterator_free(it);
 
-	GST_BUFFER_TIMESTAMP(outbuf) = sbcpay->timestamp;
 	GST_DEBUG_OBJECT(sbcpay, "Pushing %d bytes", payload_length);
 
-	return gst_basertppayload_push(GST_BASE_RTP_PAYLOAD(sbcpay), outbuf);
+	return gst_basertppayload_push_list(GST_BASE_RTP_PAYLOAD(sbcpay),
+									list);
 }
 
 static GstFlowReturn gst_rtp_sbc_pay_handle_buffer(GstBaseRTPPayload *payload,
@@ -225,6 +239,8 @@ static GstFlowReturn gst_rtp_sbc_pay_handle_buffer(GstBaseRTPPayload *payload,
 	available = gst_adapter_available(sbcpay->adapter);
 	if (available + RTP_SBC_HEADER_TOTAL >=
 				GST_BASE_RTP_PAYLOAD_MTU(sbcpay) ||
+			available >= RTP_SBC_MAX_FRAMES *
+						sbcpay->frame_length ||
 			(available >
 				(sbcpay->min_frames * sbcpay->frame_length)))
 		return gst_rtp_sbc_pay_flush_buffers(sbcpay);
@@ -36,6 +36,9 @@ GST_DEBUG_CATEGORY_STATIC(sbc_parse_debug);
 
 GST_BOILERPLATE(GstSbcParse, gst_sbc_parse, GstElement, GST_TYPE_ELEMENT);
 
+/* Frame headers read at once from the incoming data */
+#define PARSE_FRAMES 32
+
 static const GstElementDetails sbc_parse_details =
 	GST_ELEMENT_DETAILS("Bluetooth SBC parser",
 				"Codec/Parser/Audio",
@@ -59,6 +62,37 @@ static GstStaticPadTemplate sbc_parse_src_factory =
 				"bitpool = (int) [ 2, 64 ],"
 				"parsed = (boolean) true"));
 
+static gboolean sbc_parse_config_changed(struct sbc_frame_info *old,
+						struct sbc_frame_info *new)
+{
+	return old->frequency != new->frequency ||
+			old->blocks != new->blocks ||
+			old->subbands != new->subbands ||
+			old->mode != new->mode ||
+			old->allocation != new->allocation ||
+			old->bitpool != new->bitpool;
+}
+
+static void sbc_parse_set_config(GstSbcParse *parse,
+						struct sbc_frame_info *info)
+{
+	parse->info = *info;
+
+	parse->sbc.frequency = info->frequency;
+	parse->sbc.blocks = info->blocks;
+	parse->sbc.subbands = info->subbands;
+	parse->sbc.mode = info->mode;
+	parse->sbc.allocation = info->allocation;
+	parse->sbc.bitpool = info->bitpool;
+
+	if (parse->outcaps != NULL)
+		gst_caps_unref(parse->outcaps);
+
+	parse->outcaps = gst_sbc_parse_caps_from_sbc(&parse->sbc);
+
+	parse->first_parsing = FALSE;
+}
+
 static GstFlowReturn sbc_parse_chain(GstPad *pad, GstBuffer *buffer)
 {
 	GstSbcParse *parse = GST_SBC_PARSE(gst_pad_get_parent(pad));
@@ -82,41 +116,33 @@ static GstFlowReturn sbc_parse_chain(GstPad *pad, GstBuffer *buffer)
 	size = GST_BUFFER_SIZE(buffer);
 
 	while (offset < size) {
-		GstBuffer *output;
-		int consumed;
-
-		consumed = sbc_parse(&parse->new_sbc, data + offset,
-					size - offset);
-		if (consumed <= 0)
+		struct sbc_frame_info info[PARSE_FRAMES];
+		size_t consumed;
+		int i, n;
+
+		/* Only the frame headers are looked at, not the audio */
+		n = sbc_parse_frames(data + offset, size - offset, info,
+					PARSE_FRAMES, SBC_PARSE_CRC, &consumed);
+		if (n <= 0)
 			break;
 
-		if (parse->first_parsing || (memcmp(&parse->sbc,
-				&parse->new_sbc, sizeof(sbc_t)) != 0)) {
+		for (i = 0; i < n; i++) {
+			GstBuffer *output;
 
-			memcpy(&parse->sbc, &parse->new_sbc, sizeof(sbc_t));
-			if (parse->outcaps != NULL)
-				gst_caps_unref(parse->outcaps);
+			if (parse->first_parsing || sbc_parse_config_changed(
+						&parse->info, &info[i]))
+				sbc_parse_set_config(parse, &info[i]);
 
-			parse->outcaps = gst_sbc_parse_caps_from_sbc(
-						&parse->sbc);
-
-			parse->first_parsing = FALSE;
-		}
+			output = gst_buffer_create_sub(buffer, offset,
+							info[i].length);
+			gst_buffer_set_caps(output, parse->outcaps);
 
-		res = gst_pad_alloc_buffer_and_set_caps(parse->srcpad,
-						GST_BUFFER_OFFSET_NONE,
-						consumed, parse->outcaps, &output);
+			res = gst_pad_push(parse->srcpad, output);
+			if (res != GST_FLOW_OK)
+				goto done;
 
-		if (res != GST_FLOW_OK)
-			goto done;
-
-		memcpy(GST_BUFFER_DATA(output), data + offset, consumed);
-
-		res = gst_pad_push(parse->srcpad, output);
-		if (res != GST_FLOW_OK)
-			goto done;
-
-		offset += consumed;
+			offset += info[i].length;
+		}
 	}
 
 	if (offset < size)
@@ -50,7 +50,7 @@ struct _GstSbcParse {
 	GstBuffer *buffer;
 
 	sbc_t sbc;
-	sbc_t new_sbc;
+	struct sbc_frame_info info;
 	GstCaps *outcaps;
 	gboolean first_parsing;
 
@@ -65,10 +65,16 @@
 
 #define DC_TIMEOUT 3
 
+#define CODEC_TIMEOUT 3
+
 #define RING_INTERVAL 3
 
 #define BUF_SIZE 1024
 
+/* HFP codec IDs used by AT+BAC and +BCS */
+#define HFP_CODEC_CVSD	0x01
+#define HFP_CODEC_MSBC	0x02
+
 #define HEADSET_GAIN_SPEAKER 'S'
 #define HEADSET_GAIN_MICROPHONE 'M'
 
@@ -83,6 +89,7 @@ static struct {
 	int number_type;		/* Incoming number type */
 	guint ring_timer;		/* For incoming call indication */
 	const char *chld;		/* Response to AT+CHLD=? */
+	char *cind_ranges;		/* Response to AT+CIND=? */
 } ag = {
 	.telephony_ready = FALSE,
 	.features = 0,
@@ -92,6 +99,7 @@ static struct {
 	.number = NULL,
 	.number_type = 0,
 	.ring_timer = 0,
+	.cind_ranges = NULL,
 };
 
 static gboolean sco_hci = TRUE;
@@ -146,6 +154,11 @@ struct headset_slc {
 	int mic_gain;
 
 	unsigned int hf_features;
+
+	gboolean hf_msbc;	/* mSBC listed in AT+BAC */
+	int codec;		/* Confirmed with AT+BCS, 0 for none */
+	int codec_req;		/* Sent with +BCS, awaiting AT+BCS */
+	guint codec_timer;	/* Fallback to CVSD if AT+BCS never comes */
 };
 
 struct headset {
@@ -176,9 +189,12 @@ struct headset {
 
 struct event {
 	const char *cmd;
+	size_t len;
 	int (*callback) (struct audio_device *device, const char *buf);
 };
 
+#define EVENT(cmd, cb) { cmd, sizeof(cmd) - 1, cb }
+
 static GSList *headset_callbacks = NULL;
 
 static inline DBusMessage *invalid_args(DBusMessage *msg)
@@ -237,6 +253,8 @@ static void print_ag_features(uint32_t features)
 		g_string_append(gstr, "\"Enhanced call control\" ");
 	if (features & AG_FEATURE_EXTENDED_ERROR_RESULT_CODES)
 		g_string_append(gstr, "\"Extended Error Result Codes\" ");
+	if (features & AG_FEATURE_CODEC_NEGOTIATION)
+		g_string_append(gstr, "\"Codec negotiation\" ");
 
 	str = g_string_free(gstr, FALSE);
 
@@ -271,6 +289,8 @@ static void print_hf_features(uint32_t features)
 		g_string_append(gstr, "\"Enhanced call status\" ");
 	if (features & HF_FEATURE_ENHANCED_CALL_CONTROL)
 		g_string_append(gstr, "\"Enhanced call control\" ");
+	if (features & HF_FEATURE_CODEC_NEGOTIATION)
+		g_string_append(gstr, "\"Codec negotiation\" ");
 
 	str = g_string_free(gstr, FALSE);
 
@@ -296,17 +316,12 @@ static const char *state2str(headset_state_t state)
 	return NULL;
 }
 
-static int headset_send_valist(struct headset *hs, char *format, va_list ap)
+static int headset_send_raw(struct headset *hs, const char *rsp,
+								size_t count)
 {
-	char rsp[BUF_SIZE];
-	ssize_t total_written, count;
+	size_t total_written;
 	int fd;
 
-	count = vsnprintf(rsp, sizeof(rsp), format, ap);
-
-	if (count < 0)
-		return -EINVAL;
-
 	if (!hs->rfcomm) {
 		error("headset_send: the headset is not connected");
 		return -EIO;
@@ -329,6 +344,25 @@ static int headset_send_valist(struct headset *hs, char *format, va_list ap)
 	return 0;
 }
 
+static int headset_send_valist(struct headset *hs, char *format, va_list ap)
+{
+	char rsp[BUF_SIZE];
+	int count;
+
+	count = vsnprintf(rsp, sizeof(rsp), format, ap);
+
+	if (count < 0)
+		return -EINVAL;
+
+	if ((size_t) count >= sizeof(rsp))
+		count = sizeof(rsp) - 1;
+
+	return headset_send_raw(hs, rsp, count);
+}
+
+#define headset_send_str(hs, str) \
+		headset_send_raw((hs), (str), sizeof(str) - 1)
+
 static int headset_send(struct headset *hs, char *format, ...)
 {
 	va_list ap;
@@ -345,6 +379,7 @@ static int supported_features(struct audio_device *device, const char *buf)
 {
 	struct headset *hs = device->headset;
 	struct headset_slc *slc = hs->slc;
+	uint32_t features;
 	int err;
 
 	if (strlen(buf) < 9)
@@ -354,11 +389,15 @@ static int supported_features(struct audio_device *device, const char *buf)
 
 	print_hf_features(slc->hf_features);
 
-	err = headset_send(hs, "\r\n+BRSF: %u\r\n", ag.features);
+	features = ag.features;
+	if (sco_hci && manager_get_sco_msbc())
+		features |= AG_FEATURE_CODEC_NEGOTIATION;
+
+	err = headset_send(hs, "\r\n+BRSF: %u\r\n", features);
 	if (err < 0)
 		return err;
 
-	return headset_send(hs, "\r\nOK\r\n");
+	return headset_send_str(hs, "\r\nOK\r\n");
 }
 
 static char *indicator_ranges(const struct indicator *indicators)
@@ -384,52 +423,66 @@ static char *indicator_ranges(const struct indicator *indicators)
 	return g_string_free(gstr, FALSE);
 }
 
-static char *indicator_values(const struct indicator *indicators)
+static ssize_t indicator_values(const struct indicator *indicators,
+						char *buf, size_t size)
 {
-	int i;
-	GString *gstr;
+	static const char prefix[] = "\r\n+CIND: ";
+	size_t len;
+	int i, n;
 
-	gstr = g_string_new("\r\n+CIND: ");
+	memcpy(buf, prefix, sizeof(prefix) - 1);
+	len = sizeof(prefix) - 1;
 
 	for (i = 0; indicators[i].desc != NULL; i++) {
-		if (i == 0)
-			g_string_append_printf(gstr, "%d", indicators[i].val);
-		else
-			g_string_append_printf(gstr, ",%d", indicators[i].val);
+		n = snprintf(buf + len, size - len, i > 0 ? ",%d" : "%d",
+							indicators[i].val);
+
+		/* Keep room for the trailing CR LF */
+		if (n < 0 || (size_t) n + 2 >= size - len)
+			return -ENOSPC;
+
+		len += n;
 	}
 
-	g_string_append(gstr, "\r\n");
+	buf[len++] = '\r';
+	buf[len++] = '\n';
 
-	return g_string_free(gstr, FALSE);
+	return len;
 }
 
 static int report_indicators(struct audio_device *device, const char *buf)
 {
 	struct headset *hs = device->headset;
+	char values[BUF_SIZE];
+	ssize_t len;
 	int err;
-	char *str;
 
 	if (strlen(buf) < 8)
 		return -EINVAL;
 
 	if (ag.indicators == NULL) {
 		error("HFP AG indicators not initialized");
-		return headset_send(hs, "\r\nERROR\r\n");
+		return headset_send_str(hs, "\r\nERROR\r\n");
 	}
 
 	if (buf[7] == '=')
-		str = indicator_ranges(ag.indicators);
-	else
-		str = indicator_values(ag.indicators);
-
-	err = headset_send(hs, str);
+		err = headset_send_raw(hs, ag.cind_ranges,
+						strlen(ag.cind_ranges));
+	else {
+		len = indicator_values(ag.indicators, values, sizeof(values));
+		if (len < 0) {
+			error("HFP AG indicator values don't fit in %zu bytes",
+							sizeof(values));
+			return headset_send_str(hs, "\r\nERROR\r\n");
+		}
 
-	g_free(str);
+		err = headset_send_raw(hs, values, len);
+	}
 
 	if (err < 0)
 		return err;
 
-	return headset_send(hs, "\r\nOK\r\n");
+	return headset_send_str(hs, "\r\nOK\r\n");
 }
 
 static void pending_connect_complete(struct connect_cb *cb, struct audio_device *dev)
@@ -519,6 +572,19 @@ static void send_foreach_headset(GSList *devices,
 {
 	GSList *l;
 	va_list ap;
+	char rsp[BUF_SIZE];
+	int count;
+
+	/* Format once and push the same bytes to every matching headset */
+	va_start(ap, format);
+	count = vsnprintf(rsp, sizeof(rsp), format, ap);
+	va_end(ap);
+
+	if (count < 0)
+		return;
+
+	if ((size_t) count >= sizeof(rsp))
+		count = sizeof(rsp) - 1;
 
 	for (l = devices; l != NULL; l = l->next) {
 		struct audio_device *device = l->data;
@@ -530,12 +596,10 @@ static void send_foreach_headset(GSList *devices,
 		if (cmp && cmp(hs) != 0)
 			continue;
 
-		va_start(ap, format);
-		ret = headset_send_valist(hs, format, ap);
+		ret = headset_send_raw(hs, rsp, count);
 		if (ret < 0)
 			error("Failed to send to headset: %s (%d)",
 					strerror(-ret), -ret);
-		va_end(ap);
 	}
 }
 
@@ -622,19 +686,20 @@ static void sco_connect_cb(GIOChannel *chan, GError *err, gpointer user_data)
 	}
 }
 
-static int sco_connect(struct audio_device *dev, headset_stream_cb_t cb,
-			void *user_data, unsigned int *cb_id)
+static int sco_connect_io(struct audio_device *dev)
 {
 	struct headset *hs = dev->headset;
 	GError *err = NULL;
 	GIOChannel *io;
+	uint16_t voice = 0;
 
-	if (hs->state != HEADSET_STATE_CONNECTED)
-		return -EINVAL;
+	if (headset_get_sco_msbc(dev))
+		voice = BT_VOICE_TRANSPARENT;
 
 	io = bt_io_connect(BT_IO_SCO, sco_connect_cb, dev, NULL, &err,
 				BT_IO_OPT_SOURCE_BDADDR, &dev->src,
 				BT_IO_OPT_DEST_BDADDR, &dev->dst,
+				BT_IO_OPT_VOICE, voice,
 				BT_IO_OPT_INVALID);
 	if (!io) {
 		error("%s", err->message);
@@ -644,6 +709,25 @@ static int sco_connect(struct audio_device *dev, headset_stream_cb_t cb,
 
 	hs->sco = io;
 
+	return 0;
+}
+
+static int sco_connect(struct audio_device *dev, headset_stream_cb_t cb,
+			void *user_data, unsigned int *cb_id)
+{
+	struct headset *hs = dev->headset;
+	int err;
+
+	if (hs->state != HEADSET_STATE_CONNECTED)
+		return -EINVAL;
+
+	/* With a codec selection in flight SCO follows its AT+BCS */
+	if (hs->slc == NULL || hs->slc->codec_req == 0) {
+		err = sco_connect_io(dev);
+		if (err < 0)
+			return err;
+	}
+
 	headset_set_state(dev, HEADSET_STATE_PLAY_IN_PROGRESS);
 
 	pending_connect_init(hs, HEADSET_STATE_PLAYING);
@@ -666,6 +750,79 @@ static int hfp_cmp(struct headset *hs)
 		return -1;
 }
 
+static void codec_timer_stop(struct headset_slc *slc)
+{
+	if (slc->codec_timer) {
+		g_source_remove(slc->codec_timer);
+		slc->codec_timer = 0;
+	}
+}
+
+/* Sets up the SCO connection that waited for the codec selection */
+static void codec_selected(struct audio_device *dev)
+{
+	struct headset *hs = dev->headset;
+	struct pending_connect *p = hs->pending;
+	int err;
+
+	if (hs->state != HEADSET_STATE_PLAY_IN_PROGRESS || hs->sco)
+		return;
+
+	err = sco_connect_io(dev);
+	if (err < 0) {
+		if (p) {
+			p->err = err;
+			if (p->msg)
+				error_connection_attempt_failed(dev->conn,
+								p->msg, err);
+			pending_connect_finalize(dev);
+		}
+
+		headset_set_state(dev, HEADSET_STATE_CONNECTED);
+	}
+}
+
+static gboolean codec_timeout(gpointer user_data)
+{
+	struct audio_device *dev = user_data;
+	struct headset_slc *slc = dev->headset->slc;
+
+	error("No AT+BCS for codec %d, using CVSD", slc->codec_req);
+
+	slc->codec_timer = 0;
+	slc->codec_req = 0;
+	slc->codec = 0;
+
+	codec_selected(dev);
+
+	return FALSE;
+}
+
+/* Picks mSBC whenever both sides can carry it, CVSD needs no selection */
+static int codec_select(struct audio_device *dev)
+{
+	struct headset *hs = dev->headset;
+	struct headset_slc *slc = hs->slc;
+
+	codec_timer_stop(slc);
+	slc->codec_req = 0;
+
+	if (!sco_hci || !manager_get_sco_msbc() || !slc->hf_msbc ||
+			!(slc->hf_features & HF_FEATURE_CODEC_NEGOTIATION)) {
+		slc->codec = 0;
+		return 0;
+	}
+
+	if (slc->codec == HFP_CODEC_MSBC)
+		return 0;
+
+	slc->codec_req = HFP_CODEC_MSBC;
+	slc->codec_timer = g_timeout_add_seconds(CODEC_TIMEOUT,
+							codec_timeout, dev);
+
+	return headset_send(hs, "\r\n+BCS: %d\r\n", slc->codec_req);
+}
+
 static void hfp_slc_complete(struct audio_device *dev)
 {
 	struct headset *hs = dev->headset;
@@ -675,6 +832,9 @@ static void hfp_slc_complete(struct audio_device *dev)
 
 	headset_set_state(dev, HEADSET_STATE_CONNECTED);
 
+	if (codec_select(dev) < 0)
+		error("Unable to select HFP codec");
+
 	if (p == NULL)
 		return;
 
@@ -704,10 +864,10 @@ static int telephony_generic_rsp(struct audio_device *device, cme_error_t err)
 		if (slc->cme_enabled)
 			return headset_send(hs, "\r\n+CME ERROR: %d\r\n", err);
 		else
-			return headset_send(hs, "\r\nERROR\r\n");
+			return headset_send_str(hs, "\r\nERROR\r\n");
 	}
 
-	return headset_send(hs, "\r\nOK\r\n");
+	return headset_send_str(hs, "\r\nOK\r\n");
 }
 
 int telephony_event_reporting_rsp(void *telephony_device, cme_error_t err)
@@ -720,7 +880,7 @@ int telephony_event_reporting_rsp(void *telephony_device, cme_error_t err)
 	if (err != CME_ERROR_NONE)
 		return telephony_generic_rsp(telephony_device, err);
 
-	ret = headset_send(hs, "\r\nOK\r\n");
+	ret = headset_send_str(hs, "\r\nOK\r\n");
 	if (ret < 0)
 		return ret;
 
@@ -787,7 +947,7 @@ static int call_hold(struct audio_device *dev, const char *buf)
 	if (err < 0)
 		return err;
 
-	err = headset_send(hs, "\r\nOK\r\n");
+	err = headset_send_str(hs, "\r\nOK\r\n");
 	if (err < 0)
 		return err;
 
@@ -858,7 +1018,7 @@ int telephony_terminate_call_rsp(void *telephony_device,
 			AUDIO_HEADSET_INTERFACE, "CallTerminated",
 			DBUS_TYPE_INVALID);
 
-	return headset_send(hs, "\r\nOK\r\n");
+	return headset_send_str(hs, "\r\nOK\r\n");
 }
 
 static int terminate_call(struct audio_device *device, const char *buf)
@@ -888,7 +1048,7 @@ static int cli_notification(struct audio_device *device, const char *buf)
 
 	slc->cli_active = buf[8] == '1' ? TRUE : FALSE;
 
-	return headset_send(hs, "\r\nOK\r\n");
+	return headset_send_str(hs, "\r\nOK\r\n");
 }
 
 int telephony_response_and_hold_rsp(void *telephony_device, cme_error_t err)
@@ -911,7 +1071,7 @@ static int response_and_hold(struct audio_device *device, const char *buf)
 	if (ag.rh >= 0)
 		headset_send(hs, "\r\n+BTRH: %d\r\n", ag.rh);
 
-	return headset_send(hs, "\r\nOK\r\n", ag.rh);
+	return headset_send_str(hs, "\r\nOK\r\n");
 }
 
 int telephony_last_dialed_number_rsp(void *telephony_device, cme_error_t err)
@@ -1015,7 +1175,7 @@ static int signal_gain_setting(struct audio_device *device, const char *buf)
 	if (err < 0)
 		return err;
 
-	return headset_send(hs, "\r\nOK\r\n");
+	return headset_send_str(hs, "\r\nOK\r\n");
 }
 
 int telephony_transmit_dtmf_rsp(void *telephony_device, cme_error_t err)
@@ -1075,7 +1235,7 @@ static int extended_errors(struct audio_device *device, const char *buf)
 		DBG("CME errors disabled for headset %p", hs);
 	}
 
-	return headset_send(hs, "\r\nOK\r\n");
+	return headset_send_str(hs, "\r\nOK\r\n");
 }
 
 static int call_waiting_notify(struct audio_device *device, const char *buf)
@@ -1094,7 +1254,7 @@ static int call_waiting_notify(struct audio_device *device, const char *buf)
 		DBG("Call waiting notification disabled for headset %p", hs);
 	}
 
-	return headset_send(hs, "\r\nOK\r\n");
+	return headset_send_str(hs, "\r\nOK\r\n");
 }
 
 int telephony_operator_selection_rsp(void *telephony_device, cme_error_t err)
@@ -1147,7 +1307,7 @@ static int operator_selection(struct audio_device *device, const char *buf)
 		telephony_operator_selection_req(device);
 		break;
 	case '=':
-		return headset_send(hs, "\r\nOK\r\n");
+		return headset_send_str(hs, "\r\nOK\r\n");
 	default:
 		return -EINVAL;
 	}
@@ -1190,42 +1350,149 @@ static int voice_dial(struct audio_device *device, const char *buf)
 	return 0;
 }
 
-static struct event event_callbacks[] = {
-	{ "ATA", answer_call },
-	{ "ATD", dial_number },
-	{ "AT+VG", signal_gain_setting },
-	{ "AT+BRSF", supported_features },
-	{ "AT+CIND", report_indicators },
-	{ "AT+CMER", event_reporting },
-	{ "AT+CHLD", call_hold },
-	{ "AT+CHUP", terminate_call },
-	{ "AT+CKPD", key_press },
-	{ "AT+CLIP", cli_notification },
-	{ "AT+BTRH", response_and_hold },
-	{ "AT+BLDN", last_dialed_number },
-	{ "AT+VTS", dtmf_tone },
-	{ "AT+CNUM", subscriber_number },
-	{ "AT+CLCC", list_current_calls },
-	{ "AT+CMEE", extended_errors },
-	{ "AT+CCWA", call_waiting_notify },
-	{ "AT+COPS", operator_selection },
-	{ "AT+NREC", nr_and_ec },
-	{ "AT+BVRA", voice_dial },
-	{ 0 }
+static int available_codecs(struct audio_device *device, const char *buf)
+{
+	struct headset *hs = device->headset;
+	struct headset_slc *slc = hs->slc;
+	const char *ptr;
+	char *end;
+	int err;
+
+	if (strlen(buf) < 8 || buf[6] != '=')
+		return -EINVAL;
+
+	slc->hf_msbc = FALSE;
+
+	for (ptr = &buf[7]; *ptr != '\0'; ptr = end + 1) {
+		if (strtol(ptr, &end, 10) == HFP_CODEC_MSBC)
+			slc->hf_msbc = TRUE;
+
+		if (end == ptr || *end != ',')
+			break;
+	}
+
+	DBG("HF supports mSBC: %s", slc->hf_msbc ? "yes" : "no");
+
+	err = headset_send_str(hs, "\r\nOK\r\n");
+	if (err < 0)
+		return err;
+
+	/* The list changed after the SLC, the selection has to follow */
+	if (hs->state < HEADSET_STATE_CONNECTED)
+		return 0;
+
+	if (slc->codec == HFP_CODEC_MSBC && !slc->hf_msbc)
+		slc->codec = 0;
+
+	return codec_select(device);
+}
+
+static int codec_connection(struct audio_device *device, const char *buf)
+{
+	struct headset *hs = device->headset;
+	int err;
+
+	err = headset_send_str(hs, "\r\nOK\r\n");
+	if (err < 0)
+		return err;
+
+	if (hs->state != HEADSET_STATE_CONNECTED)
+		return 0;
+
+	err = codec_select(device);
+	if (err < 0)
+		return err;
+
+	err = sco_connect(device, NULL, NULL, NULL);
+	if (err < 0)
+		error("Unable to connect SCO: %s (%d)", strerror(-err), -err);
+
+	return 0;
+}
+
+static int codec_confirm(struct audio_device *device, const char *buf)
+{
+	struct headset *hs = device->headset;
+	struct headset_slc *slc = hs->slc;
+	int codec = 0, err;
+
+	if (slc->codec_req == 0)
+		return -EINVAL;
+
+	if (strlen(buf) >= 8 && buf[6] == '=')
+		codec = strtol(&buf[7], NULL, 10);
+
+	/* Anything but the requested codec leaves SCO on CVSD */
+	slc->codec = codec == slc->codec_req ? codec : 0;
+	slc->codec_req = 0;
+	codec_timer_stop(slc);
+
+	DBG("HFP codec %d confirmed", slc->codec);
+
+	if (slc->codec)
+		err = headset_send_str(hs, "\r\nOK\r\n");
+	else
+		err = headset_send_str(hs, "\r\nERROR\r\n");
+
+	if (err < 0)
+		return err;
+
+	codec_selected(device);
+
+	return 0;
+}
+
+/* Must be kept sorted by command so that handle_event() can bisect it.
+ * No command may be a prefix of another one. */
+static const struct event event_callbacks[] = {
+	EVENT("AT+BAC", available_codecs),
+	EVENT("AT+BCC", codec_connection),
+	EVENT("AT+BCS", codec_confirm),
+	EVENT("AT+BLDN", last_dialed_number),
+	EVENT("AT+BRSF", supported_features),
+	EVENT("AT+BTRH", response_and_hold),
+	EVENT("AT+BVRA", voice_dial),
+	EVENT("AT+CCWA", call_waiting_notify),
+	EVENT("AT+CHLD", call_hold),
+	EVENT("AT+CHUP", terminate_call),
+	EVENT("AT+CIND", report_indicators),
+	EVENT("AT+CKPD", key_press),
+	EVENT("AT+CLCC", list_current_calls),
+	EVENT("AT+CLIP", cli_notification),
+	EVENT("AT+CMEE", extended_errors),
+	EVENT("AT+CMER", event_reporting),
+	EVENT("AT+CNUM", subscriber_number),
+	EVENT("AT+COPS", operator_selection),
+	EVENT("AT+NREC", nr_and_ec),
+	EVENT("AT+VG", signal_gain_setting),
+	EVENT("AT+VTS", dtmf_tone),
+	EVENT("ATA", answer_call),
+	EVENT("ATD", dial_number),
 };
 
+static int event_cmp(const void *key, const void *member)
+{
+	const char *buf = key;
+	const struct event *ev = member;
+
+	return strncmp(buf, ev->cmd, ev->len);
+}
+
 static int handle_event(struct audio_device *device, const char *buf)
 {
-	struct event *ev;
+	const struct event *ev;
 
 	DBG("Received %s", buf);
 
-	for (ev = event_callbacks; ev->cmd; ev++) {
-		if (!strncmp(buf, ev->cmd, strlen(ev->cmd)))
-			return ev->callback(device, buf);
-	}
+	if (buf[0] != 'A' || buf[1] != 'T')
+		return -EINVAL;
 
-	return -EINVAL;
+	ev = bsearch(buf, event_callbacks, G_N_ELEMENTS(event_callbacks),
+					sizeof(struct event), event_cmp);
+	if (ev == NULL)
+		return -EINVAL;
+
+	return ev->callback(device, buf);
 }
 
 static void close_sco(struct audio_device *device)
@@ -1251,9 +1518,9 @@ static gboolean rfcomm_io_cb(GIOChannel *chan, GIOCondition cond,
 {
 	struct headset *hs;
 	struct headset_slc *slc;
-	unsigned char buf[BUF_SIZE];
 	gsize bytes_read = 0;
 	gsize free_space;
+	char *line, *end;
 
 	if (cond & G_IO_NVAL)
 		return FALSE;
@@ -1266,61 +1533,67 @@ static gboolean rfcomm_io_cb(GIOChannel *chan, GIOCondition cond,
 		goto failed;
 	}
 
-	if (g_io_channel_read(chan, (gchar *) buf, sizeof(buf) - 1,
-				&bytes_read) != G_IO_ERROR_NONE)
-		return TRUE;
+	/* Move a partial command to the front before reading more */
+	if (slc->data_start > 0 && slc->data_length > 0)
+		memmove(slc->buf, &slc->buf[slc->data_start],
+							slc->data_length);
+	slc->data_start = 0;
 
-	free_space = sizeof(slc->buf) - slc->data_start -
-			slc->data_length - 1;
+	free_space = sizeof(slc->buf) - slc->data_length - 1;
 
-	if (free_space < bytes_read) {
+	if (free_space == 0) {
 		/* Very likely that the HS is sending us garbage so
 		 * just ignore the data and disconnect */
 		error("Too much data to fit incomming buffer");
 		goto failed;
 	}
 
-	memcpy(&slc->buf[slc->data_start], buf, bytes_read);
+	/* Read straight into the SLC buffer and split it in place */
+	if (g_io_channel_read(chan, &slc->buf[slc->data_length], free_space,
+				&bytes_read) != G_IO_ERROR_NONE)
+		return TRUE;
+
 	slc->data_length += bytes_read;
 
-	/* Make sure the data is null terminated so we can use string
-	 * functions */
-	slc->buf[slc->data_start + slc->data_length] = '\0';
+	line = slc->buf;
+	end = slc->buf + slc->data_length;
 
-	while (slc->data_length > 0) {
+	while (line < end) {
 		char *cr;
 		int err;
-		off_t cmd_len;
 
-		cr = strchr(&slc->buf[slc->data_start], '\r');
+		cr = memchr(line, '\r', end - line);
 		if (!cr)
 			break;
 
-		cmd_len = 1 + (off_t) cr - (off_t) &slc->buf[slc->data_start];
 		*cr = '\0';
 
-		if (cmd_len > 1)
-			err = handle_event(device, &slc->buf[slc->data_start]);
+		if (cr > line)
+			err = handle_event(device, line);
 		else
 			/* Silently skip empty commands */
 			err = 0;
 
 		if (err == -EINVAL) {
 			error("Badly formated or unrecognized command: %s",
-					&slc->buf[slc->data_start]);
-			err = headset_send(hs, "\r\nERROR\r\n");
+									line);
+			err = headset_send_str(hs, "\r\nERROR\r\n");
 		} else if (err < 0)
-			error("Error handling command %s: %s (%d)",
-						&slc->buf[slc->data_start],
+			error("Error handling command %s: %s (%d)", line,
 						strerror(-err), -err);
 
-		slc->data_start += cmd_len;
-		slc->data_length -= cmd_len;
-
-		if (!slc->data_length)
-			slc->data_start = 0;
+		line = cr + 1;
 	}
 
+	slc->data_start = line - slc->buf;
+	slc->data_length = end - line;
+
+	if (!slc->data_length)
+		slc->data_start = 0;
+
+	/* Keep the pending data null terminated for string functions */
+	slc->buf[slc->data_start + slc->data_length] = '\0';
+
 	return TRUE;
 
 failed:
@@ -1759,7 +2032,7 @@ static DBusMessage *hs_ring(DBusConnection *conn, DBusMessage *msg,
 		goto done;
 	}
 
-	err = headset_send(hs, "\r\nRING\r\n");
+	err = headset_send_str(hs, "\r\nRING\r\n");
 	if (err < 0) {
 		dbus_message_unref(reply);
 		return g_dbus_create_error(msg, ERROR_INTERFACE ".Failed",
@@ -2147,6 +2420,9 @@ static int headset_close_rfcomm(struct audio_device *dev)
 		hs->rfcomm = NULL;
 	}
 
+	if (hs->slc)
+		codec_timer_stop(hs->slc);
+
 	g_free(hs->slc);
 	hs->slc = NULL;
 
@@ -2706,6 +2982,13 @@ gboolean headset_get_sco_hci(struct audio_device *dev)
 	return sco_hci;
 }
 
+gboolean headset_get_sco_msbc(struct audio_device *dev)
+{
+	struct headset *hs = dev->headset;
+
+	return sco_hci && hs->slc && hs->slc->codec == HFP_CODEC_MSBC;
+}
+
 void headset_shutdown(struct audio_device *dev)
 {
 	struct pending_connect *p = dev->headset->pending;
@@ -2829,8 +3112,13 @@ int telephony_ready_ind(uint32_t features,
 	ag.features = features;
 	ag.indicators = indicators;
 	ag.rh = rh;
+	g_free(ag.chld);
 	ag.chld = g_strdup(chld);
 
+	/* Ranges only change with the indicators, cache the response */
+	g_free(ag.cind_ranges);
+	ag.cind_ranges = indicator_ranges(indicators);
+
 	DBG("Telephony plugin initialized");
 
 	print_ag_features(ag.features);
@@ -2838,6 +3126,18 @@ int telephony_ready_ind(uint32_t features,
 	return 0;
 }
 
+void headset_telephony_exit(void)
+{
+	ag.telephony_ready = FALSE;
+	ag.indicators = NULL;
+
+	g_free(ag.cind_ranges);
+	ag.cind_ranges = NULL;
+
+	g_free(ag.chld);
+	ag.chld = NULL;
+}
+
 int telephony_list_current_call_ind(int idx, int dir, int status, int mode,
 					int mprty, const char *number,
 					int type)
@@ -60,6 +60,7 @@ struct headset *headset_init(struct audio_device *dev, uint16_t svc,
 void headset_unregister(struct audio_device *dev);
 
 uint32_t headset_config_init(GKeyFile *config);
+void headset_telephony_exit(void);
 
 void headset_update(struct audio_device *dev, uint16_t svc,
 			const char *uuidstr);
@@ -91,6 +92,7 @@ int headset_get_channel(struct audio_device *dev);
 int headset_get_sco_fd(struct audio_device *dev);
 gboolean headset_get_nrec(struct audio_device *dev);
 gboolean headset_get_sco_hci(struct audio_device *dev);
+gboolean headset_get_sco_msbc(struct audio_device *dev);
 
 gboolean headset_is_active(struct audio_device *dev);
 
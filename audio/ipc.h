@@ -174,6 +174,11 @@ struct bt_get_capabilities_req {
 #define BT_MPEG_LAYER_3				1
 
 #define BT_HFP_CODEC_PCM			0x00
+#define BT_HFP_CODEC_MSBC			0x01
+
+/* mSBC is carried over SCO in 60 octet packets: the 2 octet H2
+ * synchronization header, one 57 octet frame and a padding octet */
+#define BT_MSBC_PACKET_SIZE			60
 
 #define BT_PCM_FLAG_NREC			0x01
 #define BT_PCM_FLAG_PCM_ROUTING			0x02
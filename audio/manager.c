@@ -28,6 +28,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdarg.h>
 #include <errno.h>
 #include <unistd.h>
@@ -54,6 +55,7 @@
 #include "../src/manager.h"
 #include "../src/adapter.h"
 #include "../src/device.h"
+#include "../src/registry.h"
 
 #include "log.h"
 #include "textfile.h"
@@ -101,10 +103,18 @@ struct audio_adapter {
 
 static gboolean auto_connect = TRUE;
 static int max_connected_headsets = 1;
+static connect_policy_t connect_policy = CONNECT_POLICY_SEQUENTIAL;
+static gboolean sco_msbc = FALSE;
 static DBusConnection *connection = NULL;
 static GKeyFile *config = NULL;
 static GSList *adapters = NULL;
 static GSList *devices = NULL;
+static struct btd_registry *registry = NULL;
+
+/* Records are built once and copied for every further adapter */
+static sdp_record_t *hsp_ag_template = NULL;
+static sdp_record_t *hfp_ag_template = NULL;
+static sdp_record_t *hfp_hs_template = NULL;
 
 static struct enabled_interfaces enabled = {
 	.hfp		= TRUE,
@@ -645,7 +655,11 @@ static int headset_server_init(struct audio_adapter *adapter)
 
 	adapter->hsp_ag_server = io;
 
-	record = hsp_ag_record(chan);
+	if (!hsp_ag_template)
+		hsp_ag_template = hsp_ag_record(chan);
+
+	record = hsp_ag_template ? sdp_record_from_template(hsp_ag_template,
+						RFCOMM_UUID, chan) : NULL;
 	if (!record) {
 		error("Unable to allocate new service record");
 		goto failed;
@@ -676,7 +690,11 @@ static int headset_server_init(struct audio_adapter *adapter)
 
 	adapter->hfp_ag_server = io;
 
-	record = hfp_ag_record(chan, features);
+	if (!hfp_ag_template)
+		hfp_ag_template = hfp_ag_record(chan, features);
+
+	record = hfp_ag_template ? sdp_record_from_template(hfp_ag_template,
+						RFCOMM_UUID, chan) : NULL;
 	if (!record) {
 		error("Unable to allocate new service record");
 		goto failed;
@@ -745,7 +763,11 @@ static int gateway_server_init(struct audio_adapter *adapter)
 	}
 
 	adapter->hfp_hs_server = io;
-	record = hfp_hs_record(chan);
+	if (!hfp_hs_template)
+		hfp_hs_template = hfp_hs_record(chan);
+
+	record = hfp_hs_template ? sdp_record_from_template(hfp_hs_template,
+						RFCOMM_UUID, chan) : NULL;
 	if (!record) {
 		error("Unable to allocate new service record");
 		return -1;
@@ -796,6 +818,7 @@ static void audio_remove(struct btd_device *device)
 		return;
 
 	devices = g_slist_remove(devices, dev);
+	btd_registry_remove(registry, dev);
 
 	audio_device_unregister(dev);
 
@@ -1046,15 +1069,37 @@ static struct btd_adapter_driver avrcp_server_driver = {
 	.remove	= avrcp_server_remove,
 };
 
+/* mSBC is carried in transparent SCO air mode, which older kernels
+ * can't set up */
+static gboolean sco_transparent_supported(void)
+{
+	struct bt_voice voice;
+	int sk, err;
+
+	sk = socket(PF_BLUETOOTH, SOCK_SEQPACKET, BTPROTO_SCO);
+	if (sk < 0)
+		return FALSE;
+
+	memset(&voice, 0, sizeof(voice));
+	voice.setting = BT_VOICE_TRANSPARENT;
+
+	err = setsockopt(sk, SOL_BLUETOOTH, BT_VOICE, &voice, sizeof(voice));
+
+	close(sk);
+
+	return err == 0;
+}
+
 int audio_manager_init(DBusConnection *conn, GKeyFile *conf,
 							gboolean *enable_sco)
 {
-	char **list;
+	char **list, *str;
 	int i;
 	gboolean b;
 	GError *err = NULL;
 
 	connection = dbus_connection_ref(conn);
+	registry = btd_registry_new();
 
 	if (!conf)
 		goto proceed;
@@ -1100,6 +1145,31 @@ int audio_manager_init(DBusConnection *conn, GKeyFile *conf,
 	} else
 		auto_connect = b;
 
+	str = g_key_file_get_string(config, "General", "ConnectPolicy", NULL);
+	if (str) {
+		if (strcasecmp(str, "parallel") == 0)
+			connect_policy = CONNECT_POLICY_PARALLEL;
+		else if (strcasecmp(str, "sequential") == 0)
+			connect_policy = CONNECT_POLICY_SEQUENTIAL;
+		else
+			error("audio.conf: invalid ConnectPolicy %s", str);
+		g_free(str);
+	}
+
+	str = g_key_file_get_string(config, "General", "SCOCodec", NULL);
+	if (str) {
+		if (strcasecmp(str, "mSBC") == 0)
+			sco_msbc = TRUE;
+		else if (strcasecmp(str, "CVSD") != 0)
+			error("audio.conf: invalid SCOCodec %s", str);
+		g_free(str);
+	}
+
+	if (sco_msbc && !sco_transparent_supported()) {
+		error("Transparent SCO not supported, mSBC disabled");
+		sco_msbc = FALSE;
+	}
+
 	b = g_key_file_get_boolean(config, "Headset", "HFP",
 					&err);
 	if (err)
@@ -1147,6 +1217,9 @@ void audio_manager_exit(void)
 	dbus_connection_unref(connection);
 	connection = NULL;
 
+	btd_registry_free(registry);
+	registry = NULL;
+
 	if (config) {
 		g_key_file_free(config);
 		config = NULL;
@@ -1155,6 +1228,7 @@ void audio_manager_exit(void)
 	if (enabled.headset) {
 		btd_unregister_adapter_driver(&headset_server_driver);
 		telephony_exit();
+		headset_telephony_exit();
 	}
 
 	if (enabled.gateway)
@@ -1167,52 +1241,103 @@ void audio_manager_exit(void)
 		btd_unregister_adapter_driver(&avrcp_server_driver);
 
 	btd_unregister_device_driver(&audio_driver);
+
+	if (hsp_ag_template) {
+		sdp_record_free(hsp_ag_template);
+		hsp_ag_template = NULL;
+	}
+
+	if (hfp_ag_template) {
+		sdp_record_free(hfp_ag_template);
+		hfp_ag_template = NULL;
+	}
+
+	if (hfp_hs_template) {
+		sdp_record_free(hfp_hs_template);
+		hfp_hs_template = NULL;
+	}
 }
 
-struct audio_device *manager_find_device(const char *path,
+static gboolean device_matches(struct audio_device *dev, const char *path,
 					const bdaddr_t *src,
 					const bdaddr_t *dst,
 					const char *interface,
 					gboolean connected)
 {
-	GSList *l;
+	if ((path && (strcmp(path, "")) && strcmp(dev->path, path)))
+		return FALSE;
 
-	for (l = devices; l != NULL; l = l->next) {
-		struct audio_device *dev = l->data;
+	if ((src && bacmp(src, BDADDR_ANY)) && bacmp(&dev->src, src))
+		return FALSE;
 
-		if ((path && (strcmp(path, "")) && strcmp(dev->path, path)))
-			continue;
+	if ((dst && bacmp(dst, BDADDR_ANY)) && bacmp(&dev->dst, dst))
+		return FALSE;
 
-		if ((src && bacmp(src, BDADDR_ANY)) && bacmp(&dev->src, src))
-			continue;
+	if (interface && !strcmp(AUDIO_HEADSET_INTERFACE, interface)
+			&& !dev->headset)
+		return FALSE;
 
-		if ((dst && bacmp(dst, BDADDR_ANY)) && bacmp(&dev->dst, dst))
-			continue;
+	if (interface && !strcmp(AUDIO_GATEWAY_INTERFACE, interface)
+			&& !dev->gateway)
+		return FALSE;
 
-		if (interface && !strcmp(AUDIO_HEADSET_INTERFACE, interface)
-				&& !dev->headset)
-			continue;
+	if (interface && !strcmp(AUDIO_SINK_INTERFACE, interface)
+			&& !dev->sink)
+		return FALSE;
 
-		if (interface && !strcmp(AUDIO_GATEWAY_INTERFACE, interface)
-				&& !dev->gateway)
-			continue;
+	if (interface && !strcmp(AUDIO_SOURCE_INTERFACE, interface)
+			&& !dev->source)
+		return FALSE;
 
-		if (interface && !strcmp(AUDIO_SINK_INTERFACE, interface)
-				&& !dev->sink)
-			continue;
+	if (interface && !strcmp(AUDIO_CONTROL_INTERFACE, interface)
+			&& !dev->control)
+		return FALSE;
 
-		if (interface && !strcmp(AUDIO_SOURCE_INTERFACE, interface)
-				&& !dev->source)
-			continue;
+	if (connected && !audio_device_is_active(dev, interface))
+		return FALSE;
 
-		if (interface && !strcmp(AUDIO_CONTROL_INTERFACE, interface)
-				&& !dev->control)
-			continue;
+	return TRUE;
+}
 
-		if (connected && !audio_device_is_active(dev, interface))
-			continue;
+struct audio_device *manager_find_device(const char *path,
+					const bdaddr_t *src,
+					const bdaddr_t *dst,
+					const char *interface,
+					gboolean connected)
+{
+	struct audio_device *dev;
+	GSList *l;
 
-		return dev;
+	/* Use the registry when a key is given, there is only one device
+	 * per path and per local and remote address pair */
+	if (path && strcmp(path, "")) {
+		dev = btd_registry_find_path(registry, path);
+		if (dev && device_matches(dev, path, src, dst, interface,
+								connected))
+			return dev;
+
+		return NULL;
+	}
+
+	if (dst && bacmp(dst, BDADDR_ANY)) {
+		if (src && bacmp(src, BDADDR_ANY)) {
+			dev = btd_registry_find(registry, src, dst);
+			if (dev && device_matches(dev, path, src, dst,
+						interface, connected))
+				return dev;
+
+			return NULL;
+		}
+
+		l = btd_registry_find_all(registry, dst);
+	} else
+		l = devices;
+
+	for (; l != NULL; l = l->next) {
+		dev = l->data;
+
+		if (device_matches(dev, path, src, dst, interface, connected))
+			return dev;
 	}
 
 	return NULL;
@@ -1259,6 +1384,7 @@ struct audio_device *manager_get_device(const bdaddr_t *src,
 		return NULL;
 
 	devices = g_slist_append(devices, dev);
+	btd_registry_add(registry, src, dst, path, dev);
 
 	return dev;
 }
@@ -1291,6 +1417,16 @@ gboolean manager_allow_headset_connection(struct audio_device *device)
 	return TRUE;
 }
 
+connect_policy_t manager_get_connect_policy(void)
+{
+	return connect_policy;
+}
+
+gboolean manager_get_sco_msbc(void)
+{
+	return sco_msbc;
+}
+
 void manager_set_fast_connectable(gboolean enable)
 {
 	GSList *l;
@@ -49,6 +49,17 @@ struct audio_device *manager_get_device(const bdaddr_t *src,
 
 gboolean manager_allow_headset_connection(struct audio_device *device);
 
+/* How the remaining profiles of a device get connected once one is up */
+typedef enum {
+	CONNECT_POLICY_SEQUENTIAL,	/* One at a time, after a delay */
+	CONNECT_POLICY_PARALLEL,	/* All at once */
+} connect_policy_t;
+
+connect_policy_t manager_get_connect_policy(void);
+
+/* TRUE when mSBC may be negotiated for HCI routed SCO */
+gboolean manager_get_sco_msbc(void);
+
 /* TRUE to enable fast connectable and FALSE to disable fast connectable for all
  * audio adapters. */
 void manager_set_fast_connectable(gboolean enable);
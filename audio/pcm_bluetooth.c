@@ -52,6 +52,9 @@
 
 #define BUFFER_SIZE 2048
 
+/* PCM bytes in one mSBC frame: 15 blocks of 8 mono 16 bit samples */
+#define MSBC_CODESIZE 240
+
 #ifdef ENABLE_DEBUG
 #define DBG(fmt, arg...)  printf("DEBUG: %s: " fmt "\n" , __FUNCTION__ , ## arg)
 #else
@@ -106,6 +109,14 @@ struct bluetooth_a2dp {
 	int frame_count;			/* Current frames in buffer*/
 };
 
+struct bluetooth_sco {
+	int msbc;				/* mSBC instead of plain PCM */
+	sbc_t sbc;				/* mSBC codec data */
+	int sbc_initialized;
+	unsigned int codesize;			/* PCM bytes per SCO packet */
+	uint8_t seq;				/* H2 sequence number */
+};
+
 struct bluetooth_alsa_config {
 	char device[18];		/* Address of the remote Device */
 	int has_device;
@@ -137,6 +148,7 @@ struct bluetooth_data {
 	uint8_t buffer[BUFFER_SIZE];		/* Encoded transfer buffer */
 	unsigned int count;				/* Transfer buffer counter */
 	struct bluetooth_a2dp a2dp;			/* A2DP data */
+	struct bluetooth_sco sco;			/* SCO data */
 
 	pthread_t hw_thread;				/* Makes virtual hw pointer move */
 	int pipefd[2];					/* Inter thread communication */
@@ -310,6 +322,9 @@ static void bluetooth_exit(struct bluetooth_data *data)
 	if (a2dp->sbc_initialized)
 		sbc_finish(&a2dp->sbc);
 
+	if (data->sco.sbc_initialized)
+		sbc_finish(&data->sco.sbc);
+
 	if (data->pipefd[0] > 0)
 		close(data->pipefd[0]);
 
@@ -484,6 +499,70 @@ static int bluetooth_hsp_hw_params(snd_pcm_ioplug_t *io,
 	data->transport = BT_CAPABILITIES_TRANSPORT_SCO;
 	data->link_mtu = rsp->link_mtu;
 
+	if (!data->sco.msbc) {
+		data->sco.codesize = data->link_mtu;
+		return 0;
+	}
+
+	if (data->link_mtu < BT_MSBC_PACKET_SIZE)
+		return -EINVAL;
+
+	if (data->sco.sbc_initialized)
+		sbc_reinit(&data->sco.sbc, SBC_MSBC);
+	else
+		sbc_init(&data->sco.sbc, SBC_MSBC);
+	data->sco.sbc_initialized = 1;
+
+	data->sco.codesize = sbc_get_codesize(&data->sco.sbc);
+	data->sco.seq = 0;
+
+	return 0;
+}
+
+/* H2 synchronization header, the second octet carries a 2 bit sequence
+ * number with each bit doubled */
+static const uint8_t msbc_h2_sn[4] = { 0x08, 0x38, 0xc8, 0xf8 };
+
+static int bluetooth_msbc_encode(struct bluetooth_data *data, uint8_t *pkt)
+{
+	struct bluetooth_sco *sco = &data->sco;
+	ssize_t written;
+	int len;
+
+	pkt[0] = 0x01;
+	pkt[1] = msbc_h2_sn[sco->seq++ & 0x03];
+
+	len = sbc_encode(&sco->sbc, data->buffer, sco->codesize, pkt + 2,
+				BT_MSBC_PACKET_SIZE - 3, &written);
+	if (len <= 0 || written <= 0)
+		return -EIO;
+
+	memset(pkt + 2 + written, 0, BT_MSBC_PACKET_SIZE - 2 - written);
+
+	return BT_MSBC_PACKET_SIZE;
+}
+
+static int bluetooth_msbc_decode(struct bluetooth_data *data,
+					const uint8_t *pkt, int len)
+{
+	struct bluetooth_sco *sco = &data->sco;
+	size_t written;
+	int i;
+
+	/* Resynchronize on the H2 header, frames are never split */
+	for (i = 0; i + 2 < len; i++) {
+		if (pkt[i] != 0x01 || (pkt[i + 1] & 0x0f) != 0x08)
+			continue;
+
+		if (sbc_decode(&sco->sbc, pkt + i + 2, len - i - 2,
+				data->buffer, sco->codesize, &written) > 0 &&
+				written == sco->codesize)
+			return 0;
+	}
+
+	/* Lost frame, play silence instead of stale audio */
+	memset(data->buffer, 0, sco->codesize);
+
 	return 0;
 }
 
@@ -851,6 +930,7 @@ static snd_pcm_sframes_t bluetooth_hsp_read(snd_pcm_ioplug_t *io,
 	snd_pcm_uframes_t frames_to_write, ret;
 	unsigned char *buff;
 	unsigned int frame_size = 0;
+	uint8_t pkt[BUFFER_SIZE];
 	int nrecv;
 
 	DBG("areas->step=%u areas->first=%u offset=%lu size=%lu io->nonblock=%u",
@@ -861,8 +941,8 @@ static snd_pcm_sframes_t bluetooth_hsp_read(snd_pcm_ioplug_t *io,
 	if (data->count > 0)
 		goto proceed;
 
-	nrecv = recv(data->stream.fd, data->buffer, data->link_mtu,
-					io->nonblock ? MSG_DONTWAIT : 0);
+	nrecv = recv(data->stream.fd, data->sco.msbc ? pkt : data->buffer,
+			data->link_mtu, io->nonblock ? MSG_DONTWAIT : 0);
 
 	if (nrecv < 0) {
 		ret = (errno == EPIPE) ? -EIO : -errno;
@@ -875,22 +955,26 @@ static snd_pcm_sframes_t bluetooth_hsp_read(snd_pcm_ioplug_t *io,
 		goto done;
 	}
 
+	if (data->sco.msbc)
+		bluetooth_msbc_decode(data, pkt, nrecv);
+
 	/* Increment hardware transmition pointer */
-	data->hw_ptr = (data->hw_ptr + data->link_mtu / frame_size) %
+	data->hw_ptr = (data->hw_ptr + data->sco.codesize / frame_size) %
 				io->buffer_size;
 
 proceed:
 	buff = (unsigned char *) areas->addr +
 			(areas->first + areas->step * offset) / 8;
 
-	if ((data->count + size * frame_size) <= data->link_mtu)
+	if ((data->count + size * frame_size) <= data->sco.codesize)
 		frames_to_write = size;
 	else
-		frames_to_write = (data->link_mtu - data->count) / frame_size;
+		frames_to_write = (data->sco.codesize - data->count) /
+								frame_size;
 
 	memcpy(buff, data->buffer + data->count, frame_size * frames_to_write);
 	data->count += (frame_size * frames_to_write);
-	data->count %= data->link_mtu;
+	data->count %= data->sco.codesize;
 
 	/* Return written frames count */
 	ret = frames_to_write;
@@ -908,8 +992,9 @@ static snd_pcm_sframes_t bluetooth_hsp_write(snd_pcm_ioplug_t *io,
 	struct bluetooth_data *data = io->private_data;
 	snd_pcm_sframes_t ret = 0;
 	snd_pcm_uframes_t frames_to_read;
-	uint8_t *buff;
-	int rsend, frame_size;
+	uint8_t pkt[BT_MSBC_PACKET_SIZE];
+	uint8_t *buff, *out;
+	int rsend, frame_size, len;
 
 	DBG("areas->step=%u areas->first=%u offset=%lu, size=%lu io->nonblock=%u",
 			areas->step, areas->first, offset, size, io->nonblock);
@@ -922,10 +1007,11 @@ static snd_pcm_sframes_t bluetooth_hsp_write(snd_pcm_ioplug_t *io,
 	}
 
 	frame_size = areas->step / 8;
-	if ((data->count + size * frame_size) <= data->link_mtu)
+	if ((data->count + size * frame_size) <= data->sco.codesize)
 		frames_to_read = size;
 	else
-		frames_to_read = (data->link_mtu - data->count) / frame_size;
+		frames_to_read = (data->sco.codesize - data->count) /
+								frame_size;
 
 	DBG("count=%d frames_to_read=%lu", data->count, frames_to_read);
 
@@ -936,12 +1022,24 @@ static snd_pcm_sframes_t bluetooth_hsp_write(snd_pcm_ioplug_t *io,
 
 	/* Remember we have some frames in the pipe now */
 	data->count += frames_to_read * frame_size;
-	if (data->count != data->link_mtu) {
+	if (data->count != data->sco.codesize) {
 		ret = frames_to_read;
 		goto done;
 	}
 
-	rsend = send(data->stream.fd, data->buffer, data->link_mtu,
+	if (data->sco.msbc) {
+		len = bluetooth_msbc_encode(data, pkt);
+		if (len < 0) {
+			ret = len;
+			goto done;
+		}
+		out = pkt;
+	} else {
+		len = data->link_mtu;
+		out = data->buffer;
+	}
+
+	rsend = send(data->stream.fd, out, len,
 			io->nonblock ? MSG_DONTWAIT : 0);
 	if (rsend > 0) {
 		/* Reset count pointer */
@@ -1228,6 +1326,7 @@ static int bluetooth_hsp_hw_constraint(snd_pcm_ioplug_t *io)
 	unsigned int format_list[] = {
 		SND_PCM_FORMAT_S16
 	};
+	unsigned int rate, period;
 	int err;
 
 	/* access type */
@@ -1249,14 +1348,16 @@ static int bluetooth_hsp_hw_constraint(snd_pcm_ioplug_t *io)
 		return err;
 
 	/* supported rate */
+	rate = data->sco.msbc ? 16000 : 8000;
 	err = snd_pcm_ioplug_set_param_minmax(io, SND_PCM_IOPLUG_HW_RATE,
-							8000, 8000);
+							rate, rate);
 	if (err < 0)
 		return err;
 
-	/* supported block size */
+	/* supported block size, a whole mSBC frame when in use */
+	period = data->sco.msbc ? MSBC_CODESIZE : data->link_mtu;
 	err = snd_pcm_ioplug_set_param_minmax(io, SND_PCM_IOPLUG_HW_PERIOD_BYTES,
-						data->link_mtu, data->link_mtu);
+							period, period);
 	if (err < 0)
 		return err;
 
@@ -1625,6 +1726,11 @@ static int bluetooth_parse_capabilities(struct bluetooth_data *data,
 
 	data->transport = codec->transport;
 
+	if (codec->transport == BT_CAPABILITIES_TRANSPORT_SCO) {
+		data->sco.msbc = codec->type == BT_HFP_CODEC_MSBC;
+		return 0;
+	}
+
 	if (codec->transport != BT_CAPABILITIES_TRANSPORT_A2DP)
 		return 0;
 
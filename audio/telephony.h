@@ -36,6 +36,7 @@
 #define AG_FEATURE_ENHANCED_CALL_STATUS		0x0040
 #define AG_FEATURE_ENHANCED_CALL_CONTROL	0x0080
 #define AG_FEATURE_EXTENDED_ERROR_RESULT_CODES	0x0100
+#define AG_FEATURE_CODEC_NEGOTIATION		0x0200
 
 #define HF_FEATURE_EC_ANDOR_NR			0x0001
 #define HF_FEATURE_CALL_WAITING_AND_3WAY	0x0002
@@ -44,6 +45,7 @@
 #define HF_FEATURE_REMOTE_VOLUME_CONTROL	0x0010
 #define HF_FEATURE_ENHANCED_CALL_STATUS		0x0020
 #define HF_FEATURE_ENHANCED_CALL_CONTROL	0x0040
+#define HF_FEATURE_CODEC_NEGOTIATION		0x0080
 
 /* Indicator event values */
 #define EV_SERVICE_NONE			0
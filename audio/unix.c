@@ -227,6 +227,21 @@ static void stream_state_changed(struct avdtp_stream *stream,
 	}
 }
 
+/* In the gateway role codecs are negotiated by the HF agent owning the
+ * RFCOMM channel, so only the headset side can carry mSBC */
+static gboolean sco_get_msbc(struct audio_device *dev)
+{
+	if (dev->headset)
+		return headset_get_sco_msbc(dev);
+
+	return FALSE;
+}
+
+static uint16_t sco_link_mtu(struct audio_device *dev)
+{
+	return sco_get_msbc(dev) ? BT_MSBC_PACKET_SIZE : 48;
+}
+
 static uint8_t headset_generate_capability(struct audio_device *dev,
 						codec_capabilities_t *codec)
 {
@@ -239,6 +254,12 @@ static uint8_t headset_generate_capability(struct audio_device *dev,
 
 	pcm = (void *) codec;
 	pcm->sampling_rate = 8000;
+
+	if (sco_get_msbc(dev)) {
+		codec->type = BT_HFP_CODEC_MSBC;
+		pcm->sampling_rate = 16000;
+	}
+
 	if (dev->headset) {
 		if (headset_get_nrec(dev))
 			pcm->flags |= BT_PCM_FLAG_NREC;
@@ -305,7 +326,7 @@ static void headset_setup_complete(struct audio_device *dev, void *user_data)
 	rsp->h.name = BT_SET_CONFIGURATION;
 	rsp->h.length = sizeof(*rsp);
 
-	rsp->link_mtu = 48;
+	rsp->link_mtu = sco_link_mtu(dev);
 
 	client->data_fd = headset_get_sco_fd(dev);
 
@@ -337,7 +358,7 @@ static void gateway_setup_complete(struct audio_device *dev, GError *err, void *
 	rsp->h.name = BT_SET_CONFIGURATION;
 	rsp->h.length = sizeof(*rsp);
 
-	rsp->link_mtu = 48;
+	rsp->link_mtu = sco_link_mtu(dev);
 
 	client->data_fd = gateway_get_sco_fd(dev);
 
@@ -31,6 +31,16 @@ enum {					/**** Backend exit codes ****/
 	CUPS_BACKEND_RETRY = 6,		/* Failure requires us to retry (BlueZ specific) */
 };
 
+struct job_stream {
+	int fd;			/* Job file */
+	int sk;			/* Device socket */
+	int pipefd[2];		/* splice() pipe, -1 when not available */
+};
+
+void stream_init(struct job_stream *js, int fd, int sk);
+void stream_cleanup(struct job_stream *js);
+ssize_t stream_forward(struct job_stream *js, size_t len);
+
 int sdp_search_spp(sdp_session_t *sdp, uint8_t *channel);
 int sdp_search_hcrp(sdp_session_t *sdp, unsigned short *ctrl_psm, unsigned short *data_psm);
 
@@ -30,6 +30,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <signal.h>
+#include <sys/poll.h>
 #include <sys/socket.h>
 
 #include <bluetooth/bluetooth.h>
@@ -50,6 +51,10 @@
 #define HCRP_STATUS_CREDIT_SYNC_ERROR	0x0002
 #define HCRP_STATUS_GENERIC_FAILURE	0xffff
 
+/* Ask for more credit while this much is still left, so that the data
+ * channel keeps streaming during the control channel round trip */
+#define HCRP_CREDIT_AHEAD(mtu)		(4 * (mtu))
+
 struct hcrp_pdu_hdr {
 	uint16_t pid;
 	uint16_t tid;
@@ -107,23 +112,46 @@ static int hcrp_credit_grant(int sk, uint16_t tid, uint32_t credit)
 	return 0;
 }
 
-static int hcrp_credit_request(int sk, uint16_t tid, uint32_t *credit)
+static int hcrp_send_credit_request(int sk, uint16_t tid)
 {
 	struct hcrp_pdu_hdr hdr;
-	struct hcrp_credit_request_rp rp;
-	unsigned char buf[128];
-	int len;
 
 	hdr.pid = htons(HCRP_PDU_CREDIT_REQUEST);
 	hdr.tid = htons(tid);
 	hdr.plen = htons(0);
-	memcpy(buf, &hdr, HCRP_PDU_HDR_SIZE);
-	len = write(sk, buf, HCRP_PDU_HDR_SIZE);
+
+	if (write(sk, &hdr, HCRP_PDU_HDR_SIZE) < 0)
+		return -1;
+
+	return 0;
+}
+
+static int hcrp_recv_credit_reply(int sk, uint16_t tid, uint32_t *credit)
+{
+	struct hcrp_pdu_hdr hdr;
+	struct hcrp_credit_request_rp rp;
+	unsigned char buf[128];
+	int len;
 
 	len = read(sk, buf, sizeof(buf));
+	if (len < 0)
+		return -1;
+
+	if (len < HCRP_PDU_HDR_SIZE + HCRP_CREDIT_REQUEST_RP_SIZE) {
+		errno = EIO;
+		return -1;
+	}
+
 	memcpy(&hdr, buf, HCRP_PDU_HDR_SIZE);
 	memcpy(&rp, buf + HCRP_PDU_HDR_SIZE, HCRP_CREDIT_REQUEST_RP_SIZE);
 
+	/* Stale reply to an earlier request */
+	if (ntohs(hdr.pid) != HCRP_PDU_CREDIT_REQUEST ||
+						ntohs(hdr.tid) != tid) {
+		errno = EAGAIN;
+		return -1;
+	}
+
 	if (ntohs(rp.status) != HCRP_STATUS_SUCCESS) {
 		errno = EIO;
 		return -1;
@@ -175,9 +203,10 @@ int hcrp_print(bdaddr_t *src, bdaddr_t *dst, unsigned short ctrl_psm, unsigned s
 {
 	struct sockaddr_l2 addr;
 	struct l2cap_options opts;
+	struct job_stream js;
 	socklen_t size;
-	unsigned char buf[2048];
-	int i, ctrl_sk, data_sk, count, len, timeout = 0;
+	ssize_t count;
+	int i, ctrl_sk, data_sk, timeout = 0, requesting = 0, waiting = 0;
 	unsigned int mtu;
 	uint8_t status;
 	uint16_t tid = 0;
@@ -298,6 +327,8 @@ int hcrp_print(bdaddr_t *src, bdaddr_t *dst, unsigned short ctrl_psm, unsigned s
 			return CUPS_BACKEND_RETRY;
 	}
 
+	stream_init(&js, fd, data_sk);
+
 	for (i = 0; i < copies; i++) {
 
 		if (fd != 0) {
@@ -306,48 +337,96 @@ int hcrp_print(bdaddr_t *src, bdaddr_t *dst, unsigned short ctrl_psm, unsigned s
 		}
 
 		while (1) {
-			if (credit < mtu) {
+			struct pollfd p[2];
+			int n, err;
+
+			/* Keep one credit request in flight on the control
+			 * channel while the data channel is being filled */
+			if (!requesting && !waiting &&
+					credit < HCRP_CREDIT_AHEAD(mtu)) {
 				tid = hcrp_get_next_tid(tid);
-				if (!hcrp_credit_request(ctrl_sk, tid, &tmp)) {
-					credit += tmp;
-					timeout = 0;
-				}
+				if (!hcrp_send_credit_request(ctrl_sk, tid))
+					requesting = 1;
+			}
+
+			p[0].fd = ctrl_sk;
+			p[0].events = POLLIN;
+			p[0].revents = 0;
+			p[1].fd = data_sk;
+			p[1].events = POLLOUT;
+			p[1].revents = 0;
+
+			n = poll(p, credit > 0 ? 2 : 1, 1000);
+			if (n < 0) {
+				if (errno == EINTR)
+					continue;
+				perror("ERROR: Can't poll device");
+				goto failed;
 			}
 
-			if (!credit) {
-				if (timeout++ > 300) {
+			if (n == 0) {
+				/* The outstanding request stays valid, only a
+				 * refused one is asked again after a second */
+				waiting = 0;
+
+				if (!credit && timeout++ > 300) {
 					tid = hcrp_get_next_tid(tid);
 					if (!hcrp_get_lpt_status(ctrl_sk, tid, &status))
 						fprintf(stderr, "ERROR: LPT status 0x%02x\n", status);
 					break;
 				}
 
-				sleep(1);
 				continue;
 			}
 
-			count = read(fd, buf, (credit > mtu) ? mtu : credit);
-			if (count <= 0)
+			if (p[0].revents & (POLLERR | POLLHUP | POLLNVAL) ||
+				p[1].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+				fprintf(stderr, "ERROR: Device disconnected\n");
+				goto failed;
+			}
+
+			/* A zero grant or a failure is retried on the next
+			 * idle second, like the device asked us to wait */
+			if (p[0].revents & POLLIN) {
+				err = hcrp_recv_credit_reply(ctrl_sk, tid, &tmp);
+				if (!err && tmp > 0) {
+					credit += tmp;
+					timeout = 0;
+					requesting = 0;
+				} else if (requesting &&
+						(!err || errno != EAGAIN)) {
+					requesting = 0;
+					waiting = 1;
+				}
+			}
+
+			if (!(p[1].revents & POLLOUT) || !credit)
+				continue;
+
+			count = stream_forward(&js, (credit > mtu) ? mtu : credit);
+			if (count == 0)
 				break;
 
-			len = write(data_sk, buf, count);
-			if (len < 0) {
+			if (count < 0) {
 				perror("ERROR: Error writing to device");
-				close(data_sk);
-				close(ctrl_sk);
-				return CUPS_BACKEND_FAILED;
+				goto failed;
 			}
 
-			if (len != count)
-				fprintf(stderr, "ERROR: Can't send complete data\n");
-
-			credit -= len;
+			credit -= count;
 		}
 
 	}
 
+	stream_cleanup(&js);
 	close(data_sk);
 	close(ctrl_sk);
 
 	return CUPS_BACKEND_OK;
+
+failed:
+	stream_cleanup(&js);
+	close(data_sk);
+	close(ctrl_sk);
+
+	return CUPS_BACKEND_FAILED;
 }
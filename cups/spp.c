@@ -38,11 +38,14 @@
 
 #include "cups.h"
 
+#define SPP_CHUNK_SIZE	65536
+
 int spp_print(bdaddr_t *src, bdaddr_t *dst, uint8_t channel, int fd, int copies, const char *cups_class)
 {
 	struct sockaddr_rc addr;
-	unsigned char buf[2048];
-	int i, sk, err, len;
+	struct job_stream js;
+	ssize_t len;
+	int i, sk;
 
 	if ((sk = socket(PF_BLUETOOTH, SOCK_STREAM, BTPROTO_RFCOMM)) < 0) {
 		perror("ERROR: Can't create socket");
@@ -94,6 +97,8 @@ int spp_print(bdaddr_t *src, bdaddr_t *dst, uint8_t channel, int fd, int copies,
 #endif /* HAVE_SIGSET */
 	}
 
+	stream_init(&js, fd, sk);
+
 	for (i = 0; i < copies; i++) {
 
 		if (fd != 0) {
@@ -101,17 +106,20 @@ int spp_print(bdaddr_t *src, bdaddr_t *dst, uint8_t channel, int fd, int copies,
 			lseek(fd, 0, SEEK_SET);
 		}
 
-		while ((len = read(fd, buf, sizeof(buf))) > 0) {
-			err = write(sk, buf, len);
-			if (err < 0) {
-				perror("ERROR: Error writing to device");
-				close(sk);
-				return CUPS_BACKEND_FAILED;
-			}
+		do {
+			len = stream_forward(&js, SPP_CHUNK_SIZE);
+		} while (len > 0);
+
+		if (len < 0) {
+			perror("ERROR: Error writing to device");
+			stream_cleanup(&js);
+			close(sk);
+			return CUPS_BACKEND_FAILED;
 		}
 
 	}
 
+	stream_cleanup(&js);
 	close(sk);
 
 	return CUPS_BACKEND_OK;
@@ -0,0 +1,146 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2010  Marcel Holtmann <marcel@holtmann.org>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/sdp.h>
+#include <bluetooth/sdp_lib.h>
+
+#include "cups.h"
+
+void stream_init(struct job_stream *js, int fd, int sk)
+{
+	js->fd = fd;
+	js->sk = sk;
+
+	if (pipe(js->pipefd) < 0)
+		js->pipefd[0] = js->pipefd[1] = -1;
+}
+
+void stream_cleanup(struct job_stream *js)
+{
+	if (js->pipefd[0] < 0)
+		return;
+
+	close(js->pipefd[0]);
+	close(js->pipefd[1]);
+	js->pipefd[0] = js->pipefd[1] = -1;
+}
+
+static int write_all(int sk, const unsigned char *buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t n = write(sk, buf, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		buf += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/* Copy through user space, also used to drain a pipe whose data
+ * could not be spliced into the socket */
+static ssize_t stream_copy(int fd, int sk, size_t len)
+{
+	unsigned char buf[8192];
+	ssize_t n;
+
+	if (len > sizeof(buf))
+		len = sizeof(buf);
+
+	do {
+		n = read(fd, buf, len);
+	} while (n < 0 && errno == EINTR);
+
+	if (n <= 0)
+		return n;
+
+	if (write_all(sk, buf, n) < 0)
+		return -1;
+
+	return n;
+}
+
+/* Move up to len bytes from the job file to the socket. Returns the
+ * number of bytes sent, 0 at the end of the job or -1 on error. */
+ssize_t stream_forward(struct job_stream *js, size_t len)
+{
+	ssize_t in, out, done;
+
+	if (js->pipefd[0] < 0)
+		return stream_copy(js->fd, js->sk, len);
+
+	in = splice(js->fd, NULL, js->pipefd[1], NULL, len, SPLICE_F_MOVE);
+	if (in < 0) {
+		if (errno != EINVAL && errno != ENOSYS)
+			return -1;
+
+		stream_cleanup(js);
+		return stream_copy(js->fd, js->sk, len);
+	}
+
+	for (done = 0; done < in; done += out) {
+		out = splice(js->pipefd[0], NULL, js->sk, NULL, in - done,
+								SPLICE_F_MOVE);
+		if (out > 0)
+			continue;
+
+		if (out < 0 && errno == EINTR) {
+			out = 0;
+			continue;
+		}
+
+		if (out < 0 && errno != EINVAL && errno != ENOSYS)
+			return -1;
+
+		/* The socket does not take spliced data, flush the pipe
+		 * by hand and stop using it */
+		while (done < in) {
+			out = stream_copy(js->pipefd[0], js->sk, in - done);
+			if (out <= 0)
+				return -1;
+			done += out;
+		}
+
+		stream_cleanup(js);
+		break;
+	}
+
+	return in;
+}
@@ -39,7 +39,10 @@
 
 struct generic_data {
 	unsigned int refcount;
+	DBusConnection *conn;
 	GSList *interfaces;
+	GHashTable *methods;
+	GSList *pending;
 	char *introspect;
 };
 
@@ -52,6 +55,22 @@ struct interface_data {
 	GDBusDestroyFunction destroy;
 };
 
+/* Property change signal waiting for the mainloop to become idle */
+struct pending_signal {
+	char *key;
+	DBusMessage *message;
+};
+
+static GSList *pending_objects = NULL;
+static guint pending_id = 0;
+
+/* Methods sharing the same interface and name, in table order */
+struct method_data {
+	struct interface_data *iface;
+	const GDBusMethodTable *method;
+	struct method_data *next;
+};
+
 static void print_arguments(GString *gstr, const char *sig,
 						const char *direction)
 {
@@ -208,10 +227,54 @@ static DBusMessage *introspect(DBusConnection *connection,
 	return reply;
 }
 
+static void flush_pending_signals(struct generic_data *data)
+{
+	while (data->pending) {
+		struct pending_signal *pending = data->pending->data;
+
+		data->pending = g_slist_remove(data->pending, pending);
+
+		dbus_connection_send(data->conn, pending->message, NULL);
+		dbus_message_unref(pending->message);
+		g_free(pending->key);
+		g_free(pending);
+	}
+
+	pending_objects = g_slist_remove(pending_objects, data);
+}
+
+static gboolean process_pending_signals(gpointer user_data)
+{
+	pending_id = 0;
+
+	while (pending_objects)
+		flush_pending_signals(pending_objects->data);
+
+	return FALSE;
+}
+
+/* No reply or signal sent on the connection may overtake queued changes */
+static void flush_pending_connection(DBusConnection *connection)
+{
+	GSList *l = pending_objects;
+
+	while (l) {
+		struct generic_data *data = l->data;
+
+		l = l->next;
+
+		if (data->conn == connection)
+			flush_pending_signals(data);
+	}
+}
+
 static void generic_unregister(DBusConnection *connection, void *user_data)
 {
 	struct generic_data *data = user_data;
 
+	flush_pending_signals(data);
+
+	g_hash_table_destroy(data->methods);
 	g_free(data->introspect);
 	g_free(data);
 }
@@ -233,33 +296,58 @@ static struct interface_data *find_interface(GSList *interfaces,
 	return NULL;
 }
 
+static void method_data_free(gpointer user_data)
+{
+	struct method_data *entry = user_data;
+
+	while (entry) {
+		struct method_data *next = entry->next;
+
+		g_free(entry);
+		entry = next;
+	}
+}
+
+static const struct method_data *find_method(struct generic_data *data,
+						const char *interface,
+						const char *member)
+{
+	char key[DBUS_MAXIMUM_NAME_LENGTH * 2 + 2];
+
+	if (!interface || !member)
+		return NULL;
+
+	snprintf(key, sizeof(key), "%s.%s", interface, member);
+
+	return g_hash_table_lookup(data->methods, key);
+}
+
 static DBusHandlerResult generic_message(DBusConnection *connection,
 					DBusMessage *message, void *user_data)
 {
 	struct generic_data *data = user_data;
-	struct interface_data *iface;
-	const GDBusMethodTable *method;
-	const char *interface;
+	const struct method_data *entry;
+	const char *signature;
 
-	interface = dbus_message_get_interface(message);
+	if (dbus_message_get_type(message) != DBUS_MESSAGE_TYPE_METHOD_CALL)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-	iface = find_interface(data->interfaces, interface);
-	if (!iface)
+	entry = find_method(data, dbus_message_get_interface(message),
+					dbus_message_get_member(message));
+	if (!entry)
 		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-	for (method = iface->methods; method &&
-			method->name && method->function; method++) {
-		DBusMessage *reply;
+	signature = dbus_message_get_signature(message);
 
-		if (dbus_message_is_method_call(message, iface->name,
-							method->name) == FALSE)
-			continue;
+	for (; entry; entry = entry->next) {
+		const GDBusMethodTable *method = entry->method;
+		DBusMessage *reply;
 
-		if (dbus_message_has_signature(message,
-						method->signature) == FALSE)
+		if (strcmp(signature, method->signature) != 0)
 			continue;
 
-		reply = method->function(connection, message, iface->user_data);
+		reply = method->function(connection, message,
+						entry->iface->user_data);
 
 		if (method->flags & G_DBUS_METHOD_FLAG_NOREPLY) {
 			if (reply != NULL)
@@ -275,6 +363,8 @@ static DBusHandlerResult generic_message(DBusConnection *connection,
 		if (reply == NULL)
 			return DBUS_HANDLER_RESULT_NEED_MEMORY;
 
+		flush_pending_connection(connection);
+
 		dbus_connection_send(connection, reply, NULL);
 		dbus_message_unref(reply);
 
@@ -336,6 +426,7 @@ static void add_interface(struct generic_data *data, const char *name,
 				GDBusDestroyFunction destroy)
 {
 	struct interface_data *iface;
+	const GDBusMethodTable *method;
 
 	iface = g_new0(struct interface_data, 1);
 	iface->name = g_strdup(name);
@@ -346,6 +437,31 @@ static void add_interface(struct generic_data *data, const char *name,
 	iface->destroy = destroy;
 
 	data->interfaces = g_slist_append(data->interfaces, iface);
+
+	for (method = methods; method &&
+			method->name && method->function; method++) {
+		struct method_data *entry, *last;
+		char *key;
+
+		entry = g_new0(struct method_data, 1);
+		entry->iface = iface;
+		entry->method = method;
+
+		key = g_strdup_printf("%s.%s", name, method->name);
+
+		last = g_hash_table_lookup(data->methods, key);
+		if (last == NULL) {
+			g_hash_table_insert(data->methods, key, entry);
+			continue;
+		}
+
+		g_free(key);
+
+		while (last->next)
+			last = last->next;
+
+		last->next = entry;
+	}
 }
 
 static struct generic_data *object_path_ref(DBusConnection *connection,
@@ -366,9 +482,14 @@ static struct generic_data *object_path_ref(DBusConnection *connection,
 	data->introspect = g_strdup(DBUS_INTROSPECT_1_0_XML_DOCTYPE_DECL_NODE "<node></node>");
 
 	data->refcount = 1;
+	data->conn = connection;
+
+	data->methods = g_hash_table_new_full(g_str_hash, g_str_equal,
+						g_free, method_data_free);
 
 	if (!dbus_connection_register_object_path(connection, path,
 						&generic_table, data)) {
+		g_hash_table_destroy(data->methods);
 		g_free(data->introspect);
 		g_free(data);
 		return NULL;
@@ -385,13 +506,24 @@ static struct generic_data *object_path_ref(DBusConnection *connection,
 static gboolean remove_interface(struct generic_data *data, const char *name)
 {
 	struct interface_data *iface;
+	const GDBusMethodTable *method;
 
 	iface = find_interface(data->interfaces, name);
 	if (!iface)
 		return FALSE;
 
+	flush_pending_signals(data);
+
 	data->interfaces = g_slist_remove(data->interfaces, iface);
 
+	for (method = iface->methods; method &&
+			method->name && method->function; method++) {
+		char *key = g_strdup_printf("%s.%s", name, method->name);
+
+		g_hash_table_remove(data->methods, key);
+		g_free(key);
+	}
+
 	if (iface->destroy)
 		iface->destroy(iface->user_data);
 
@@ -486,6 +618,8 @@ static dbus_bool_t emit_signal_valist(DBusConnection *conn,
 	if (!ret)
 		goto fail;
 
+	flush_pending_connection(conn);
+
 	signature = dbus_message_get_signature(signal);
 	if (strcmp(args, signature) != 0) {
 		error("%s.%s: expected signature'%s' but got '%s'",
@@ -619,6 +753,8 @@ gboolean g_dbus_send_message(DBusConnection *connection, DBusMessage *message)
 	if (dbus_message_get_type(message) == DBUS_MESSAGE_TYPE_METHOD_CALL)
 		dbus_message_set_no_reply(message, TRUE);
 
+	flush_pending_connection(connection);
+
 	result = dbus_connection_send(connection, message, NULL);
 
 	dbus_message_unref(message);
@@ -626,6 +762,62 @@ gboolean g_dbus_send_message(DBusConnection *connection, DBusMessage *message)
 	return result;
 }
 
+/*
+ * Property changes are sent once the mainloop gets idle, only the last
+ * value of each property changed in the meantime goes out.
+ */
+gboolean g_dbus_send_property_changed(DBusConnection *connection,
+					DBusMessage *signal, const char *name)
+{
+	struct generic_data *data = NULL;
+	struct pending_signal *pending;
+	const char *path, *interface;
+	GSList *l;
+	char *key;
+
+	path = dbus_message_get_path(signal);
+	interface = dbus_message_get_interface(signal);
+
+	if (!path || !interface || !name)
+		return g_dbus_send_message(connection, signal);
+
+	/* Only objects registered through gdbus can hold back signals */
+	if (!dbus_connection_get_object_path_data(connection, path,
+						(void *) &data) || !data)
+		return g_dbus_send_message(connection, signal);
+
+	key = g_strconcat(interface, ".", name, NULL);
+
+	/* A newer value replaces the queued one and moves to the back */
+	for (l = data->pending; l; l = l->next) {
+		pending = l->data;
+
+		if (strcmp(pending->key, key) != 0)
+			continue;
+
+		data->pending = g_slist_remove(data->pending, pending);
+		dbus_message_unref(pending->message);
+		g_free(pending->key);
+		g_free(pending);
+		break;
+	}
+
+	pending = g_new0(struct pending_signal, 1);
+	pending->key = key;
+	pending->message = signal;
+
+	if (!data->pending)
+		pending_objects = g_slist_append(pending_objects, data);
+
+	data->pending = g_slist_append(data->pending, pending);
+
+	if (!pending_id)
+		pending_id = g_idle_add_full(G_PRIORITY_DEFAULT,
+					process_pending_signals, NULL, NULL);
+
+	return TRUE;
+}
+
 gboolean g_dbus_send_reply_valist(DBusConnection *connection,
 				DBusMessage *message, int type, va_list args)
 {
@@ -41,8 +41,38 @@ static DBusHandlerResult message_filter(DBusConnection *connection,
 					DBusMessage *message, void *user_data);
 
 static guint listener_id = 0;
+static guint listener_serial = 0;
 static GSList *listeners = NULL;
 
+/*
+ * Besides the listeners list, which keeps registration order, listeners
+ * are hashed by the sender, path, interface and member they match on,
+ * with unset fields left out of the key.  A signal only needs to look
+ * at the buckets of the combinations of unset fields in use.
+ */
+enum {
+	MATCH_SENDER	= 1 << 0,
+	MATCH_PATH	= 1 << 1,
+	MATCH_INTERFACE	= 1 << 2,
+	MATCH_MEMBER	= 1 << 3,
+	MATCH_SHAPES	= 1 << 4,
+};
+
+struct filter_key {
+	const char *sender;
+	const char *path;
+	const char *interface;
+	const char *member;
+};
+
+struct filter_bucket {
+	struct filter_key key;
+	GSList *listeners;
+};
+
+static GHashTable *listener_index = NULL;
+static guint listener_shapes[MATCH_SHAPES];
+
 struct filter_callback {
 	GDBusWatchFunction conn_func;
 	GDBusWatchFunction disc_func;
@@ -64,6 +94,7 @@ struct filter_data {
 	GSList *processed;
 	gboolean lock;
 	gboolean registered;
+	guint serial;
 };
 
 static struct filter_data *filter_data_find(DBusConnection *connection,
@@ -108,6 +139,179 @@ static struct filter_data *filter_data_find(DBusConnection *connection,
 	return NULL;
 }
 
+static guint filter_key_hash(gconstpointer key)
+{
+	const struct filter_key *k = key;
+	guint hash = 0;
+
+	if (k->sender)
+		hash = g_str_hash(k->sender);
+	if (k->path)
+		hash = hash * 31 + g_str_hash(k->path);
+	if (k->interface)
+		hash = hash * 31 + g_str_hash(k->interface);
+	if (k->member)
+		hash = hash * 31 + g_str_hash(k->member);
+
+	return hash;
+}
+
+static gboolean filter_key_equal(gconstpointer a, gconstpointer b)
+{
+	const struct filter_key *ka = a;
+	const struct filter_key *kb = b;
+
+	return g_strcmp0(ka->sender, kb->sender) == 0 &&
+			g_strcmp0(ka->path, kb->path) == 0 &&
+			g_strcmp0(ka->interface, kb->interface) == 0 &&
+			g_strcmp0(ka->member, kb->member) == 0;
+}
+
+static void filter_bucket_free(gpointer user_data)
+{
+	struct filter_bucket *bucket = user_data;
+
+	g_slist_free(bucket->listeners);
+	g_free(bucket);
+}
+
+static void filter_data_key(struct filter_data *data, struct filter_key *key)
+{
+	key->sender = data->sender;
+	key->path = data->path;
+	key->interface = data->interface;
+	key->member = data->member;
+}
+
+static guint filter_data_shape(struct filter_data *data)
+{
+	guint shape = 0;
+
+	if (data->sender)
+		shape |= MATCH_SENDER;
+	if (data->path)
+		shape |= MATCH_PATH;
+	if (data->interface)
+		shape |= MATCH_INTERFACE;
+	if (data->member)
+		shape |= MATCH_MEMBER;
+
+	return shape;
+}
+
+static void listener_add(struct filter_data *data)
+{
+	struct filter_bucket *bucket;
+	struct filter_key key;
+
+	listeners = g_slist_append(listeners, data);
+
+	if (!listener_index)
+		listener_index = g_hash_table_new_full(filter_key_hash,
+						filter_key_equal, NULL,
+						filter_bucket_free);
+
+	filter_data_key(data, &key);
+
+	bucket = g_hash_table_lookup(listener_index, &key);
+	if (!bucket) {
+		bucket = g_new0(struct filter_bucket, 1);
+		bucket->key = key;
+		g_hash_table_insert(listener_index, &bucket->key, bucket);
+	}
+
+	data->serial = ++listener_serial;
+	bucket->listeners = g_slist_append(bucket->listeners, data);
+
+	listener_shapes[filter_data_shape(data)]++;
+}
+
+static void listener_remove(struct filter_data *data)
+{
+	struct filter_bucket *bucket;
+	struct filter_key key;
+
+	listeners = g_slist_remove(listeners, data);
+
+	if (!listener_index)
+		return;
+
+	filter_data_key(data, &key);
+
+	bucket = g_hash_table_lookup(listener_index, &key);
+	if (!bucket || !g_slist_find(bucket->listeners, data))
+		return;
+
+	bucket->listeners = g_slist_remove(bucket->listeners, data);
+	listener_shapes[filter_data_shape(data)]--;
+
+	if (bucket->listeners == NULL) {
+		g_hash_table_remove(listener_index, &bucket->key);
+		return;
+	}
+
+	/* The key strings belong to the first listener of the bucket */
+	filter_data_key(bucket->listeners->data, &bucket->key);
+}
+
+/*
+ * Same result as filter_data_find for fully specified signals, without
+ * walking through every listener of the process.
+ */
+static struct filter_data *filter_data_lookup(DBusConnection *connection,
+							const char *sender,
+							const char *path,
+							const char *interface,
+							const char *member,
+							const char *argument)
+{
+	struct filter_data *found = NULL;
+	guint shape;
+
+	if (!sender || !path || !interface || !member || !listener_index)
+		return filter_data_find(connection, sender, path, interface,
+							member, argument);
+
+	for (shape = 0; shape < MATCH_SHAPES; shape++) {
+		struct filter_bucket *bucket;
+		struct filter_key key;
+		GSList *l;
+
+		if (listener_shapes[shape] == 0)
+			continue;
+
+		key.sender = shape & MATCH_SENDER ? sender : NULL;
+		key.path = shape & MATCH_PATH ? path : NULL;
+		key.interface = shape & MATCH_INTERFACE ? interface : NULL;
+		key.member = shape & MATCH_MEMBER ? member : NULL;
+
+		bucket = g_hash_table_lookup(listener_index, &key);
+		if (!bucket)
+			continue;
+
+		/* Buckets keep registration order, so the first listener
+		 * matching wins just like with the listeners list */
+		for (l = bucket->listeners; l != NULL; l = l->next) {
+			struct filter_data *data = l->data;
+
+			if (found && data->serial > found->serial)
+				break;
+
+			if (connection != data->connection)
+				continue;
+
+			if (argument && data->argument &&
+				g_str_equal(argument, data->argument) == FALSE)
+				continue;
+
+			found = data;
+			break;
+		}
+	}
+
+	return found;
+}
+
 static void format_rule(struct filter_data *data, char *rule, size_t size)
 {
 	int offset;
@@ -211,7 +415,7 @@ static struct filter_data *filter_data_get(DBusConnection *connection,
 		return NULL;
 	}
 
-	listeners = g_slist_append(listeners, data);
+	listener_add(data);
 
 	return data;
 }
@@ -318,7 +522,7 @@ static gboolean filter_data_remove_callback(struct filter_data *data,
 		return FALSE;
 
 	connection = dbus_connection_ref(data->connection);
-	listeners = g_slist_remove(listeners, data);
+	listener_remove(data);
 	filter_data_free(data);
 
 	/* Remove filter if there are no listeners left for the connection */
@@ -421,7 +625,8 @@ static DBusHandlerResult message_filter(DBusConnection *connection,
 	member = dbus_message_get_member(message);
 	dbus_message_get_args(message, NULL, DBUS_TYPE_STRING, &arg, DBUS_TYPE_INVALID);
 
-	data = filter_data_find(connection, sender, path, iface, member, arg);
+	data = filter_data_lookup(connection, sender, path, iface, member,
+									arg);
 	if (!data) {
 		error("Got %s.%s signal which has no listeners", iface, member);
 		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
@@ -442,7 +647,7 @@ static DBusHandlerResult message_filter(DBusConnection *connection,
 
 	remove_match(data);
 
-	listeners = g_slist_remove(listeners, data);
+	listener_remove(data);
 	filter_data_free(data);
 
 	/* Remove filter if there no listener left for the connection */
@@ -626,7 +831,7 @@ void g_dbus_remove_all_watches(DBusConnection *connection)
 	struct filter_data *data;
 
 	while ((data = filter_data_find(connection, NULL, NULL, NULL, NULL, NULL))) {
-		listeners = g_slist_remove(listeners, data);
+		listener_remove(data);
 		filter_data_call_and_free(data);
 	}
 
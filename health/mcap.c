@@ -31,6 +31,7 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <unistd.h>
+#include <time.h>
 
 #include "btio.h"
 #include <bluetooth/bluetooth.h>
@@ -42,8 +43,6 @@
 #define RESPONSE_TIMER	6	/* seconds */
 #define MAX_CACHED	10	/* 10 devices */
 
-#define MCAP_ERROR g_quark_from_static_string("mcap-error-quark")
-
 #define RELEASE_TIMER(__mcl) do {	\
 	g_source_remove(__mcl->tid);	\
 	__mcl->tid = 0;			\
@@ -676,6 +675,8 @@ static void close_mcl(struct mcap_mcl *mcl, gboolean cache_requested)
 {
 	gboolean save = ((!(mcl->ctrl & MCAP_CTRL_FREE)) && cache_requested);
 
+	mcap_sync_stop(mcl);
+
 	if (mcl->tid) {
 		RELEASE_TIMER(mcl);
 	}
@@ -1014,6 +1015,8 @@ static void process_md_create_mdl_req(struct mcap_mcl *mcl, void *cmd,
 		shutdown_mdl(mdl);
 	}
 
+	/* A new configuration gets its data channel options negotiated */
+	mdl->dcp.valid = FALSE;
 	mdl->mdep_id = mdep_id;
 	mdl->state = MDL_WAITING;
 
@@ -1565,6 +1568,27 @@ static gboolean mdl_event_cb(GIOChannel *chan, GIOCondition cond, gpointer data)
 	return FALSE;
 }
 
+static void save_dc_params(struct mcap_mdl *mdl, GIOChannel *chan)
+{
+	struct mcap_dc_params *dcp = &mdl->dcp;
+	GError *gerr = NULL;
+
+	dcp->valid = bt_io_get(chan, BT_IO_L2CAP, &gerr,
+					BT_IO_OPT_PSM, &dcp->psm,
+					BT_IO_OPT_IMTU, &dcp->imtu,
+					BT_IO_OPT_OMTU, &dcp->omtu,
+					BT_IO_OPT_MODE, &dcp->mode,
+					BT_IO_OPT_INVALID);
+	if (!dcp->valid) {
+		DBG("Can't get data channel options: %s", gerr->message);
+		g_error_free(gerr);
+		return;
+	}
+
+	DBG("MDL %d data channel: imtu %u omtu %u mode %u", mdl->mdlid,
+					dcp->imtu, dcp->omtu, dcp->mode);
+}
+
 static void mcap_connect_mdl_cb(GIOChannel *chan, GError *conn_err,
 								gpointer data)
 {
@@ -1578,6 +1602,8 @@ static void mcap_connect_mdl_cb(GIOChannel *chan, GError *conn_err,
 
 	if (conn_err) {
 		DBG("ERROR: mdl connect callback");
+		/* Don't insist on options the remote may not accept anymore */
+		mdl->dcp.valid = FALSE;
 		mdl->state = MDL_CLOSED;
 		g_io_channel_unref(mdl->dc);
 		mdl->dc = NULL;
@@ -1585,6 +1611,8 @@ static void mcap_connect_mdl_cb(GIOChannel *chan, GError *conn_err,
 		return;
 	}
 
+	save_dc_params(mdl, chan);
+
 	mdl->state = MDL_CONNECTED;
 	mdl->wid = g_io_add_watch(mdl->dc, G_IO_ERR | G_IO_HUP | G_IO_NVAL,
 						(GIOFunc) mdl_event_cb, mdl);
@@ -1598,6 +1626,8 @@ gboolean mcap_connect_mdl(struct mcap_mdl *mdl, BtIOType BtType,
 					gpointer user_data, GError **err)
 {
 	struct mcap_mdl_op_cb *con;
+	uint16_t imtu = MCAP_DC_MTU, omtu = MCAP_DC_MTU;
+	uint8_t mode = L2CAP_MODE_BASIC;
 
 	if (mdl->state != MDL_WAITING) {
 		g_set_error(err, MCAP_ERROR, MCAP_ERROR_INVALID_MDL,
@@ -1612,12 +1642,23 @@ gboolean mcap_connect_mdl(struct mcap_mdl *mdl, BtIOType BtType,
 
 	/* TODO: Check if BtIOType is ERTM or Streaming before continue */
 
+	/* A reconnected MDL asks right away for what was agreed on the
+	 * last time, so the configuration is settled in one exchange */
+	if (mdl->dcp.valid && mdl->dcp.psm == dcpsm) {
+		DBG("Reusing data channel options of MDL %d", mdl->mdlid);
+		imtu = mdl->dcp.imtu;
+		omtu = mdl->dcp.omtu;
+		mode = mdl->dcp.mode;
+	}
+
 	mdl->dc = bt_io_connect(BtType, mcap_connect_mdl_cb, con,
 				NULL, err,
 				BT_IO_OPT_SOURCE_BDADDR, &mdl->mcl->ms->src,
 				BT_IO_OPT_DEST_BDADDR, &mdl->mcl->addr,
 				BT_IO_OPT_PSM, dcpsm,
-				BT_IO_OPT_MTU, MCAP_DC_MTU,
+				BT_IO_OPT_IMTU, imtu,
+				BT_IO_OPT_OMTU, omtu,
+				BT_IO_OPT_MODE, mode,
 				BT_IO_OPT_SEC_LEVEL, mdl->mcl->ms->sec,
 				BT_IO_OPT_INVALID);
 	if (!mdl->dc) {
@@ -1730,6 +1771,8 @@ static void connect_dc_event_cb(GIOChannel *chan, GError *err,
 	struct mcap_mdl *mdl = user_data;
 	struct mcap_mcl *mcl = mdl->mcl;
 
+	save_dc_params(mdl, chan);
+
 	mdl->state = MDL_CONNECTED;
 	mdl->dc = g_io_channel_ref(chan);
 	mdl->wid = g_io_add_watch(mdl->dc, G_IO_ERR | G_IO_HUP | G_IO_NVAL,
@@ -82,6 +82,11 @@ extern "C" {
 #define MCAP_MDEPID_INITIAL		0x00
 #define MCAP_MDEPID_FINAL		0x7F
 
+/* CSP special values */
+#define MCAP_BTCLOCK_IMMEDIATE		0xFFFFFFFF
+#define MCAP_BTCLOCK_MAX		0x0FFFFFFF
+#define MCAP_TMSTAMP_DONTSET		0xFFFFFFFFFFFFFFFFULL
+
 /*
  * MCAP Request Packet Format
  */
@@ -134,7 +139,7 @@ typedef struct {
 } __attribute__ ((packed)) mcap_md_sync_set_req;
 
 typedef struct {
-	int8_t		op;
+	uint8_t		op;
 	uint8_t		rc;
 	uint32_t	btclock;
 	uint64_t	timestst;
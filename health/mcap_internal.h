@@ -76,7 +76,10 @@ struct mcap_instance {
 	mcap_mcl_event_cb	mcl_reconnected_cb;	/* Old MCL has been reconnected */
 	mcap_mcl_event_cb	mcl_disconnected_cb;	/* MCL disconnected */
 	mcap_mcl_event_cb	mcl_uncached_cb;	/* MCL has been removed from MCAP cache */
+	mcap_sync_info_ind_cb	mcl_sync_infoind_cb;	/* (CSP Master) Received info indication */
 	gpointer		user_data;		/* Data to be provided in callbacks */
+	gboolean		csp_enabled;		/* CSP: functionality enabled */
+	guint			csp_ind_interval;	/* CSP: SYNC_INFO_IND period (ms) */
 };
 
 struct mcap_mcl {
@@ -95,6 +98,7 @@ struct mcap_mcl {
 	guint			ref;		/* References counter */
 	uint8_t			ctrl;		/* MCL control flag */
 	uint16_t		next_mdl;	/* id used to create next MDL */
+	struct mcap_csp		*csp;		/* CSP control structure */
 };
 
 #define	MCAP_CTRL_CACHED	0x01	/* MCL is cached */
@@ -104,6 +108,15 @@ struct mcap_mcl {
 #define	MCAP_CTRL_FREE		0x10	/* MCL is marked as releasable */
 #define	MCAP_CTRL_NOCACHE	0x20	/* MCL is marked as not cacheable */
 
+/* L2CAP options a data channel ended up with, reused when reconnecting */
+struct mcap_dc_params {
+	gboolean		valid;		/* Options have been negotiated */
+	uint16_t		psm;		/* Data channel PSM */
+	uint16_t		imtu;		/* Incoming MTU */
+	uint16_t		omtu;		/* Outgoing MTU */
+	uint8_t			mode;		/* Basic, ERTM or Streaming */
+};
+
 struct mcap_mdl {
 	struct mcap_mcl		*mcl;		/* MCL where this MDL belongs */
 	GIOChannel		*dc;		/* MCAP Data Channel IO */
@@ -111,11 +124,13 @@ struct mcap_mdl {
 	uint16_t		mdlid;		/* MDL id */
 	uint8_t			mdep_id;	/* MCAP Data End Point */
 	MDLState		state;		/* MDL state */
+	struct mcap_dc_params	dcp;		/* Last data channel options */
 };
 
 int mcap_send_data(int sock, const uint8_t *buf, uint32_t size);
 
 void proc_sync_cmd(struct mcap_mcl *mcl, uint8_t *cmd, uint32_t len);
+void mcap_sync_stop(struct mcap_mcl *mcl);
 
 #ifdef __cplusplus
 }
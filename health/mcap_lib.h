@@ -31,6 +31,8 @@
 extern "C" {
 #endif
 
+#define MCAP_ERROR g_quark_from_static_string("mcap-error-quark")
+
 typedef enum {
 /* MCAP Error Response Codes */
 	MCAP_ERROR_INVALID_OP_CODE = 1,
@@ -90,6 +92,20 @@ typedef void (* mcap_mcl_event_cb) (struct mcap_mcl *mcl, gpointer data);
 typedef void (* mcap_mcl_connect_cb) (struct mcap_mcl *mcl, GError *err,
 								gpointer data);
 
+/* CSP callbacks */
+
+typedef void (* mcap_sync_cap_cb) (struct mcap_mcl *mcl, uint8_t mcap_err,
+					uint8_t btclockres, uint16_t synclead,
+					uint16_t tmstampres, uint16_t tmstampacc,
+					GError *err, gpointer data);
+typedef void (* mcap_sync_set_cb) (struct mcap_mcl *mcl, uint8_t mcap_err,
+					uint32_t btclock, uint64_t timestamp,
+					uint16_t accuracy, GError *err,
+					gpointer data);
+typedef void (* mcap_sync_info_ind_cb) (struct mcap_mcl *mcl,
+					uint32_t btclock, uint64_t timestamp,
+					uint16_t accuracy, gpointer data);
+
 /************ Operations ************/
 
 /* Mdl operations*/
@@ -159,6 +175,22 @@ void mcap_release_instance(struct mcap_instance *mi);
 uint16_t mcap_get_ctrl_psm(struct mcap_instance *mi, GError **err);
 uint16_t mcap_get_data_psm(struct mcap_instance *mi, GError **err);
 
+/* Clock Synchronization Protocol */
+
+int mcap_enable_csp(struct mcap_instance *mi, guint ind_interval,
+					mcap_sync_info_ind_cb infoind_cb);
+int mcap_disable_csp(struct mcap_instance *mi);
+gboolean mcap_sync_cap_req(struct mcap_mcl *mcl, uint16_t reqacc,
+					mcap_sync_cap_cb cb, gpointer user_data,
+					GError **err);
+gboolean mcap_sync_set_req(struct mcap_mcl *mcl, uint8_t update,
+					uint32_t btclock, uint64_t timestamp,
+					mcap_sync_set_cb cb, gpointer user_data,
+					GError **err);
+uint64_t mcap_get_timestamp(struct mcap_mcl *mcl,
+					struct timespec *given_time);
+uint32_t mcap_get_btclock(struct mcap_mcl *mcl);
+
 #ifdef __cplusplus
 }
 #endif
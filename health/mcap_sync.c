@@ -26,69 +26,842 @@
 
 #include "btio.h"
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <endian.h>
+#include <byteswap.h>
 #include <netinet/in.h>
 
 #include "log.h"
 
 #include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+#include <bluetooth/hci_lib.h>
+#include <bluetooth/l2cap.h>
 #include "mcap.h"
 #include "mcap_lib.h"
 #include "mcap_internal.h"
 
-typedef struct {
-	uint8_t         op;
-	uint8_t         rc;
-} __attribute__ ((packed)) mcap_md_sync_error_rsp;
+#define MCAP_BTCLOCK_HALF	(MCAP_BTCLOCK_FIELD / 2)
+#define MCAP_BTCLOCK_FIELD	(MCAP_BTCLOCK_MAX + 1)
 
-static int mcap_sync_send_cmd(struct mcap_mcl *mcl, uint8_t oc, uint8_t rc)
+/* The Bluetooth clock ticks every 312.5 us */
+#define BTCLOCK_TO_US(ticks)	(((uint64_t) (ticks) * 625) / 2)
+#define BTCLOCK_TO_MS(ticks)	((BTCLOCK_TO_US(ticks) + 999) / 1000)
+
+#define SYNC_RSP_TIMER		6	/* seconds */
+#define SYNC_MAX_DELAY		60000	/* ms, furthest sync point accepted */
+#define SYNC_LEAD_MARGIN	20	/* ms, on top of measured latency */
+#define SYNC_CLOCK_SAMPLES	4	/* Clock reads to estimate latency */
+#define SYNC_CLOCK_TIMEOUT	100	/* ms, HCI Read Clock runs in mainloop */
+#define SYNC_NATIVE_ACCURACY	20	/* ppm, typical crystal drift */
+#define SYNC_IND_INTERVAL	1000	/* ms, default SYNC_INFO_IND rate */
+
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+#define hton64(x)	bswap_64(x)
+#define ntoh64(x)	bswap_64(x)
+#else
+#define hton64(x)	(x)
+#define ntoh64(x)	(x)
+#endif
+
+struct sync_pending {
+	uint8_t			op;		/* Expected response */
+	mcap_sync_cap_cb	cap_cb;		/* CAP_REQ callback */
+	mcap_sync_set_cb	set_cb;		/* SET_REQ callback */
+	gpointer		user_data;	/* Callback user data */
+};
+
+struct mcap_csp {
+	uint64_t	base_tmstamp;	/* Timestamp at base_time */
+	struct timespec	base_time;	/* Local clock for base_tmstamp */
+
+	int		dd;		/* HCI device, -1 if not open */
+	uint16_t	handle;		/* ACL handle of the MCL */
+
+	gboolean	caps_valid;	/* Capabilities already measured */
+	uint8_t		btclockres;	/* Clock access resolution (ticks) */
+	uint16_t	synclead;	/* Sync lead time (ms) */
+	uint16_t	tmstampres;	/* Timestamp resolution (us) */
+	uint16_t	tmstampacc;	/* Timestamp accuracy (ppm) */
+	uint16_t	latency;	/* Worst clock read latency (us) */
+
+	/* Sync-Slave role */
+	gboolean	local_caps;	/* Remote has read our capabilities */
+	uint16_t	rem_req_acc;	/* Accuracy required by remote (ppm) */
+	guint		ind_timer;	/* Periodic SYNC_INFO_IND */
+	guint		set_timer;	/* Deferred SYNC_SET */
+	uint8_t		set_update;	/* Deferred SYNC_SET parameters */
+	uint32_t	set_btclock;
+	uint64_t	set_tmstamp;
+
+	/* Sync-Master role */
+	gboolean	remote_caps;	/* Remote capabilities known */
+	struct sync_pending *pending;	/* Request waiting for response */
+	guint		rsp_timer;	/* Response timeout */
+};
+
+static void sync_gettime(struct timespec *ts)
 {
-	mcap_md_sync_error_rsp *cmd;
-	uint8_t *rsp;
-	int sock, sent;
+#ifdef CLOCK_MONOTONIC_RAW
+	/* Not slewed by NTP, so it tracks the local oscillator only */
+	if (clock_gettime(CLOCK_MONOTONIC_RAW, ts) == 0)
+		return;
+#endif
+	clock_gettime(CLOCK_MONOTONIC, ts);
+}
+
+static int64_t time_diff_us(const struct timespec *a, const struct timespec *b)
+{
+	return ((int64_t) a->tv_sec - b->tv_sec) * 1000000 +
+					(a->tv_nsec - b->tv_nsec) / 1000;
+}
+
+static void time_add_us(struct timespec *ts, int64_t us)
+{
+	ts->tv_sec += us / 1000000;
+	ts->tv_nsec += (us % 1000000) * 1000;
+
+	if (ts->tv_nsec >= 1000000000) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+static struct mcap_csp *get_csp(struct mcap_mcl *mcl)
+{
+	struct mcap_csp *csp;
+
+	if (mcl->csp)
+		return mcl->csp;
+
+	csp = g_new0(struct mcap_csp, 1);
+	csp->dd = -1;
+	sync_gettime(&csp->base_time);
+
+	mcl->csp = csp;
+
+	return csp;
+}
+
+static int csp_open_hci(struct mcap_mcl *mcl)
+{
+	struct mcap_csp *csp = mcl->csp;
+	struct l2cap_conninfo info;
+	socklen_t len = sizeof(info);
+	char addr[18];
+	int dev_id, sk;
+
+	if (csp->dd >= 0)
+		return 0;
 
+	if (mcl->cc == NULL)
+		return -ENOTCONN;
+
+	sk = g_io_channel_unix_get_fd(mcl->cc);
+
+	memset(&info, 0, sizeof(info));
+	if (getsockopt(sk, SOL_L2CAP, L2CAP_CONNINFO, &info, &len) < 0)
+		return -errno;
+
+	if (bacmp(&mcl->ms->src, BDADDR_ANY) == 0)
+		dev_id = hci_get_route(&mcl->addr);
+	else {
+		ba2str(&mcl->ms->src, addr);
+		dev_id = hci_devid(addr);
+	}
+
+	if (dev_id < 0)
+		return -ENODEV;
+
+	csp->dd = hci_open_dev(dev_id);
+	if (csp->dd < 0)
+		return -errno;
+
+	csp->handle = info.hci_handle;
+
+	return 0;
+}
+
+/* Signed distance from b to a on the 28-bit clock, wraps are taken
+ * as the shorter way round */
+static int32_t btclock_diff(uint32_t a, uint32_t b)
+{
+	int32_t diff = (a - b) & MCAP_BTCLOCK_MAX;
+
+	if (diff >= MCAP_BTCLOCK_HALF)
+		diff -= MCAP_BTCLOCK_FIELD;
+
+	return diff;
+}
+
+/* Reads the piconet clock shared with the remote device together with
+ * the local time it corresponds to. Returns the read latency in us. */
+static int csp_read_clock(struct mcap_mcl *mcl, uint32_t *btclock,
+					struct timespec *ts, uint16_t *btres)
+{
+	struct mcap_csp *csp = mcl->csp;
+	struct timespec t1, t2;
+	uint16_t accuracy;
+	int64_t latency;
+	int err;
+
+	err = csp_open_hci(mcl);
+	if (err < 0)
+		return err;
+
+	sync_gettime(&t1);
+
+	if (hci_read_clock(csp->dd, csp->handle, 1, btclock, &accuracy,
+						SYNC_CLOCK_TIMEOUT) < 0)
+		return -errno;
+
+	sync_gettime(&t2);
+
+	*btclock &= MCAP_BTCLOCK_MAX;
+
+	/* Assume the clock was sampled half way through the command */
+	latency = time_diff_us(&t2, &t1);
+	*ts = t1;
+	time_add_us(ts, latency / 2);
+
+	if (btres)
+		*btres = accuracy;
+
+	return latency > 0xffff ? 0xffff : latency;
+}
+
+static int csp_init_caps(struct mcap_mcl *mcl)
+{
+	struct mcap_csp *csp = mcl->csp;
+	struct timespec ts, res;
+	uint32_t btclock;
+	uint16_t btres = 1;
+	int i, latency, max = 0;
+
+	if (csp->caps_valid)
+		return 0;
+
+	for (i = 0; i < SYNC_CLOCK_SAMPLES; i++) {
+		latency = csp_read_clock(mcl, &btclock, &ts, &btres);
+		if (latency < 0)
+			return latency;
+
+		if (latency > max)
+			max = latency;
+	}
+
+#ifdef CLOCK_MONOTONIC_RAW
+	if (clock_getres(CLOCK_MONOTONIC_RAW, &res) < 0)
+#endif
+		clock_getres(CLOCK_MONOTONIC, &res);
+
+	csp->tmstampres = MAX(1, res.tv_sec * 1000000 + res.tv_nsec / 1000);
+	csp->tmstampacc = SYNC_NATIVE_ACCURACY;
+	csp->btclockres = MAX(1, MIN(btres, 0xff));
+	csp->latency = max;
+	csp->synclead = (max * 2) / 1000 + SYNC_LEAD_MARGIN;
+	csp->caps_valid = TRUE;
+
+	DBG("CSP caps: clock read latency %d us, sync lead time %u ms",
+						max, csp->synclead);
+
+	return 0;
+}
+
+/* Worst error of a timestamp taken together with a clock read */
+static uint16_t csp_accuracy(struct mcap_csp *csp, int latency)
+{
+	uint64_t acc;
+
+	acc = latency / 2 + BTCLOCK_TO_US(csp->btclockres) / 2 +
+							csp->tmstampres;
+
+	return acc > 0xffff ? 0xffff : acc;
+}
+
+uint64_t mcap_get_timestamp(struct mcap_mcl *mcl, struct timespec *given_time)
+{
+	struct mcap_csp *csp = mcl->csp;
+	struct timespec now;
+
+	if (!csp)
+		return MCAP_TMSTAMP_DONTSET;
+
+	if (given_time)
+		now = *given_time;
+	else
+		sync_gettime(&now);
+
+	return csp->base_tmstamp + time_diff_us(&now, &csp->base_time);
+}
+
+uint32_t mcap_get_btclock(struct mcap_mcl *mcl)
+{
+	struct timespec ts;
+	uint32_t btclock;
+
+	get_csp(mcl);
+
+	if (csp_read_clock(mcl, &btclock, &ts, NULL) < 0)
+		return MCAP_BTCLOCK_IMMEDIATE;
+
+	return btclock;
+}
+
+static int send_sync_cmd(struct mcap_mcl *mcl, const void *buf, uint32_t len)
+{
 	if (mcl->cc == NULL)
 		return -1;
 
-	sock = g_io_channel_unix_get_fd(mcl->cc);
+	return mcap_send_data(g_io_channel_unix_get_fd(mcl->cc), buf, len);
+}
+
+static int send_cap_rsp(struct mcap_mcl *mcl, uint8_t rc,
+					struct mcap_csp *caps)
+{
+	mcap_md_sync_cap_rsp rsp;
+
+	memset(&rsp, 0, sizeof(rsp));
+	rsp.op = MCAP_MD_SYNC_CAP_RSP;
+	rsp.rc = rc;
+
+	if (rc == MCAP_SUCCESS) {
+		rsp.btclock = caps->btclockres;
+		rsp.sltime = htons(caps->synclead);
+		rsp.timestnr = htons(caps->tmstampres);
+		rsp.timestna = htons(caps->tmstampacc);
+	}
+
+	return send_sync_cmd(mcl, &rsp, sizeof(rsp));
+}
+
+static int send_set_rsp(struct mcap_mcl *mcl, uint8_t rc, uint32_t btclock,
+					uint64_t tmstamp, uint16_t accuracy)
+{
+	mcap_md_sync_set_rsp rsp;
+
+	memset(&rsp, 0, sizeof(rsp));
+	rsp.op = MCAP_MD_SYNC_SET_RSP;
+	rsp.rc = rc;
 
-	rsp = g_malloc(sizeof(mcap_md_sync_error_rsp));
-	cmd = (mcap_md_sync_error_rsp *)rsp;
-	cmd->op = oc;
-	cmd->rc = rc;
+	if (rc == MCAP_SUCCESS) {
+		rsp.btclock = htonl(btclock);
+		rsp.timestst = hton64(tmstamp);
+		rsp.timestsa = htons(accuracy);
+	}
 
-	sent = mcap_send_data(sock, rsp, sizeof(mcap_md_sync_error_rsp));
-	g_free(rsp);
-	return sent;
+	return send_sync_cmd(mcl, &rsp, sizeof(rsp));
+}
+
+static gboolean sync_info_ind_cb(gpointer data)
+{
+	struct mcap_mcl *mcl = data;
+	struct mcap_csp *csp = mcl->csp;
+	mcap_md_sync_info_ind ind;
+	struct timespec ts;
+	uint32_t btclock;
+	int latency;
+
+	latency = csp_read_clock(mcl, &btclock, &ts, NULL);
+	if (latency < 0) {
+		DBG("Can't read Bluetooth clock: %s (%d)",
+					strerror(-latency), -latency);
+		return TRUE;
+	}
+
+	ind.op = MCAP_MD_SYNC_INFO_IND;
+	ind.btclock = htonl(btclock);
+	ind.timestst = hton64(mcap_get_timestamp(mcl, &ts));
+	ind.timestsa = htons(csp_accuracy(csp, latency));
+
+	send_sync_cmd(mcl, &ind, sizeof(ind));
+
+	return TRUE;
+}
+
+static void sync_info_ind_start(struct mcap_mcl *mcl)
+{
+	struct mcap_csp *csp = mcl->csp;
+	guint interval = mcl->ms->csp_ind_interval;
+
+	if (csp->ind_timer)
+		return;
+
+	if (interval == 0)
+		interval = SYNC_IND_INTERVAL;
+
+	csp->ind_timer = g_timeout_add(interval, sync_info_ind_cb, mcl);
+}
+
+static void sync_info_ind_stop(struct mcap_csp *csp)
+{
+	if (!csp->ind_timer)
+		return;
+
+	g_source_remove(csp->ind_timer);
+	csp->ind_timer = 0;
+}
+
+static gboolean sync_set_timer_cb(gpointer data);
+
+static void do_sync_set(struct mcap_mcl *mcl)
+{
+	struct mcap_csp *csp = mcl->csp;
+	struct timespec ts;
+	uint32_t btclock;
+	uint64_t tmstamp;
+	uint16_t accuracy;
+	int32_t late = 0;
+	int latency;
+
+	latency = csp_read_clock(mcl, &btclock, &ts, NULL);
+	if (latency < 0) {
+		send_set_rsp(mcl, MCAP_UNSPECIFIED_ERROR, 0, 0, 0);
+		return;
+	}
+
+	if (csp->set_btclock != MCAP_BTCLOCK_IMMEDIATE)
+		late = btclock_diff(btclock, csp->set_btclock);
+
+	/* The timer fired before the sync point, wait for the rest */
+	if (late < 0) {
+		csp->set_timer = g_timeout_add(BTCLOCK_TO_MS(-late),
+						sync_set_timer_cb, mcl);
+		return;
+	}
+
+	if (csp->set_tmstamp != MCAP_TMSTAMP_DONTSET) {
+		/* Compensate for any delay past the requested sync point */
+		tmstamp = csp->set_tmstamp + BTCLOCK_TO_US(late);
+
+		csp->base_time = ts;
+		csp->base_tmstamp = tmstamp;
+	}
+
+	accuracy = csp_accuracy(csp, latency);
+
+	DBG("CSP set: btclock %u timestamp %llu accuracy %u us latency %d us",
+			btclock, (unsigned long long) mcap_get_timestamp(mcl, &ts),
+			accuracy, latency);
+
+	send_set_rsp(mcl, MCAP_SUCCESS, btclock,
+				mcap_get_timestamp(mcl, &ts), accuracy);
+
+	if (csp->set_update)
+		sync_info_ind_start(mcl);
+	else
+		sync_info_ind_stop(csp);
+}
+
+static gboolean sync_set_timer_cb(gpointer data)
+{
+	struct mcap_mcl *mcl = data;
+
+	mcl->csp->set_timer = 0;
+
+	do_sync_set(mcl);
+
+	return FALSE;
+}
+
+static void process_sync_cap_req(struct mcap_mcl *mcl, uint8_t *cmd,
+								uint32_t len)
+{
+	mcap_md_sync_cap_req *req = (mcap_md_sync_cap_req *) cmd;
+	struct mcap_csp *csp = get_csp(mcl);
+	uint16_t req_acc;
+
+	if (len != sizeof(mcap_md_sync_cap_req)) {
+		send_cap_rsp(mcl, MCAP_INVALID_PARAM_VALUE, NULL);
+		return;
+	}
+
+	req_acc = ntohs(req->timest);
+
+	if (csp_init_caps(mcl) < 0) {
+		send_cap_rsp(mcl, MCAP_RESOURCE_UNAVAILABLE, NULL);
+		return;
+	}
+
+	/* The remote asks for better accuracy than we can provide */
+	if (req_acc < csp->tmstampacc) {
+		send_cap_rsp(mcl, MCAP_RESOURCE_UNAVAILABLE, NULL);
+		return;
+	}
+
+	csp->rem_req_acc = req_acc;
+	csp->local_caps = TRUE;
+
+	send_cap_rsp(mcl, MCAP_SUCCESS, csp);
+}
+
+static void process_sync_set_req(struct mcap_mcl *mcl, uint8_t *cmd,
+								uint32_t len)
+{
+	mcap_md_sync_set_req *req = (mcap_md_sync_set_req *) cmd;
+	struct mcap_csp *csp = get_csp(mcl);
+	struct timespec ts;
+	uint32_t btclock, now, delta;
+	uint64_t delay;
+
+	if (len != sizeof(mcap_md_sync_set_req)) {
+		send_set_rsp(mcl, MCAP_INVALID_PARAM_VALUE, 0, 0, 0);
+		return;
+	}
+
+	if (!csp->local_caps) {
+		send_set_rsp(mcl, MCAP_INVALID_OPERATION, 0, 0, 0);
+		return;
+	}
+
+	if (csp->set_timer) {
+		send_set_rsp(mcl, MCAP_RESOURCE_UNAVAILABLE, 0, 0, 0);
+		return;
+	}
+
+	btclock = ntohl(req->btclock);
+
+	if (req->timestui > 1 || (btclock != MCAP_BTCLOCK_IMMEDIATE &&
+					btclock > MCAP_BTCLOCK_MAX)) {
+		send_set_rsp(mcl, MCAP_INVALID_PARAM_VALUE, 0, 0, 0);
+		return;
+	}
+
+	csp->set_update = req->timestui;
+	csp->set_btclock = btclock;
+	csp->set_tmstamp = ntoh64(req->timestst);
+
+	if (btclock == MCAP_BTCLOCK_IMMEDIATE) {
+		do_sync_set(mcl);
+		return;
+	}
+
+	if (csp_read_clock(mcl, &now, &ts, NULL) < 0) {
+		send_set_rsp(mcl, MCAP_UNSPECIFIED_ERROR, 0, 0, 0);
+		return;
+	}
+
+	/* Sync points in the past or too close to be reached are refused */
+	delta = (btclock - now) & MCAP_BTCLOCK_MAX;
+	delay = BTCLOCK_TO_MS(delta);
+
+	if (delta > MCAP_BTCLOCK_HALF || delay < csp->synclead ||
+						delay > SYNC_MAX_DELAY) {
+		send_set_rsp(mcl, MCAP_INVALID_PARAM_VALUE, 0, 0, 0);
+		return;
+	}
+
+	csp->set_timer = g_timeout_add(delay, sync_set_timer_cb, mcl);
+}
+
+static struct sync_pending *take_pending(struct mcap_mcl *mcl, uint8_t op)
+{
+	struct mcap_csp *csp = mcl->csp;
+	struct sync_pending *pending;
+
+	if (!csp || !csp->pending || csp->pending->op != op)
+		return NULL;
+
+	pending = csp->pending;
+	csp->pending = NULL;
+
+	if (csp->rsp_timer) {
+		g_source_remove(csp->rsp_timer);
+		csp->rsp_timer = 0;
+	}
+
+	return pending;
+}
+
+static void pending_failed(struct mcap_mcl *mcl, struct sync_pending *pending,
+								GError *err)
+{
+	if (pending->cap_cb)
+		pending->cap_cb(mcl, MCAP_UNSPECIFIED_ERROR, 0, 0, 0, 0, err,
+							pending->user_data);
+	else if (pending->set_cb)
+		pending->set_cb(mcl, MCAP_UNSPECIFIED_ERROR, 0, 0, 0, err,
+							pending->user_data);
+}
+
+static void process_sync_cap_rsp(struct mcap_mcl *mcl, uint8_t *cmd,
+								uint32_t len)
+{
+	mcap_md_sync_cap_rsp *rsp = (mcap_md_sync_cap_rsp *) cmd;
+	struct sync_pending *pending;
+	GError *gerr = NULL;
+
+	pending = take_pending(mcl, MCAP_MD_SYNC_CAP_RSP);
+	if (!pending)
+		return;
+
+	if (len < 2 || (rsp->rc == MCAP_SUCCESS && len != sizeof(*rsp))) {
+		g_set_error(&gerr, MCAP_ERROR, MCAP_ERROR_FAILED,
+					"Malformed sync capabilities response");
+		pending_failed(mcl, pending, gerr);
+		g_error_free(gerr);
+		g_free(pending);
+		return;
+	}
+
+	if (rsp->rc == MCAP_SUCCESS)
+		mcl->csp->remote_caps = TRUE;
+
+	if (rsp->rc != MCAP_SUCCESS)
+		pending->cap_cb(mcl, rsp->rc, 0, 0, 0, 0, NULL,
+							pending->user_data);
+	else
+		pending->cap_cb(mcl, rsp->rc, rsp->btclock,
+				ntohs(rsp->sltime), ntohs(rsp->timestnr),
+				ntohs(rsp->timestna), NULL,
+				pending->user_data);
+
+	g_free(pending);
+}
+
+static void process_sync_set_rsp(struct mcap_mcl *mcl, uint8_t *cmd,
+								uint32_t len)
+{
+	mcap_md_sync_set_rsp *rsp = (mcap_md_sync_set_rsp *) cmd;
+	struct sync_pending *pending;
+	GError *gerr = NULL;
+
+	pending = take_pending(mcl, MCAP_MD_SYNC_SET_RSP);
+	if (!pending)
+		return;
+
+	if (len < 2 || (rsp->rc == MCAP_SUCCESS && len != sizeof(*rsp))) {
+		g_set_error(&gerr, MCAP_ERROR, MCAP_ERROR_FAILED,
+					"Malformed sync set response");
+		pending_failed(mcl, pending, gerr);
+		g_error_free(gerr);
+		g_free(pending);
+		return;
+	}
+
+	if (rsp->rc != MCAP_SUCCESS)
+		pending->set_cb(mcl, rsp->rc, 0, 0, 0, NULL,
+							pending->user_data);
+	else
+		pending->set_cb(mcl, rsp->rc, ntohl(rsp->btclock),
+				ntoh64(rsp->timestst), ntohs(rsp->timestsa),
+				NULL, pending->user_data);
+
+	g_free(pending);
+}
+
+static void process_sync_info_ind(struct mcap_mcl *mcl, uint8_t *cmd,
+								uint32_t len)
+{
+	mcap_md_sync_info_ind *ind = (mcap_md_sync_info_ind *) cmd;
+	struct mcap_instance *mi = mcl->ms;
+
+	if (len != sizeof(mcap_md_sync_info_ind))
+		return;
+
+	if (!mi->mcl_sync_infoind_cb)
+		return;
+
+	mi->mcl_sync_infoind_cb(mcl, ntohl(ind->btclock),
+				ntoh64(ind->timestst), ntohs(ind->timestsa),
+				mi->user_data);
+}
+
+static gboolean sync_rsp_timer_cb(gpointer data)
+{
+	struct mcap_mcl *mcl = data;
+	struct mcap_csp *csp = mcl->csp;
+	struct sync_pending *pending = csp->pending;
+	GError *gerr = NULL;
+
+	csp->rsp_timer = 0;
+	csp->pending = NULL;
+
+	g_set_error(&gerr, MCAP_ERROR, MCAP_ERROR_FAILED,
+					"Timeout waiting response");
+	pending_failed(mcl, pending, gerr);
+	g_error_free(gerr);
+	g_free(pending);
+
+	return FALSE;
+}
+
+static gboolean sync_send_req(struct mcap_mcl *mcl, void *req, uint32_t len,
+					struct sync_pending *pending,
+					GError **err)
+{
+	struct mcap_csp *csp;
+
+	if (!mcl->ms->csp_enabled) {
+		g_set_error(err, MCAP_ERROR, MCAP_ERROR_REQUEST_NOT_SUPPORTED,
+					"Clock synchronization not enabled");
+		g_free(pending);
+		return FALSE;
+	}
+
+	if (mcl->state == MCL_IDLE || mcl->cc == NULL) {
+		g_set_error(err, MCAP_ERROR, MCAP_ERROR_MCL_CLOSED,
+					"MCL is not connected");
+		g_free(pending);
+		return FALSE;
+	}
+
+	csp = get_csp(mcl);
+
+	if (csp->pending) {
+		g_set_error(err, MCAP_ERROR, MCAP_ERROR_RESOURCE_UNAVAILABLE,
+					"Pending clock synchronization request");
+		g_free(pending);
+		return FALSE;
+	}
+
+	if (send_sync_cmd(mcl, req, len) < 0) {
+		g_set_error(err, MCAP_ERROR, MCAP_ERROR_FAILED,
+					"Command can't be sent, write error");
+		g_free(pending);
+		return FALSE;
+	}
+
+	csp->pending = pending;
+	csp->rsp_timer = g_timeout_add_seconds(SYNC_RSP_TIMER,
+						sync_rsp_timer_cb, mcl);
+
+	return TRUE;
+}
+
+gboolean mcap_sync_cap_req(struct mcap_mcl *mcl, uint16_t reqacc,
+					mcap_sync_cap_cb cb, gpointer user_data,
+					GError **err)
+{
+	mcap_md_sync_cap_req req;
+	struct sync_pending *pending;
+
+	req.op = MCAP_MD_SYNC_CAP_REQ;
+	req.timest = htons(reqacc);
+
+	pending = g_new0(struct sync_pending, 1);
+	pending->op = MCAP_MD_SYNC_CAP_RSP;
+	pending->cap_cb = cb;
+	pending->user_data = user_data;
+
+	return sync_send_req(mcl, &req, sizeof(req), pending, err);
+}
+
+gboolean mcap_sync_set_req(struct mcap_mcl *mcl, uint8_t update,
+					uint32_t btclock, uint64_t timestamp,
+					mcap_sync_set_cb cb, gpointer user_data,
+					GError **err)
+{
+	mcap_md_sync_set_req req;
+	struct sync_pending *pending;
+
+	if (!mcl->csp || !mcl->csp->remote_caps) {
+		g_set_error(err, MCAP_ERROR, MCAP_ERROR_INVALID_OPERATION,
+					"Remote clock capabilities unknown");
+		return FALSE;
+	}
+
+	req.op = MCAP_MD_SYNC_SET_REQ;
+	req.timestui = update ? 1 : 0;
+	req.btclock = htonl(btclock);
+	req.timestst = hton64(timestamp);
+
+	pending = g_new0(struct sync_pending, 1);
+	pending->op = MCAP_MD_SYNC_SET_RSP;
+	pending->set_cb = cb;
+	pending->user_data = user_data;
+
+	return sync_send_req(mcl, &req, sizeof(req), pending, err);
+}
+
+void mcap_sync_stop(struct mcap_mcl *mcl)
+{
+	struct mcap_csp *csp = mcl->csp;
+	struct sync_pending *pending;
+	GError *gerr = NULL;
+
+	if (!csp)
+		return;
+
+	sync_info_ind_stop(csp);
+
+	if (csp->set_timer)
+		g_source_remove(csp->set_timer);
+
+	if (csp->rsp_timer)
+		g_source_remove(csp->rsp_timer);
+
+	if (csp->dd >= 0)
+		hci_close_dev(csp->dd);
+
+	pending = csp->pending;
+
+	g_free(csp);
+	mcl->csp = NULL;
+
+	if (!pending)
+		return;
+
+	g_set_error(&gerr, MCAP_ERROR, MCAP_ERROR_MCL_CLOSED, "MCL closed");
+	pending_failed(mcl, pending, gerr);
+	g_error_free(gerr);
+	g_free(pending);
 }
 
 void proc_sync_cmd(struct mcap_mcl *mcl, uint8_t *cmd, uint32_t len)
 {
+	if (!mcl->ms->csp_enabled) {
+		/* Reply with unsupported request */
+		if (cmd[0] == MCAP_MD_SYNC_CAP_REQ)
+			send_cap_rsp(mcl, MCAP_REQUEST_NOT_SUPPORTED, NULL);
+		else if (cmd[0] == MCAP_MD_SYNC_SET_REQ)
+			send_set_rsp(mcl, MCAP_REQUEST_NOT_SUPPORTED, 0, 0, 0);
+		return;
+	}
+
 	switch (cmd[0]) {
 	case MCAP_MD_SYNC_CAP_REQ:
-		DBG("TODO: received MCAP_MD_SYNC_CAP_REQ: %d",
-							MCAP_MD_SYNC_CAP_REQ);
-		/* Not implemented yet. Reply with unsupported request */
-		mcap_sync_send_cmd(mcl, MCAP_MD_SYNC_CAP_RSP,
-						MCAP_REQUEST_NOT_SUPPORTED);
+		process_sync_cap_req(mcl, cmd, len);
 		break;
 	case MCAP_MD_SYNC_CAP_RSP:
-		DBG("TODO: received MCAP_MD_SYNC_CAP_RSP: %d",
-							MCAP_MD_SYNC_CAP_RSP);
+		process_sync_cap_rsp(mcl, cmd, len);
 		break;
 	case MCAP_MD_SYNC_SET_REQ:
-		DBG("TODO: received MCAP_MD_SYNC_SET_REQ: %d",
-							MCAP_MD_SYNC_SET_REQ);
-		/* Not implemented yet. Reply with unsupported request */
-		mcap_sync_send_cmd(mcl, MCAP_MD_SYNC_SET_RSP,
-						MCAP_REQUEST_NOT_SUPPORTED);
+		process_sync_set_req(mcl, cmd, len);
 		break;
 	case MCAP_MD_SYNC_SET_RSP:
-		DBG("TODO: received MCAP_MD_SYNC_SET_RSP: %d",
-							MCAP_MD_SYNC_SET_RSP);
+		process_sync_set_rsp(mcl, cmd, len);
 		break;
 	case MCAP_MD_SYNC_INFO_IND:
-		DBG("TODO: received MCAP_MD_SYNC_INFO_IND :%d",
-							MCAP_MD_SYNC_INFO_IND);
+		process_sync_info_ind(mcl, cmd, len);
 		break;
 	}
 }
+
+int mcap_enable_csp(struct mcap_instance *mi, guint ind_interval,
+					mcap_sync_info_ind_cb infoind_cb)
+{
+	if (!mi)
+		return -EINVAL;
+
+	mi->csp_enabled = TRUE;
+	mi->csp_ind_interval = ind_interval;
+	mi->mcl_sync_infoind_cb = infoind_cb;
+
+	return 0;
+}
+
+int mcap_disable_csp(struct mcap_instance *mi)
+{
+	if (!mi)
+		return -EINVAL;
+
+	mi->csp_enabled = FALSE;
+	mi->mcl_sync_infoind_cb = NULL;
+
+	return 0;
+}
@@ -49,12 +49,14 @@
 #include "log.h"
 #include "textfile.h"
 #include "uinput.h"
+#include "uinput-batch.h"
 
 #include "../src/storage.h"
 #include "../src/manager.h"
 #include "../src/dbus-common.h"
 #include "adapter.h"
 #include "../src/device.h"
+#include "../src/registry.h"
 
 #include "device.h"
 #include "error.h"
@@ -95,20 +97,12 @@ struct input_device {
 	GSList			*connections;
 };
 
-GSList *devices = NULL;
+/* Input devices by path and by local and remote address */
+static struct btd_registry *devices = NULL;
 
-static struct input_device *find_device_by_path(GSList *list, const char *path)
+static struct input_device *find_device_by_path(const char *path)
 {
-	GSList *l;
-
-	for (l = list; l; l = l->next) {
-		struct input_device *idev = l->data;
-
-		if (!strcmp(idev->path, path))
-			return idev;
-	}
-
-	return NULL;
+	return btd_registry_find_path(devices, path);
 }
 
 static struct input_conn *find_connection(GSList *list, const char *pattern)
@@ -147,6 +141,8 @@ static void input_conn_free(struct input_conn *iconn)
 
 	g_free(iconn->uuid);
 	g_free(iconn->alias);
+	if (iconn->fake)
+		uinput_batch_free(iconn->fake->batch);
 	g_free(iconn->fake);
 	g_free(iconn);
 }
@@ -252,27 +248,14 @@ static int decode_key(const char *str)
 	return key;
 }
 
-static void send_event(int fd, uint16_t type, uint16_t code, int32_t value)
+static void send_key(struct fake_input *fake, uint16_t key)
 {
-	struct uinput_event event;
-	int err;
-
-	memset(&event, 0, sizeof(event));
-	event.type	= type;
-	event.code	= code;
-	event.value	= value;
-
-	err = write(fd, &event, sizeof(event));
-}
+	uinput_batch_report(fake->batch, fake->rfcomm);
 
-static void send_key(int fd, uint16_t key)
-{
-	/* Key press */
-	send_event(fd, EV_KEY, key, 1);
-	send_event(fd, EV_SYN, SYN_REPORT, 0);
-	/* Key release */
-	send_event(fd, EV_KEY, key, 0);
-	send_event(fd, EV_SYN, SYN_REPORT, 0);
+	/* Key press and release go out in a single write */
+	uinput_batch_key(fake->batch, key, 1);
+	uinput_batch_key(fake->batch, key, 0);
+	uinput_batch_flush(fake->batch);
 }
 
 static gboolean rfcomm_io_cb(GIOChannel *chan, GIOCondition cond, gpointer data)
@@ -307,11 +290,13 @@ static gboolean rfcomm_io_cb(GIOChannel *chan, GIOCondition cond, gpointer data)
 
 	key = decode_key(buf);
 	if (key != KEY_RESERVED)
-		send_key(fake->uinput, key);
+		send_key(fake, key);
 
 	return TRUE;
 
 failed:
+	uinput_batch_free(fake->batch);
+	fake->batch = NULL;
 	ioctl(fake->uinput, UI_DEV_DESTROY);
 	close(fake->uinput);
 	fake->uinput = -1;
@@ -373,6 +358,8 @@ static void rfcomm_connect_cb(GIOChannel *chan, GError *err, gpointer user_data)
 		goto failed;
 	}
 
+	fake->batch = uinput_batch_new(fake->uinput, idev->name);
+
 	fake->io = g_io_channel_unix_new(fake->rfcomm);
 	g_io_channel_set_close_on_unref(fake->io, TRUE);
 	g_io_add_watch(fake->io, G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
@@ -918,6 +905,9 @@ static int fake_disconnect(struct input_conn *iconn)
 	g_io_channel_unref(fake->io);
 	fake->io = NULL;
 
+	uinput_batch_free(fake->batch);
+	fake->batch = NULL;
+
 	if (fake->uinput >= 0) {
 		ioctl(fake->uinput, UI_DEV_DESTROY);
 		close(fake->uinput);
@@ -1007,7 +997,12 @@ static void device_unregister(void *data)
 	DBG("Unregistered interface %s on path %s", INPUT_DEVICE_INTERFACE,
 								idev->path);
 
-	devices = g_slist_remove(devices, idev);
+	btd_registry_remove(devices, idev);
+	if (btd_registry_size(devices) == 0) {
+		btd_registry_free(devices);
+		devices = NULL;
+	}
+
 	input_device_free(idev);
 }
 
@@ -1112,6 +1107,14 @@ static struct input_conn *input_conn_new(struct input_device *idev,
 	return iconn;
 }
 
+static void device_add(struct input_device *idev)
+{
+	if (!devices)
+		devices = btd_registry_new();
+
+	btd_registry_add(devices, &idev->src, &idev->dst, idev->path, idev);
+}
+
 int input_device_register(DBusConnection *conn, struct btd_device *device,
 			const char *path, const bdaddr_t *src,
 			const bdaddr_t *dst, const char *uuid,
@@ -1120,12 +1123,12 @@ int input_device_register(DBusConnection *conn, struct btd_device *device,
 	struct input_device *idev;
 	struct input_conn *iconn;
 
-	idev = find_device_by_path(devices, path);
+	idev = find_device_by_path(path);
 	if (!idev) {
 		idev = input_device_new(conn, device, path, src, dst, handle);
 		if (!idev)
 			return -EINVAL;
-		devices = g_slist_append(devices, idev);
+		device_add(idev);
 	}
 
 	iconn = input_conn_new(idev, uuid, "hid", timeout);
@@ -1144,12 +1147,12 @@ int fake_input_register(DBusConnection *conn, struct btd_device *device,
 	struct input_device *idev;
 	struct input_conn *iconn;
 
-	idev = find_device_by_path(devices, path);
+	idev = find_device_by_path(path);
 	if (!idev) {
 		idev = input_device_new(conn, device, path, src, dst, 0);
 		if (!idev)
 			return -EINVAL;
-		devices = g_slist_append(devices, idev);
+		device_add(idev);
 	}
 
 	iconn = input_conn_new(idev, uuid, "hsp", 0);
@@ -1169,16 +1172,7 @@ int fake_input_register(DBusConnection *conn, struct btd_device *device,
 static struct input_device *find_device(const bdaddr_t *src,
 					const bdaddr_t *dst)
 {
-	GSList *list;
-
-	for (list = devices; list != NULL; list = list->next) {
-		struct input_device *idev = list->data;
-
-		if (!bacmp(&idev->src, src) && !bacmp(&idev->dst, dst))
-			return idev;
-	}
-
-	return NULL;
+	return btd_registry_find(devices, src, dst);
 }
 
 int input_device_unregister(const char *path, const char *uuid)
@@ -1186,7 +1180,7 @@ int input_device_unregister(const char *path, const char *uuid)
 	struct input_device *idev;
 	struct input_conn *iconn;
 
-	idev = find_device_by_path(devices, path);
+	idev = find_device_by_path(path);
 	if (idev == NULL)
 		return -EINVAL;
 
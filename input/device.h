@@ -34,6 +34,7 @@ struct fake_input {
 	int		flags;
 	GIOChannel	*io;
 	int		uinput;		/* uinput socket */
+	struct uinput_batch *batch;	/* events queued for uinput */
 	int		rfcomm;		/* RFCOMM socket */
 	uint8_t		ch;		/* RFCOMM channel number */
 	gboolean	(*connect) (struct input_conn *iconn, GError **err);
@@ -47,9 +47,13 @@
 #include "device.h"
 #include "fakehid.h"
 #include "uinput.h"
+#include "uinput-batch.h"
 
 #define PS3_FLAGS_MASK 0xFFFFFF00
 
+/* Reports drained from the socket before yielding to the main loop */
+#define PS3_MAX_REPORTS 16
+
 enum ps3remote_special_keys {
 	PS3R_BIT_PS = 0,
 	PS3R_BIT_ENTER = 3,
@@ -213,10 +217,11 @@ static gboolean ps3remote_event(GIOChannel *chan, GIOCondition cond,
 				gpointer data)
 {
 	struct fake_input *fake = data;
-	struct uinput_event event;
 	unsigned int key, value = 0;
+	GIOError gerr;
 	gsize size;
 	char buff[50];
+	int sk, i;
 
 	if (cond & G_IO_NVAL)
 		return FALSE;
@@ -226,36 +231,34 @@ static gboolean ps3remote_event(GIOChannel *chan, GIOCondition cond,
 		goto failed;
 	}
 
-	memset(buff, 0, sizeof(buff));
+	sk = g_io_channel_unix_get_fd(chan);
 
-	if (g_io_channel_read(chan, buff, sizeof(buff), &size) !=
-							G_IO_ERROR_NONE) {
-		error("IO Channel read error");
-		goto failed;
-	}
+	/* The socket is non-blocking: decode every report queued since the
+	 * last wakeup and hand all of their events to uinput at once */
+	for (i = 0; i < PS3_MAX_REPORTS; i++) {
+		memset(buff, 0, sizeof(buff));
 
-	key = ps3remote_decode(buff, size, &value);
-	if (key == KEY_RESERVED) {
-		error("Got invalid key from decode");
-		goto failed;
-	} else if (key == KEY_MAX)
-		return TRUE;
-
-	memset(&event, 0, sizeof(event));
-	gettimeofday(&event.time, NULL);
-	event.type = EV_KEY;
-	event.code = key;
-	event.value = value;
-	if (write(fake->uinput, &event, sizeof(event)) != sizeof(event)) {
-		error("Error writing to uinput device");
-		goto failed;
+		gerr = g_io_channel_read(chan, buff, sizeof(buff), &size);
+		if (gerr == G_IO_ERROR_AGAIN)
+			break;
+
+		if (gerr != G_IO_ERROR_NONE) {
+			error("IO Channel read error");
+			goto failed;
+		}
+
+		key = ps3remote_decode(buff, size, &value);
+		if (key == KEY_RESERVED) {
+			error("Got invalid key from decode");
+			goto failed;
+		} else if (key == KEY_MAX)
+			continue;
+
+		uinput_batch_report(fake->batch, sk);
+		uinput_batch_key(fake->batch, key, value);
 	}
 
-	memset(&event, 0, sizeof(event));
-	gettimeofday(&event.time, NULL);
-	event.type = EV_SYN;
-	event.code = SYN_REPORT;
-	if (write(fake->uinput, &event, sizeof(event)) != sizeof(event)) {
+	if (uinput_batch_flush(fake->batch) < 0) {
 		error("Error writing to uinput device");
 		goto failed;
 	}
@@ -263,6 +266,8 @@ static gboolean ps3remote_event(GIOChannel *chan, GIOCondition cond,
 	return TRUE;
 
 failed:
+	uinput_batch_free(fake->batch);
+	fake->batch = NULL;
 	ioctl(fake->uinput, UI_DEV_DESTROY);
 	close(fake->uinput);
 	fake->uinput = -1;
@@ -373,13 +378,20 @@ struct fake_hid *get_fake_hid(uint16_t vendor, uint16_t product)
 int fake_hid_connadd(struct fake_input *fake, GIOChannel *intr_io,
 						struct fake_hid *fake_hid)
 {
+	char name[32];
+
 	if (fake_hid->setup_uinput(fake, fake_hid)) {
 		error("Error setting up uinput");
 		return ENOMEM;
 	}
 
+	snprintf(name, sizeof(name), "fakehid %04x:%04x", fake_hid->vendor,
+							fake_hid->product);
+	fake->batch = uinput_batch_new(fake->uinput, name);
+
 	fake->io = g_io_channel_ref(intr_io);
 	g_io_channel_set_close_on_unref(fake->io, TRUE);
+	g_io_channel_set_flags(fake->io, G_IO_FLAG_NONBLOCK, NULL);
 	g_io_add_watch(fake->io, G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
 					(GIOFunc) fake_hid->event, fake);
 
@@ -70,6 +70,13 @@ struct bt_security {
 
 #define BT_DEFER_SETUP	7
 
+#define BT_VOICE	11
+struct bt_voice {
+	uint16_t setting;
+};
+#define BT_VOICE_TRANSPARENT	0x0003
+#define BT_VOICE_CVSD_16BIT	0x0060
+
 /* Connection and socket states */
 enum {
 	BT_CONNECTED = 1, /* Equal to TCP_ESTABLISHED to make net code happy */
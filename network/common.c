@@ -32,9 +32,12 @@
 #include <sys/param.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <sys/wait.h>
 #include <net/if.h>
 #include <linux/sockios.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
 
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/l2cap.h>
@@ -47,6 +50,37 @@
 
 static int ctl;
 
+/*
+ * Interfaces of new connections are added to their bridge and brought up
+ * through a persistent rtnetlink socket.  Requests made while the main
+ * loop is busy are sent together and completed when the kernel acks them.
+ */
+struct bnep_if_req {
+	guint		id;
+	uint32_t	seq;
+	char		devname[16];
+	char		*bridge;
+	struct timeval	start;
+	bnep_if_cb_t	cb;
+	void		*user_data;
+};
+
+static int rtnl = -1;
+static guint rtnl_watch = 0;
+static guint rtnl_flush = 0;
+static uint32_t rtnl_seq = 0;
+static guint rtnl_next_id = 1;
+static GSList *rtnl_queue = NULL;	/* Requests not sent yet */
+static GSList *rtnl_pending = NULL;	/* Requests waiting for an ack */
+static gboolean rtnl_master = TRUE;	/* Kernel honours IFLA_MASTER */
+
+/* Time from bnep_if_setup to the interface being bridged and up */
+static struct {
+	unsigned int	count;
+	unsigned long	total;
+	unsigned long	max;
+} setup_stats;
+
 static struct {
 	const char	*name;		/* Friendly name */
 	const char	*uuid128;	/* UUID 128 */
@@ -103,22 +137,101 @@ const char *bnep_name(uint16_t id)
 	return NULL;
 }
 
+static gboolean rtnl_event(GIOChannel *chan, GIOCondition cond,
+							gpointer user_data);
+
+static int rtnl_init(void)
+{
+	struct sockaddr_nl addr;
+	GIOChannel *io;
+	int sk, err;
+
+	sk = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_ROUTE);
+	if (sk < 0)
+		return -errno;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+
+	if (bind(sk, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		err = errno;
+		close(sk);
+		return -err;
+	}
+
+	io = g_io_channel_unix_new(sk);
+	g_io_channel_set_close_on_unref(io, TRUE);
+	rtnl_watch = g_io_add_watch(io, G_IO_IN | G_IO_HUP | G_IO_ERR |
+						G_IO_NVAL, rtnl_event, NULL);
+	g_io_channel_unref(io);
+
+	rtnl = sk;
+
+	return 0;
+}
+
+static void rtnl_req_free(gpointer data, gpointer user_data)
+{
+	struct bnep_if_req *req = data;
+
+	g_free(req->bridge);
+	g_free(req);
+}
+
+static void rtnl_cleanup(void)
+{
+	if (rtnl_flush > 0) {
+		g_source_remove(rtnl_flush);
+		rtnl_flush = 0;
+	}
+
+	if (rtnl_watch > 0) {
+		g_source_remove(rtnl_watch);
+		rtnl_watch = 0;
+	}
+
+	rtnl = -1;
+
+	g_slist_foreach(rtnl_queue, rtnl_req_free, NULL);
+	g_slist_free(rtnl_queue);
+	rtnl_queue = NULL;
+
+	g_slist_foreach(rtnl_pending, rtnl_req_free, NULL);
+	g_slist_free(rtnl_pending);
+	rtnl_pending = NULL;
+}
+
 int bnep_init(void)
 {
+	int err;
+
 	ctl = socket(PF_BLUETOOTH, SOCK_RAW, BTPROTO_BNEP);
 
 	if (ctl < 0) {
-		int err = errno;
+		err = errno;
 		error("Failed to open control socket: %s (%d)",
 						strerror(err), err);
 		return -err;
 	}
 
+	err = rtnl_init();
+	if (err < 0)
+		error("Failed to open rtnetlink socket: %s (%d)",
+						strerror(-err), -err);
+
 	return 0;
 }
 
 int bnep_cleanup(void)
 {
+	if (setup_stats.count > 0)
+		DBG("%u interfaces set up, avg %lu max %lu usec",
+				setup_stats.count,
+				setup_stats.total / setup_stats.count,
+				setup_stats.max);
+
+	rtnl_cleanup();
+
 	close(ctl);
 	return 0;
 }
@@ -260,3 +373,314 @@ int bnep_add_to_bridge(const char *devname, const char *bridge)
 
 	return 0;
 }
+
+static void rtnl_complete(struct bnep_if_req *req, int err)
+{
+	struct timeval now;
+	unsigned long usec;
+
+	gettimeofday(&now, NULL);
+	usec = (now.tv_sec - req->start.tv_sec) * 1000000 +
+					now.tv_usec - req->start.tv_usec;
+
+	if (err == 0) {
+		setup_stats.count++;
+		setup_stats.total += usec;
+		if (usec > setup_stats.max)
+			setup_stats.max = usec;
+
+		info("bridge %s: interface %s added", req->bridge,
+								req->devname);
+	}
+
+	DBG("%s: setup %s in %lu usec (%u interfaces, max %lu usec)",
+				req->devname, err ? "failed" : "done", usec,
+				setup_stats.count, setup_stats.max);
+
+	if (req->cb)
+		req->cb(req->devname, err, req->user_data);
+
+	rtnl_req_free(req, NULL);
+}
+
+/* Kernels before 2.6.39 ack IFLA_MASTER without acting on it */
+static gboolean bnep_if_bridged(const char *devname)
+{
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "/sys/class/net/%s/brport", devname);
+
+	return access(path, F_OK) == 0;
+}
+
+/* Same as the netlink request, one ioctl at a time */
+static int bnep_if_setup_sync(const char *devname, const char *bridge)
+{
+	if (bnep_add_to_bridge(devname, bridge) < 0)
+		return errno ? -errno : -EIO;
+
+	bnep_if_up(devname);
+
+	return 0;
+}
+
+static int rtnl_append(char *buf, size_t size, struct bnep_if_req *req)
+{
+	struct nlmsghdr *hdr = (struct nlmsghdr *) buf;
+	struct ifinfomsg *ifi;
+	struct rtattr *rta;
+	int ifindex, master;
+
+	ifindex = if_nametoindex(req->devname);
+	master = if_nametoindex(req->bridge);
+	if (ifindex == 0 || master == 0)
+		return -ENODEV;
+
+	if (size < NLMSG_SPACE(sizeof(*ifi)) + RTA_SPACE(sizeof(uint32_t)))
+		return -ENOBUFS;
+
+	memset(buf, 0, NLMSG_SPACE(sizeof(*ifi)) +
+					RTA_SPACE(sizeof(uint32_t)));
+
+	hdr->nlmsg_len = NLMSG_LENGTH(sizeof(*ifi));
+	hdr->nlmsg_type = RTM_NEWLINK;
+	hdr->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+	hdr->nlmsg_seq = req->seq;
+
+	/* The kernel handles the master before the flags, so the interface
+	 * is already part of the bridge when it comes up */
+	ifi = NLMSG_DATA(hdr);
+	ifi->ifi_family = AF_UNSPEC;
+	ifi->ifi_index = ifindex;
+	ifi->ifi_flags = IFF_UP | IFF_MULTICAST;
+	ifi->ifi_change = IFF_UP | IFF_MULTICAST;
+
+	rta = (struct rtattr *) (buf + NLMSG_ALIGN(hdr->nlmsg_len));
+	rta->rta_type = IFLA_MASTER;
+	rta->rta_len = RTA_LENGTH(sizeof(uint32_t));
+	memcpy(RTA_DATA(rta), &master, sizeof(uint32_t));
+
+	hdr->nlmsg_len = NLMSG_ALIGN(hdr->nlmsg_len) + rta->rta_len;
+
+	return NLMSG_ALIGN(hdr->nlmsg_len);
+}
+
+static gboolean rtnl_send_queue(gpointer user_data)
+{
+	struct sockaddr_nl addr;
+	GSList *batch = NULL;
+	char buf[4096];
+	size_t len = 0;
+
+	rtnl_flush = 0;
+
+	while (rtnl_queue) {
+		struct bnep_if_req *req = rtnl_queue->data;
+		int n;
+
+		if (rtnl < 0 || !rtnl_master) {
+			rtnl_queue = g_slist_remove(rtnl_queue, req);
+			rtnl_complete(req, bnep_if_setup_sync(req->devname,
+								req->bridge));
+			continue;
+		}
+
+		n = rtnl_append(buf + len, sizeof(buf) - len, req);
+		if (n == -ENOBUFS) {
+			/* The rest goes out with the next datagram */
+			rtnl_flush = g_idle_add(rtnl_send_queue, NULL);
+			break;
+		}
+
+		rtnl_queue = g_slist_remove(rtnl_queue, req);
+
+		if (n < 0) {
+			error("Can't add %s to the bridge %s: %s(%d)",
+					req->devname, req->bridge,
+					strerror(-n), -n);
+			rtnl_complete(req, n);
+			continue;
+		}
+
+		len += n;
+		batch = g_slist_append(batch, req);
+	}
+
+	if (len == 0)
+		return FALSE;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+
+	if (sendto(rtnl, buf, len, 0, (struct sockaddr *) &addr,
+						sizeof(addr)) < 0) {
+		int err = errno;
+
+		error("rtnetlink send failed: %s (%d)", strerror(err), err);
+
+		/* Nothing reached the kernel, use the ioctls instead */
+		while (batch) {
+			struct bnep_if_req *req = batch->data;
+
+			batch = g_slist_remove(batch, req);
+			rtnl_complete(req, bnep_if_setup_sync(req->devname,
+								req->bridge));
+		}
+
+		return FALSE;
+	}
+
+	rtnl_pending = g_slist_concat(rtnl_pending, batch);
+
+	return FALSE;
+}
+
+static struct bnep_if_req *find_pending(uint32_t seq)
+{
+	GSList *l;
+
+	for (l = rtnl_pending; l; l = l->next) {
+		struct bnep_if_req *req = l->data;
+
+		if (req->seq == seq)
+			return req;
+	}
+
+	return NULL;
+}
+
+static gboolean rtnl_event(GIOChannel *chan, GIOCondition cond,
+							gpointer user_data)
+{
+	char buf[4096];
+	struct nlmsghdr *hdr;
+	int len;
+
+	if (cond & (G_IO_NVAL | G_IO_HUP | G_IO_ERR)) {
+		error("Hangup or error on rtnetlink socket");
+		rtnl_watch = 0;
+		rtnl = -1;
+
+		/* Whatever is left is done with the ioctls */
+		while (rtnl_pending) {
+			struct bnep_if_req *req = rtnl_pending->data;
+
+			rtnl_pending = g_slist_remove(rtnl_pending, req);
+			rtnl_complete(req, bnep_if_setup_sync(req->devname,
+								req->bridge));
+		}
+
+		return FALSE;
+	}
+
+	len = recv(rtnl, buf, sizeof(buf), MSG_DONTWAIT);
+	if (len < 0) {
+		int err = errno;
+
+		if (err == EAGAIN || err == EINTR)
+			return TRUE;
+
+		error("rtnetlink receive failed: %s (%d)", strerror(err), err);
+		rtnl_watch = 0;
+		rtnl = -1;
+
+		/* Their acks are lost, later requests use the ioctls */
+		while (rtnl_pending) {
+			struct bnep_if_req *req = rtnl_pending->data;
+
+			rtnl_pending = g_slist_remove(rtnl_pending, req);
+			rtnl_complete(req, -err);
+		}
+
+		return FALSE;
+	}
+
+	for (hdr = (struct nlmsghdr *) buf; NLMSG_OK(hdr, len);
+					hdr = NLMSG_NEXT(hdr, len)) {
+		struct nlmsgerr *nlerr;
+		struct bnep_if_req *req;
+		int err;
+
+		if (hdr->nlmsg_type != NLMSG_ERROR)
+			continue;
+
+		req = find_pending(hdr->nlmsg_seq);
+		if (!req)
+			continue;
+
+		rtnl_pending = g_slist_remove(rtnl_pending, req);
+
+		nlerr = NLMSG_DATA(hdr);
+		err = nlerr->error;
+
+		if (err < 0)
+			error("Can't add %s to the bridge %s: %s(%d)",
+					req->devname, req->bridge,
+					strerror(-err), -err);
+		else if (!bnep_if_bridged(req->devname)) {
+			if (rtnl_master)
+				info("IFLA_MASTER not supported, "
+						"bridging with ioctls");
+			rtnl_master = FALSE;
+			err = bnep_if_setup_sync(req->devname, req->bridge);
+		}
+
+		rtnl_complete(req, err);
+	}
+
+	return TRUE;
+}
+
+guint bnep_if_setup(const char *devname, const char *bridge,
+					bnep_if_cb_t cb, void *user_data)
+{
+	struct bnep_if_req *req;
+
+	if (!devname || !bridge)
+		return 0;
+
+	req = g_new0(struct bnep_if_req, 1);
+	req->id = rtnl_next_id++;
+	req->seq = ++rtnl_seq;
+	strncpy(req->devname, devname, sizeof(req->devname) - 1);
+	req->bridge = g_strdup(bridge);
+	req->cb = cb;
+	req->user_data = user_data;
+	gettimeofday(&req->start, NULL);
+
+	rtnl_queue = g_slist_append(rtnl_queue, req);
+
+	if (rtnl_flush == 0)
+		rtnl_flush = g_idle_add(rtnl_send_queue, NULL);
+
+	return req->id;
+}
+
+static struct bnep_if_req *find_req(GSList *list, guint id)
+{
+	for (; list; list = list->next) {
+		struct bnep_if_req *req = list->data;
+
+		if (req->id == id)
+			return req;
+	}
+
+	return NULL;
+}
+
+void bnep_if_setup_cancel(guint id)
+{
+	struct bnep_if_req *req;
+
+	req = find_req(rtnl_queue, id);
+	if (req) {
+		rtnl_queue = g_slist_remove(rtnl_queue, req);
+		rtnl_req_free(req, NULL);
+		return;
+	}
+
+	/* Already sent, wait for the ack but don't report it */
+	req = find_req(rtnl_pending, id);
+	if (req)
+		req->cb = NULL;
+}
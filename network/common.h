@@ -40,3 +40,9 @@ int bnep_connadd(int sk, uint16_t role, char *dev);
 int bnep_if_up(const char *devname);
 int bnep_if_down(const char *devname);
 int bnep_add_to_bridge(const char *devname, const char *bridge);
+
+typedef void (*bnep_if_cb_t) (const char *devname, int err, void *user_data);
+
+guint bnep_if_setup(const char *devname, const char *bridge,
+					bnep_if_cb_t cb, void *user_data);
+void bnep_if_setup_cancel(guint id);
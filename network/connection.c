@@ -44,6 +44,7 @@
 #include "dbus-common.h"
 #include "adapter.h"
 #include "device.h"
+#include "registry.h"
 
 #include "error.h"
 #include "common.h"
@@ -82,20 +83,11 @@ struct __service_16 {
 } __attribute__ ((packed));
 
 static DBusConnection *connection = NULL;
-static GSList *peers = NULL;
+static struct btd_registry *peers = NULL;
 
-static struct network_peer *find_peer(GSList *list, const char *path)
+static struct network_peer *find_peer(const char *path)
 {
-	GSList *l;
-
-	for (l = list; l; l = l->next) {
-		struct network_peer *peer = l->data;
-
-		if (!strcmp(peer->path, path))
-			return peer;
-	}
-
-	return NULL;
+	return btd_registry_find_path(peers, path);
 }
 
 static struct network_conn *find_connection(GSList *list, uint16_t id)
@@ -541,7 +533,7 @@ static void path_unregister(void *data)
 	DBG("Unregistered interface %s on path %s",
 		NETWORK_PEER_INTERFACE, peer->path);
 
-	peers = g_slist_remove(peers, peer);
+	btd_registry_remove(peers, peer);
 	peer_free(peer);
 }
 
@@ -563,7 +555,7 @@ void connection_unregister(const char *path, uint16_t id)
 	struct network_peer *peer;
 	struct network_conn *nc;
 
-	peer = find_peer(peers, path);
+	peer = find_peer(path);
 	if (!peer)
 		return;
 
@@ -617,12 +609,12 @@ int connection_register(struct btd_device *device, const char *path,
 	if (!path)
 		return -EINVAL;
 
-	peer = find_peer(peers, path);
+	peer = find_peer(path);
 	if (!peer) {
 		peer = create_peer(device, path, src, dst);
 		if (!peer)
 			return -1;
-		peers = g_slist_append(peers, peer);
+		btd_registry_add(peers, src, dst, path, peer);
 	}
 
 	nc = find_connection(peer->connections, id);
@@ -644,12 +636,16 @@ int connection_register(struct btd_device *device, const char *path,
 int connection_init(DBusConnection *conn)
 {
 	connection = dbus_connection_ref(conn);
+	peers = btd_registry_new();
 
 	return 0;
 }
 
 void connection_exit(void)
 {
+	btd_registry_free(peers);
+	peers = NULL;
+
 	dbus_connection_unref(connection);
 	connection = NULL;
 }
@@ -61,6 +61,8 @@ struct network_session {
 	bdaddr_t	dst;		/* Remote Bluetooth Address */
 	GIOChannel	*io;		/* Pending connect channel */
 	guint		watch;		/* BNEP socket watch */
+	struct network_server *ns;	/* Server of the connection */
+	guint		setup_id;	/* Interface setup in progress */
 };
 
 struct network_adapter {
@@ -267,6 +269,26 @@ static ssize_t send_bnep_ctrl_rsp(int sk, uint16_t val)
 	return send(sk, &rsp, sizeof(rsp), 0);
 }
 
+static void session_free(void *data);
+
+static void server_if_setup_cb(const char *devname, int err, void *user_data)
+{
+	struct network_session *session = user_data;
+	struct network_server *ns = session->ns;
+	int sk = g_io_channel_unix_get_fd(session->io);
+
+	session->setup_id = 0;
+
+	if (err < 0) {
+		send_bnep_ctrl_rsp(sk, BNEP_CONN_NOT_ALLOWED);
+		ns->sessions = g_slist_remove(ns->sessions, session);
+		session_free(session);
+		return;
+	}
+
+	send_bnep_ctrl_rsp(sk, BNEP_SUCCESS);
+}
+
 static int server_connadd(struct network_server *ns,
 				struct network_session *session,
 				uint16_t dst_role)
@@ -284,13 +306,13 @@ static int server_connadd(struct network_server *ns,
 
 	info("Added new connection: %s", devname);
 
-	if (bnep_add_to_bridge(devname, ns->bridge) < 0) {
-		error("Can't add %s to the bridge %s: %s(%d)",
-				devname, ns->bridge, strerror(errno), errno);
-		return -EPERM;
-	}
-
-	bnep_if_up(devname);
+	/* The setup response is sent once the interface is bridged and up,
+	 * meanwhile the next connection can already be set up */
+	session->ns = ns;
+	session->setup_id = bnep_if_setup(devname, ns->bridge,
+						server_if_setup_cb, session);
+	if (session->setup_id == 0)
+		return -EINVAL;
 
 	ns->sessions = g_slist_append(ns->sessions, session);
 
@@ -350,6 +372,9 @@ static void session_free(void *data)
 	if (session->watch)
 		g_source_remove(session->watch);
 
+	if (session->setup_id)
+		bnep_if_setup_cancel(session->setup_id);
+
 	if (session->io)
 		g_io_channel_unref(session->io);
 
@@ -426,9 +451,11 @@ static gboolean bnep_setup(GIOChannel *chan,
 	if (server_connadd(ns, na->setup, dst_role) < 0)
 		goto reply;
 
+	/* This watch is going away and the server owns the session now */
+	na->setup->watch = 0;
 	na->setup = NULL;
 
-	rsp = BNEP_SUCCESS;
+	return FALSE;
 
 reply:
 	send_bnep_ctrl_rsp(sk, rsp);
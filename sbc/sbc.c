@@ -51,6 +51,17 @@
 
 #define SBC_SYNCWORD	0x9C
 
+#define MSBC_SYNCWORD	0xAD
+#define MSBC_BLOCKS	15
+#define MSBC_BITPOOL	26
+
+/* CRC-8 state after the two all-zero header octets of an mSBC frame */
+#define MSBC_CRC_PREFIX	0xA3
+
+/* Private state is placed on its own cache lines, so that streams being
+ * encoded on different threads (see sbc_farm.c) never share one */
+#define SBC_PRIV_ALIGN_MASK	63
+
 /* This structure contains an unpacked SBC frame.
    Yes, there is probably quite some unused space herein */
 struct sbc_frame {
@@ -134,9 +145,9 @@ static const uint8_t crc_table[256] = {
 	0x97, 0x8A, 0xAD, 0xB0, 0xE3, 0xFE, 0xD9, 0xC4
 };
 
-static uint8_t sbc_crc8(const uint8_t *data, size_t len)
+static SBC_ALWAYS_INLINE uint8_t sbc_crc8_internal(uint8_t crc,
+					const uint8_t *data, size_t len)
 {
-	uint8_t crc = 0x0f;
 	size_t i;
 	uint8_t octet;
 
@@ -155,23 +166,30 @@ static uint8_t sbc_crc8(const uint8_t *data, size_t len)
 	return crc;
 }
 
+static uint8_t sbc_crc8(const uint8_t *data, size_t len)
+{
+	return sbc_crc8_internal(0x0f, data, len);
+}
+
 /*
  * Code straight from the spec to calculate the bits array
  * Takes a pointer to the frame in question, a pointer to the bits array and
- * the sampling frequency (as 2 bit integer)
+ * the frame parameters, the sampling frequency being the 2 bit integer.
+ * Callers pass compile time constants for the parameters they know in
+ * advance so that they get folded into the loops below.
  */
 static SBC_ALWAYS_INLINE void sbc_calculate_bits_internal(
-		const struct sbc_frame *frame, int (*bits)[8], int subbands)
+		const struct sbc_frame *frame, int (*bits)[8], int subbands,
+		int channels, int mode, int allocation, uint8_t sf,
+		int bitpool)
 {
-	uint8_t sf = frame->frequency;
-
-	if (frame->mode == MONO || frame->mode == DUAL_CHANNEL) {
+	if (mode == MONO || mode == DUAL_CHANNEL) {
 		int bitneed[2][8], loudness, max_bitneed, bitcount, slicecount, bitslice;
 		int ch, sb;
 
-		for (ch = 0; ch < frame->channels; ch++) {
+		for (ch = 0; ch < channels; ch++) {
 			max_bitneed = 0;
-			if (frame->allocation == SNR) {
+			if (allocation == SNR) {
 				for (sb = 0; sb < subbands; sb++) {
 					bitneed[ch][sb] = frame->scale_factor[ch][sb];
 					if (bitneed[ch][sb] > max_bitneed)
@@ -209,9 +227,9 @@ static SBC_ALWAYS_INLINE void sbc_calculate_bits_internal(
 					else if (bitneed[ch][sb] == bitslice + 1)
 						slicecount += 2;
 				}
-			} while (bitcount + slicecount < frame->bitpool);
+			} while (bitcount + slicecount < bitpool);
 
-			if (bitcount + slicecount == frame->bitpool) {
+			if (bitcount + slicecount == bitpool) {
 				bitcount += slicecount;
 				bitslice--;
 			}
@@ -226,18 +244,18 @@ static SBC_ALWAYS_INLINE void sbc_calculate_bits_internal(
 				}
 			}
 
-			for (sb = 0; bitcount < frame->bitpool &&
+			for (sb = 0; bitcount < bitpool &&
 							sb < subbands; sb++) {
 				if ((bits[ch][sb] >= 2) && (bits[ch][sb] < 16)) {
 					bits[ch][sb]++;
 					bitcount++;
-				} else if ((bitneed[ch][sb] == bitslice + 1) && (frame->bitpool > bitcount + 1)) {
+				} else if ((bitneed[ch][sb] == bitslice + 1) && (bitpool > bitcount + 1)) {
 					bits[ch][sb] = 2;
 					bitcount += 2;
 				}
 			}
 
-			for (sb = 0; bitcount < frame->bitpool &&
+			for (sb = 0; bitcount < bitpool &&
 							sb < subbands; sb++) {
 				if (bits[ch][sb] < 16) {
 					bits[ch][sb]++;
@@ -247,12 +265,12 @@ static SBC_ALWAYS_INLINE void sbc_calculate_bits_internal(
 
 		}
 
-	} else if (frame->mode == STEREO || frame->mode == JOINT_STEREO) {
+	} else if (mode == STEREO || mode == JOINT_STEREO) {
 		int bitneed[2][8], loudness, max_bitneed, bitcount, slicecount, bitslice;
 		int ch, sb;
 
 		max_bitneed = 0;
-		if (frame->allocation == SNR) {
+		if (allocation == SNR) {
 			for (ch = 0; ch < 2; ch++) {
 				for (sb = 0; sb < subbands; sb++) {
 					bitneed[ch][sb] = frame->scale_factor[ch][sb];
@@ -296,9 +314,9 @@ static SBC_ALWAYS_INLINE void sbc_calculate_bits_internal(
 						slicecount += 2;
 				}
 			}
-		} while (bitcount + slicecount < frame->bitpool);
+		} while (bitcount + slicecount < bitpool);
 
-		if (bitcount + slicecount == frame->bitpool) {
+		if (bitcount + slicecount == bitpool) {
 			bitcount += slicecount;
 			bitslice--;
 		}
@@ -317,11 +335,11 @@ static SBC_ALWAYS_INLINE void sbc_calculate_bits_internal(
 
 		ch = 0;
 		sb = 0;
-		while (bitcount < frame->bitpool) {
+		while (bitcount < bitpool) {
 			if ((bits[ch][sb] >= 2) && (bits[ch][sb] < 16)) {
 				bits[ch][sb]++;
 				bitcount++;
-			} else if ((bitneed[ch][sb] == bitslice + 1) && (frame->bitpool > bitcount + 1)) {
+			} else if ((bitneed[ch][sb] == bitslice + 1) && (bitpool > bitcount + 1)) {
 				bits[ch][sb] = 2;
 				bitcount += 2;
 			}
@@ -336,7 +354,7 @@ static SBC_ALWAYS_INLINE void sbc_calculate_bits_internal(
 
 		ch = 0;
 		sb = 0;
-		while (bitcount < frame->bitpool) {
+		while (bitcount < bitpool) {
 			if (bits[ch][sb] < 16) {
 				bits[ch][sb]++;
 				bitcount++;
@@ -354,44 +372,8 @@ static SBC_ALWAYS_INLINE void sbc_calculate_bits_internal(
 
 }
 
-static void sbc_calculate_bits(const struct sbc_frame *frame, int (*bits)[8])
+static int sbc_unpack_header(const uint8_t *data, struct sbc_frame *frame)
 {
-	if (frame->subbands == 4)
-		sbc_calculate_bits_internal(frame, bits, 4);
-	else
-		sbc_calculate_bits_internal(frame, bits, 8);
-}
-
-/*
- * Unpacks a SBC frame at the beginning of the stream in data,
- * which has at most len bytes into frame.
- * Returns the length in bytes of the packed frame, or a negative
- * value on error. The error codes are:
- *
- *  -1   Data stream too short
- *  -2   Sync byte incorrect
- *  -3   CRC8 incorrect
- *  -4   Bitpool value out of bounds
- */
-static int sbc_unpack_frame(const uint8_t *data, struct sbc_frame *frame,
-								size_t len)
-{
-	unsigned int consumed;
-	/* Will copy the parts of the header that are relevant to crc
-	 * calculation here */
-	uint8_t crc_header[11] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
-	int crc_pos = 0;
-	int32_t temp;
-
-	int audio_sample;
-	int ch, sb, blk, bit;	/* channel, subband, block and bit standard
-				   counters */
-	int bits[2][8];		/* bits distribution */
-	uint32_t levels[2][8];	/* levels derived from that */
-
-	if (len < 4)
-		return -1;
-
 	if (data[0] != SBC_SYNCWORD)
 		return -2;
 
@@ -440,6 +422,54 @@ static int sbc_unpack_frame(const uint8_t *data, struct sbc_frame *frame,
 			frame->bitpool > 32 * frame->subbands)
 		return -4;
 
+	return 0;
+}
+
+static int sbc_unpack_header_msbc(const uint8_t *data,
+						struct sbc_frame *frame)
+{
+	/* The header octets are reserved and all parameters are fixed */
+	if (data[0] != MSBC_SYNCWORD || data[1] != 0 || data[2] != 0)
+		return -2;
+
+	frame->frequency = SBC_FREQ_16000;
+	frame->block_mode = SBC_BLK_16;
+	frame->blocks = MSBC_BLOCKS;
+	frame->mode = MONO;
+	frame->channels = 1;
+	frame->allocation = LOUDNESS;
+	frame->subband_mode = SBC_SB_8;
+	frame->subbands = 8;
+	frame->bitpool = MSBC_BITPOOL;
+
+	return 0;
+}
+
+/*
+ * Unpacks the body of a SBC frame whose header has already been parsed
+ * into frame, the frame_* parameters describe the configuration found
+ * in that header.
+ */
+static SBC_ALWAYS_INLINE int sbc_unpack_frame_internal(const uint8_t *data,
+				struct sbc_frame *frame, size_t len,
+				int frame_subbands, int frame_channels,
+				int frame_blocks, int frame_mode,
+				int frame_allocation, uint8_t frame_frequency,
+				int msbc)
+{
+	unsigned int consumed;
+	/* Will copy the parts of the header that are relevant to crc
+	 * calculation here */
+	uint8_t crc_header[11] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+	int crc_pos = 0;
+	int32_t temp;
+
+	int audio_sample;
+	int ch, sb, blk, bit;	/* channel, subband, block and bit standard
+				   counters */
+	int bits[2][8];		/* bits distribution */
+	uint32_t levels[2][8];	/* levels derived from that */
+
 	/* data[3] is crc, we're checking it later */
 
 	consumed = 32;
@@ -448,27 +478,27 @@ static int sbc_unpack_frame(const uint8_t *data, struct sbc_frame *frame,
 	crc_header[1] = data[2];
 	crc_pos = 16;
 
-	if (frame->mode == JOINT_STEREO) {
-		if (len * 8 < consumed + frame->subbands)
+	if (frame_mode == JOINT_STEREO) {
+		if (len * 8 < consumed + frame_subbands)
 			return -1;
 
 		frame->joint = 0x00;
-		for (sb = 0; sb < frame->subbands - 1; sb++)
+		for (sb = 0; sb < frame_subbands - 1; sb++)
 			frame->joint |= ((data[4] >> (7 - sb)) & 0x01) << sb;
-		if (frame->subbands == 4)
+		if (frame_subbands == 4)
 			crc_header[crc_pos / 8] = data[4] & 0xf0;
 		else
 			crc_header[crc_pos / 8] = data[4];
 
-		consumed += frame->subbands;
-		crc_pos += frame->subbands;
+		consumed += frame_subbands;
+		crc_pos += frame_subbands;
 	}
 
-	if (len * 8 < consumed + (4 * frame->subbands * frame->channels))
+	if (len * 8 < consumed + (4 * frame_subbands * frame_channels))
 		return -1;
 
-	for (ch = 0; ch < frame->channels; ch++) {
-		for (sb = 0; sb < frame->subbands; sb++) {
+	for (ch = 0; ch < frame_channels; ch++) {
+		for (sb = 0; sb < frame_subbands; sb++) {
 			/* FIXME assert(consumed % 4 == 0); */
 			frame->scale_factor[ch][sb] =
 				(data[consumed >> 3] >> (4 - (consumed & 0x7))) & 0x0F;
@@ -480,19 +510,28 @@ static int sbc_unpack_frame(const uint8_t *data, struct sbc_frame *frame,
 		}
 	}
 
-	if (data[3] != sbc_crc8(crc_header, crc_pos))
-		return -3;
+	if (msbc) {
+		if (data[3] != sbc_crc8_internal(MSBC_CRC_PREFIX,
+						crc_header + 2, crc_pos - 16))
+			return -3;
+	} else {
+		if (data[3] != sbc_crc8(crc_header, crc_pos))
+			return -3;
+	}
 
-	sbc_calculate_bits(frame, bits);
+	sbc_calculate_bits_internal(frame, bits, frame_subbands,
+				frame_channels, frame_mode, frame_allocation,
+				frame_frequency,
+				msbc ? MSBC_BITPOOL : frame->bitpool);
 
-	for (ch = 0; ch < frame->channels; ch++) {
-		for (sb = 0; sb < frame->subbands; sb++)
+	for (ch = 0; ch < frame_channels; ch++) {
+		for (sb = 0; sb < frame_subbands; sb++)
 			levels[ch][sb] = (1 << bits[ch][sb]) - 1;
 	}
 
-	for (blk = 0; blk < frame->blocks; blk++) {
-		for (ch = 0; ch < frame->channels; ch++) {
-			for (sb = 0; sb < frame->subbands; sb++) {
+	for (blk = 0; blk < frame_blocks; blk++) {
+		for (ch = 0; ch < frame_channels; ch++) {
+			for (sb = 0; sb < frame_subbands; sb++) {
 				if (levels[ch][sb] > 0) {
 					audio_sample = 0;
 					for (bit = 0; bit < bits[ch][sb]; bit++) {
@@ -514,9 +553,9 @@ static int sbc_unpack_frame(const uint8_t *data, struct sbc_frame *frame,
 		}
 	}
 
-	if (frame->mode == JOINT_STEREO) {
-		for (blk = 0; blk < frame->blocks; blk++) {
-			for (sb = 0; sb < frame->subbands; sb++) {
+	if (frame_mode == JOINT_STEREO) {
+		for (blk = 0; blk < frame_blocks; blk++) {
+			for (sb = 0; sb < frame_subbands; sb++) {
 				if (frame->joint & (0x01 << sb)) {
 					temp = frame->sb_sample[blk][0][sb] +
 						frame->sb_sample[blk][1][sb];
@@ -535,6 +574,59 @@ static int sbc_unpack_frame(const uint8_t *data, struct sbc_frame *frame,
 	return consumed >> 3;
 }
 
+/*
+ * Unpacks a SBC frame at the beginning of the stream in data,
+ * which has at most len bytes into frame.
+ * Returns the length in bytes of the packed frame, or a negative
+ * value on error. The error codes are:
+ *
+ *  -1   Data stream too short
+ *  -2   Sync byte incorrect
+ *  -3   CRC8 incorrect
+ *  -4   Bitpool value out of bounds
+ */
+static int sbc_unpack_frame(const uint8_t *data, struct sbc_frame *frame,
+								size_t len)
+{
+	int err;
+
+	if (len < 4)
+		return -1;
+
+	err = sbc_unpack_header(data, frame);
+	if (err < 0)
+		return err;
+
+	if (frame->subbands == 4)
+		return sbc_unpack_frame_internal(data, frame, len, 4,
+					frame->channels, frame->blocks,
+					frame->mode, frame->allocation,
+					frame->frequency, 0);
+	else
+		return sbc_unpack_frame_internal(data, frame, len, 8,
+					frame->channels, frame->blocks,
+					frame->mode, frame->allocation,
+					frame->frequency, 0);
+}
+
+/* Same as sbc_unpack_frame but anything else than an mSBC frame is
+ * rejected as an incorrect sync byte */
+static int sbc_unpack_frame_msbc(const uint8_t *data,
+					struct sbc_frame *frame, size_t len)
+{
+	int err;
+
+	if (len < 4)
+		return -1;
+
+	err = sbc_unpack_header_msbc(data, frame);
+	if (err < 0)
+		return err;
+
+	return sbc_unpack_frame_internal(data, frame, len, 8, 1, MSBC_BLOCKS,
+					MONO, LOUDNESS, SBC_FREQ_16000, 1);
+}
+
 static void sbc_decoder_init(struct sbc_decoder_state *state,
 					const struct sbc_frame *frame)
 {
@@ -671,18 +763,19 @@ static int sbc_synthesize_audio(struct sbc_decoder_state *state,
 	}
 }
 
-static int sbc_analyze_audio(struct sbc_encoder_state *state,
-						struct sbc_frame *frame)
+static SBC_ALWAYS_INLINE int sbc_analyze_audio_internal(
+		struct sbc_encoder_state *state, struct sbc_frame *frame,
+		int frame_subbands, int frame_channels, int frame_blocks)
 {
 	int ch, blk;
 	int16_t *x;
 
-	switch (frame->subbands) {
+	switch (frame_subbands) {
 	case 4:
-		for (ch = 0; ch < frame->channels; ch++) {
+		for (ch = 0; ch < frame_channels; ch++) {
 			x = &state->X[ch][state->position - 16 +
-							frame->blocks * 4];
-			for (blk = 0; blk < frame->blocks; blk += 4) {
+							frame_blocks * 4];
+			for (blk = 0; blk < frame_blocks; blk += 4) {
 				state->sbc_analyze_4b_4s(
 					x,
 					frame->sb_sample_f[blk][ch],
@@ -691,13 +784,13 @@ static int sbc_analyze_audio(struct sbc_encoder_state *state,
 				x -= 16;
 			}
 		}
-		return frame->blocks * 4;
+		return frame_blocks * 4;
 
 	case 8:
-		for (ch = 0; ch < frame->channels; ch++) {
+		for (ch = 0; ch < frame_channels; ch++) {
 			x = &state->X[ch][state->position - 32 +
-							frame->blocks * 8];
-			for (blk = 0; blk < frame->blocks; blk += 4) {
+							frame_blocks * 8];
+			for (blk = 0; blk < frame_blocks; blk += 4) {
 				state->sbc_analyze_4b_8s(
 					x,
 					frame->sb_sample_f[blk][ch],
@@ -706,7 +799,7 @@ static int sbc_analyze_audio(struct sbc_encoder_state *state,
 				x -= 32;
 			}
 		}
-		return frame->blocks * 8;
+		return frame_blocks * 8;
 
 	default:
 		return -EIO;
@@ -759,7 +852,9 @@ static int sbc_analyze_audio(struct sbc_encoder_state *state,
 static SBC_ALWAYS_INLINE ssize_t sbc_pack_frame_internal(uint8_t *data,
 					struct sbc_frame *frame, size_t len,
 					int frame_subbands, int frame_channels,
-					int joint)
+					int frame_blocks, int frame_mode,
+					int frame_allocation, uint8_t frame_frequency,
+					int joint, int msbc)
 {
 	/* Bitstream writer starts from the fourth byte */
 	uint8_t *data_ptr = data + 4;
@@ -777,15 +872,24 @@ static SBC_ALWAYS_INLINE ssize_t sbc_pack_frame_internal(uint8_t *data,
 	uint32_t levels[2][8];	/* levels are derived from that */
 	uint32_t sb_sample_delta[2][8];
 
+	if (msbc) {
+		/* Fixed header, its CRC-8 contribution is precomputed */
+		data[0] = MSBC_SYNCWORD;
+		data[1] = 0;
+		data[2] = 0;
+
+		goto scale_factors;
+	}
+
 	data[0] = SBC_SYNCWORD;
 
-	data[1] = (frame->frequency & 0x03) << 6;
+	data[1] = (frame_frequency & 0x03) << 6;
 
-	data[1] |= (frame->block_mode & 0x03) << 4;
+	data[1] |= (((frame_blocks >> 2) - 1) & 0x03) << 4;
 
-	data[1] |= (frame->mode & 0x03) << 2;
+	data[1] |= (frame_mode & 0x03) << 2;
 
-	data[1] |= (frame->allocation & 0x01) << 1;
+	data[1] |= (frame_allocation & 0x01) << 1;
 
 	switch (frame_subbands) {
 	case 4:
@@ -801,11 +905,11 @@ static SBC_ALWAYS_INLINE ssize_t sbc_pack_frame_internal(uint8_t *data,
 
 	data[2] = frame->bitpool;
 
-	if ((frame->mode == MONO || frame->mode == DUAL_CHANNEL) &&
+	if ((frame_mode == MONO || frame_mode == DUAL_CHANNEL) &&
 			frame->bitpool > frame_subbands << 4)
 		return -5;
 
-	if ((frame->mode == STEREO || frame->mode == JOINT_STEREO) &&
+	if ((frame_mode == STEREO || frame_mode == JOINT_STEREO) &&
 			frame->bitpool > frame_subbands << 5)
 		return -5;
 
@@ -815,13 +919,14 @@ static SBC_ALWAYS_INLINE ssize_t sbc_pack_frame_internal(uint8_t *data,
 	crc_header[1] = data[2];
 	crc_pos = 16;
 
-	if (frame->mode == JOINT_STEREO) {
+	if (frame_mode == JOINT_STEREO) {
 		PUT_BITS(data_ptr, bits_cache, bits_count,
 			joint, frame_subbands);
 		crc_header[crc_pos >> 3] = joint;
 		crc_pos += frame_subbands;
 	}
 
+scale_factors:
 	for (ch = 0; ch < frame_channels; ch++) {
 		for (sb = 0; sb < frame_subbands; sb++) {
 			PUT_BITS(data_ptr, bits_cache, bits_count,
@@ -836,9 +941,16 @@ static SBC_ALWAYS_INLINE ssize_t sbc_pack_frame_internal(uint8_t *data,
 	if (crc_pos % 8)
 		crc_header[crc_pos >> 3] <<= 8 - (crc_pos % 8);
 
-	data[3] = sbc_crc8(crc_header, crc_pos);
+	if (msbc)
+		data[3] = sbc_crc8_internal(MSBC_CRC_PREFIX,
+						crc_header, crc_pos);
+	else
+		data[3] = sbc_crc8(crc_header, crc_pos);
 
-	sbc_calculate_bits(frame, bits);
+	sbc_calculate_bits_internal(frame, bits, frame_subbands,
+				frame_channels, frame_mode, frame_allocation,
+				frame_frequency,
+				msbc ? MSBC_BITPOOL : frame->bitpool);
 
 	for (ch = 0; ch < frame_channels; ch++) {
 		for (sb = 0; sb < frame_subbands; sb++) {
@@ -851,7 +963,7 @@ static SBC_ALWAYS_INLINE ssize_t sbc_pack_frame_internal(uint8_t *data,
 		}
 	}
 
-	for (blk = 0; blk < frame->blocks; blk++) {
+	for (blk = 0; blk < frame_blocks; blk++) {
 		for (ch = 0; ch < frame_channels; ch++) {
 			for (sb = 0; sb < frame_subbands; sb++) {
 
@@ -873,26 +985,6 @@ static SBC_ALWAYS_INLINE ssize_t sbc_pack_frame_internal(uint8_t *data,
 	return data_ptr - data;
 }
 
-static ssize_t sbc_pack_frame(uint8_t *data, struct sbc_frame *frame, size_t len,
-								int joint)
-{
-	if (frame->subbands == 4) {
-		if (frame->channels == 1)
-			return sbc_pack_frame_internal(
-				data, frame, len, 4, 1, joint);
-		else
-			return sbc_pack_frame_internal(
-				data, frame, len, 4, 2, joint);
-	} else {
-		if (frame->channels == 1)
-			return sbc_pack_frame_internal(
-				data, frame, len, 8, 1, joint);
-		else
-			return sbc_pack_frame_internal(
-				data, frame, len, 8, 2, joint);
-	}
-}
-
 static void sbc_encoder_init(struct sbc_encoder_state *state,
 					const struct sbc_frame *frame)
 {
@@ -904,13 +996,293 @@ static void sbc_encoder_init(struct sbc_encoder_state *state,
 
 struct sbc_priv {
 	int init;
+	int msbc;
+	/* Frame kernels, narrowed down on the first sbc_decode/sbc_encode */
+	int (*unpack_frame)(const uint8_t *data, struct sbc_frame *frame,
+								size_t len);
+	ssize_t (*encode_frame)(struct sbc_priv *priv, const void *input,
+					void *output, size_t output_len);
+	int (*enc_process_input)(int position,
+			const uint8_t *pcm, int16_t X[2][SBC_X_BUFFER_SIZE],
+			int nsamples, int nchannels);
 	struct SBC_ALIGNED sbc_frame frame;
 	struct SBC_ALIGNED sbc_decoder_state dec_state;
 	struct SBC_ALIGNED sbc_encoder_state enc_state;
 };
 
+/*
+ * mSBC frames have 15 blocks, so every other frame starts in the middle
+ * of the two blocks layout of the X buffer. Blocks at an odd offset can
+ * start a run of four handled by the regular analysis filter, the rest
+ * go through the single block one.
+ */
+static void sbc_analyze_audio_msbc(struct sbc_encoder_state *state,
+						struct sbc_frame *frame)
+{
+	int16_t *x = &state->X[0][state->position + (MSBC_BLOCKS - 1) * 8];
+	int stride = frame->sb_sample_f[1][0] - frame->sb_sample_f[0][0];
+	int blk = 0;
+
+	while (blk < MSBC_BLOCKS) {
+		int odd = (x - state->X[0]) & 8;
+
+		if (odd && blk + 4 <= MSBC_BLOCKS) {
+			state->sbc_analyze_4b_8s(x - 24,
+					frame->sb_sample_f[blk][0], stride);
+			x -= 32;
+			blk += 4;
+		} else {
+			state->sbc_analyze_1b_8s(x,
+					frame->sb_sample_f[blk][0], odd);
+			x -= 8;
+			blk++;
+		}
+	}
+}
+
+static SBC_ALWAYS_INLINE ssize_t sbc_encode_msbc_internal(
+				struct sbc_priv *priv, const void *input,
+				void *output, size_t output_len, int big_endian)
+{
+	struct sbc_encoder_state *state = &priv->enc_state;
+
+	if (big_endian)
+		state->position = state->sbc_enc_process_input_msbc_be(
+				state->position, input, state->X);
+	else
+		state->position = state->sbc_enc_process_input_msbc_le(
+				state->position, input, state->X);
+
+	sbc_analyze_audio_msbc(state, &priv->frame);
+
+	/* The block past the last one is never written and stays zero,
+	 * so scale factor code working on 4 blocks at once is fine */
+	state->sbc_calc_scalefactors(priv->frame.sb_sample_f,
+				priv->frame.scale_factor, MSBC_BLOCKS, 1, 8);
+
+	return sbc_pack_frame_internal(output, &priv->frame, output_len,
+					8, 1, MSBC_BLOCKS, MONO, LOUDNESS,
+					SBC_FREQ_16000, 0, 1);
+}
+
+static ssize_t sbc_encode_msbc_le(struct sbc_priv *priv, const void *input,
+					void *output, size_t output_len)
+{
+	return sbc_encode_msbc_internal(priv, input, output, output_len, 0);
+}
+
+static ssize_t sbc_encode_msbc_be(struct sbc_priv *priv, const void *input,
+					void *output, size_t output_len)
+{
+	return sbc_encode_msbc_internal(priv, input, output, output_len, 1);
+}
+
+static SBC_ALWAYS_INLINE ssize_t sbc_encode_frame_internal(
+				struct sbc_priv *priv, const void *input,
+				void *output, size_t output_len,
+				int frame_subbands, int frame_channels,
+				int frame_blocks, int frame_mode,
+				int frame_allocation, uint8_t frame_frequency)
+{
+	struct sbc_encoder_state *state = &priv->enc_state;
+	struct sbc_frame *frame = &priv->frame;
+	int j = 0;
+
+	state->position = priv->enc_process_input(state->position,
+				(const uint8_t *) input, state->X,
+				frame_subbands * frame_blocks, frame_channels);
+
+	sbc_analyze_audio_internal(state, frame, frame_subbands,
+						frame_channels, frame_blocks);
+
+	if (frame_mode == JOINT_STEREO)
+		j = state->sbc_calc_scalefactors_j(frame->sb_sample_f,
+				frame->scale_factor, frame_blocks,
+				frame_subbands);
+	else
+		state->sbc_calc_scalefactors(frame->sb_sample_f,
+				frame->scale_factor, frame_blocks,
+				frame_channels, frame_subbands);
+
+	return sbc_pack_frame_internal(output, frame, output_len,
+				frame_subbands, frame_channels, frame_blocks,
+				frame_mode, frame_allocation, frame_frequency,
+				j, 0);
+}
+
+static ssize_t sbc_encode_frame(struct sbc_priv *priv, const void *input,
+					void *output, size_t output_len)
+{
+	struct sbc_frame *frame = &priv->frame;
+
+	if (frame->subbands == 4) {
+		if (frame->channels == 1)
+			return sbc_encode_frame_internal(priv, input, output,
+					output_len, 4, 1, frame->blocks,
+					frame->mode, frame->allocation,
+					frame->frequency);
+		else
+			return sbc_encode_frame_internal(priv, input, output,
+					output_len, 4, 2, frame->blocks,
+					frame->mode, frame->allocation,
+					frame->frequency);
+	} else {
+		if (frame->channels == 1)
+			return sbc_encode_frame_internal(priv, input, output,
+					output_len, 8, 1, frame->blocks,
+					frame->mode, frame->allocation,
+					frame->frequency);
+		else
+			return sbc_encode_frame_internal(priv, input, output,
+					output_len, 8, 2, frame->blocks,
+					frame->mode, frame->allocation,
+					frame->frequency);
+	}
+}
+
+/*
+ * Unpacks a frame expected to be in the given configuration with all of
+ * its parameters known at compile time. Frames in any other
+ * configuration are handed over to the generic code.
+ */
+static SBC_ALWAYS_INLINE int sbc_unpack_frame_fixed(const uint8_t *data,
+				struct sbc_frame *frame, size_t len,
+				uint8_t frequency, uint8_t block_mode,
+				int mode, int allocation, uint8_t subband_mode)
+{
+	uint8_t header = (frequency << 6) | (block_mode << 4) |
+				(mode << 2) | (allocation << 1) | subband_mode;
+	int err;
+
+	if (len < 4 || data[1] != header)
+		return sbc_unpack_frame(data, frame, len);
+
+	err = sbc_unpack_header(data, frame);
+	if (err < 0)
+		return err;
+
+	return sbc_unpack_frame_internal(data, frame, len,
+					subband_mode ? 8 : 4,
+					mode == MONO ? 1 : 2,
+					4 + block_mode * 4, mode, allocation,
+					frequency, 0);
+}
+
+#define SBC_KERNEL(name, frequency, block_mode, mode, allocation,	\
+							subband_mode)	\
+static int sbc_unpack_frame_##name(const uint8_t *data,		\
+					struct sbc_frame *frame, size_t len) \
+{									\
+	return sbc_unpack_frame_fixed(data, frame, len, frequency,	\
+				block_mode, mode, allocation,		\
+				subband_mode);				\
+}									\
+									\
+static ssize_t sbc_encode_frame_##name(struct sbc_priv *priv,		\
+			const void *input, void *output, size_t output_len) \
+{									\
+	return sbc_encode_frame_internal(priv, input, output,		\
+				output_len, subband_mode ? 8 : 4,	\
+				mode == MONO ? 1 : 2,			\
+				4 + block_mode * 4, mode, allocation,	\
+				frequency);				\
+}
+
+/* The configurations almost every A2DP source and sink ends up with */
+SBC_KERNEL(44100_js_16b_8s, SBC_FREQ_44100, SBC_BLK_16, JOINT_STEREO,
+						LOUDNESS, SBC_SB_8)
+SBC_KERNEL(48000_js_16b_8s, SBC_FREQ_48000, SBC_BLK_16, JOINT_STEREO,
+						LOUDNESS, SBC_SB_8)
+
+static const struct sbc_kernel {
+	uint8_t frequency;
+	uint8_t block_mode;
+	uint8_t mode;
+	uint8_t allocation;
+	uint8_t subband_mode;
+	int (*unpack_frame)(const uint8_t *data, struct sbc_frame *frame,
+								size_t len);
+	ssize_t (*encode_frame)(struct sbc_priv *priv, const void *input,
+					void *output, size_t output_len);
+} sbc_kernels[] = {
+	{ SBC_FREQ_44100, SBC_BLK_16, JOINT_STEREO, LOUDNESS, SBC_SB_8,
+		sbc_unpack_frame_44100_js_16b_8s,
+		sbc_encode_frame_44100_js_16b_8s },
+	{ SBC_FREQ_48000, SBC_BLK_16, JOINT_STEREO, LOUDNESS, SBC_SB_8,
+		sbc_unpack_frame_48000_js_16b_8s,
+		sbc_encode_frame_48000_js_16b_8s },
+};
+
+/* Returns the kernels specialized for the frame configuration, if any */
+static const struct sbc_kernel *sbc_find_kernel(const struct sbc_frame *frame)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(sbc_kernels) / sizeof(sbc_kernels[0]); i++) {
+		const struct sbc_kernel *k = &sbc_kernels[i];
+
+		if (k->frequency == frame->frequency &&
+				k->block_mode == frame->block_mode &&
+				k->mode == frame->mode &&
+				k->allocation == frame->allocation &&
+				k->subband_mode == frame->subband_mode)
+			return k;
+	}
+
+	return NULL;
+}
+
+/* Selects the input processing function and the frame kernel once, so
+ * that sbc_encode does not have to look at the configuration again */
+static void sbc_select_encoder(sbc_t *sbc, struct sbc_priv *priv)
+{
+	struct sbc_encoder_state *state = &priv->enc_state;
+	const struct sbc_kernel *kernel;
+
+	if (priv->msbc) {
+		if (sbc->endian == SBC_BE)
+			priv->encode_frame = sbc_encode_msbc_be;
+		else
+			priv->encode_frame = sbc_encode_msbc_le;
+		return;
+	}
+
+	if (priv->frame.subbands == 8) {
+		if (sbc->endian == SBC_BE)
+			priv->enc_process_input =
+				state->sbc_enc_process_input_8s_be;
+		else
+			priv->enc_process_input =
+				state->sbc_enc_process_input_8s_le;
+	} else {
+		if (sbc->endian == SBC_BE)
+			priv->enc_process_input =
+				state->sbc_enc_process_input_4s_be;
+		else
+			priv->enc_process_input =
+				state->sbc_enc_process_input_4s_le;
+	}
+
+	kernel = sbc_find_kernel(&priv->frame);
+	if (kernel)
+		priv->encode_frame = kernel->encode_frame;
+	else
+		priv->encode_frame = sbc_encode_frame;
+}
+
 static void sbc_set_defaults(sbc_t *sbc, unsigned long flags)
 {
+	struct sbc_priv *priv = sbc->priv;
+
+	sbc->flags = flags;
+	priv->msbc = (flags & SBC_MSBC) ? 1 : 0;
+
+	/* Decoding starts with the generic unpacker and encoding picks its
+	 * kernel on the first frame, whichever direction is used first */
+	priv->unpack_frame = priv->msbc ? sbc_unpack_frame_msbc :
+							sbc_unpack_frame;
+	priv->encode_frame = NULL;
+
 	sbc->frequency = SBC_FREQ_44100;
 	sbc->mode = SBC_MODE_STEREO;
 	sbc->subbands = SBC_SB_8;
@@ -923,6 +1295,15 @@ static void sbc_set_defaults(sbc_t *sbc, unsigned long flags)
 #else
 #error "Unknown byte order"
 #endif
+
+	if (priv->msbc) {
+		sbc->frequency = SBC_FREQ_16000;
+		sbc->mode = SBC_MODE_MONO;
+		sbc->allocation = SBC_AM_LOUDNESS;
+		sbc->subbands = SBC_SB_8;
+		sbc->blocks = SBC_BLK_16;
+		sbc->bitpool = MSBC_BITPOOL;
+	}
 }
 
 int sbc_init(sbc_t *sbc, unsigned long flags)
@@ -932,12 +1313,14 @@ int sbc_init(sbc_t *sbc, unsigned long flags)
 
 	memset(sbc, 0, sizeof(sbc_t));
 
-	sbc->priv_alloc_base = malloc(sizeof(struct sbc_priv) + SBC_ALIGN_MASK);
+	sbc->priv_alloc_base = malloc(sizeof(struct sbc_priv) +
+							SBC_PRIV_ALIGN_MASK);
 	if (!sbc->priv_alloc_base)
 		return -ENOMEM;
 
 	sbc->priv = (void *) (((uintptr_t) sbc->priv_alloc_base +
-			SBC_ALIGN_MASK) & ~((uintptr_t) SBC_ALIGN_MASK));
+				SBC_PRIV_ALIGN_MASK) &
+				~((uintptr_t) SBC_PRIV_ALIGN_MASK));
 
 	memset(sbc->priv, 0, sizeof(struct sbc_priv));
 
@@ -951,6 +1334,96 @@ ssize_t sbc_parse(sbc_t *sbc, const void *input, size_t input_len)
 	return sbc_decode(sbc, input, input_len, NULL, 0, NULL);
 }
 
+ssize_t sbc_parse_header(const void *input, size_t input_len,
+				struct sbc_frame_info *info, unsigned long flags)
+{
+	const uint8_t *data = input;
+	struct sbc_frame frame;
+	unsigned int bits, join, crc;
+	int err;
+
+	if (!input || !info)
+		return -EIO;
+
+	if (input_len < 4)
+		return -1;
+
+	if (data[0] == MSBC_SYNCWORD)
+		err = sbc_unpack_header_msbc(data, &frame);
+	else
+		err = sbc_unpack_header(data, &frame);
+
+	if (err < 0)
+		return err;
+
+	info->frequency = frame.frequency;
+	info->blocks = frame.block_mode;
+	info->subbands = frame.subband_mode;
+	info->mode = frame.mode;
+	info->allocation = frame.allocation;
+	info->bitpool = frame.bitpool;
+	info->msbc = data[0] == MSBC_SYNCWORD;
+
+	join = frame.mode == JOINT_STEREO ? frame.subbands : 0;
+
+	info->length = 4 + (4 * frame.subbands * frame.channels) / 8;
+	if (frame.channels == 1 || frame.mode == DUAL_CHANNEL)
+		info->length += (frame.blocks * frame.channels *
+						frame.bitpool + 7) / 8;
+	else
+		info->length += (join + frame.blocks * frame.bitpool + 7) / 8;
+
+	if (!(flags & SBC_PARSE_CRC))
+		return info->length;
+
+	/* The CRC covers the joint and scale factor bits following the
+	 * header, and for plain SBC the two header octets before it */
+	bits = join + 4 * frame.subbands * frame.channels;
+	if (input_len * 8 < 32 + bits)
+		return -1;
+
+	if (info->msbc)
+		crc = sbc_crc8_internal(MSBC_CRC_PREFIX, data + 4, bits);
+	else
+		crc = sbc_crc8_internal(sbc_crc8(data + 1, 16), data + 4,
+									bits);
+
+	if (data[3] != crc)
+		return -3;
+
+	return info->length;
+}
+
+int sbc_parse_frames(const void *input, size_t input_len,
+				struct sbc_frame_info *info, int count,
+				unsigned long flags, size_t *consumed)
+{
+	const uint8_t *data = input;
+	size_t offset = 0;
+	ssize_t len;
+	int n;
+
+	for (n = 0; n < count; n++) {
+		len = sbc_parse_header(data + offset, input_len - offset,
+							&info[n], flags);
+		if (len < 0) {
+			if (n == 0 && len != -1)
+				return len;
+			break;
+		}
+
+		if ((size_t) len > input_len - offset)
+			break;
+
+		offset += len;
+	}
+
+	if (consumed)
+		*consumed = offset;
+
+	return n;
+}
+
 ssize_t sbc_decode(sbc_t *sbc, const void *input, size_t input_len,
 			void *output, size_t output_len, size_t *written)
 {
@@ -963,12 +1436,23 @@ ssize_t sbc_decode(sbc_t *sbc, const void *input, size_t input_len,
 
 	priv = sbc->priv;
 
-	framelen = sbc_unpack_frame(input, &priv->frame, input_len);
+	framelen = priv->unpack_frame(input, &priv->frame, input_len);
 
 	if (!priv->init) {
+		const struct sbc_kernel *kernel;
+
 		sbc_decoder_init(&priv->dec_state, &priv->frame);
 		priv->init = 1;
 
+		/* Later frames go through the kernel picked for this one */
+		kernel = sbc_find_kernel(&priv->frame);
+		if (priv->msbc)
+			priv->unpack_frame = sbc_unpack_frame_msbc;
+		else if (kernel)
+			priv->unpack_frame = kernel->unpack_frame;
+		else
+			priv->unpack_frame = sbc_unpack_frame;
+
 		sbc->frequency = priv->frame.frequency;
 		sbc->mode = priv->frame.mode;
 		sbc->subbands = priv->frame.subband_mode;
@@ -1021,11 +1505,7 @@ ssize_t sbc_encode(sbc_t *sbc, const void *input, size_t input_len,
 			void *output, size_t output_len, ssize_t *written)
 {
 	struct sbc_priv *priv;
-	int samples;
 	ssize_t framelen;
-	int (*sbc_enc_process_input)(int position,
-			const uint8_t *pcm, int16_t X[2][SBC_X_BUFFER_SIZE],
-			int nsamples, int nchannels);
 
 	if (!sbc || !input)
 		return -EIO;
@@ -1035,7 +1515,8 @@ ssize_t sbc_encode(sbc_t *sbc, const void *input, size_t input_len,
 	if (written)
 		*written = 0;
 
-	if (!priv->init) {
+	/* A context that decoded first has no encoder selected yet */
+	if (!priv->init || !priv->encode_frame) {
 		priv->frame.frequency = sbc->frequency;
 		priv->frame.mode = sbc->mode;
 		priv->frame.channels = sbc->mode == SBC_MODE_MONO ? 1 : 2;
@@ -1043,12 +1524,14 @@ ssize_t sbc_encode(sbc_t *sbc, const void *input, size_t input_len,
 		priv->frame.subband_mode = sbc->subbands;
 		priv->frame.subbands = sbc->subbands ? 8 : 4;
 		priv->frame.block_mode = sbc->blocks;
-		priv->frame.blocks = 4 + (sbc->blocks * 4);
+		priv->frame.blocks = priv->msbc ? MSBC_BLOCKS :
+						4 + (sbc->blocks * 4);
 		priv->frame.bitpool = sbc->bitpool;
 		priv->frame.codesize = sbc_get_codesize(sbc);
 		priv->frame.length = sbc_get_frame_length(sbc);
 
 		sbc_encoder_init(&priv->enc_state, &priv->frame);
+		sbc_select_encoder(sbc, priv);
 		priv->init = 1;
 	}
 
@@ -1060,47 +1543,12 @@ ssize_t sbc_encode(sbc_t *sbc, const void *input, size_t input_len,
 	if (!output || output_len < priv->frame.length)
 		return -ENOSPC;
 
-	/* Select the needed input data processing function and call it */
-	if (priv->frame.subbands == 8) {
-		if (sbc->endian == SBC_BE)
-			sbc_enc_process_input =
-				priv->enc_state.sbc_enc_process_input_8s_be;
-		else
-			sbc_enc_process_input =
-				priv->enc_state.sbc_enc_process_input_8s_le;
-	} else {
-		if (sbc->endian == SBC_BE)
-			sbc_enc_process_input =
-				priv->enc_state.sbc_enc_process_input_4s_be;
-		else
-			sbc_enc_process_input =
-				priv->enc_state.sbc_enc_process_input_4s_le;
-	}
-
-	priv->enc_state.position = sbc_enc_process_input(
-		priv->enc_state.position, (const uint8_t *) input,
-		priv->enc_state.X, priv->frame.subbands * priv->frame.blocks,
-		priv->frame.channels);
-
-	samples = sbc_analyze_audio(&priv->enc_state, &priv->frame);
-
-	if (priv->frame.mode == JOINT_STEREO) {
-		int j = priv->enc_state.sbc_calc_scalefactors_j(
-			priv->frame.sb_sample_f, priv->frame.scale_factor,
-			priv->frame.blocks, priv->frame.subbands);
-		framelen = sbc_pack_frame(output, &priv->frame, output_len, j);
-	} else {
-		priv->enc_state.sbc_calc_scalefactors(
-			priv->frame.sb_sample_f, priv->frame.scale_factor,
-			priv->frame.blocks, priv->frame.channels,
-			priv->frame.subbands);
-		framelen = sbc_pack_frame(output, &priv->frame, output_len, 0);
-	}
+	framelen = priv->encode_frame(priv, input, output, output_len);
 
 	if (written)
 		*written = framelen;
 
-	return samples * priv->frame.channels * 2;
+	return priv->frame.codesize;
 }
 
 void sbc_finish(sbc_t *sbc)
@@ -1124,7 +1572,7 @@ size_t sbc_get_frame_length(sbc_t *sbc)
 		return priv->frame.length;
 
 	subbands = sbc->subbands ? 8 : 4;
-	blocks = 4 + (sbc->blocks * 4);
+	blocks = priv->msbc ? MSBC_BLOCKS : 4 + (sbc->blocks * 4);
 	channels = sbc->mode == SBC_MODE_MONO ? 1 : 2;
 	joint = sbc->mode == SBC_MODE_JOINT_STEREO ? 1 : 0;
 	bitpool = sbc->bitpool;
@@ -1148,7 +1596,7 @@ unsigned sbc_get_frame_duration(sbc_t *sbc)
 	priv = sbc->priv;
 	if (!priv->init) {
 		subbands = sbc->subbands ? 8 : 4;
-		blocks = 4 + (sbc->blocks * 4);
+		blocks = priv->msbc ? MSBC_BLOCKS : 4 + (sbc->blocks * 4);
 	} else {
 		subbands = priv->frame.subbands;
 		blocks = priv->frame.blocks;
@@ -1185,7 +1633,7 @@ size_t sbc_get_codesize(sbc_t *sbc)
 	priv = sbc->priv;
 	if (!priv->init) {
 		subbands = sbc->subbands ? 8 : 4;
-		blocks = 4 + (sbc->blocks * 4);
+		blocks = priv->msbc ? MSBC_BLOCKS : 4 + (sbc->blocks * 4);
 		channels = sbc->mode == SBC_MODE_MONO ? 1 : 2;
 	} else {
 		subbands = priv->frame.subbands;
@@ -64,6 +64,12 @@ extern "C" {
 #define SBC_LE			0x00
 #define SBC_BE			0x01
 
+/* Flags for sbc_init and sbc_reinit */
+
+/* mSBC, the HFP wideband speech codec: 16 kHz mono, 15 blocks,
+ * 8 subbands, loudness allocation and bitpool 26 with a fixed header */
+#define SBC_MSBC		0x01
+
 struct sbc_struct {
 	unsigned long flags;
 
@@ -86,6 +92,35 @@ int sbc_reinit(sbc_t *sbc, unsigned long flags);
 
 ssize_t sbc_parse(sbc_t *sbc, const void *input, size_t input_len);
 
+/* Configuration and length of one frame, using the same constants as
+ * the matching sbc_t fields */
+struct sbc_frame_info {
+	uint8_t frequency;
+	uint8_t blocks;
+	uint8_t subbands;
+	uint8_t mode;
+	uint8_t allocation;
+	uint8_t bitpool;
+	uint8_t msbc;
+	size_t length;
+};
+
+/* Flags for sbc_parse_header and sbc_parse_frames */
+#define SBC_PARSE_CRC		0x01	/* Verify the frame CRC */
+
+/* Reads the header of the frame at the start of input without decoding
+ * the frame. Returns the frame length, which may be more than input_len,
+ * or the same negative errors as sbc_decode */
+ssize_t sbc_parse_header(const void *input, size_t input_len,
+				struct sbc_frame_info *info, unsigned long flags);
+
+/* Finds up to count complete frames following each other at the start
+ * of input. Returns the number of frames found, or a negative error if
+ * the first one is invalid, and the bytes they take in consumed */
+int sbc_parse_frames(const void *input, size_t input_len,
+				struct sbc_frame_info *info, int count,
+				unsigned long flags, size_t *consumed);
+
 /* Decodes ONE input block into ONE output block */
 ssize_t sbc_decode(sbc_t *sbc, const void *input, size_t input_len,
 			void *output, size_t output_len, size_t *written);
@@ -0,0 +1,508 @@
+/*
+ *
+ *  Bluetooth low-complexity, subband codec (SBC) library
+ *
+ *  Copyright (C) 2010  Nokia Corporation
+ *  Copyright (C) 2004-2010  Marcel Holtmann <marcel@holtmann.org>
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "sbc.h"
+#include "sbc_farm.h"
+
+#define SBC_FARM_CACHELINE	64
+#define SBC_FARM_ALIGNED	__attribute__((aligned(SBC_FARM_CACHELINE)))
+
+struct farm_job {
+	struct farm_job *next;
+	const uint8_t *input;
+	size_t input_len;
+	uint8_t *output;
+	size_t output_len;
+	void *tag;
+} SBC_FARM_ALIGNED;
+
+/* Every stream lives on its own cache lines, so that workers encoding
+ * different streams never bounce lines between each other */
+struct sbc_farm_stream {
+	sbc_t *sbc;
+	sbc_farm_cb_t cb;
+	void *user_data;
+	sbc_farm_t *farm;
+
+	/* Protected by the farm lock */
+	struct farm_job *head;
+	struct farm_job *tail;
+	struct sbc_farm_stream *next_run;
+	unsigned int pending;
+	int scheduled;
+	int flushing;
+} SBC_FARM_ALIGNED;
+
+struct sbc_farm {
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t idle;
+
+	/* Streams with queued jobs not being encoded by any worker */
+	struct sbc_farm_stream *run_head;
+	struct sbc_farm_stream *run_tail;
+
+	struct farm_job *jobs;
+	struct farm_job *free_jobs;
+	unsigned int max_jobs;
+	unsigned int outstanding;
+
+	struct sbc_farm_completion *ring;
+	unsigned int ring_head;
+	unsigned int ring_count;
+	int notify[2];
+
+	pthread_t *threads;
+	unsigned int nthreads;
+	int quit;
+};
+
+static void run_queue_push(sbc_farm_t *farm, struct sbc_farm_stream *stream)
+{
+	stream->next_run = NULL;
+
+	if (farm->run_tail)
+		farm->run_tail->next_run = stream;
+	else
+		farm->run_head = stream;
+
+	farm->run_tail = stream;
+}
+
+static struct sbc_farm_stream *run_queue_pop(sbc_farm_t *farm)
+{
+	struct sbc_farm_stream *stream = farm->run_head;
+
+	if (!stream)
+		return NULL;
+
+	farm->run_head = stream->next_run;
+	if (!farm->run_head)
+		farm->run_tail = NULL;
+
+	return stream;
+}
+
+static void ring_push(sbc_farm_t *farm, const struct sbc_farm_completion *c)
+{
+	unsigned int idx = (farm->ring_head + farm->ring_count) %
+							farm->max_jobs;
+
+	farm->ring[idx] = *c;
+
+	/* Only the empty to non-empty transition needs a wakeup */
+	if (farm->ring_count++ == 0) {
+		char b = 0;
+
+		if (write(farm->notify[1], &b, 1) < 0 && errno != EAGAIN)
+			perror("sbc_farm: notify");
+	}
+}
+
+static void farm_encode(struct sbc_farm_stream *stream,
+				const struct farm_job *job,
+				struct sbc_farm_completion *c)
+{
+	const uint8_t *input = job->input;
+	uint8_t *output = job->output;
+	size_t input_len = job->input_len;
+	size_t output_len = job->output_len;
+
+	memset(c, 0, sizeof(*c));
+	c->stream = stream;
+	c->tag = job->tag;
+	c->output = job->output;
+
+	while (input_len > 0) {
+		ssize_t consumed, written;
+
+		consumed = sbc_encode(stream->sbc, input, input_len,
+					output, output_len, &written);
+		if (consumed == -ENOSPC && c->written > 0)
+			break;
+
+		if (consumed < 0) {
+			c->err = consumed;
+			break;
+		}
+
+		if (consumed == 0)
+			break;
+
+		if (written < 0) {
+			c->err = written;
+			break;
+		}
+
+		input += consumed;
+		input_len -= consumed;
+		output += written;
+		output_len -= written;
+
+		c->consumed += consumed;
+		c->written += written;
+	}
+}
+
+static void *farm_worker(void *data)
+{
+	sbc_farm_t *farm = data;
+
+	pthread_mutex_lock(&farm->lock);
+
+	while (1) {
+		struct sbc_farm_stream *stream;
+		struct sbc_farm_completion c;
+		struct farm_job *job;
+
+		stream = run_queue_pop(farm);
+		if (!stream) {
+			if (farm->quit)
+				break;
+
+			pthread_cond_wait(&farm->work, &farm->lock);
+			continue;
+		}
+
+		/* The stream is off the run queue, so no other worker can
+		 * touch it or its sbc_t until it gets queued again */
+		job = stream->head;
+
+		pthread_mutex_unlock(&farm->lock);
+
+		farm_encode(stream, job, &c);
+
+		if (stream->cb)
+			stream->cb(&c, stream->user_data);
+
+		pthread_mutex_lock(&farm->lock);
+
+		stream->head = job->next;
+		if (!stream->head)
+			stream->tail = NULL;
+
+		job->next = farm->free_jobs;
+		farm->free_jobs = job;
+
+		if (stream->cb)
+			farm->outstanding--;
+		else
+			ring_push(farm, &c);
+
+		stream->pending--;
+
+		/* Requeue at the tail so that busy streams can't starve
+		 * the others */
+		if (stream->head) {
+			run_queue_push(farm, stream);
+			continue;
+		}
+
+		stream->scheduled = 0;
+
+		if (stream->flushing)
+			pthread_cond_broadcast(&farm->idle);
+	}
+
+	pthread_mutex_unlock(&farm->lock);
+
+	return NULL;
+}
+
+static int set_nonblock_cloexec(int fd)
+{
+	int flags;
+
+	flags = fcntl(fd, F_GETFL);
+	if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+		return -errno;
+
+	flags = fcntl(fd, F_GETFD);
+	if (flags < 0 || fcntl(fd, F_SETFD, flags | FD_CLOEXEC) < 0)
+		return -errno;
+
+	return 0;
+}
+
+static void farm_stop(sbc_farm_t *farm, unsigned int nthreads)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&farm->lock);
+	farm->quit = 1;
+	pthread_cond_broadcast(&farm->work);
+	pthread_mutex_unlock(&farm->lock);
+
+	for (i = 0; i < nthreads; i++)
+		pthread_join(farm->threads[i], NULL);
+}
+
+static void farm_release(sbc_farm_t *farm)
+{
+	if (farm->notify[0] >= 0)
+		close(farm->notify[0]);
+
+	if (farm->notify[1] >= 0)
+		close(farm->notify[1]);
+
+	pthread_cond_destroy(&farm->idle);
+	pthread_cond_destroy(&farm->work);
+	pthread_mutex_destroy(&farm->lock);
+
+	free(farm->threads);
+	free(farm->ring);
+	free(farm->jobs);
+	free(farm);
+}
+
+sbc_farm_t *sbc_farm_new(unsigned int workers, unsigned int max_jobs)
+{
+	sbc_farm_t *farm;
+	unsigned int i;
+
+	if (max_jobs == 0)
+		return NULL;
+
+	if (workers == 0) {
+		long n = sysconf(_SC_NPROCESSORS_ONLN);
+		workers = n > 0 ? n : 1;
+	}
+
+	farm = calloc(1, sizeof(*farm));
+	if (!farm)
+		return NULL;
+
+	pthread_mutex_init(&farm->lock, NULL);
+	pthread_cond_init(&farm->work, NULL);
+	pthread_cond_init(&farm->idle, NULL);
+	farm->notify[0] = -1;
+	farm->notify[1] = -1;
+	farm->max_jobs = max_jobs;
+
+	if (posix_memalign((void **) &farm->jobs, SBC_FARM_CACHELINE,
+				max_jobs * sizeof(struct farm_job)) != 0) {
+		farm->jobs = NULL;
+		goto failed;
+	}
+
+	for (i = 0; i < max_jobs; i++) {
+		farm->jobs[i].next = farm->free_jobs;
+		farm->free_jobs = &farm->jobs[i];
+	}
+
+	farm->ring = calloc(max_jobs, sizeof(struct sbc_farm_completion));
+	farm->threads = calloc(workers, sizeof(pthread_t));
+	if (!farm->ring || !farm->threads)
+		goto failed;
+
+	if (pipe(farm->notify) < 0) {
+		farm->notify[0] = -1;
+		farm->notify[1] = -1;
+		goto failed;
+	}
+
+	if (set_nonblock_cloexec(farm->notify[0]) < 0 ||
+			set_nonblock_cloexec(farm->notify[1]) < 0)
+		goto failed;
+
+	for (i = 0; i < workers; i++) {
+		if (pthread_create(&farm->threads[i], NULL,
+						farm_worker, farm) != 0) {
+			farm_stop(farm, i);
+			goto failed;
+		}
+	}
+
+	farm->nthreads = workers;
+
+	return farm;
+
+failed:
+	farm_release(farm);
+	return NULL;
+}
+
+void sbc_farm_free(sbc_farm_t *farm)
+{
+	if (!farm)
+		return;
+
+	/* Workers only quit once the run queue has been drained */
+	farm_stop(farm, farm->nthreads);
+
+	farm_release(farm);
+}
+
+sbc_farm_stream_t *sbc_farm_stream_new(sbc_farm_t *farm, sbc_t *sbc,
+					sbc_farm_cb_t cb, void *user_data)
+{
+	struct sbc_farm_stream *stream;
+
+	if (!farm || !sbc)
+		return NULL;
+
+	if (posix_memalign((void **) &stream, SBC_FARM_CACHELINE,
+						sizeof(*stream)) != 0)
+		return NULL;
+
+	memset(stream, 0, sizeof(*stream));
+	stream->farm = farm;
+	stream->sbc = sbc;
+	stream->cb = cb;
+	stream->user_data = user_data;
+
+	return stream;
+}
+
+void sbc_farm_stream_flush(sbc_farm_stream_t *stream)
+{
+	sbc_farm_t *farm;
+
+	if (!stream)
+		return;
+
+	farm = stream->farm;
+
+	pthread_mutex_lock(&farm->lock);
+
+	stream->flushing++;
+	while (stream->pending > 0)
+		pthread_cond_wait(&farm->idle, &farm->lock);
+	stream->flushing--;
+
+	pthread_mutex_unlock(&farm->lock);
+}
+
+void sbc_farm_stream_free(sbc_farm_stream_t *stream)
+{
+	if (!stream)
+		return;
+
+	/* Completions still sitting in the ring only carry the stream
+	 * pointer as an identifier, so they stay valid to reap */
+	sbc_farm_stream_flush(stream);
+
+	free(stream);
+}
+
+int sbc_farm_submit(sbc_farm_stream_t *stream, const void *input,
+			size_t input_len, void *output, size_t output_len,
+			void *tag)
+{
+	sbc_farm_t *farm;
+	struct farm_job *job;
+
+	if (!stream || !input || !output)
+		return -EINVAL;
+
+	farm = stream->farm;
+
+	pthread_mutex_lock(&farm->lock);
+
+	if (farm->quit || farm->outstanding >= farm->max_jobs) {
+		pthread_mutex_unlock(&farm->lock);
+		return -EAGAIN;
+	}
+
+	job = farm->free_jobs;
+	farm->free_jobs = job->next;
+
+	job->next = NULL;
+	job->input = input;
+	job->input_len = input_len;
+	job->output = output;
+	job->output_len = output_len;
+	job->tag = tag;
+
+	if (stream->tail)
+		stream->tail->next = job;
+	else
+		stream->head = job;
+	stream->tail = job;
+
+	stream->pending++;
+	farm->outstanding++;
+
+	if (!stream->scheduled) {
+		stream->scheduled = 1;
+		run_queue_push(farm, stream);
+		pthread_cond_signal(&farm->work);
+	}
+
+	pthread_mutex_unlock(&farm->lock);
+
+	return 0;
+}
+
+int sbc_farm_get_fd(sbc_farm_t *farm)
+{
+	if (!farm)
+		return -EINVAL;
+
+	return farm->notify[0];
+}
+
+int sbc_farm_poll(sbc_farm_t *farm, struct sbc_farm_completion *c,
+							unsigned int max)
+{
+	unsigned int n;
+
+	if (!farm || !c)
+		return -EINVAL;
+
+	pthread_mutex_lock(&farm->lock);
+
+	for (n = 0; n < max && farm->ring_count > 0; n++) {
+		c[n] = farm->ring[farm->ring_head];
+		farm->ring_head = (farm->ring_head + 1) % farm->max_jobs;
+		farm->ring_count--;
+	}
+
+	farm->outstanding -= n;
+
+	if (farm->ring_count == 0) {
+		char buf[16];
+
+		while (read(farm->notify[0], buf, sizeof(buf)) > 0)
+			;
+	}
+
+	pthread_mutex_unlock(&farm->lock);
+
+	return n;
+}
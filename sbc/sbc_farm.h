@@ -0,0 +1,88 @@
+/*
+ *
+ *  Bluetooth low-complexity, subband codec (SBC) library
+ *
+ *  Copyright (C) 2010  Nokia Corporation
+ *  Copyright (C) 2004-2010  Marcel Holtmann <marcel@holtmann.org>
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __SBC_FARM_H
+#define __SBC_FARM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "sbc.h"
+
+/*
+ * Encoder farm: encodes frames of many independent streams on a fixed
+ * pool of worker threads.  Jobs submitted to one stream are encoded one
+ * at a time and completed in submission order; jobs of different streams
+ * run in parallel.  While attached to a farm the sbc_t of a stream must
+ * only be touched by the farm.
+ */
+
+typedef struct sbc_farm sbc_farm_t;
+typedef struct sbc_farm_stream sbc_farm_stream_t;
+
+struct sbc_farm_completion {
+	sbc_farm_stream_t *stream;
+	void *tag;		/* as passed to sbc_farm_submit */
+	void *output;
+	ssize_t consumed;	/* input bytes encoded */
+	ssize_t written;	/* output bytes produced */
+	int err;		/* 0 or negative sbc_encode error */
+};
+
+/* Called from a worker thread, in submission order for every stream */
+typedef void (*sbc_farm_cb_t)(const struct sbc_farm_completion *c,
+							void *user_data);
+
+/* workers == 0 means one worker per online CPU; max_jobs bounds the
+ * number of submitted but not yet completed (or not yet reaped) jobs */
+sbc_farm_t *sbc_farm_new(unsigned int workers, unsigned int max_jobs);
+void sbc_farm_free(sbc_farm_t *farm);
+
+/* If cb is NULL completions are queued in the farm completion ring */
+sbc_farm_stream_t *sbc_farm_stream_new(sbc_farm_t *farm, sbc_t *sbc,
+					sbc_farm_cb_t cb, void *user_data);
+void sbc_farm_stream_free(sbc_farm_stream_t *stream);
+
+/* Encodes as many complete frames of input as fit into output.
+ * Returns 0 or -EAGAIN when max_jobs are already outstanding */
+int sbc_farm_submit(sbc_farm_stream_t *stream, const void *input,
+			size_t input_len, void *output, size_t output_len,
+			void *tag);
+
+/* Waits until every job submitted to stream has been completed */
+void sbc_farm_stream_flush(sbc_farm_stream_t *stream);
+
+/* Becomes readable while the completion ring is not empty */
+int sbc_farm_get_fd(sbc_farm_t *farm);
+
+/* Reaps up to max completions from the ring without blocking */
+int sbc_farm_poll(sbc_farm_t *farm, struct sbc_farm_completion *c,
+							unsigned int max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SBC_FARM_H */
@@ -208,6 +208,14 @@ static inline void sbc_analyze_4b_8s_simd(int16_t *x,
 	sbc_analyze_eight_simd(x + 0, out, analysis_consts_fixed8_simd_even);
 }
 
+static void sbc_analyze_1b_8s_simd(int16_t *x, int32_t *out, int odd)
+{
+	if (odd)
+		sbc_analyze_eight_simd(x, out, analysis_consts_fixed8_simd_odd);
+	else
+		sbc_analyze_eight_simd(x, out, analysis_consts_fixed8_simd_even);
+}
+
 static inline int16_t unaligned16_be(const uint8_t *ptr)
 {
 	return (int16_t) ((ptr[0] << 8) | ptr[1]);
@@ -343,6 +351,72 @@ static SBC_ALWAYS_INLINE int sbc_encoder_process_input_s8_internal(
 	return position;
 }
 
+/*
+ * mSBC frames are 15 blocks long, so every other frame begins with the
+ * second half of a two blocks group and the ones in between end with the
+ * first half of one. Those halves are stored exactly where the permutation
+ * above puts them, the X buffer thus always looks as if it was filled two
+ * blocks at a time.
+ */
+static SBC_ALWAYS_INLINE int sbc_encoder_process_input_msbc_internal(
+	int position,
+	const uint8_t *pcm, int16_t X[2][SBC_X_BUFFER_SIZE],
+	int big_endian)
+{
+	int nsamples = 15 * 8;
+	int16_t *x;
+
+	/* handle X buffer wraparound, keeping the half group if any */
+	if (position < nsamples) {
+		int half = position & 8;
+		int base = (SBC_X_BUFFER_SIZE - 72 - half) & ~15;
+
+		memcpy(&X[0][base], &X[0][position - half],
+					(72 + half) * sizeof(int16_t));
+		position = base + half;
+	}
+
+	#define PCM(i) (big_endian ? \
+		unaligned16_be(pcm + (i) * 2) : unaligned16_le(pcm + (i) * 2))
+
+	/* second half of a group started by the previous frame */
+	if (position & 8) {
+		position -= 8;
+		x = &X[0][position];
+		x[0]  = PCM(7);
+		x[2]  = PCM(6);
+		x[3]  = PCM(0);
+		x[4]  = PCM(5);
+		x[5]  = PCM(1);
+		x[6]  = PCM(4);
+		x[7]  = PCM(2);
+		x[8]  = PCM(3);
+		pcm += 16;
+		nsamples -= 8;
+	}
+
+	position = sbc_encoder_process_input_s8_internal(position, pcm, X,
+					nsamples & ~15, 1, big_endian);
+	pcm += (nsamples & ~15) * 2;
+
+	/* first half of a group completed by the next frame */
+	if (nsamples & 8) {
+		position -= 8;
+		x = &X[0][position];
+		x[-7] = PCM(7);
+		x[1]  = PCM(3);
+		x[2]  = PCM(6);
+		x[3]  = PCM(0);
+		x[4]  = PCM(5);
+		x[5]  = PCM(1);
+		x[6]  = PCM(4);
+		x[7]  = PCM(2);
+	}
+	#undef PCM
+
+	return position;
+}
+
 /*
  * Input data processing functions. The data is endian converted if needed,
  * channels are deintrleaved and audio samples are reordered for use in
@@ -403,6 +477,18 @@ static int sbc_enc_process_input_8s_be(int position,
 			position, pcm, X, nsamples, 1, 1);
 }
 
+static int sbc_enc_process_input_msbc_le(int position,
+		const uint8_t *pcm, int16_t X[2][SBC_X_BUFFER_SIZE])
+{
+	return sbc_encoder_process_input_msbc_internal(position, pcm, X, 0);
+}
+
+static int sbc_enc_process_input_msbc_be(int position,
+		const uint8_t *pcm, int16_t X[2][SBC_X_BUFFER_SIZE])
+{
+	return sbc_encoder_process_input_msbc_internal(position, pcm, X, 1);
+}
+
 /* Supplementary function to count the number of leading zeros */
 
 static inline int sbc_clz(uint32_t x)
@@ -523,12 +609,15 @@ void sbc_init_primitives(struct sbc_encoder_state *state)
 	/* Default implementation for analyze functions */
 	state->sbc_analyze_4b_4s = sbc_analyze_4b_4s_simd;
 	state->sbc_analyze_4b_8s = sbc_analyze_4b_8s_simd;
+	state->sbc_analyze_1b_8s = sbc_analyze_1b_8s_simd;
 
 	/* Default implementation for input reordering / deinterleaving */
 	state->sbc_enc_process_input_4s_le = sbc_enc_process_input_4s_le;
 	state->sbc_enc_process_input_4s_be = sbc_enc_process_input_4s_be;
 	state->sbc_enc_process_input_8s_le = sbc_enc_process_input_8s_le;
 	state->sbc_enc_process_input_8s_be = sbc_enc_process_input_8s_be;
+	state->sbc_enc_process_input_msbc_le = sbc_enc_process_input_msbc_le;
+	state->sbc_enc_process_input_msbc_be = sbc_enc_process_input_msbc_be;
 
 	/* Default implementation for scale factors calculation */
 	state->sbc_calc_scalefactors = sbc_calc_scalefactors;
@@ -35,69 +35,27 @@
 #include <string.h>
 #include <libgen.h>
 
-#if __BYTE_ORDER == __LITTLE_ENDIAN
-struct sbc_frame_hdr {
-	uint8_t syncword:8;		/* Sync word */
-	uint8_t subbands:1;		/* Subbands */
-	uint8_t allocation_method:1;	/* Allocation method */
-	uint8_t channel_mode:2;		/* Channel mode */
-	uint8_t blocks:2;		/* Blocks */
-	uint8_t sampling_frequency:2;	/* Sampling frequency */
-	uint8_t bitpool:8;		/* Bitpool */
-	uint8_t crc_check:8;		/* CRC check */
-} __attribute__ ((packed));
-#elif __BYTE_ORDER == __BIG_ENDIAN
-struct sbc_frame_hdr {
-	uint8_t syncword:8;		/* Sync word */
-	uint8_t sampling_frequency:2;	/* Sampling frequency */
-	uint8_t blocks:2;		/* Blocks */
-	uint8_t channel_mode:2;		/* Channel mode */
-	uint8_t allocation_method:1;	/* Allocation method */
-	uint8_t subbands:1;		/* Subbands */
-	uint8_t bitpool:8;		/* Bitpool */
-	uint8_t crc_check:8;		/* CRC check */
-} __attribute__ ((packed));
-#else
-#error "Unknown byte order"
-#endif
-
-static int calc_frame_len(struct sbc_frame_hdr *hdr)
-{
-	int tmp, nrof_subbands, nrof_blocks;
+#include "sbc.h"
 
-	nrof_subbands = (hdr->subbands + 1) * 4;
-	nrof_blocks = (hdr->blocks + 1) * 4;
+/* Frame headers parsed at once from the read buffer */
+#define PARSE_FRAMES 256
 
-	switch (hdr->channel_mode) {
-	case 0x00:
-		nrof_subbands /= 2;
-		tmp = nrof_blocks * hdr->bitpool;
-		break;
-	case 0x01:
-		tmp = nrof_blocks * hdr->bitpool * 2;
-		break;
-	case 0x02:
-		tmp = nrof_blocks * hdr->bitpool;
-		break;
-	case 0x03:
-		tmp = nrof_blocks * hdr->bitpool + nrof_subbands;
-		break;
-	default:
-		return 0;
-	}
+static int frame_subbands(struct sbc_frame_info *info)
+{
+	return info->subbands ? 8 : 4;
+}
 
-	return (nrof_subbands + ((tmp + 7) / 8));
+static int frame_blocks(struct sbc_frame_info *info)
+{
+	/* mSBC frames have 15 blocks, signalled as 16 */
+	return info->msbc ? 15 : (info->blocks + 1) * 4;
 }
 
-static double calc_bit_rate(struct sbc_frame_hdr *hdr)
+static double calc_bit_rate(struct sbc_frame_info *info)
 {
-	int nrof_subbands, nrof_blocks;
 	double f;
 
-	nrof_subbands = (hdr->subbands + 1) * 4;
-	nrof_blocks = (hdr->blocks + 1) * 4;
-
-	switch (hdr->sampling_frequency) {
+	switch (info->frequency) {
 	case 0:
 		f = 16;
 		break;
@@ -114,8 +72,8 @@ static double calc_bit_rate(struct sbc_frame_hdr *hdr)
 		return 0;
 	}
 
-	return ((8 * (calc_frame_len(hdr) + 4) * f) /
-			(nrof_subbands * nrof_blocks));
+	return ((8 * info->length * f) /
+			(frame_subbands(info) * frame_blocks(info)));
 }
 
 static char *freq2str(uint8_t freq)
@@ -150,34 +108,29 @@ static char *mode2str(uint8_t mode)
 	}
 }
 
-static ssize_t __read(int fd, void *buf, size_t count)
-{
-	ssize_t len, pos = 0;
+#define SIZE 32
 
-	while (count > 0) {
-		len = read(fd, buf + pos, count);
-		if (len <= 0)
-			return len;
+static void add_value(int *values, int value)
+{
+	int n;
 
-		count -= len;
-		pos   += len;
+	for (n = 0; n < SIZE; n++) {
+		if (values[n] == 0 || values[n] == value) {
+			values[n] = value;
+			break;
+		}
 	}
-
-	return pos;
 }
 
-#define SIZE 32
-
 static int analyze_file(char *filename)
 {
-	struct sbc_frame_hdr hdr;
-	unsigned char buf[64];
-	double rate;
+	struct sbc_frame_info info[PARSE_FRAMES], first;
+	static unsigned char buf[65536];
+	double rate = 0;
 	int bitpool[SIZE], frame_len[SIZE];
-	int subbands, blocks, freq, mode, method;
-	int n, p1, p2, fd, size, num;
+	int n, i, fd, num = 0;
+	size_t used = 0, pos, consumed;
 	ssize_t len;
-	unsigned int count;
 
 	if (strcmp(filename, "-")) {
 		printf("Filename\t\t%s\n", basename(filename));
@@ -190,99 +143,79 @@ static int analyze_file(char *filename)
 	} else
 		fd = fileno(stdin);
 
-	len = __read(fd, &hdr, sizeof(hdr));
-	if (len != sizeof(hdr) || hdr.syncword != 0x9c) {
-		fprintf(stderr, "Not a SBC audio file\n");
-		return -1;
-	}
-
-	subbands = (hdr.subbands + 1) * 4;
-	blocks = (hdr.blocks + 1) * 4;
-	freq = hdr.sampling_frequency;
-	mode = hdr.channel_mode;
-	method = hdr.allocation_method;
-
-	count = calc_frame_len(&hdr);
-
-	bitpool[0] = hdr.bitpool;
-	frame_len[0] = count + 4;
-
-	for (n = 1; n < SIZE; n++) {
-		bitpool[n] = 0;
-		frame_len[n] = 0;
-	}
-
-	if (lseek(fd, 0, SEEK_SET) < 0) {
-		num = 1;
-		rate = calc_bit_rate(&hdr);
-		while (count) {
-			size = count > sizeof(buf) ? sizeof(buf) : count;
-			len = __read(fd, buf, size);
-			if (len < 0)
-				break;
-			count -= len;
-		}
-	} else {
-		num = 0;
-		rate = 0;
-	}
+	memset(bitpool, 0, sizeof(bitpool));
+	memset(frame_len, 0, sizeof(frame_len));
 
+	/* Frames are only located through their headers, whole buffers
+	 * of them at a time */
 	while (1) {
-		len = __read(fd, &hdr, sizeof(hdr));
+		len = read(fd, buf + used, sizeof(buf) - used);
 		if (len < 0) {
-			fprintf(stderr, "Unable to read frame header"
-					" (error %d)\n", errno);
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "Unable to read frame data "
+						"(error %d)\n", errno);
 			break;
 		}
 
-		if (len == 0)
-			break;
+		used += len;
+		pos = 0;
+
+		while (pos < used) {
+			n = sbc_parse_frames(buf + pos, used - pos, info,
+						PARSE_FRAMES, 0, &consumed);
+			if (n < 0) {
+				if (num == 0) {
+					fprintf(stderr,
+						"Not a SBC audio file\n");
+					goto failed;
+				}
+
+				fprintf(stderr, "Corrupted SBC stream "
+						"(len %zu syncword 0x%02x)\n",
+						used - pos, buf[pos]);
+				goto done;
+			}
 
-		if ((size_t) len < sizeof(hdr) || hdr.syncword != 0x9c) {
-			fprintf(stderr, "Corrupted SBC stream "
-					"(len %zd syncword 0x%02x)\n",
-					len, hdr.syncword);
-			break;
-		}
+			if (n == 0)
+				break;
 
-		count = calc_frame_len(&hdr);
-		len = count + 4;
+			if (num == 0)
+				first = info[0];
 
-		p1 = -1;
-		p2 = -1;
-		for (n = 0; n < SIZE; n++) {
-			if (p1 < 0 && (bitpool[n] == 0 || bitpool[n] == hdr.bitpool))
-				p1 = n;
-			if (p2 < 0 && (frame_len[n] == 0 || frame_len[n] == len))
-				p2 = n;
+			for (i = 0; i < n; i++) {
+				add_value(bitpool, info[i].bitpool);
+				add_value(frame_len, info[i].length);
+				rate += calc_bit_rate(&info[i]);
+			}
+
+			num += n;
+			pos += consumed;
 		}
-		if (p1 >= 0)
-			bitpool[p1] = hdr.bitpool;
-		if (p2 >= 0)
-			frame_len[p2] = len;
 
-		while (count) {
-			size = count > sizeof(buf) ? sizeof(buf) : count;
+		memmove(buf, buf + pos, used - pos);
+		used -= pos;
 
-			len = __read(fd, buf, size);
-			if (len != size) {
-				fprintf(stderr, "Unable to read frame data "
-						"(error %d)\n", errno);
-				break;
-			}
+		if (len == 0)
+			break;
+	}
 
-			count -= len;
-		}
+	if (used > 0)
+		fprintf(stderr, "Unable to read frame data "
+					"(%zu bytes left)\n", used);
 
-		rate += calc_bit_rate(&hdr);
-		num++;
+done:
+	if (num == 0) {
+		fprintf(stderr, "Not a SBC audio file\n");
+		goto failed;
 	}
 
-	printf("Subbands\t\t%d\n", subbands);
-	printf("Block length\t\t%d\n", blocks);
-	printf("Sampling frequency\t%s\n", freq2str(freq));
-	printf("Channel mode\t\t%s\n", mode2str(hdr.channel_mode));
-	printf("Allocation method\t%s\n", method ? "SNR" : "Loudness");
+	printf("Subbands\t\t%d\n", frame_subbands(&first));
+	printf("Block length\t\t%d\n", frame_blocks(&first));
+	printf("Sampling frequency\t%s\n", freq2str(first.frequency));
+	printf("Channel mode\t\t%s\n", mode2str(first.mode));
+	printf("Allocation method\t%s\n",
+					first.allocation ? "SNR" : "Loudness");
 	printf("Bitpool\t\t\t%d", bitpool[0]);
 	for (n = 1; n < SIZE; n++)
 		if (bitpool[n] > 0)
@@ -294,8 +227,7 @@ static int analyze_file(char *filename)
 		if (frame_len[n] > 0)
 			printf(", %d", frame_len[n]);
 	printf(" Bytes\n");
-	if (num > 0)
-		printf("Bit rate\t\t%.3f kbps\n", rate / num);
+	printf("Bit rate\t\t%.3f kbps\n", rate / num);
 
 	if (fd > fileno(stderr))
 		close(fd);
@@ -303,6 +235,12 @@ static int analyze_file(char *filename)
 	printf("\n");
 
 	return 0;
+
+failed:
+	if (fd > fileno(stderr))
+		close(fd);
+
+	return -1;
 }
 
 int main(int argc, char *argv[])
@@ -25,6 +25,7 @@
 #include <config.h>
 #endif
 
+#define _GNU_SOURCE
 #include <ctype.h>
 #include <dirent.h>
 #include <errno.h>
@@ -53,6 +54,7 @@
 
 #include "../src/dbus-common.h"
 #include "../src/adapter.h"
+#include "../src/registry.h"
 
 #include "log.h"
 #include "textfile.h"
@@ -65,7 +67,7 @@
 
 #define SERIAL_PROXY_INTERFACE	"org.bluez.SerialProxy"
 #define SERIAL_MANAGER_INTERFACE "org.bluez.SerialProxyManager"
-#define BUF_SIZE		1024
+#define FORWARD_BUF_SIZE	16384
 
 typedef enum {
 	TTY_PROXY,
@@ -97,14 +99,44 @@ struct serial_proxy {
 	GIOChannel	*io;		/* Server listen */
 	GIOChannel	*rfcomm;	/* Remote RFCOMM channel*/
 	GIOChannel	*local;		/* Local channel: TTY or Unix socket */
+	struct forward	*rx;		/* RFCOMM to local forwarding */
+	struct forward	*tx;		/* Local to RFCOMM forwarding */
 	struct serial_adapter *adapter;	/* Adapter pointer */
 };
 
-static GSList *adapters = NULL;
+/* One direction of the proxy. Data is moved with splice() through a pipe
+ * when both ends support it, otherwise through a bounded ring buffer.
+ * While data is pending for the destination the source is not read. */
+struct forward {
+	struct serial_proxy *prx;
+	GIOChannel	*src;
+	GIOChannel	*dst;
+	guint		src_watch;
+	guint		dst_watch;
+	int		pipefd[2];	/* splice() pipe, -1 when not used */
+	gboolean	eof;		/* Source has been closed */
+	size_t		head;		/* Ring buffer read offset */
+	size_t		pending;	/* Bytes waiting for destination */
+	char		buf[FORWARD_BUF_SIZE];
+};
+
+static struct btd_registry *adapters = NULL;	/* By adapter path */
 static int sk_counter = 0;
 
-static void disable_proxy(struct serial_proxy *prx)
+static void forward_free(struct forward *fwd);
+
+static void proxy_disconnect(struct serial_proxy *prx)
 {
+	if (prx->rx) {
+		forward_free(prx->rx);
+		prx->rx = NULL;
+	}
+
+	if (prx->tx) {
+		forward_free(prx->tx);
+		prx->tx = NULL;
+	}
+
 	if (prx->rfcomm) {
 		g_io_channel_shutdown(prx->rfcomm, TRUE, NULL);
 		g_io_channel_unref(prx->rfcomm);
@@ -116,6 +148,11 @@ static void disable_proxy(struct serial_proxy *prx)
 		g_io_channel_unref(prx->local);
 		prx->local = NULL;
 	}
+}
+
+static void disable_proxy(struct serial_proxy *prx)
+{
+	proxy_disconnect(prx);
 
 	remove_record_from_server(prx->record_id);
 	prx->record_id = 0;
@@ -222,74 +259,275 @@ static sdp_record_t *proxy_record_new(const char *uuid128, uint8_t channel)
 	return record;
 }
 
-static GIOError channel_write(GIOChannel *chan, char *buf, size_t size)
+static void forward_close_pipe(struct forward *fwd)
 {
-	GIOError err = G_IO_ERROR_NONE;
-	gsize wbytes, written;
+	if (fwd->pipefd[0] < 0)
+		return;
 
-	wbytes = written = 0;
-	while (wbytes < size) {
-		err = g_io_channel_write(chan,
-				buf + wbytes,
-				size - wbytes,
-				&written);
+	close(fwd->pipefd[0]);
+	close(fwd->pipefd[1]);
+	fwd->pipefd[0] = fwd->pipefd[1] = -1;
+}
 
-		if (err != G_IO_ERROR_NONE)
-			return err;
+/* Switch a direction from splice() to the ring buffer, moving whatever
+ * is still sitting in the pipe into the buffer */
+static int forward_fallback(struct forward *fwd)
+{
+	size_t len = 0;
+
+	DBG("splice not supported, falling back to buffered forwarding");
 
-		wbytes += written;
+	while (len < fwd->pending) {
+		ssize_t n;
+
+		n = read(fwd->pipefd[0], fwd->buf + len, fwd->pending - len);
+		if (n <= 0) {
+			if (n < 0 && errno == EINTR)
+				continue;
+			forward_close_pipe(fwd);
+			return -EIO;
+		}
+
+		len += n;
 	}
 
-	return err;
+	fwd->head = 0;
+	forward_close_pipe(fwd);
+
+	return 0;
 }
 
-static gboolean forward_data(GIOChannel *chan, GIOCondition cond, gpointer data)
+/* Returns the number of bytes read, 0 on end of file or a negative
+ * error, -EAGAIN meaning that nothing is available right now */
+static ssize_t forward_fill(struct forward *fwd)
 {
-	char buf[BUF_SIZE];
-	struct serial_proxy *prx = data;
-	GIOChannel *dest;
-	GIOError err;
-	size_t rbytes;
+	int fd = g_io_channel_unix_get_fd(fwd->src);
+	size_t space = sizeof(fwd->buf) - fwd->pending;
+	size_t tail;
+	ssize_t n;
 
-	if (cond & G_IO_NVAL)
-		return FALSE;
+	if (space == 0)
+		return -ENOBUFS;
 
-	dest = (chan == prx->rfcomm) ? prx->local : prx->rfcomm;
+	if (fwd->pipefd[1] >= 0) {
+		n = splice(fd, NULL, fwd->pipefd[1], NULL, space,
+					SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (n >= 0)
+			goto done;
 
-	if (cond & (G_IO_HUP | G_IO_ERR)) {
-		/* Try forward remaining data */
-		do {
-			rbytes = 0;
-			err = g_io_channel_read(chan, buf, sizeof(buf), &rbytes);
-			if (err != G_IO_ERROR_NONE || rbytes == 0)
-				break;
+		if (errno != EINVAL && errno != ENOSYS)
+			return -errno;
 
-			err = channel_write(dest, buf, rbytes);
-		} while (err == G_IO_ERROR_NONE);
+		if (forward_fallback(fwd) < 0)
+			return -EIO;
+	}
 
-		g_io_channel_shutdown(prx->local, TRUE, NULL);
-		g_io_channel_unref(prx->local);
-		prx->local = NULL;
+	tail = (fwd->head + fwd->pending) % sizeof(fwd->buf);
+	if (space > sizeof(fwd->buf) - tail)
+		space = sizeof(fwd->buf) - tail;
 
-		g_io_channel_shutdown(prx->rfcomm, TRUE, NULL);
-		g_io_channel_unref(prx->rfcomm);
-		prx->rfcomm = NULL;
+	n = read(fd, fwd->buf + tail, space);
+	if (n < 0)
+		return -errno;
 
-		return FALSE;
+done:
+	fwd->pending += n;
+
+	return n;
+}
+
+/* Returns 0 once everything pending was written, -EAGAIN if the
+ * destination can't take more data right now or a negative error */
+static int forward_flush(struct forward *fwd)
+{
+	int fd = g_io_channel_unix_get_fd(fwd->dst);
+
+	while (fwd->pending > 0) {
+		size_t len;
+		ssize_t n;
+
+		if (fwd->pipefd[0] >= 0) {
+			n = splice(fwd->pipefd[0], NULL, fd, NULL, fwd->pending,
+					SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			if (n < 0 && (errno == EINVAL || errno == ENOSYS)) {
+				if (forward_fallback(fwd) < 0)
+					return -EIO;
+				continue;
+			}
+		} else {
+			len = MIN(fwd->pending, sizeof(fwd->buf) - fwd->head);
+			n = write(fd, fwd->buf + fwd->head, len);
+		}
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		fwd->pending -= n;
+
+		if (fwd->pipefd[0] < 0)
+			fwd->head = (fwd->head + n) % sizeof(fwd->buf);
 	}
 
-	rbytes = 0;
-	err = g_io_channel_read(chan, buf, sizeof(buf), &rbytes);
-	if (err != G_IO_ERROR_NONE)
+	fwd->head = 0;
+
+	return 0;
+}
+
+static gboolean forward_src_cb(GIOChannel *chan, GIOCondition cond,
+							gpointer data);
+static gboolean forward_dst_cb(GIOChannel *chan, GIOCondition cond,
+							gpointer data);
+
+static void forward_watch_src(struct forward *fwd)
+{
+	if (fwd->src_watch || fwd->eof)
+		return;
+
+	fwd->src_watch = g_io_add_watch(fwd->src,
+				G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
+				forward_src_cb, fwd);
+}
+
+static void forward_watch_dst(struct forward *fwd)
+{
+	if (fwd->dst_watch)
+		return;
+
+	fwd->dst_watch = g_io_add_watch(fwd->dst,
+				G_IO_OUT | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
+				forward_dst_cb, fwd);
+}
+
+/* Push pending data out and decide which side to watch next: the
+ * destination while data is pending, the source otherwise. Returns
+ * FALSE if the proxy connection has to be torn down. */
+static gboolean forward_pump(struct forward *fwd)
+{
+	int err;
+
+	err = forward_flush(fwd);
+	if (err < 0 && err != -EAGAIN) {
+		error("Serial proxy write failed: %s (%d)",
+						strerror(-err), -err);
 		return FALSE;
+	}
+
+	if (fwd->pending > 0) {
+		if (fwd->src_watch) {
+			g_source_remove(fwd->src_watch);
+			fwd->src_watch = 0;
+		}
+		forward_watch_dst(fwd);
+		return TRUE;
+	}
+
+	if (fwd->dst_watch) {
+		g_source_remove(fwd->dst_watch);
+		fwd->dst_watch = 0;
+	}
 
-	err = channel_write(dest, buf, rbytes);
-	if (err != G_IO_ERROR_NONE)
+	if (fwd->eof)
 		return FALSE;
 
+	forward_watch_src(fwd);
+
 	return TRUE;
 }
 
+static gboolean forward_src_cb(GIOChannel *chan, GIOCondition cond,
+							gpointer data)
+{
+	struct forward *fwd = data;
+	ssize_t n;
+
+	if (cond & G_IO_NVAL)
+		return FALSE;
+
+	if (cond & G_IO_ERR)
+		goto disconnect;
+
+	/* On hang up keep reading until the remaining data is consumed */
+	n = forward_fill(fwd);
+	if (n == 0)
+		fwd->eof = TRUE;
+	else if (n < 0 && n != -EAGAIN) {
+		error("Serial proxy read failed: %s (%d)",
+						strerror(-n), -n);
+		goto disconnect;
+	}
+
+	if (!forward_pump(fwd))
+		goto disconnect;
+
+	return fwd->src_watch ? TRUE : FALSE;
+
+disconnect:
+	proxy_disconnect(fwd->prx);
+	return FALSE;
+}
+
+static gboolean forward_dst_cb(GIOChannel *chan, GIOCondition cond,
+							gpointer data)
+{
+	struct forward *fwd = data;
+
+	if (cond & G_IO_NVAL)
+		return FALSE;
+
+	if (cond & (G_IO_HUP | G_IO_ERR))
+		goto disconnect;
+
+	if (!forward_pump(fwd))
+		goto disconnect;
+
+	return fwd->dst_watch ? TRUE : FALSE;
+
+disconnect:
+	proxy_disconnect(fwd->prx);
+	return FALSE;
+}
+
+static struct forward *forward_new(struct serial_proxy *prx,
+					GIOChannel *src, GIOChannel *dst)
+{
+	struct forward *fwd;
+
+	fwd = g_new0(struct forward, 1);
+	fwd->prx = prx;
+	fwd->src = src;
+	fwd->dst = dst;
+
+	g_io_channel_set_flags(src, G_IO_FLAG_NONBLOCK, NULL);
+	g_io_channel_set_flags(dst, G_IO_FLAG_NONBLOCK, NULL);
+
+	if (pipe(fwd->pipefd) < 0)
+		fwd->pipefd[0] = fwd->pipefd[1] = -1;
+	else {
+		fcntl(fwd->pipefd[0], F_SETFL, O_NONBLOCK);
+		fcntl(fwd->pipefd[1], F_SETFL, O_NONBLOCK);
+	}
+
+	forward_watch_src(fwd);
+
+	return fwd;
+}
+
+static void forward_free(struct forward *fwd)
+{
+	if (fwd->src_watch)
+		g_source_remove(fwd->src_watch);
+
+	if (fwd->dst_watch)
+		g_source_remove(fwd->dst_watch);
+
+	forward_close_pipe(fwd);
+
+	g_free(fwd);
+}
+
 static inline int unix_socket_connect(const char *address)
 {
 	struct sockaddr_un addr;
@@ -423,13 +661,8 @@ static void connect_event_cb(GIOChannel *chan, GError *conn_err, gpointer data)
 
 	prx->local = g_io_channel_unix_new(sk);
 
-	g_io_add_watch(prx->rfcomm,
-			G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
-			forward_data, prx);
-
-	g_io_add_watch(prx->local,
-			G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
-			forward_data, prx);
+	prx->rx = forward_new(prx, prx->rfcomm, prx->local);
+	prx->tx = forward_new(prx, prx->local, prx->rfcomm);
 
 	return;
 
@@ -1154,7 +1387,12 @@ static void manager_path_unregister(void *data)
 	if (adapter->conn)
 		dbus_connection_unref(adapter->conn);
 
-	adapters = g_slist_remove(adapters, adapter);
+	btd_registry_remove(adapters, adapter);
+	if (btd_registry_size(adapters) == 0) {
+		btd_registry_free(adapters);
+		adapters = NULL;
+	}
+
 	g_slist_free(adapter->proxies);
 	btd_adapter_unref(adapter->btd_adapter);
 	g_free(adapter);
@@ -1173,19 +1411,9 @@ static GDBusSignalTable manager_signals[] = {
 	{ }
 };
 
-static struct serial_adapter *find_adapter(GSList *list,
-					struct btd_adapter *btd_adapter)
+static struct serial_adapter *find_adapter(struct btd_adapter *btd_adapter)
 {
-	GSList *l;
-
-	for (l = list; l; l = l->next) {
-		struct serial_adapter *adapter = l->data;
-
-		if (adapter->btd_adapter == btd_adapter)
-			return adapter;
-	}
-
-	return NULL;
+	return btd_registry_find_path(adapters, adapter_get_path(btd_adapter));
 }
 
 static void serial_proxy_init(struct serial_adapter *adapter)
@@ -1264,7 +1492,7 @@ int proxy_register(DBusConnection *conn, struct btd_adapter *btd_adapter)
 	struct serial_adapter *adapter;
 	const char *path;
 
-	adapter = find_adapter(adapters, btd_adapter);
+	adapter = find_adapter(btd_adapter);
 	if (adapter)
 		return -EINVAL;
 
@@ -1283,7 +1511,10 @@ int proxy_register(DBusConnection *conn, struct btd_adapter *btd_adapter)
 		return -1;
 	}
 
-	adapters = g_slist_append(adapters, adapter);
+	if (!adapters)
+		adapters = btd_registry_new();
+
+	btd_registry_add(adapters, NULL, NULL, path, adapter);
 
 	DBG("Registered interface %s on path %s",
 		SERIAL_MANAGER_INTERFACE, path);
@@ -1297,7 +1528,7 @@ void proxy_unregister(struct btd_adapter *btd_adapter)
 {
 	struct serial_adapter *adapter;
 
-	adapter = find_adapter(adapters, btd_adapter);
+	adapter = find_adapter(btd_adapter);
 	if (!adapter)
 		return;
 
@@ -57,6 +57,7 @@
 #include "glib-helper.h"
 #include "agent.h"
 #include "storage.h"
+#include "registry.h"
 
 #define IO_CAPABILITY_DISPLAYONLY	0x00
 #define IO_CAPABILITY_DISPLAYYESNO	0x01
@@ -114,10 +115,14 @@ struct btd_adapter {
 	guint auth_idle_id;		/* Ongoing authorization */
 	GSList *connections;		/* Connected devices */
 	GSList *devices;		/* Devices structure pointers */
+	struct btd_registry *registry;	/* Devices by address and path */
 	GSList *mode_sessions;		/* Request Mode sessions */
 	GSList *disc_sessions;		/* Discovery sessions */
 	guint scheduler_id;		/* Scheduler handle */
 	sdp_list_t *services;		/* Services associated to adapter */
+	struct sdp_uuid_set *uuids;	/* Service class UUIDs in use */
+	uint8_t eir[240];		/* EIR data last written */
+	gboolean eir_valid;
 
 	struct hci_dev dev;		/* hci info */
 	int8_t tx_power;		/* inq response tx power level */
@@ -220,19 +225,29 @@ static void update_ext_inquiry_response(struct btd_adapter *adapter)
 
 	memset(data, 0, sizeof(data));
 
-	dd = hci_open_dev(adapter->dev_id);
-	if (dd < 0)
-		return;
-
 	if (dev->ssp_mode > 0)
 		create_ext_inquiry_response((char *) dev->name,
 						adapter->tx_power,
-						adapter->services, data);
+						adapter->uuids, data);
+
+	/* Nothing to do if the controller already has the same data */
+	if (adapter->eir_valid && memcmp(adapter->eir, data,
+							sizeof(data)) == 0)
+		return;
+
+	dd = hci_open_dev(adapter->dev_id);
+	if (dd < 0)
+		return;
 
 	if (hci_write_ext_inquiry_response(dd, fec, data,
-						HCI_REQ_TIMEOUT) < 0)
+						HCI_REQ_TIMEOUT) < 0) {
 		error("Can't write extended inquiry response: %s (%d)",
 						strerror(errno), errno);
+		adapter->eir_valid = FALSE;
+	} else {
+		memcpy(adapter->eir, data, sizeof(data));
+		adapter->eir_valid = TRUE;
+	}
 
 	hci_close_dev(dd);
 }
@@ -1032,20 +1047,26 @@ done:
 struct btd_device *adapter_find_device(struct btd_adapter *adapter,
 							const char *dest)
 {
-	struct btd_device *device;
-	GSList *l;
+	bdaddr_t dst;
 
-	if (!adapter)
+	if (!adapter || bachk(dest) < 0)
 		return NULL;
 
-	l = g_slist_find_custom(adapter->devices, dest,
-					(GCompareFunc) device_address_cmp);
-	if (!l)
-		return NULL;
+	str2ba(dest, &dst);
 
-	device = l->data;
+	return btd_registry_find(adapter->registry, NULL, &dst);
+}
 
-	return device;
+static void adapter_insert_device(struct btd_adapter *adapter,
+						struct btd_device *device)
+{
+	bdaddr_t dst;
+
+	device_get_address(device, &dst);
+
+	adapter->devices = g_slist_append(adapter->devices, device);
+	btd_registry_add(adapter->registry, NULL, &dst,
+					device_get_path(device), device);
 }
 
 struct btd_device *adapter_find_connection(struct btd_adapter *adapter,
@@ -1126,13 +1147,16 @@ static void adapter_service_ins_rem(const bdaddr_t *bdaddr, void *rec,
 	for (; adapters; adapters = adapters->next) {
 		adapter = adapters->data;
 
-		if (insert == TRUE)
+		if (insert == TRUE) {
 			adapter->services = sdp_list_insert_sorted(
 							adapter->services, rec,
 							record_sort);
-		else
+			sdp_uuid_set_add(adapter->uuids, rec);
+		} else {
 			adapter->services = sdp_list_remove(adapter->services,
 									rec);
+			sdp_uuid_set_remove(adapter->uuids, rec);
+		}
 
 		adapter_emit_uuids_updated(adapter);
 	}
@@ -1155,6 +1179,11 @@ sdp_list_t *adapter_get_services(struct btd_adapter *adapter)
 	return adapter->services;
 }
 
+struct sdp_uuid_set *adapter_get_uuid_set(struct btd_adapter *adapter)
+{
+	return adapter->uuids;
+}
+
 struct btd_device *adapter_create_device(DBusConnection *conn,
 						struct btd_adapter *adapter,
 						const char *address)
@@ -1170,7 +1199,7 @@ struct btd_device *adapter_create_device(DBusConnection *conn,
 
 	device_set_temporary(device, TRUE);
 
-	adapter->devices = g_slist_append(adapter->devices, device);
+	adapter_insert_device(adapter, device);
 
 	path = device_get_path(device);
 	g_dbus_emit_signal(conn, adapter->path,
@@ -1191,6 +1220,7 @@ void adapter_remove_device(DBusConnection *conn, struct btd_adapter *adapter,
 	struct agent *agent;
 
 	adapter->devices = g_slist_remove(adapter->devices, device);
+	btd_registry_remove(adapter->registry, device);
 	adapter->connections = g_slist_remove(adapter->connections, device);
 
 	adapter_update_devices(adapter);
@@ -1697,32 +1727,22 @@ static DBusMessage *create_paired_device(DBusConnection *conn,
 	return device_create_bonding(device, conn, msg, agent_path, cap);
 }
 
-static gint device_path_cmp(struct btd_device *device, const gchar *path)
-{
-	const gchar *dev_path = device_get_path(device);
-
-	return strcasecmp(dev_path, path);
-}
-
 static DBusMessage *remove_device(DBusConnection *conn, DBusMessage *msg,
 								void *data)
 {
 	struct btd_adapter *adapter = data;
 	struct btd_device *device;
 	const char *path;
-	GSList *l;
 
 	if (dbus_message_get_args(msg, NULL, DBUS_TYPE_OBJECT_PATH, &path,
 						DBUS_TYPE_INVALID) == FALSE)
 		return invalid_args(msg);
 
-	l = g_slist_find_custom(adapter->devices,
-			path, (GCompareFunc) device_path_cmp);
-	if (!l)
+	device = btd_registry_find_path(adapter->registry, path);
+	if (!device)
 		return g_dbus_create_error(msg,
 				ERROR_INTERFACE ".DoesNotExist",
 				"Device does not exist");
-	device = l->data;
 
 	if (device_is_temporary(device) || device_is_busy(device))
 		return g_dbus_create_error(msg,
@@ -1747,22 +1767,18 @@ static DBusMessage *find_device(DBusConnection *conn, DBusMessage *msg,
 	struct btd_device *device;
 	DBusMessage *reply;
 	const gchar *address;
-	GSList *l;
 	const gchar *dev_path;
 
 	if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &address,
 						DBUS_TYPE_INVALID))
 		return invalid_args(msg);
 
-	l = g_slist_find_custom(adapter->devices,
-			address, (GCompareFunc) device_address_cmp);
-	if (!l)
+	device = adapter_find_device(adapter, address);
+	if (!device)
 		return g_dbus_create_error(msg,
 				ERROR_INTERFACE ".DoesNotExist",
 				"Device does not exist");
 
-	device = l->data;
-
 	reply = dbus_message_new_method_return(msg);
 	if (!reply)
 		return NULL;
@@ -2029,8 +2045,7 @@ static void create_stored_device_from_profiles(char *key, char *value,
 	GSList *uuids = bt_string2list(value);
 	struct btd_device *device;
 
-	if (g_slist_find_custom(adapter->devices,
-				key, (GCompareFunc) device_address_cmp))
+	if (adapter_find_device(adapter, key))
 		return;
 
 	device = device_create(connection, adapter, key);
@@ -2038,7 +2053,7 @@ static void create_stored_device_from_profiles(char *key, char *value,
 		return;
 
 	device_set_temporary(device, FALSE);
-	adapter->devices = g_slist_append(adapter->devices, device);
+	adapter_insert_device(adapter, device);
 
 	device_probe_drivers(device, uuids);
 
@@ -2052,14 +2067,13 @@ static void create_stored_device_from_linkkeys(char *key, char *value,
 	struct btd_adapter *adapter = user_data;
 	struct btd_device *device;
 
-	if (g_slist_find_custom(adapter->devices, key,
-					(GCompareFunc) device_address_cmp))
+	if (adapter_find_device(adapter, key))
 		return;
 
 	device = device_create(connection, adapter, key);
 	if (device) {
 		device_set_temporary(device, FALSE);
-		adapter->devices = g_slist_append(adapter->devices, device);
+		adapter_insert_device(adapter, device);
 	}
 }
 
@@ -2069,14 +2083,13 @@ static void create_stored_device_from_blocked(char *key, char *value,
 	struct btd_adapter *adapter = user_data;
 	struct btd_device *device;
 
-	if (g_slist_find_custom(adapter->devices,
-				key, (GCompareFunc) device_address_cmp))
+	if (adapter_find_device(adapter, key))
 		return;
 
 	device = device_create(connection, adapter, key);
 	if (device) {
 		device_set_temporary(device, FALSE);
-		adapter->devices = g_slist_append(adapter->devices, device);
+		adapter_insert_device(adapter, device);
 	}
 }
 
@@ -2134,6 +2147,9 @@ static void load_drivers(struct btd_adapter *adapter)
 {
 	GSList *l;
 
+	/* One class of device and EIR update for all driver records */
+	sdp_record_batch_begin();
+
 	for (l = adapter_drivers; l; l = l->next) {
 		struct btd_adapter_driver *driver = l->data;
 
@@ -2142,6 +2158,8 @@ static void load_drivers(struct btd_adapter *adapter)
 
 		probe_driver(adapter, driver);
 	}
+
+	sdp_record_batch_commit();
 }
 
 static void load_connections(struct btd_adapter *adapter)
@@ -2517,6 +2535,7 @@ int adapter_stop(struct btd_adapter *adapter)
 				"Powered", DBUS_TYPE_BOOLEAN, &powered);
 
 	adapter->up = 0;
+	adapter->eir_valid = FALSE;
 	adapter->scan_mode = SCAN_DISABLED;
 	adapter->mode = MODE_OFF;
 	adapter->state = DISCOVER_TYPE_NONE;
@@ -2566,6 +2585,9 @@ static void adapter_free(gpointer user_data)
 	if (adapter->auth_idle_id)
 		g_source_remove(adapter->auth_idle_id);
 
+	btd_registry_free(adapter->registry);
+	sdp_uuid_set_free(adapter->uuids);
+
 	g_free(adapter->path);
 	g_free(adapter);
 }
@@ -2616,6 +2638,8 @@ struct btd_adapter *adapter_create(DBusConnection *conn, int id,
 	}
 
 	adapter->dev_id = id;
+	adapter->registry = btd_registry_new();
+	adapter->uuids = sdp_uuid_set_new();
 	if (main_opts.name_resolv)
 		adapter->state |= RESOLVE_NAME;
 	adapter->path = g_strdup(path);
@@ -2644,6 +2668,9 @@ void adapter_remove(struct btd_adapter *adapter)
 		device_remove(l->data, FALSE);
 	g_slist_free(adapter->devices);
 
+	btd_registry_free(adapter->registry);
+	adapter->registry = NULL;
+
 	if (adapter->initialized)
 		unload_drivers(adapter);
 
@@ -3213,7 +3240,10 @@ int btd_register_adapter_driver(struct btd_adapter_driver *driver)
 		return 0;
 
 	adapters = manager_get_adapters();
+
+	sdp_record_batch_begin();
 	g_slist_foreach(adapters, probe_driver, driver);
+	sdp_record_batch_commit();
 
 	return 0;
 }
@@ -58,6 +58,7 @@ struct set_opts {
 	uint16_t omtu;
 	int master;
 	uint8_t mode;
+	uint16_t voice;
 };
 
 struct connect {
@@ -595,11 +596,22 @@ static int sco_connect(int sock, const bdaddr_t *dst)
 	return 0;
 }
 
-static gboolean sco_set(int sock, uint16_t mtu, GError **err)
+static gboolean sco_set(int sock, uint16_t mtu, uint16_t voice, GError **err)
 {
 	struct sco_options sco_opt;
+	struct bt_voice bt_voice;
 	socklen_t len;
 
+	if (voice) {
+		memset(&bt_voice, 0, sizeof(bt_voice));
+		bt_voice.setting = voice;
+		if (setsockopt(sock, SOL_BLUETOOTH, BT_VOICE, &bt_voice,
+							sizeof(bt_voice)) < 0) {
+			ERROR_FAILED(err, "setsockopt(BT_VOICE)", errno);
+			return FALSE;
+		}
+	}
+
 	if (!mtu)
 		return TRUE;
 
@@ -685,6 +697,9 @@ static gboolean parse_set_opts(struct set_opts *opts, GError **err,
 		case BT_IO_OPT_MODE:
 			opts->mode = va_arg(args, int);
 			break;
+		case BT_IO_OPT_VOICE:
+			opts->voice = va_arg(args, int);
+			break;
 		default:
 			g_set_error(err, BT_IO_ERROR, BT_IO_ERROR_INVALID_ARGS,
 					"Unknown option %d", opt);
@@ -797,6 +812,9 @@ static gboolean l2cap_get(int sock, GError **err, BtIOOption opt1,
 		case BT_IO_OPT_IMTU:
 			*(va_arg(args, uint16_t *)) = l2o.imtu;
 			break;
+		case BT_IO_OPT_MODE:
+			*(va_arg(args, uint8_t *)) = l2o.mode;
+			break;
 		case BT_IO_OPT_MASTER:
 			len = sizeof(flags);
 			if (getsockopt(sock, SOL_L2CAP, L2CAP_LM, &flags,
@@ -1099,7 +1117,7 @@ gboolean bt_io_set(GIOChannel *io, BtIOType type, GError **err,
 	case BT_IO_RFCOMM:
 		return rfcomm_set(sock, opts.sec_level, opts.master, err);
 	case BT_IO_SCO:
-		return sco_set(sock, opts.mtu, err);
+		return sco_set(sock, opts.mtu, opts.voice, err);
 	}
 
 	g_set_error(err, BT_IO_ERROR, BT_IO_ERROR_INVALID_ARGS,
@@ -1172,7 +1190,7 @@ static GIOChannel *create_io(BtIOType type, gboolean server,
 		}
 		if (sco_bind(sock, &opts->src, err) < 0)
 			goto failed;
-		if (!sco_set(sock, opts->mtu, err))
+		if (!sco_set(sock, opts->mtu, opts->voice, err))
 			goto failed;
 		break;
 	default:
@@ -287,7 +287,7 @@ dbus_bool_t emit_property_changed(DBusConnection *conn,
 
 	append_variant(&iter, type, value);
 
-	return g_dbus_send_message(conn, signal);
+	return g_dbus_send_property_changed(conn, signal, name);
 }
 
 dbus_bool_t emit_array_property_changed(DBusConnection *conn,
@@ -313,5 +313,5 @@ dbus_bool_t emit_array_property_changed(DBusConnection *conn,
 
 	append_array_variant(&iter, type, value, num);
 
-	return g_dbus_send_message(conn, signal);
+	return g_dbus_send_property_changed(conn, signal, name);
 }
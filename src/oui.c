@@ -27,6 +27,7 @@
 
 #include <stdio.h>
 #include <errno.h>
+#include <stdint.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -40,70 +41,208 @@
 
 #define OUIFILE "/var/lib/misc/oui.txt"
 
-char *ouitocomp(const char *oui)
+struct oui_entry {
+	uint32_t oui;
+	uint32_t name;		/* Offset into the name pool */
+};
+
+/* Parsed once on first lookup and kept for the lifetime of the process */
+static struct {
+	int loaded;
+	struct oui_entry *entries;
+	size_t count;
+	char *names;
+} cache;
+
+static int hexval(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
+/* Parses "XX-XX-XX" into a 24 bit value */
+static int parse_oui(const char *str, uint32_t *oui)
+{
+	uint32_t val = 0;
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		int h;
+
+		if (i % 3 == 2) {
+			if (str[i] != '-')
+				return -1;
+			continue;
+		}
+
+		h = hexval(str[i]);
+		if (h < 0)
+			return -1;
+
+		val = (val << 4) | h;
+	}
+
+	*oui = val;
+
+	return 0;
+}
+
+static int entry_cmp(const void *a, const void *b)
+{
+	const struct oui_entry *e1 = a, *e2 = b;
+
+	if (e1->oui < e2->oui)
+		return -1;
+
+	return e1->oui > e2->oui;
+}
+
+static int open_ouifile(void)
 {
-	struct stat st;
-	char *str, *map, *off, *end;
 	int fd;
 
 	fd = open("oui.txt", O_RDONLY);
 	if (fd < 0) {
 		fd = open(OUIFILE, O_RDONLY);
-		if (fd < 0) {
+		if (fd < 0)
 			fd = open("/usr/share/misc/oui.txt", O_RDONLY);
-			if (fd < 0)
-				return NULL;
-		}
 	}
 
-	if (fstat(fd, &st) < 0) {
-		close(fd);
-		return NULL;
-	}
+	return fd;
+}
+
+static void load_cache(void)
+{
+	struct stat st;
+	char *map, *line, *end;
+	size_t entries_size = 0, names_size = 0, names_len = 0;
+	int fd;
+
+	cache.loaded = 1;
+
+	fd = open_ouifile();
+	if (fd < 0)
+		return;
 
-	str = malloc(128);
-	if (!str) {
+	if (fstat(fd, &st) < 0 || st.st_size == 0) {
 		close(fd);
-		return NULL;
+		return;
 	}
 
-	memset(str, 0, 128);
-
 	map = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
 	if (!map || map == MAP_FAILED) {
-		free(str);
 		close(fd);
-		return NULL;
+		return;
 	}
 
-	off = strstr(map, oui);
-	if (off) {
-		off += 18;
-		end = strpbrk(off, "\r\n");
-		strncpy(str, off, end - off);
-	} else {
-		free(str);
-		str = NULL;
+	end = map + st.st_size;
+
+	/* Entries look like "00-00-00   (hex)\t\tXEROX CORPORATION" */
+	for (line = map; line < end; ) {
+		char *eol, *name;
+		struct oui_entry *e;
+		uint32_t oui;
+		size_t len;
+
+		eol = memchr(line, '\n', end - line);
+		if (!eol)
+			eol = end;
+
+		while (line < eol && (*line == ' ' || *line == '\t'))
+			line++;
+
+		if (eol - line < 18 || parse_oui(line, &oui) < 0 ||
+				memcmp(line + 8, "   (hex)", 8) != 0)
+			goto next;
+
+		name = line + 18;
+		len = eol - name;
+		if (len > 0 && name[len - 1] == '\r')
+			len--;
+
+		if (cache.count == entries_size) {
+			entries_size = entries_size ? entries_size * 2 : 1024;
+			e = realloc(cache.entries, entries_size * sizeof(*e));
+			if (!e)
+				break;
+			cache.entries = e;
+		}
+
+		if (names_len + len + 1 > names_size) {
+			char *n;
+
+			names_size = names_size ? names_size * 2 : 32768;
+			if (names_size < names_len + len + 1)
+				names_size = names_len + len + 1;
+
+			n = realloc(cache.names, names_size);
+			if (!n)
+				break;
+			cache.names = n;
+		}
+
+		memcpy(cache.names + names_len, name, len);
+		cache.names[names_len + len] = '\0';
+
+		e = &cache.entries[cache.count++];
+		e->oui = oui;
+		e->name = names_len;
+
+		names_len += len + 1;
+
+next:
+		line = eol + 1;
 	}
 
 	munmap(map, st.st_size);
-
 	close(fd);
 
-	return str;
+	qsort(cache.entries, cache.count, sizeof(struct oui_entry), entry_cmp);
+}
+
+const char *ouilookup(const char *oui)
+{
+	struct oui_entry key, *e;
+
+	if (!cache.loaded)
+		load_cache();
+
+	if (cache.count == 0 || parse_oui(oui, &key.oui) < 0)
+		return NULL;
+
+	e = bsearch(&key, cache.entries, cache.count,
+				sizeof(struct oui_entry), entry_cmp);
+	if (!e)
+		return NULL;
+
+	return cache.names + e->name;
+}
+
+char *ouitocomp(const char *oui)
+{
+	const char *comp;
+
+	comp = ouilookup(oui);
+	if (!comp)
+		return NULL;
+
+	return strdup(comp);
 }
 
 int oui2comp(const char *oui, char *comp, size_t size)
 {
-	char *tmp;
+	const char *tmp;
 
-	tmp = ouitocomp(oui);
+	tmp = ouilookup(oui);
 	if (!tmp)
 		return -1;
 
 	snprintf(comp, size, "%s", tmp);
 
-	free(tmp);
-
 	return 0;
 }
@@ -21,5 +21,6 @@
  *
  */
 
+const char *ouilookup(const char *oui);
 char *ouitocomp(const char *oui);
 int oui2comp(const char *oui, char *comp, size_t size);
@@ -0,0 +1,295 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2004-2010  Marcel Holtmann <marcel@holtmann.org>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <bluetooth/bluetooth.h>
+
+#include <glib.h>
+
+#include "registry.h"
+
+struct registry_entry {
+	bdaddr_t	src;
+	bdaddr_t	dst;
+	gboolean	has_addr;
+	char		*path;
+	void		*data;
+};
+
+struct btd_registry {
+	GHashTable	*by_data;	/* Owns the entries */
+	GHashTable	*by_addr;	/* Local and remote address pair */
+	GHashTable	*by_dst;	/* Remote address, list of objects */
+	GHashTable	*by_path;
+};
+
+static guint bdaddr_hash(const bdaddr_t *ba)
+{
+	/* The lower half is the most random part of an address */
+	return ba->b[0] | ba->b[1] << 8 | ba->b[2] << 16 |
+				(guint) (ba->b[3] ^ ba->b[4] ^ ba->b[5]) << 24;
+}
+
+static guint addr_hash(gconstpointer key)
+{
+	const struct registry_entry *entry = key;
+
+	return bdaddr_hash(&entry->dst) * 31 + bdaddr_hash(&entry->src);
+}
+
+static gboolean addr_equal(gconstpointer a, gconstpointer b)
+{
+	const struct registry_entry *ea = a;
+	const struct registry_entry *eb = b;
+
+	return bacmp(&ea->dst, &eb->dst) == 0 &&
+					bacmp(&ea->src, &eb->src) == 0;
+}
+
+static guint dst_hash(gconstpointer key)
+{
+	return bdaddr_hash(key);
+}
+
+static gboolean dst_equal(gconstpointer a, gconstpointer b)
+{
+	return bacmp(a, b) == 0;
+}
+
+static void entry_free(gpointer data)
+{
+	struct registry_entry *entry = data;
+
+	g_free(entry->path);
+	g_free(entry);
+}
+
+struct btd_registry *btd_registry_new(void)
+{
+	struct btd_registry *registry;
+
+	registry = g_new0(struct btd_registry, 1);
+	registry->by_data = g_hash_table_new_full(g_direct_hash,
+					g_direct_equal, NULL, entry_free);
+	registry->by_addr = g_hash_table_new(addr_hash, addr_equal);
+	registry->by_dst = g_hash_table_new_full(dst_hash, dst_equal,
+							g_free, NULL);
+	registry->by_path = g_hash_table_new(g_str_hash, g_str_equal);
+
+	return registry;
+}
+
+static void free_dst_list(gpointer key, gpointer value, gpointer user_data)
+{
+	g_slist_free(value);
+}
+
+void btd_registry_free(struct btd_registry *registry)
+{
+	if (!registry)
+		return;
+
+	g_hash_table_foreach(registry->by_dst, free_dst_list, NULL);
+
+	g_hash_table_destroy(registry->by_path);
+	g_hash_table_destroy(registry->by_dst);
+	g_hash_table_destroy(registry->by_addr);
+	g_hash_table_destroy(registry->by_data);
+
+	g_free(registry);
+}
+
+void btd_registry_add(struct btd_registry *registry, const bdaddr_t *src,
+				const bdaddr_t *dst, const char *path,
+				void *data)
+{
+	struct registry_entry *entry;
+
+	btd_registry_remove(registry, data);
+
+	entry = g_new0(struct registry_entry, 1);
+	entry->data = data;
+	g_hash_table_insert(registry->by_data, data, entry);
+
+	if (dst) {
+		GSList *list;
+
+		bacpy(&entry->src, src ? src : BDADDR_ANY);
+		bacpy(&entry->dst, dst);
+		entry->has_addr = TRUE;
+
+		/* Earlier registrations win, like in a list scan */
+		if (!g_hash_table_lookup(registry->by_addr, entry))
+			g_hash_table_insert(registry->by_addr, entry, entry);
+
+		list = g_hash_table_lookup(registry->by_dst, dst);
+		list = g_slist_append(list, data);
+		g_hash_table_insert(registry->by_dst,
+					g_memdup(dst, sizeof(*dst)), list);
+	}
+
+	if (path) {
+		entry->path = g_strdup(path);
+		if (!g_hash_table_lookup(registry->by_path, entry->path))
+			g_hash_table_insert(registry->by_path, entry->path,
+									entry);
+	}
+}
+
+/* Hands a key over to another entry registered with the same one */
+static struct registry_entry *find_same_addr(struct btd_registry *registry,
+					struct registry_entry *entry)
+{
+	GSList *l;
+
+	l = g_hash_table_lookup(registry->by_dst, &entry->dst);
+	for (; l; l = l->next) {
+		struct registry_entry *other;
+
+		if (l->data == entry->data)
+			continue;
+
+		other = g_hash_table_lookup(registry->by_data, l->data);
+		if (bacmp(&other->src, &entry->src) == 0)
+			return other;
+	}
+
+	return NULL;
+}
+
+static gboolean find_same_path(gpointer key, gpointer value,
+							gpointer user_data)
+{
+	struct registry_entry *entry = value;
+	struct registry_entry *removed = user_data;
+
+	return entry != removed && entry->path &&
+				strcmp(entry->path, removed->path) == 0;
+}
+
+void btd_registry_remove(struct btd_registry *registry, void *data)
+{
+	struct registry_entry *entry, *other;
+
+	if (!registry)
+		return;
+
+	entry = g_hash_table_lookup(registry->by_data, data);
+	if (!entry)
+		return;
+
+	if (entry->has_addr) {
+		GSList *list;
+
+		if (g_hash_table_lookup(registry->by_addr, entry) == entry) {
+			g_hash_table_remove(registry->by_addr, entry);
+
+			other = find_same_addr(registry, entry);
+			if (other)
+				g_hash_table_insert(registry->by_addr, other,
+									other);
+		}
+
+		list = g_hash_table_lookup(registry->by_dst, &entry->dst);
+		list = g_slist_remove(list, data);
+		if (list)
+			g_hash_table_insert(registry->by_dst,
+					g_memdup(&entry->dst, sizeof(bdaddr_t)),
+					list);
+		else
+			g_hash_table_remove(registry->by_dst, &entry->dst);
+	}
+
+	if (entry->path &&
+			g_hash_table_lookup(registry->by_path, entry->path) ==
+									entry) {
+		g_hash_table_remove(registry->by_path, entry->path);
+
+		other = g_hash_table_find(registry->by_data, find_same_path,
+									entry);
+		if (other)
+			g_hash_table_insert(registry->by_path, other->path,
+									other);
+	}
+
+	g_hash_table_remove(registry->by_data, data);
+}
+
+void *btd_registry_find(struct btd_registry *registry, const bdaddr_t *src,
+							const bdaddr_t *dst)
+{
+	struct registry_entry key, *entry;
+	GSList *list;
+
+	if (!registry || !dst)
+		return NULL;
+
+	if (!src || bacmp(src, BDADDR_ANY) == 0) {
+		list = g_hash_table_lookup(registry->by_dst, dst);
+
+		return list ? list->data : NULL;
+	}
+
+	bacpy(&key.src, src);
+	bacpy(&key.dst, dst);
+
+	entry = g_hash_table_lookup(registry->by_addr, &key);
+	if (!entry) {
+		/* Objects registered for any adapter */
+		bacpy(&key.src, BDADDR_ANY);
+		entry = g_hash_table_lookup(registry->by_addr, &key);
+	}
+
+	return entry ? entry->data : NULL;
+}
+
+void *btd_registry_find_path(struct btd_registry *registry, const char *path)
+{
+	struct registry_entry *entry;
+
+	if (!registry || !path)
+		return NULL;
+
+	entry = g_hash_table_lookup(registry->by_path, path);
+
+	return entry ? entry->data : NULL;
+}
+
+GSList *btd_registry_find_all(struct btd_registry *registry,
+							const bdaddr_t *dst)
+{
+	if (!registry || !dst)
+		return NULL;
+
+	return g_hash_table_lookup(registry->by_dst, dst);
+}
+
+guint btd_registry_size(struct btd_registry *registry)
+{
+	return registry ? g_hash_table_size(registry->by_data) : 0;
+}
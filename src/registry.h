@@ -0,0 +1,49 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2004-2010  Marcel Holtmann <marcel@holtmann.org>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Objects indexed by local and remote address and by object path, for
+ * constant time lookups of the devices, connections and adapters that
+ * profiles keep track of.  An object is registered once with any of the
+ * keys it has; a NULL or BDADDR_ANY source matches every adapter.
+ */
+
+struct btd_registry;
+
+struct btd_registry *btd_registry_new(void);
+void btd_registry_free(struct btd_registry *registry);
+
+void btd_registry_add(struct btd_registry *registry, const bdaddr_t *src,
+				const bdaddr_t *dst, const char *path,
+				void *data);
+void btd_registry_remove(struct btd_registry *registry, void *data);
+
+void *btd_registry_find(struct btd_registry *registry, const bdaddr_t *src,
+							const bdaddr_t *dst);
+void *btd_registry_find_path(struct btd_registry *registry, const char *path);
+
+/* Objects of all adapters for a remote address, owned by the registry */
+GSList *btd_registry_find_all(struct btd_registry *registry,
+							const bdaddr_t *dst);
+
+guint btd_registry_size(struct btd_registry *registry);
@@ -57,6 +57,14 @@ static uint16_t did_vendor = 0x0000;
 static uint16_t did_product = 0x0000;
 static uint16_t did_version = 0x0000;
 
+/*
+ * While a batch is open, class of device and EIR updates are only noted
+ * and done once when the outermost batch is committed.
+ */
+static unsigned int batch_depth = 0;
+static gboolean batch_pending = FALSE;
+static bdaddr_t batch_src;
+
 /*
  * List of version numbers supported by the SDP server.
  * Add to this list when newer versions are supported.
@@ -99,62 +107,222 @@ static void update_db_timestamp(void)
 	sdp_attr_replace(server, SDP_ATTR_SVCDB_STATE, d);
 }
 
-static void update_adapter_svclass_list(struct btd_adapter *adapter)
+/* Major service class bits set by a service class UUID */
+static uint8_t svclass_bits(uint16_t uuid16)
 {
-	sdp_list_t *list = adapter_get_services(adapter);
-	uint8_t val = 0;
+	switch (uuid16) {
+	case DIALUP_NET_SVCLASS_ID:
+	case CIP_SVCLASS_ID:
+		return 0x42;	/* Telephony & Networking */
+	case IRMC_SYNC_SVCLASS_ID:
+	case OBEX_OBJPUSH_SVCLASS_ID:
+	case OBEX_FILETRANS_SVCLASS_ID:
+	case IRMC_SYNC_CMD_SVCLASS_ID:
+	case PBAP_PSE_SVCLASS_ID:
+		return 0x10;	/* Object Transfer */
+	case HEADSET_SVCLASS_ID:
+	case HANDSFREE_SVCLASS_ID:
+		return 0x20;	/* Audio */
+	case CORDLESS_TELEPHONY_SVCLASS_ID:
+	case INTERCOM_SVCLASS_ID:
+	case FAX_SVCLASS_ID:
+	case SAP_SVCLASS_ID:
+	/*
+	 * Setting the telephony bit for the handsfree audio gateway
+	 * role is not required by the HFP specification, but the
+	 * Nokia 616 carkit is just plain broken! It will refuse
+	 * pairing without this bit set.
+	 */
+	case HANDSFREE_AGW_SVCLASS_ID:
+		return 0x40;	/* Telephony */
+	case AUDIO_SOURCE_SVCLASS_ID:
+	case VIDEO_SOURCE_SVCLASS_ID:
+		return 0x08;	/* Capturing */
+	case AUDIO_SINK_SVCLASS_ID:
+	case VIDEO_SINK_SVCLASS_ID:
+		return 0x04;	/* Rendering */
+	case PANU_SVCLASS_ID:
+	case NAP_SVCLASS_ID:
+	case GN_SVCLASS_ID:
+		return 0x02;	/* Networking */
+	}
 
-	for (; list; list = list->next) {
-		sdp_record_t *rec = (sdp_record_t *) list->data;
+	return 0;
+}
 
-		if (rec->svclass.type != SDP_UUID16)
-			continue;
+struct sdp_uuid_entry {
+	uuid_t uuid;
+	unsigned int refs;
+};
 
-		switch (rec->svclass.value.uuid16) {
-		case DIALUP_NET_SVCLASS_ID:
-		case CIP_SVCLASS_ID:
-			val |= 0x42;	/* Telephony & Networking */
-			break;
-		case IRMC_SYNC_SVCLASS_ID:
-		case OBEX_OBJPUSH_SVCLASS_ID:
-		case OBEX_FILETRANS_SVCLASS_ID:
-		case IRMC_SYNC_CMD_SVCLASS_ID:
-		case PBAP_PSE_SVCLASS_ID:
-			val |= 0x10;	/* Object Transfer */
-			break;
-		case HEADSET_SVCLASS_ID:
-		case HANDSFREE_SVCLASS_ID:
-			val |= 0x20;	/* Audio */
-			break;
-		case CORDLESS_TELEPHONY_SVCLASS_ID:
-		case INTERCOM_SVCLASS_ID:
-		case FAX_SVCLASS_ID:
-		case SAP_SVCLASS_ID:
-		/*
-		 * Setting the telephony bit for the handsfree audio gateway
-		 * role is not required by the HFP specification, but the
-		 * Nokia 616 carkit is just plain broken! It will refuse
-		 * pairing without this bit set.
-		 */
-		case HANDSFREE_AGW_SVCLASS_ID:
-			val |= 0x40;	/* Telephony */
-			break;
-		case AUDIO_SOURCE_SVCLASS_ID:
-		case VIDEO_SOURCE_SVCLASS_ID:
-			val |= 0x08;	/* Capturing */
-			break;
-		case AUDIO_SINK_SVCLASS_ID:
-		case VIDEO_SINK_SVCLASS_ID:
-			val |= 0x04;	/* Rendering */
-			break;
-		case PANU_SVCLASS_ID:
-		case NAP_SVCLASS_ID:
-		case GN_SVCLASS_ID:
-			val |= 0x02;	/* Networking */
-			break;
-		}
+/*
+ * Service class UUIDs of the records of an adapter, counted by the
+ * number of records using them.  Entries stay in the order they were
+ * first used in, which is the order of the EIR UUID lists.
+ */
+struct sdp_uuid_set {
+	GHashTable *table;
+	GHashTable *records;	/* Entry each record is counted in */
+	GSList *entries;
+	unsigned int class_refs[8];
+};
+
+static guint uuid_hash(gconstpointer key)
+{
+	const uuid_t *uuid = key;
+	const uint8_t *data;
+	guint hash = 0;
+	int i;
+
+	switch (uuid->type) {
+	case SDP_UUID16:
+		return uuid->value.uuid16;
+	case SDP_UUID32:
+		return uuid->value.uuid32;
+	}
+
+	data = (const uint8_t *) &uuid->value.uuid128;
+
+	for (i = 0; i < 16; i++)
+		hash = hash * 31 + data[i];
+
+	return hash;
+}
+
+static gboolean uuid_equal(gconstpointer a, gconstpointer b)
+{
+	const uuid_t *ua = a;
+	const uuid_t *ub = b;
+
+	if (ua->type != ub->type)
+		return FALSE;
+
+	switch (ua->type) {
+	case SDP_UUID16:
+		return ua->value.uuid16 == ub->value.uuid16;
+	case SDP_UUID32:
+		return ua->value.uuid32 == ub->value.uuid32;
+	}
+
+	return memcmp(&ua->value.uuid128, &ub->value.uuid128,
+					sizeof(ua->value.uuid128)) == 0;
+}
+
+struct sdp_uuid_set *sdp_uuid_set_new(void)
+{
+	struct sdp_uuid_set *set;
+
+	set = g_new0(struct sdp_uuid_set, 1);
+	set->table = g_hash_table_new_full(uuid_hash, uuid_equal, NULL,
+								g_free);
+	set->records = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	return set;
+}
+
+void sdp_uuid_set_free(struct sdp_uuid_set *set)
+{
+	if (!set)
+		return;
+
+	g_slist_free(set->entries);
+	g_hash_table_destroy(set->records);
+	g_hash_table_destroy(set->table);
+	g_free(set);
+}
+
+static void class_refs_update(struct sdp_uuid_set *set, const uuid_t *uuid,
+								int delta)
+{
+	uint8_t bits;
+	int i;
+
+	if (uuid->type != SDP_UUID16)
+		return;
+
+	bits = svclass_bits(uuid->value.uuid16);
+
+	for (i = 0; i < 8; i++)
+		if (bits & (1 << i))
+			set->class_refs[i] += delta;
+}
+
+void sdp_uuid_set_add(struct sdp_uuid_set *set, sdp_record_t *rec)
+{
+	struct sdp_uuid_entry *entry;
+
+	if (g_hash_table_lookup(set->records, rec))
+		return;
+
+	entry = g_hash_table_lookup(set->table, &rec->svclass);
+	if (entry) {
+		entry->refs++;
+		g_hash_table_insert(set->records, rec, entry);
+		return;
 	}
 
+	entry = g_new0(struct sdp_uuid_entry, 1);
+	entry->uuid = rec->svclass;
+	entry->refs = 1;
+
+	g_hash_table_insert(set->table, &entry->uuid, entry);
+	g_hash_table_insert(set->records, rec, entry);
+	set->entries = g_slist_append(set->entries, entry);
+
+	class_refs_update(set, &entry->uuid, 1);
+}
+
+void sdp_uuid_set_remove(struct sdp_uuid_set *set, sdp_record_t *rec)
+{
+	struct sdp_uuid_entry *entry;
+
+	/* Not rec->svclass, it may have changed since the record got added */
+	entry = g_hash_table_lookup(set->records, rec);
+	if (!entry)
+		return;
+
+	g_hash_table_remove(set->records, rec);
+
+	if (--entry->refs > 0)
+		return;
+
+	class_refs_update(set, &entry->uuid, -1);
+
+	set->entries = g_slist_remove(set->entries, entry);
+	g_hash_table_remove(set->table, &entry->uuid);
+}
+
+/* Recount a record whose service class may have been changed in place */
+void sdp_uuid_set_update(struct sdp_uuid_set *set, sdp_record_t *rec)
+{
+	struct sdp_uuid_entry *entry;
+
+	entry = g_hash_table_lookup(set->records, rec);
+	if (!entry || uuid_equal(&entry->uuid, &rec->svclass))
+		return;
+
+	sdp_uuid_set_remove(set, rec);
+	sdp_uuid_set_add(set, rec);
+}
+
+uint8_t sdp_uuid_set_service_classes(struct sdp_uuid_set *set)
+{
+	uint8_t val = 0;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		if (set->class_refs[i] > 0)
+			val |= 1 << i;
+
+	return val;
+}
+
+static void update_adapter_svclass_list(struct btd_adapter *adapter)
+{
+	uint8_t val;
+
+	val = sdp_uuid_set_service_classes(adapter_get_uuid_set(adapter));
+
 	SDPDBG("Service classes 0x%02x", val);
 
 	manager_update_svc(adapter, val);
@@ -162,7 +330,20 @@ static void update_adapter_svclass_list(struct btd_adapter *adapter)
 
 static void update_svclass_list(const bdaddr_t *src)
 {
-	GSList *adapters = manager_get_adapters();
+	GSList *adapters;
+
+	if (batch_depth > 0) {
+		/* Records of different adapters, update them all */
+		if (!batch_pending)
+			bacpy(&batch_src, src);
+		else if (bacmp(&batch_src, src) != 0)
+			bacpy(&batch_src, BDADDR_ANY);
+
+		batch_pending = TRUE;
+		return;
+	}
+
+	adapters = manager_get_adapters();
 
 	for (; adapters; adapters = adapters->next) {
 		struct btd_adapter *adapter = adapters->data;
@@ -176,10 +357,10 @@ static void update_svclass_list(const bdaddr_t *src)
 
 }
 
-static void eir_generate_uuid128(sdp_list_t *list,
-					uint8_t *ptr, uint16_t *eir_len)
+static void eir_generate_uuid128(GSList *list, uint8_t *ptr,
+							uint16_t *eir_len)
 {
-	int i, k, index = 0;
+	int k, index = 0;
 	uint16_t len = *eir_len;
 	uint8_t *uuid128;
 	gboolean truncated = FALSE;
@@ -188,10 +369,10 @@ static void eir_generate_uuid128(sdp_list_t *list,
 	uuid128 = ptr + 2;
 
 	for (; list; list = list->next) {
-		sdp_record_t *rec = (sdp_record_t *) list->data;
-		uint8_t *uuid128_data = rec->svclass.value.uuid128.data;
+		struct sdp_uuid_entry *entry = list->data;
+		uint8_t *uuid128_data = entry->uuid.value.uuid128.data;
 
-		if (rec->svclass.type != SDP_UUID128)
+		if (entry->uuid.type != SDP_UUID128)
 			continue;
 
 		/* Stop if not enough space to put next UUID128 */
@@ -200,20 +381,6 @@ static void eir_generate_uuid128(sdp_list_t *list,
 			break;
 		}
 
-		/* Check for duplicates, EIR data is Little Endian */
-		for (i = 0; i < index; i++) {
-			for (k = 0; k < SIZEOF_UUID128; k++) {
-				if (uuid128[i * SIZEOF_UUID128 + k] !=
-					uuid128_data[SIZEOF_UUID128 - k])
-					break;
-			}
-			if (k == SIZEOF_UUID128)
-				break;
-		}
-
-		if (i < index)
-			continue;
-
 		/* EIR data is Little Endian */
 		for (k = 0; k < SIZEOF_UUID128; k++)
 			uuid128[index * SIZEOF_UUID128 + k] =
@@ -234,10 +401,11 @@ static void eir_generate_uuid128(sdp_list_t *list,
 }
 
 void create_ext_inquiry_response(const char *name,
-					int8_t tx_power, sdp_list_t *services,
+					int8_t tx_power,
+					struct sdp_uuid_set *services,
 					uint8_t *data)
 {
-	sdp_list_t *list = services;
+	GSList *list = services ? services->entries : NULL;
 	uint8_t *ptr = data;
 	uint16_t eir_len = 0;
 	uint16_t uuid16[EIR_DATA_LENGTH / 2];
@@ -285,17 +453,17 @@ void create_ext_inquiry_response(const char *name,
 		eir_len += 10;
 	}
 
-	/* Group all UUID16 types */
+	/* Group all UUID16 types, the set has no duplicates */
 	for (; list; list = list->next) {
-		sdp_record_t *rec = (sdp_record_t *) list->data;
+		struct sdp_uuid_entry *entry = list->data;
 
-		if (rec->svclass.type != SDP_UUID16)
+		if (entry->uuid.type != SDP_UUID16)
 			continue;
 
-		if (rec->svclass.value.uuid16 < 0x1100)
+		if (entry->uuid.value.uuid16 < 0x1100)
 			continue;
 
-		if (rec->svclass.value.uuid16 == PNP_INFO_SVCLASS_ID)
+		if (entry->uuid.value.uuid16 == PNP_INFO_SVCLASS_ID)
 			continue;
 
 		/* Stop if not enough space to put next UUID16 */
@@ -304,15 +472,7 @@ void create_ext_inquiry_response(const char *name,
 			break;
 		}
 
-		/* Check for duplicates */
-		for (i = 0; i < index; i++)
-			if (uuid16[i] == rec->svclass.value.uuid16)
-				break;
-
-		if (i < index)
-			continue;
-
-		uuid16[index++] = rec->svclass.value.uuid16;
+		uuid16[index++] = entry->uuid.value.uuid16;
 		eir_len += sizeof(uint16_t);
 	}
 
@@ -332,8 +492,8 @@ void create_ext_inquiry_response(const char *name,
 	}
 
 	/* Group all UUID128 types */
-	if (eir_len <= EIR_DATA_LENGTH - 2)
-		eir_generate_uuid128(services, ptr, &eir_len);
+	if (services && eir_len <= EIR_DATA_LENGTH - 2)
+		eir_generate_uuid128(services->entries, ptr, &eir_len);
 }
 
 void register_public_browse_group(void)
@@ -521,6 +681,93 @@ int add_record_to_server(const bdaddr_t *src, sdp_record_t *rec)
 	return 0;
 }
 
+void sdp_record_batch_begin(void)
+{
+	batch_depth++;
+}
+
+void sdp_record_batch_commit(void)
+{
+	if (batch_depth == 0 || --batch_depth > 0)
+		return;
+
+	if (!batch_pending)
+		return;
+
+	batch_pending = FALSE;
+	update_svclass_list(&batch_src);
+}
+
+static gboolean is_seq(sdp_data_t *d)
+{
+	return d->dtd == SDP_SEQ8 || d->dtd == SDP_SEQ16 ||
+							d->dtd == SDP_SEQ32;
+}
+
+static sdp_data_t *proto_port_data(sdp_data_t *seq, uint16_t proto)
+{
+	sdp_data_t *d;
+
+	for (; seq; seq = seq->next) {
+		if (!is_seq(seq))
+			continue;
+
+		d = seq->val.dataseq;
+		if (!d || !SDP_IS_UUID(d->dtd))
+			continue;
+
+		if (sdp_uuid_to_proto(&d->val.uuid) != proto)
+			continue;
+
+		return d->next;
+	}
+
+	return NULL;
+}
+
+/*
+ * Copy a record built once as template, setting the RFCOMM channel or
+ * L2CAP PSM of its protocol descriptor list to port.
+ */
+sdp_record_t *sdp_record_from_template(sdp_record_t *tmpl, uint16_t proto,
+								uint16_t port)
+{
+	sdp_record_t *rec;
+	sdp_data_t *pdl, *d;
+
+	rec = sdp_copy_record(tmpl);
+	rec->handle = 0xffffffff;
+
+	if (proto == 0)
+		return rec;
+
+	pdl = sdp_data_get(rec, SDP_ATTR_PROTO_DESC_LIST);
+	if (!pdl || !is_seq(pdl))
+		goto fail;
+
+	d = proto_port_data(pdl->val.dataseq, proto);
+	if (!d)
+		goto fail;
+
+	switch (d->dtd) {
+	case SDP_UINT8:
+		d->val.uint8 = port;
+		break;
+	case SDP_UINT16:
+		d->val.uint16 = port;
+		break;
+	default:
+		goto fail;
+	}
+
+	return rec;
+
+fail:
+	error("Template record has no port for protocol 0x%04x", proto);
+	sdp_record_free(rec);
+	return NULL;
+}
+
 int remove_record_from_server(uint32_t handle)
 {
 	sdp_record_t *rec;
@@ -653,6 +900,7 @@ int service_register_req(sdp_req_t *req, sdp_buf_t *rsp)
 	uint8_t *p = req->buf + sizeof(sdp_pdu_hdr_t);
 	int bufsize = req->len - sizeof(sdp_pdu_hdr_t);
 	sdp_record_t *rec;
+	GSList *adapters;
 
 	req->flags = *p++;
 	if (req->flags & SDP_DEVICE_RECORD) {
@@ -697,6 +945,12 @@ success:
 		sdp_pattern_add_uuid(rec, &uuid);
 	}
 
+	/* A record carrying its own handle was added to the sets before
+	 * its attributes were extracted */
+	for (adapters = manager_get_adapters(); adapters;
+						adapters = adapters->next)
+		sdp_uuid_set_update(adapter_get_uuid_set(adapters->data), rec);
+
 	update_db_timestamp();
 	update_svclass_list(&req->device);
 
@@ -719,6 +973,7 @@ invalid:
 int service_update_req(sdp_req_t *req, sdp_buf_t *rsp)
 {
 	sdp_record_t *orec, *nrec;
+	GSList *adapters;
 	int status = 0, scanned = 0;
 	uint8_t *p = req->buf + sizeof(sdp_pdu_hdr_t);
 	int bufsize = req->len - sizeof(sdp_pdu_hdr_t);
@@ -746,6 +1001,11 @@ int service_update_req(sdp_req_t *req, sdp_buf_t *rsp)
 
 	assert(nrec == orec);
 
+	for (adapters = manager_get_adapters(); adapters;
+						adapters = adapters->next)
+		sdp_uuid_set_update(adapter_get_uuid_set(adapters->data),
+									orec);
+
 	update_db_timestamp();
 	update_svclass_list(BDADDR_ANY);
 
@@ -107,6 +107,22 @@ void stop_sdp_server(void);
 int add_record_to_server(const bdaddr_t *src, sdp_record_t *rec);
 int remove_record_from_server(uint32_t handle);
 
+void sdp_record_batch_begin(void);
+void sdp_record_batch_commit(void);
+
+sdp_record_t *sdp_record_from_template(sdp_record_t *tmpl, uint16_t proto,
+								uint16_t port);
+
+struct sdp_uuid_set;
+
+struct sdp_uuid_set *sdp_uuid_set_new(void);
+void sdp_uuid_set_free(struct sdp_uuid_set *set);
+void sdp_uuid_set_add(struct sdp_uuid_set *set, sdp_record_t *rec);
+void sdp_uuid_set_remove(struct sdp_uuid_set *set, sdp_record_t *rec);
+void sdp_uuid_set_update(struct sdp_uuid_set *set, sdp_record_t *rec);
+uint8_t sdp_uuid_set_service_classes(struct sdp_uuid_set *set);
+
 void create_ext_inquiry_response(const char *name,
-					int8_t tx_power, sdp_list_t *services,
+					int8_t tx_power,
+					struct sdp_uuid_set *services,
 					uint8_t *data);
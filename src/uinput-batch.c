@@ -0,0 +1,198 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2004-2010  Marcel Holtmann <marcel@holtmann.org>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include <glib.h>
+
+#include "log.h"
+#include "uinput.h"
+#include "uinput-batch.h"
+
+#ifndef SIOCGSTAMP
+#define SIOCGSTAMP	0x8906
+#endif
+
+#define UINPUT_BATCH_SIZE	64
+
+struct uinput_batch {
+	int fd;
+	char *name;
+
+	struct uinput_event events[UINPUT_BATCH_SIZE];
+	unsigned int count;
+
+	/* Reports whose events are queued but not written yet */
+	unsigned int pending;
+	uint64_t pending_sum;
+	uint64_t pending_oldest;
+
+	/* Time from the report reaching the socket to the uinput write */
+	uint64_t reports;
+	uint64_t latency_total;
+	uint64_t latency_max;
+	unsigned int writes;
+};
+
+static uint64_t timeval_usec(const struct timeval *tv)
+{
+	return (uint64_t) tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+static uint64_t now_usec(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return timeval_usec(&tv);
+}
+
+struct uinput_batch *uinput_batch_new(int fd, const char *name)
+{
+	struct uinput_batch *batch;
+
+	batch = g_new0(struct uinput_batch, 1);
+	batch->fd = fd;
+	batch->name = g_strdup(name);
+
+	return batch;
+}
+
+void uinput_batch_free(struct uinput_batch *batch)
+{
+	if (!batch)
+		return;
+
+	if (batch->reports > 0)
+		DBG("%s: %llu reports in %u writes, latency avg %llu max %llu"
+				" usec", batch->name,
+				(unsigned long long) batch->reports,
+				batch->writes,
+				(unsigned long long) (batch->latency_total /
+							batch->reports),
+				(unsigned long long) batch->latency_max);
+
+	g_free(batch->name);
+	g_free(batch);
+}
+
+/*
+ * Marks the start of the events of a report just read from sk.  The
+ * kernel receive timestamp of the socket is used so that time spent in
+ * the main loop before the read is accounted for as well.
+ */
+void uinput_batch_report(struct uinput_batch *batch, int sk)
+{
+	struct timeval tv;
+	uint64_t stamp;
+
+	if (sk < 0 || ioctl(sk, SIOCGSTAMP, &tv) < 0)
+		stamp = now_usec();
+	else
+		stamp = timeval_usec(&tv);
+
+	if (!batch->pending || stamp < batch->pending_oldest)
+		batch->pending_oldest = stamp;
+
+	batch->pending++;
+	batch->pending_sum += stamp;
+}
+
+void uinput_batch_event(struct uinput_batch *batch, uint16_t type,
+					uint16_t code, int32_t value)
+{
+	struct uinput_event *event;
+
+	if (batch->count == UINPUT_BATCH_SIZE)
+		uinput_batch_flush(batch);
+
+	event = &batch->events[batch->count++];
+	memset(event, 0, sizeof(*event));
+	event->type = type;
+	event->code = code;
+	event->value = value;
+}
+
+void uinput_batch_key(struct uinput_batch *batch, uint16_t key, int pressed)
+{
+	uinput_batch_event(batch, EV_KEY, key, pressed);
+	uinput_batch_event(batch, EV_SYN, SYN_REPORT, 0);
+}
+
+int uinput_batch_flush(struct uinput_batch *batch)
+{
+	size_t len = batch->count * sizeof(struct uinput_event);
+	uint64_t now;
+	ssize_t ret;
+
+	/* Reports that produced no events are not accounted for */
+	if (batch->count == 0) {
+		batch->pending = 0;
+		batch->pending_sum = 0;
+		return 0;
+	}
+
+	batch->count = 0;
+
+	ret = write(batch->fd, batch->events, len);
+	if (ret < 0) {
+		int err = errno;
+		error("%s: uinput write failed: %s (%d)", batch->name,
+							strerror(err), err);
+		batch->pending = 0;
+		batch->pending_sum = 0;
+		return -err;
+	}
+
+	batch->writes++;
+
+	if (batch->pending == 0)
+		return 0;
+
+	now = now_usec();
+
+	if (now > batch->pending_oldest &&
+				now - batch->pending_oldest > batch->latency_max)
+		batch->latency_max = now - batch->pending_oldest;
+
+	if (now * batch->pending > batch->pending_sum)
+		batch->latency_total += now * batch->pending -
+							batch->pending_sum;
+
+	batch->reports += batch->pending;
+	batch->pending = 0;
+	batch->pending_sum = 0;
+
+	return 0;
+}
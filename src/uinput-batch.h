@@ -0,0 +1,38 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2004-2010  Marcel Holtmann <marcel@holtmann.org>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Events of one or more input reports are queued and handed to uinput
+ * with a single write once the reports read in a wakeup are decoded.
+ */
+
+struct uinput_batch;
+
+struct uinput_batch *uinput_batch_new(int fd, const char *name);
+void uinput_batch_free(struct uinput_batch *batch);
+
+void uinput_batch_report(struct uinput_batch *batch, int sk);
+void uinput_batch_event(struct uinput_batch *batch, uint16_t type,
+					uint16_t code, int32_t value);
+void uinput_batch_key(struct uinput_batch *batch, uint16_t key, int pressed);
+int uinput_batch_flush(struct uinput_batch *batch);
@@ -0,0 +1,306 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2004-2010  Marcel Holtmann <marcel@holtmann.org>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <sys/time.h>
+
+#include "../tools/ubcsp.h"
+
+/*
+ * The UART is a memory loopback: everything ubcsp sends is read back by
+ * it, so the link establishment completes against itself and unreliable
+ * packets come back as received packets.
+ */
+static uint8 loop_buffer[65536];
+static uint32 loop_head = 0;
+static uint32 loop_tail = 0;
+
+static unsigned long uart_writes = 0;
+static unsigned long uart_reads = 0;
+
+void put_uart_block(const uint8 *data, uint32 len)
+{
+	if (loop_tail + len > sizeof(loop_buffer)) {
+		memmove(loop_buffer, loop_buffer + loop_head,
+						loop_tail - loop_head);
+		loop_tail -= loop_head;
+		loop_head = 0;
+	}
+
+	if (loop_tail + len > sizeof(loop_buffer)) {
+		fprintf(stderr, "Loopback buffer overflow\n");
+		exit(1);
+	}
+
+	memcpy(loop_buffer + loop_tail, data, len);
+	loop_tail += len;
+
+	uart_writes++;
+}
+
+uint32 get_uart_block(uint8 *data, uint32 len)
+{
+	uint32 avail = loop_tail - loop_head;
+
+	if (len > avail)
+		len = avail;
+
+	memcpy(data, loop_buffer + loop_head, len);
+	loop_head += len;
+
+	if (len)
+		uart_reads++;
+
+	return len;
+}
+
+/* The CRC as ubcsp computed it before, four bits at a time */
+static uint16 nibble_crc(uint8 ch, uint16 crc)
+{
+	static const uint16 crc_table[] = {
+		0x0000, 0x1081, 0x2102, 0x3183,
+		0x4204, 0x5285, 0x6306, 0x7387,
+		0x8408, 0x9489, 0xa50a, 0xb58b,
+		0xc60c, 0xd68d, 0xe70e, 0xf78f
+	};
+
+	crc = (crc >> 4) ^ crc_table[(crc ^ ch) & 0x000f];
+	crc = (crc >> 4) ^ crc_table[(crc ^ (ch >> 4)) & 0x000f];
+
+	return crc;
+}
+
+static uint16 byte_table[256];
+
+static uint16 byte_crc(uint8 ch, uint16 crc)
+{
+	return (crc >> 8) ^ byte_table[(crc ^ ch) & 0xff];
+}
+
+static double elapsed(struct timeval *start)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+
+	return (now.tv_sec - start->tv_sec) +
+				(now.tv_usec - start->tv_usec) / 1000000.0;
+}
+
+static int bench_crc(const uint8 *data, int len, int rounds)
+{
+	struct timeval start;
+	uint16 crc1 = 0xffff, crc2 = 0xffff;
+	double t1, t2;
+	int i, n;
+
+	for (i = 0; i < 256; i++)
+		byte_table[i] = nibble_crc(i, 0);
+
+	gettimeofday(&start, NULL);
+	for (n = 0; n < rounds; n++)
+		for (i = 0; i < len; i++)
+			crc1 = nibble_crc(data[i], crc1);
+	t1 = elapsed(&start);
+
+	gettimeofday(&start, NULL);
+	for (n = 0; n < rounds; n++)
+		for (i = 0; i < len; i++)
+			crc2 = byte_crc(data[i], crc2);
+	t2 = elapsed(&start);
+
+	printf("CRC nibble table: %8.1f MB/s\n",
+				len * (double) rounds / t1 / 1000000.0);
+	printf("CRC byte table:   %8.1f MB/s\n",
+				len * (double) rounds / t2 / 1000000.0);
+
+	if (crc1 != crc2) {
+		fprintf(stderr, "CRC mismatch 0x%04x != 0x%04x\n", crc1, crc2);
+		return -1;
+	}
+
+	return 0;
+}
+
+static struct ubcsp_packet send_packet;
+static uint8 send_buffer[4096];
+
+static struct ubcsp_packet receive_packet;
+static uint8 receive_buffer[4096];
+
+static int establish_link(void)
+{
+	uint8 activity = 0;
+	int i;
+
+	ubcsp_initialize();
+
+	receive_packet.length = sizeof(receive_buffer);
+	receive_packet.payload = receive_buffer;
+	ubcsp_receive_packet(&receive_packet);
+
+	/* Reaching the active state is reported as a sent packet */
+	for (i = 0; i < 1000; i++) {
+		ubcsp_poll(&activity);
+
+		if (activity & UBCSP_PACKET_SENT)
+			break;
+	}
+
+	if (i == 1000) {
+		fprintf(stderr, "Link establishment failed\n");
+		return -1;
+	}
+
+	/* Let the answers to our own late SYNC and CONF messages go out,
+	 * since any frame sent completes a pending unreliable packet */
+	for (i = 0; i < 1000; i++)
+		ubcsp_poll(&activity);
+
+	return 0;
+}
+
+static int bench_packets(int len, int count)
+{
+	struct timeval start;
+	double t;
+	int i, n;
+
+	if (establish_link() < 0)
+		return -1;
+
+	/* Plenty of octets that need SLIP escaping */
+	for (i = 0; i < len; i++)
+		send_buffer[i] = (i % 7) ? rand() : (i & 8 ? 0xc0 : 0xdb);
+
+	uart_writes = 0;
+	uart_reads = 0;
+
+	gettimeofday(&start, NULL);
+
+	for (n = 0; n < count; n++) {
+		uint8 activity = 0;
+		int polls = 0;
+
+		send_packet.channel = 5;
+		send_packet.reliable = 0;
+		send_packet.use_crc = 1;
+		send_packet.length = len;
+		send_packet.payload = send_buffer;
+
+		receive_packet.length = sizeof(receive_buffer);
+		ubcsp_receive_packet(&receive_packet);
+
+		ubcsp_send_packet(&send_packet);
+
+		while (!(activity & UBCSP_PACKET_RECEIVED)) {
+			uint8 more = 0;
+
+			ubcsp_poll(&more);
+			activity |= more;
+
+			if (++polls > 100000) {
+				fprintf(stderr, "Packet %d not received\n", n);
+				return -1;
+			}
+		}
+
+		if (receive_packet.length != len ||
+				memcmp(receive_buffer, send_buffer, len) != 0) {
+			fprintf(stderr, "Packet %d corrupted\n", n);
+			return -1;
+		}
+	}
+
+	t = elapsed(&start);
+
+	printf("%4d octet packets: %8.0f packets/s, "
+				"%lu UART writes, %lu UART reads\n",
+				len, count / t, uart_writes, uart_reads);
+
+	return 0;
+}
+
+static void usage(void)
+{
+	printf("bcspbench - BCSP CRC and SLIP codec benchmark\n\n");
+
+	printf("Usage:\n"
+		"\tbcspbench [-n packets] [-s size]\n");
+}
+
+static struct option main_options[] = {
+	{ "packets",	1, 0, 'n' },
+	{ "size",	1, 0, 's' },
+	{ "help",	0, 0, 'h' },
+	{ 0, 0, 0, 0 }
+};
+
+int main(int argc, char *argv[])
+{
+	uint8 data[4096];
+	int opt, i, count = 10000, size = 0;
+
+	while ((opt = getopt_long(argc, argv, "+n:s:h",
+						main_options, NULL)) != -1) {
+		switch (opt) {
+		case 'n':
+			count = atoi(optarg);
+			break;
+		case 's':
+			size = atoi(optarg);
+			if (size < 1 || size > 4000) {
+				fprintf(stderr, "Invalid packet size\n");
+				exit(1);
+			}
+			break;
+		case 'h':
+		default:
+			usage();
+			exit(0);
+		}
+	}
+
+	for (i = 0; i < (int) sizeof(data); i++)
+		data[i] = rand();
+
+	if (bench_crc(data, sizeof(data), 2000) < 0)
+		exit(1);
+
+	if (size > 0)
+		return bench_packets(size, count) < 0 ? 1 : 0;
+
+	if (bench_packets(16, count) < 0 || bench_packets(256, count) < 0 ||
+					bench_packets(1024, count) < 0)
+		exit(1);
+
+	return 0;
+}
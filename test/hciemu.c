@@ -78,6 +78,16 @@ static inline uint64_t ntoh64(uint64_t n)
 #define VHCI_ACL_MTU		192
 #define VHCI_ACL_MAX_PKT	8
 
+#define VHCI_MAX_PEERS		1024
+#define VHCI_PEER_HANDLE	0x0100
+
+#define VHCI_LOAD_TICK		10	/* ms */
+#define VHCI_HIST_BUCKETS	24
+
+#define VHCI_MAX_UUIDS		16
+#define VHCI_NAME_SIZE		248
+#define VHCI_EIR_SIZE		240
+
 struct vhci_device {
 	uint8_t		features[8];
 	uint8_t		name[248];
@@ -108,6 +118,72 @@ struct vhci_link_info {
 static struct vhci_device vdev;
 static struct vhci_conn *vconn[VHCI_MAX_CONN];
 
+/*
+ * Peers are simulated remote devices, which only exist inside the
+ * emulator.  Their addresses are 00:CA:FE:00:xx:xx with the peer index
+ * in the low octets, and their connection handles start at
+ * VHCI_PEER_HANDLE so they never clash with the ones of vconn.
+ */
+struct vhci_peer {
+	bdaddr_t	bdaddr;
+	uint16_t	handle;		/* 0 while not connected */
+	uint16_t	acl_cnt;	/* packets to report as completed */
+	struct timeval	found;		/* last inquiry result */
+	struct timeval	requested;	/* last connection request */
+	struct timeval	key_req;	/* last link key request */
+};
+
+/* Host reaction times, in power of two buckets of microseconds */
+struct vhci_histogram {
+	const char	*name;
+	unsigned long	count;
+	unsigned long	bucket[VHCI_HIST_BUCKETS];
+	uint64_t	total;
+	uint64_t	max;
+};
+
+struct vhci_load {
+	unsigned int	inquiry_peers;	/* results for every inquiry */
+	unsigned int	connect_peers;	/* incoming connection requests */
+	unsigned int	rate;		/* results and requests per second */
+	unsigned int	acl_rate;	/* ACL packets per second */
+	unsigned int	acl_size;
+
+	unsigned int	inquiry_next;
+	unsigned int	connect_next;
+	unsigned int	acl_next;
+	unsigned int	inquiry_credit;
+	unsigned int	connect_credit;
+	unsigned int	acl_credit;
+	uint8_t		page_scan;
+
+	unsigned long	results;
+	unsigned long	requests;
+	unsigned long	acl_in;
+	unsigned long	acl_out;
+};
+
+/* What the virtual devices report about themselves */
+struct vhci_eir {
+	const char	*name;		/* peer index is appended */
+	uint16_t	uuid[VHCI_MAX_UUIDS];
+	int		uuid_count;
+	uint8_t		raw[VHCI_EIR_SIZE];
+	int		raw_len;	/* sent as is when set */
+};
+
+static struct vhci_peer vpeer[VHCI_MAX_PEERS];
+static struct vhci_load vload;
+static struct vhci_eir veir = {
+	.name		= "hciemu peer",
+	.uuid		= { 0x1101, 0x110b, 0x111e },	/* SPP, A2DP, HFP */
+	.uuid_count	= 3,
+};
+
+static struct vhci_histogram hist_name = { "Inquiry result to name request" };
+static struct vhci_histogram hist_accept = { "Connection request to accept" };
+static struct vhci_histogram hist_key = { "Link key request to reply" };
+
 struct btsnoop_hdr {
 	uint8_t		id[8];		/* Identification Pattern */
 	uint32_t	version;	/* Version Number = 1 */
@@ -248,12 +324,112 @@ static struct vhci_conn *conn_get_by_bdaddr(bdaddr_t *ba)
 	register int i;
 
 	for (i = 0; i < VHCI_MAX_CONN; i++)
-		if (!bacmp(&vconn[i]->dest, ba))
+		if (vconn[i] && !bacmp(&vconn[i]->dest, ba))
 			return vconn[i];
 
 	return NULL;
 }
 
+static struct vhci_peer *peer_get_by_bdaddr(bdaddr_t *ba)
+{
+	unsigned int index;
+
+	if (ba->b[2] != 0x00 || ba->b[3] != 0xfe ||
+				ba->b[4] != 0xca || ba->b[5] != 0x00)
+		return NULL;
+
+	index = ba->b[0] | (ba->b[1] << 8);
+	if (index >= VHCI_MAX_PEERS)
+		return NULL;
+
+	return &vpeer[index];
+}
+
+static struct vhci_peer *peer_get_by_handle(uint16_t handle)
+{
+	struct vhci_peer *peer;
+
+	if (handle < VHCI_PEER_HANDLE ||
+				handle >= VHCI_PEER_HANDLE + VHCI_MAX_PEERS)
+		return NULL;
+
+	peer = &vpeer[handle - VHCI_PEER_HANDLE];
+	if (peer->handle != handle)
+		return NULL;
+
+	return peer;
+}
+
+static void hist_add(struct vhci_histogram *hist, struct timeval *since)
+{
+	struct timeval now;
+	uint64_t usec;
+	int i;
+
+	if (!since->tv_sec && !since->tv_usec)
+		return;
+
+	gettimeofday(&now, NULL);
+	usec = (now.tv_sec - since->tv_sec) * 1000000ll +
+					(now.tv_usec - since->tv_usec);
+	memset(since, 0, sizeof(*since));
+
+	for (i = 0; i < VHCI_HIST_BUCKETS - 1; i++)
+		if (usec < (2ull << i))
+			break;
+
+	hist->bucket[i]++;
+	hist->count++;
+	hist->total += usec;
+	if (usec > hist->max)
+		hist->max = usec;
+}
+
+static void hist_print(struct vhci_histogram *hist)
+{
+	int i;
+
+	if (!hist->count)
+		return;
+
+	syslog(LOG_INFO, "%s: %lu samples, avg %llu usec, max %llu usec",
+				hist->name, hist->count,
+				(unsigned long long) (hist->total / hist->count),
+				(unsigned long long) hist->max);
+
+	for (i = 0; i < VHCI_HIST_BUCKETS; i++) {
+		if (!hist->bucket[i])
+			continue;
+
+		syslog(LOG_INFO, "  < %8llu usec: %lu",
+				2ull << i, hist->bucket[i]);
+	}
+}
+
+static void send_event(uint8_t evt, void *data, int plen)
+{
+	uint8_t buf[HCI_MAX_FRAME_SIZE], *ptr = buf;
+	hci_event_hdr *he;
+
+	/* Packet type */
+	*ptr++ = HCI_EVENT_PKT;
+
+	/* Event header */
+	he = (void *) ptr; ptr += HCI_EVENT_HDR_SIZE;
+
+	he->evt  = evt;
+	he->plen = plen;
+
+	memcpy(ptr, data, plen);
+	ptr += plen;
+
+	write_snoop(vdev.dd, HCI_EVENT_PKT, 1, buf, ptr - buf);
+
+	if (write(vdev.fd, buf, ptr - buf) < 0)
+		syslog(LOG_ERR, "Can't send event: %s (%d)",
+						strerror(errno), errno);
+}
+
 static void command_status(uint16_t ogf, uint16_t ocf, uint8_t status)
 {
 	uint8_t buf[HCI_MAX_FRAME_SIZE], *ptr = buf;
@@ -430,6 +606,434 @@ static void num_completed_pkts(struct vhci_conn *conn)
 						strerror(errno), errno);
 }
 
+static void peer_init(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < VHCI_MAX_PEERS; i++) {
+		vpeer[i].bdaddr.b[0] = i & 0xff;
+		vpeer[i].bdaddr.b[1] = i >> 8;
+		vpeer[i].bdaddr.b[2] = 0x00;
+		vpeer[i].bdaddr.b[3] = 0xfe;
+		vpeer[i].bdaddr.b[4] = 0xca;
+		vpeer[i].bdaddr.b[5] = 0x00;
+	}
+}
+
+static int peer_name(struct vhci_peer *peer, char *name)
+{
+	int len;
+
+	len = snprintf(name, VHCI_NAME_SIZE, "%s %u", veir.name,
+					(unsigned int) (peer - vpeer));
+
+	return len < VHCI_NAME_SIZE ? len : VHCI_NAME_SIZE - 1;
+}
+
+static void peer_eir(struct vhci_peer *peer, uint8_t *eir)
+{
+	char name[VHCI_NAME_SIZE];
+	uint8_t *ptr = eir;
+	int i, len, max;
+
+	if (veir.raw_len > 0) {
+		memcpy(eir, veir.raw, veir.raw_len);
+		return;
+	}
+
+	/* Whatever the UUID list leaves free goes to the name */
+	max = VHCI_EIR_SIZE - 2;
+	if (veir.uuid_count > 0)
+		max -= 2 + veir.uuid_count * 2;
+
+	len = peer_name(peer, name);
+
+	/* Complete or shortened local name */
+	ptr[0] = (len > max ? max : len) + 1;
+	ptr[1] = len > max ? 0x08 : 0x09;
+	memcpy(ptr + 2, name, ptr[0] - 1);
+	ptr += ptr[0] + 1;
+
+	if (veir.uuid_count == 0)
+		return;
+
+	/* Complete list of 16-bit service UUIDs */
+	ptr[0] = veir.uuid_count * 2 + 1;
+	ptr[1] = 0x03;
+	for (i = 0; i < veir.uuid_count; i++) {
+		ptr[2 + i * 2] = veir.uuid[i] & 0xff;
+		ptr[3 + i * 2] = veir.uuid[i] >> 8;
+	}
+}
+
+static int parse_uuids(const char *str)
+{
+	char *end;
+
+	veir.uuid_count = 0;
+
+	while (*str != '\0') {
+		if (veir.uuid_count == VHCI_MAX_UUIDS)
+			return -1;
+
+		veir.uuid[veir.uuid_count++] = strtoul(str, &end, 16);
+		if (end == str || (*end != ',' && *end != '\0'))
+			return -1;
+
+		str = *end == ',' ? end + 1 : end;
+	}
+
+	return 0;
+}
+
+static int parse_eir(const char *str)
+{
+	unsigned int val;
+
+	veir.raw_len = 0;
+
+	while (str[0] != '\0') {
+		if (veir.raw_len == VHCI_EIR_SIZE || !isxdigit(str[0]) ||
+							!isxdigit(str[1]))
+			return -1;
+
+		sscanf(str, "%2x", &val);
+		veir.raw[veir.raw_len++] = val;
+		str += 2;
+	}
+
+	return 0;
+}
+
+static void inquiry_result(struct vhci_peer *peer)
+{
+	uint8_t buf[1 + EXTENDED_INQUIRY_INFO_SIZE];
+	uint8_t dev_class[3] = { 0x04, 0x04, 0x24 };
+	uint16_t index = peer - vpeer;
+	extended_inquiry_info *ei;
+	inquiry_info_with_rssi *ir;
+	inquiry_info *ii;
+
+	memset(buf, 0, sizeof(buf));
+	buf[0] = 1;
+
+	switch (vdev.inq_mode) {
+	case 0x02:
+		ei = (void *) (buf + 1);
+		bacpy(&ei->bdaddr, &peer->bdaddr);
+		ei->pscan_rep_mode = 0x01;
+		memcpy(ei->dev_class, dev_class, 3);
+		ei->clock_offset = htobs(index);
+		ei->rssi = -40 - (index % 50);
+		peer_eir(peer, ei->data);
+		send_event(EVT_EXTENDED_INQUIRY_RESULT, buf,
+					1 + EXTENDED_INQUIRY_INFO_SIZE);
+		break;
+
+	case 0x01:
+		ir = (void *) (buf + 1);
+		bacpy(&ir->bdaddr, &peer->bdaddr);
+		ir->pscan_rep_mode = 0x01;
+		memcpy(ir->dev_class, dev_class, 3);
+		ir->clock_offset = htobs(index);
+		ir->rssi = -40 - (index % 50);
+		send_event(EVT_INQUIRY_RESULT_WITH_RSSI, buf,
+					1 + INQUIRY_INFO_WITH_RSSI_SIZE);
+		break;
+
+	default:
+		ii = (void *) (buf + 1);
+		bacpy(&ii->bdaddr, &peer->bdaddr);
+		ii->pscan_rep_mode = 0x01;
+		memcpy(ii->dev_class, dev_class, 3);
+		ii->clock_offset = htobs(index);
+		send_event(EVT_INQUIRY_RESULT, buf, 1 + INQUIRY_INFO_SIZE);
+		break;
+	}
+
+	gettimeofday(&peer->found, NULL);
+	vload.results++;
+}
+
+static void inquiry_complete(void)
+{
+	uint8_t status = 0x00;
+
+	send_event(EVT_INQUIRY_COMPLETE, &status, 1);
+}
+
+static void peer_connect_request(struct vhci_peer *peer)
+{
+	evt_conn_request cr;
+
+	bacpy(&cr.bdaddr, &peer->bdaddr);
+	cr.dev_class[0] = 0x04;
+	cr.dev_class[1] = 0x04;
+	cr.dev_class[2] = 0x24;
+	cr.link_type = ACL_LINK;
+
+	send_event(EVT_CONN_REQUEST, &cr, EVT_CONN_REQUEST_SIZE);
+
+	gettimeofday(&peer->requested, NULL);
+	vload.requests++;
+}
+
+static void peer_connect_complete(struct vhci_peer *peer, uint8_t status)
+{
+	evt_conn_complete cc;
+
+	if (!status)
+		peer->handle = VHCI_PEER_HANDLE + (peer - vpeer);
+
+	bacpy(&cc.bdaddr, &peer->bdaddr);
+	cc.status = status;
+	cc.handle = htobs(peer->handle);
+	cc.link_type = ACL_LINK;
+	cc.encr_mode = 0x00;
+
+	send_event(EVT_CONN_COMPLETE, &cc, EVT_CONN_COMPLETE_SIZE);
+}
+
+static void peer_disconnect(struct vhci_peer *peer, uint8_t reason)
+{
+	evt_disconn_complete dc;
+
+	dc.status = 0x00;
+	dc.handle = htobs(peer->handle);
+	dc.reason = reason;
+
+	peer->handle = 0;
+	peer->acl_cnt = 0;
+
+	send_event(EVT_DISCONN_COMPLETE, &dc, EVT_DISCONN_COMPLETE_SIZE);
+}
+
+static void peer_acl_data(struct vhci_peer *peer)
+{
+	uint8_t buf[HCI_MAX_FRAME_SIZE], *ptr = buf;
+	hci_acl_hdr *ah;
+	int i;
+
+	/* Packet type */
+	*ptr++ = HCI_ACLDATA_PKT;
+
+	/* ACL header */
+	ah = (void *) ptr; ptr += HCI_ACL_HDR_SIZE;
+
+	ah->handle = htobs(acl_handle_pack(peer->handle, ACL_START));
+	ah->dlen = htobs(vload.acl_size);
+
+	/* L2CAP connectionless data nobody listens to */
+	*((uint16_t *) ptr) = htobs(vload.acl_size - 4); ptr += 2;
+	*((uint16_t *) ptr) = htobs(0x0002); ptr += 2;
+
+	for (i = 4; i < vload.acl_size; i++)
+		*ptr++ = i;
+
+	write_snoop(vdev.dd, HCI_ACLDATA_PKT, 1, buf, ptr - buf);
+
+	if (write(vdev.fd, buf, ptr - buf) < 0)
+		syslog(LOG_ERR, "Can't send ACL data: %s (%d)",
+						strerror(errno), errno);
+
+	vload.acl_out++;
+}
+
+static void peer_num_completed_pkts(void)
+{
+	uint8_t buf[EVT_NUM_COMP_PKTS_SIZE + 4];
+	unsigned int i;
+
+	for (i = 0; i < VHCI_MAX_PEERS; i++) {
+		if (!vpeer[i].acl_cnt)
+			continue;
+
+		buf[0] = 1;
+		bt_put_unaligned(htobs(vpeer[i].handle), (uint16_t *) &buf[1]);
+		bt_put_unaligned(htobs(vpeer[i].acl_cnt), (uint16_t *) &buf[3]);
+
+		send_event(EVT_NUM_COMP_PKTS, buf, sizeof(buf));
+
+		vpeer[i].acl_cnt = 0;
+	}
+}
+
+static gboolean load_tick(gpointer data)
+{
+	struct vhci_peer *peer;
+	unsigned int i;
+
+	if (vload.inquiry_next < vload.inquiry_peers) {
+		vload.inquiry_credit += vload.rate * VHCI_LOAD_TICK;
+
+		while (vload.inquiry_credit >= 1000 &&
+				vload.inquiry_next < vload.inquiry_peers) {
+			vload.inquiry_credit -= 1000;
+			inquiry_result(&vpeer[vload.inquiry_next++]);
+		}
+
+		if (vload.inquiry_next == vload.inquiry_peers)
+			inquiry_complete();
+	}
+
+	if (vload.page_scan && vload.connect_next < vload.connect_peers) {
+		vload.connect_credit += vload.rate * VHCI_LOAD_TICK;
+
+		while (vload.connect_credit >= 1000 &&
+				vload.connect_next < vload.connect_peers) {
+			vload.connect_credit -= 1000;
+
+			peer = &vpeer[vload.connect_next++];
+			if (!peer->handle)
+				peer_connect_request(peer);
+		}
+	}
+
+	if (vload.acl_rate) {
+		vload.acl_credit += vload.acl_rate * VHCI_LOAD_TICK;
+
+		/* Round robin over the connected peers */
+		for (i = 0; i < VHCI_MAX_PEERS && vload.acl_credit >= 1000; i++) {
+			peer = &vpeer[vload.acl_next];
+			vload.acl_next = (vload.acl_next + 1) % VHCI_MAX_PEERS;
+
+			if (!peer->handle)
+				continue;
+
+			vload.acl_credit -= 1000;
+			peer_acl_data(peer);
+		}
+
+		/* Don't save up for a burst while nobody is connected */
+		if (vload.acl_credit >= 1000)
+			vload.acl_credit = 0;
+	}
+
+	peer_num_completed_pkts();
+
+	return TRUE;
+}
+
+static void load_report(void)
+{
+	syslog(LOG_INFO, "Sent %lu inquiry results, %lu connection requests "
+				"and %lu ACL packets, received %lu ACL packets",
+				vload.results, vload.requests,
+				vload.acl_out, vload.acl_in);
+
+	hist_print(&hist_name);
+	hist_print(&hist_accept);
+	hist_print(&hist_key);
+}
+
+static void remote_name_request(uint8_t *data)
+{
+	remote_name_req_cp *cp = (void *) data;
+	evt_remote_name_req_complete rn;
+	struct vhci_peer *peer;
+
+	memset(&rn, 0, sizeof(rn));
+	bacpy(&rn.bdaddr, &cp->bdaddr);
+
+	peer = peer_get_by_bdaddr(&cp->bdaddr);
+	if (peer) {
+		hist_add(&hist_name, &peer->found);
+		peer_name(peer, (char *) rn.name);
+	} else
+		rn.status = 0x04;	/* Page timeout */
+
+	send_event(EVT_REMOTE_NAME_REQ_COMPLETE, &rn,
+					EVT_REMOTE_NAME_REQ_COMPLETE_SIZE);
+}
+
+static void read_remote_features(uint8_t *data)
+{
+	read_remote_features_cp *cp = (void *) data;
+	evt_read_remote_features_complete rf;
+
+	memset(&rf, 0, sizeof(rf));
+	rf.handle = cp->handle;
+
+	if (peer_get_by_handle(btohs(cp->handle)))
+		memcpy(rf.features, vdev.features, 8);
+	else
+		rf.status = 0x02;	/* Unknown connection identifier */
+
+	send_event(EVT_READ_REMOTE_FEATURES_COMPLETE, &rf,
+				EVT_READ_REMOTE_FEATURES_COMPLETE_SIZE);
+}
+
+static void auth_complete(uint16_t handle, uint8_t status)
+{
+	evt_auth_complete ac;
+
+	ac.status = status;
+	ac.handle = htobs(handle);
+
+	send_event(EVT_AUTH_COMPLETE, &ac, EVT_AUTH_COMPLETE_SIZE);
+}
+
+static void auth_requested(uint8_t *data)
+{
+	auth_requested_cp *cp = (void *) data;
+	struct vhci_peer *peer;
+
+	peer = peer_get_by_handle(btohs(cp->handle));
+	if (!peer) {
+		auth_complete(btohs(cp->handle), 0x02);
+		return;
+	}
+
+	/* Ask the host for a stored link key first */
+	send_event(EVT_LINK_KEY_REQ, &peer->bdaddr, EVT_LINK_KEY_REQ_SIZE);
+
+	gettimeofday(&peer->key_req, NULL);
+}
+
+/* Reply, negative reply and PIN code commands of the pairing dialog */
+static void pairing_reply(uint16_t ocf, uint8_t *data)
+{
+	struct vhci_peer *peer;
+	evt_link_key_notify kn;
+	uint8_t rp[7];
+	int i;
+
+	rp[0] = 0x00;
+	bacpy((bdaddr_t *) &rp[1], (bdaddr_t *) data);
+	command_complete(OGF_LINK_CTL, ocf, sizeof(rp), rp);
+
+	peer = peer_get_by_bdaddr((bdaddr_t *) data);
+	if (!peer || !peer->handle)
+		return;
+
+	switch (ocf) {
+	case OCF_LINK_KEY_REPLY:
+		hist_add(&hist_key, &peer->key_req);
+		auth_complete(peer->handle, 0x00);
+		break;
+
+	case OCF_LINK_KEY_NEG_REPLY:
+		hist_add(&hist_key, &peer->key_req);
+		send_event(EVT_PIN_CODE_REQ, &peer->bdaddr,
+						EVT_PIN_CODE_REQ_SIZE);
+		break;
+
+	case OCF_PIN_CODE_REPLY:
+		bacpy(&kn.bdaddr, &peer->bdaddr);
+		for (i = 0; i < 16; i++)
+			kn.link_key[i] = i ^ peer->bdaddr.b[0];
+		kn.key_type = 0x00;
+
+		send_event(EVT_LINK_KEY_NOTIFY, &kn, EVT_LINK_KEY_NOTIFY_SIZE);
+		auth_complete(peer->handle, 0x00);
+		break;
+
+	case OCF_PIN_CODE_NEG_REPLY:
+		auth_complete(peer->handle, 0x05);
+		break;
+	}
+}
+
 static int scan_enable(uint8_t *data)
 {
 	struct sockaddr_in sa;
@@ -437,6 +1041,8 @@ static int scan_enable(uint8_t *data)
 	bdaddr_t ba;
 	int sk, opt;
 
+	vload.page_scan = *data & SCAN_PAGE;
+
 	if (!(*data & SCAN_PAGE)) {
 		if (vdev.scan) {
 			g_io_channel_close(vdev.scan);
@@ -486,8 +1092,16 @@ failed:
 static void accept_connection(uint8_t *data)
 {
 	accept_conn_req_cp *cp = (void *) data;
+	struct vhci_peer *peer;
 	struct vhci_conn *conn;
 
+	peer = peer_get_by_bdaddr(&cp->bdaddr);
+	if (peer) {
+		hist_add(&hist_accept, &peer->requested);
+		peer_connect_complete(peer, 0x00);
+		return;
+	}
+
 	if (!(conn = conn_get_by_bdaddr(&cp->bdaddr)))
 		return;
 
@@ -510,14 +1124,34 @@ static void close_connection(struct vhci_conn *conn)
 	free(conn);
 }
 
+static void reject_connection(uint8_t *data)
+{
+	reject_conn_req_cp *cp = (void *) data;
+	struct vhci_peer *peer;
+
+	peer = peer_get_by_bdaddr(&cp->bdaddr);
+	if (!peer)
+		return;
+
+	hist_add(&hist_accept, &peer->requested);
+	peer_connect_complete(peer, cp->reason);
+}
+
 static void disconnect(uint8_t *data)
 {
 	disconnect_cp *cp = (void *) data;
+	struct vhci_peer *peer;
 	struct vhci_conn *conn;
 	uint16_t handle;
 
 	handle = btohs(cp->handle);
 
+	peer = peer_get_by_handle(handle);
+	if (peer) {
+		peer_disconnect(peer, 0x16);
+		return;
+	}
+
 	if (handle > VHCI_MAX_CONN)
 		return;
 
@@ -531,11 +1165,18 @@ static void create_connection(uint8_t *data)
 {
 	create_conn_cp *cp = (void *) data;
 	struct vhci_link_info info;
+	struct vhci_peer *peer;
 	struct vhci_conn *conn;
 	struct sockaddr_in sa;
 	int h, sk, opt;
 	bdaddr_t ba;
 
+	peer = peer_get_by_bdaddr(&cp->bdaddr);
+	if (peer) {
+		peer_connect_complete(peer, 0x00);
+		return;
+	}
+
 	for (h = 0; h < VHCI_MAX_CONN; h++)
 		if (!vconn[h])
 			goto do_connect;
@@ -610,6 +1251,20 @@ static void hci_link_control(uint16_t ocf, int plen, uint8_t *data)
 	const uint16_t ogf = OGF_LINK_CTL;
 
 	switch (ocf) {
+	case OCF_INQUIRY:
+		command_status(ogf, ocf, 0x00);
+		vload.inquiry_next = 0;
+		vload.inquiry_credit = 0;
+		if (!vload.inquiry_peers)
+			inquiry_complete();
+		break;
+
+	case OCF_INQUIRY_CANCEL:
+		vload.inquiry_next = vload.inquiry_peers;
+		status = 0x00;
+		command_complete(ogf, ocf, 1, &status);
+		break;
+
 	case OCF_CREATE_CONN:
 		command_status(ogf, ocf, 0x00);
 		create_connection(data);
@@ -620,11 +1275,38 @@ static void hci_link_control(uint16_t ocf, int plen, uint8_t *data)
 		accept_connection(data);
 		break;
 
+	case OCF_REJECT_CONN_REQ:
+		command_status(ogf, ocf, 0x00);
+		reject_connection(data);
+		break;
+
 	case OCF_DISCONNECT:
 		command_status(ogf, ocf, 0x00);
 		disconnect(data);
 		break;
 
+	case OCF_REMOTE_NAME_REQ:
+		command_status(ogf, ocf, 0x00);
+		remote_name_request(data);
+		break;
+
+	case OCF_READ_REMOTE_FEATURES:
+		command_status(ogf, ocf, 0x00);
+		read_remote_features(data);
+		break;
+
+	case OCF_AUTH_REQUESTED:
+		command_status(ogf, ocf, 0x00);
+		auth_requested(data);
+		break;
+
+	case OCF_LINK_KEY_REPLY:
+	case OCF_LINK_KEY_NEG_REPLY:
+	case OCF_PIN_CODE_REPLY:
+	case OCF_PIN_CODE_NEG_REPLY:
+		pairing_reply(ocf, data);
+		break;
+
 	default:
 		status = 0x01;
 		command_complete(ogf, ocf, 1, &status);
@@ -844,12 +1526,21 @@ static void hci_command(uint8_t *data)
 static void hci_acl_data(uint8_t *data)
 {
 	hci_acl_hdr *ah = (void *) data;
+	struct vhci_peer *peer;
 	struct vhci_conn *conn;
 	uint16_t handle;
 	int fd;
 
 	handle = acl_handle(btohs(ah->handle));
 
+	peer = peer_get_by_handle(handle);
+	if (peer) {
+		/* Reported as completed with the next load tick */
+		peer->acl_cnt++;
+		vload.acl_in++;
+		return;
+	}
+
 	if (handle > VHCI_MAX_CONN || !(conn = vconn[handle - 1])) {
 		syslog(LOG_ERR, "Bad connection handle %d", handle);
 		return;
@@ -1178,6 +1869,14 @@ static void usage(void)
 		"\t[-b bdaddr] emulate specified address\n"
 		"\t[-s file] create snoop file\n"
 		"\t[-n] do not detach\n"
+		"\t[-i peers] report peers devices for every inquiry\n"
+		"\t[-c peers] request connections from peers devices\n"
+		"\t[-r rate] inquiry results and connection requests per second\n"
+		"\t[-a rate] send ACL packets per second to connected peers\n"
+		"\t[-l size] size of these ACL packets\n"
+		"\t[-N name] name of the peers, their index is appended\n"
+		"\t[-u uuids] comma separated 16-bit UUIDs in the peers EIR\n"
+		"\t[-e hex] raw EIR data of the peers\n"
 		"\t[-h] help, you are looking at it\n");
 }
 
@@ -1186,6 +1885,14 @@ static struct option main_options[] = {
 	{ "bdaddr",	1, 0, 'b' },
 	{ "snoop",	1, 0, 's' },
 	{ "nodetach",	0, 0, 'n' },
+	{ "inquiry",	1, 0, 'i' },
+	{ "connect",	1, 0, 'c' },
+	{ "rate",	1, 0, 'r' },
+	{ "acl",	1, 0, 'a' },
+	{ "aclsize",	1, 0, 'l' },
+	{ "name",	1, 0, 'N' },
+	{ "uuids",	1, 0, 'u' },
+	{ "eir",	1, 0, 'e' },
 	{ "help",	0, 0, 'h' },
 	{ 0 }
 };
@@ -1200,7 +1907,10 @@ int main(int argc, char *argv[])
 
 	bacpy(&bdaddr, BDADDR_ANY);
 
-	while ((opt=getopt_long(argc, argv, "d:b:s:nh", main_options, NULL)) != EOF) {
+	vload.rate = 100;
+	vload.acl_size = 64;
+
+	while ((opt=getopt_long(argc, argv, "d:b:s:ni:c:r:a:l:N:u:e:h", main_options, NULL)) != EOF) {
 		switch(opt) {
 		case 'd':
 			device = strdup(optarg);
@@ -1218,6 +1928,52 @@ int main(int argc, char *argv[])
 			detach = 0;
 			break;
 
+		case 'i':
+			vload.inquiry_peers = atoi(optarg);
+			if (vload.inquiry_peers > VHCI_MAX_PEERS)
+				vload.inquiry_peers = VHCI_MAX_PEERS;
+			break;
+
+		case 'c':
+			vload.connect_peers = atoi(optarg);
+			if (vload.connect_peers > VHCI_MAX_PEERS)
+				vload.connect_peers = VHCI_MAX_PEERS;
+			break;
+
+		case 'r':
+			vload.rate = atoi(optarg);
+			break;
+
+		case 'a':
+			vload.acl_rate = atoi(optarg);
+			break;
+
+		case 'l':
+			vload.acl_size = atoi(optarg);
+			if (vload.acl_size < 4)
+				vload.acl_size = 4;
+			else if (vload.acl_size > VHCI_ACL_MTU)
+				vload.acl_size = VHCI_ACL_MTU;
+			break;
+
+		case 'N':
+			veir.name = strdup(optarg);
+			break;
+
+		case 'u':
+			if (parse_uuids(optarg) < 0) {
+				fprintf(stderr, "Invalid UUID list\n");
+				exit(1);
+			}
+			break;
+
+		case 'e':
+			if (parse_eir(optarg) < 0) {
+				fprintf(stderr, "Invalid EIR data\n");
+				exit(1);
+			}
+			break;
+
 		case 'h':
 		default:
 			usage();
@@ -1334,14 +2090,23 @@ int main(int argc, char *argv[])
 	vdev.fd = fd;
 	vdev.dd = dd;
 
+	peer_init();
+
+	/* No inquiry results until the host starts an inquiry */
+	vload.inquiry_next = vload.inquiry_peers;
+
 	dev_io = g_io_channel_unix_new(fd);
 	g_io_add_watch(dev_io, G_IO_IN, io_hci_data, NULL);
 
+	g_timeout_add(VHCI_LOAD_TICK, load_tick, NULL);
+
 	setpriority(PRIO_PROCESS, 0, -19);
 
 	/* Start event processor */
 	g_main_loop_run(event_loop);
 
+	load_report();
+
 	close(fd);
 
 	if (dd >= 0)
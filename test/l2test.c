@@ -46,6 +46,9 @@
 #include <bluetooth/hci_lib.h>
 #include <bluetooth/l2cap.h>
 
+#include "stats.h"
+#include "traffic.h"
+
 #define NIBBLE_TO_ASCII(c)  ((c) < 0x0a ? (c) + 0x30 : (c) + 0x57)
 
 /* Test modes */
@@ -64,6 +67,9 @@ enum {
 	CSENDRECV,
 	INFOREQ,
 	PAIRING,
+	LECHO,
+	LATENCY,
+	MULTISEND,
 };
 
 static unsigned char *buf;
@@ -98,6 +104,12 @@ static int count = 1;
 /* Default delay after sending count number of frames */
 static unsigned long delay = 0;
 
+/* Default number of channels of the multi channel send mode */
+static int channels = 4;
+
+/* Default report format */
+static int format = STATS_TEXT;
+
 static char *filename = NULL;
 
 static int rfcmode = 0;
@@ -111,11 +123,6 @@ static int reliable = 0;
 static int timestamp = 0;
 static int defer_setup = 0;
 
-static float tv2fl(struct timeval tv)
-{
-	return (float)tv.tv_sec + (float)(tv.tv_usec/1000000.0);
-}
-
 static char *ltoh(unsigned long c, char* s)
 {
 	int c1;
@@ -600,7 +607,7 @@ static void dump_mode(int sk)
 
 static void recv_mode(int sk)
 {
-	struct timeval tv_beg, tv_end, tv_diff;
+	uint64_t start, elapsed;
 	struct pollfd p;
 	char ts[30];
 	long total;
@@ -629,7 +636,7 @@ static void recv_mode(int sk)
 
 	seq = 0;
 	while (1) {
-		gettimeofday(&tv_beg, NULL);
+		start = stats_now();
 		total = 0;
 		while (total < data_size) {
 			uint32_t sq;
@@ -698,12 +705,16 @@ static void recv_mode(int sk)
 
 			total += len;
 		}
-		gettimeofday(&tv_end, NULL);
+		elapsed = stats_now() - start;
 
-		timersub(&tv_end, &tv_beg, &tv_diff);
+		if (format != STATS_TEXT) {
+			stats_report_throughput(format, "recv", -1, total,
+								elapsed);
+			continue;
+		}
 
 		syslog(LOG_INFO,"%s%ld bytes in %.2f sec, %.2f kB/s", ts, total,
-			tv2fl(tv_diff), (float)(total / tv2fl(tv_diff) ) / 1024.0);
+			elapsed / 1000000.0, total * 1000000.0 / elapsed / 1024.0);
 	}
 }
 
@@ -802,6 +813,63 @@ static void send_and_recv_mode(int sk)
 	return;
 }
 
+static void traffic_opts_init(struct traffic_opts *opts)
+{
+	memset(opts, 0, sizeof(*opts));
+	opts->buf = buf;
+	opts->data_size = data_size;
+	opts->buffer_size = buffer_size;
+	opts->num_frames = num_frames;
+	opts->count = count;
+	opts->delay = delay;
+	opts->format = format;
+}
+
+static void echo_mode(int sk)
+{
+	struct traffic_opts opts;
+
+	traffic_opts_init(&opts);
+	traffic_echo(&opts, sk);
+}
+
+static void latency_mode(int sk)
+{
+	struct traffic_opts opts;
+
+	if (data_size < 0 || data_size > omtu)
+		data_size = omtu;
+
+	traffic_opts_init(&opts);
+	traffic_latency(&opts, sk);
+}
+
+static void multi_send_mode(char *svr)
+{
+	struct traffic_opts opts;
+	int *sk, i;
+
+	sk = calloc(channels, sizeof(*sk));
+	if (!sk) {
+		syslog(LOG_ERR, "Can't allocate channels");
+		exit(1);
+	}
+
+	for (i = 0; i < channels; i++) {
+		sk[i] = do_connect(svr);
+		if (sk[i] < 0)
+			exit(1);
+	}
+
+	if (data_size < 0 || data_size > omtu)
+		data_size = omtu;
+
+	traffic_opts_init(&opts);
+	traffic_multi_send(&opts, sk, channels);
+
+	free(sk);
+}
+
 static void reconnect_mode(char *svr)
 {
 	while (1) {
@@ -1060,7 +1128,10 @@ static void usage(void)
 		"\t-c connect, disconnect, connect, ...\n"
 		"\t-m multiple connects\n"
 		"\t-p trigger dedicated bonding\n"
-		"\t-z information request\n");
+		"\t-z information request\n"
+		"\t-e listen and echo incoming data\n"
+		"\t-l connect and measure round trip time (against -e)\n"
+		"\t-g connect multiple channels and send on all of them\n");
 
 	printf("Options:\n"
 		"\t[-b bytes] [-i device] [-P psm]\n"
@@ -1082,7 +1153,9 @@ static void usage(void)
 		"\t[-E] request encryption\n"
 		"\t[-S] secure connection\n"
 		"\t[-M] become master\n"
-		"\t[-T] enable timestamps\n");
+		"\t[-T] enable timestamps\n"
+		"\t[-J num] number of channels to send on (default = 4)\n"
+		"\t[-K format] report format: text, csv or json (default = text)\n");
 }
 
 int main(int argc, char *argv[])
@@ -1092,7 +1165,7 @@ int main(int argc, char *argv[])
 
 	bacpy(&bdaddr, BDADDR_ANY);
 
-	while ((opt=getopt(argc,argv,"rdscuwmntqxyzpb:i:P:I:O:B:N:L:W:C:D:X:F:Q:Z:RUGAESMT")) != EOF) {
+	while ((opt=getopt(argc,argv,"rdscuwmntqxyzpelgb:i:P:I:O:B:N:L:W:C:D:X:F:Q:Z:J:K:RUGAESMT")) != EOF) {
 		switch(opt) {
 		case 'r':
 			mode = RECV;
@@ -1158,6 +1231,20 @@ int main(int argc, char *argv[])
 			need_addr = 1;
 			break;
 
+		case 'e':
+			mode = LECHO;
+			break;
+
+		case 'l':
+			mode = LATENCY;
+			need_addr = 1;
+			break;
+
+		case 'g':
+			mode = MULTISEND;
+			need_addr = 1;
+			break;
+
 		case 'b':
 			data_size = atoi(optarg);
 			break;
@@ -1256,6 +1343,20 @@ int main(int argc, char *argv[])
 			txwin_size = atoi(optarg);
 			break;
 
+		case 'J':
+			channels = atoi(optarg);
+			if (channels < 1)
+				channels = 1;
+			break;
+
+		case 'K':
+			format = stats_format(optarg);
+			if (format < 0) {
+				usage();
+				exit(1);
+			}
+			break;
+
 		default:
 			usage();
 			exit(1);
@@ -1353,6 +1454,24 @@ int main(int argc, char *argv[])
 		case PAIRING:
 			do_pairing(argv[optind]);
 			exit(0);
+
+		case LECHO:
+			do_listen(echo_mode);
+			break;
+
+		case LATENCY:
+			sk = do_connect(argv[optind]);
+			if (sk < 0)
+				exit(1);
+			traffic_catch_term();
+			latency_mode(sk);
+			close(sk);
+			break;
+
+		case MULTISEND:
+			traffic_catch_term();
+			multi_send_mode(argv[optind]);
+			break;
 	}
 
 	syslog(LOG_INFO, "Exit");
@@ -46,6 +46,9 @@
 #include <bluetooth/sdp.h>
 #include <bluetooth/sdp_lib.h>
 
+#include "stats.h"
+#include "traffic.h"
+
 /* Test modes */
 enum {
 	SEND,
@@ -55,7 +58,10 @@ enum {
 	DUMP,
 	CONNECT,
 	CRECV,
-	LSEND
+	LSEND,
+	LECHO,
+	LATENCY,
+	MULTISEND,
 };
 
 static unsigned char *buf;
@@ -70,6 +76,12 @@ static int count = 1;
 /* Default delay after sending count number of frames */
 static unsigned long delay = 0;
 
+/* Default number of channels of the multi channel send mode */
+static int channels = 4;
+
+/* Default report format */
+static int format = STATS_TEXT;
+
 /* Default addr and channel */
 static bdaddr_t bdaddr;
 static uint16_t uuid = 0x0000;
@@ -86,11 +98,6 @@ static int linger = 0;
 static int timestamp = 0;
 static int defer_setup = 0;
 
-static float tv2fl(struct timeval tv)
-{
-	return (float)tv.tv_sec + (float)(tv.tv_usec/1000000.0);
-}
-
 static uint8_t get_channel(const char *svr, uint16_t uuid)
 {
 	sdp_session_t *sdp;
@@ -414,7 +421,7 @@ static void dump_mode(int sk)
 
 static void recv_mode(int sk)
 {
-	struct timeval tv_beg, tv_end, tv_diff;
+	uint64_t start, elapsed;
 	char ts[30];
 	long total;
 	uint32_t seq;
@@ -425,7 +432,7 @@ static void recv_mode(int sk)
 
 	seq = 0;
 	while (1) {
-		gettimeofday(&tv_beg,NULL);
+		start = stats_now();
 		total = 0;
 		while (total < data_size) {
 			//uint32_t sq;
@@ -475,12 +482,16 @@ static void recv_mode(int sk)
 #endif
 			total += r;
 		}
-		gettimeofday(&tv_end,NULL);
+		elapsed = stats_now() - start;
 
-		timersub(&tv_end,&tv_beg,&tv_diff);
+		if (format != STATS_TEXT) {
+			stats_report_throughput(format, "recv", -1, total,
+								elapsed);
+			continue;
+		}
 
 		syslog(LOG_INFO,"%s%ld bytes in %.2f sec, %.2f kB/s", ts, total,
-			tv2fl(tv_diff), (float)(total / tv2fl(tv_diff) ) / 1024.0);
+			elapsed / 1000000.0, total * 1000000.0 / elapsed / 1024.0);
 	}
 }
 
@@ -534,6 +545,62 @@ static void send_mode(int sk)
 		syslog(LOG_INFO, "Done");
 }
 
+static void traffic_opts_init(struct traffic_opts *opts)
+{
+	memset(opts, 0, sizeof(*opts));
+	opts->buf = buf;
+	opts->data_size = data_size;
+	opts->buffer_size = data_size;
+	opts->num_frames = num_frames;
+	opts->count = count;
+	opts->delay = delay;
+	opts->format = format;
+}
+
+static void echo_mode(int sk)
+{
+	struct traffic_opts opts;
+
+	traffic_opts_init(&opts);
+	traffic_echo(&opts, sk);
+}
+
+static void latency_mode(int sk)
+{
+	struct traffic_opts opts;
+
+	traffic_opts_init(&opts);
+	traffic_latency(&opts, sk);
+}
+
+static void multi_send_mode(char *svr)
+{
+	struct traffic_opts opts;
+	int *sk, i;
+
+	sk = calloc(channels, sizeof(*sk));
+	if (!sk) {
+		syslog(LOG_ERR, "Can't allocate channels");
+		exit(1);
+	}
+
+	/* Every connection needs its own server channel, they are taken
+	 * consecutively from the first one */
+	for (i = 0; i < channels; i++) {
+		sk[i] = do_connect(svr);
+		if (sk[i] < 0)
+			exit(1);
+
+		uuid = 0x0000;
+		channel++;
+	}
+
+	traffic_opts_init(&opts);
+	traffic_multi_send(&opts, sk, channels);
+
+	free(sk);
+}
+
 static void reconnect_mode(char *svr)
 {
 	while(1) {
@@ -576,7 +643,10 @@ static void usage(void)
 		"\t-u connect and receive\n"
 		"\t-n connect and be silent\n"
 		"\t-c connect, disconnect, connect, ...\n"
-		"\t-m multiple connects\n");
+		"\t-m multiple connects\n"
+		"\t-e listen and echo incoming data\n"
+		"\t-l connect and measure round trip time (against -e)\n"
+		"\t-g connect multiple channels and send on all of them\n");
 
 	printf("Options:\n"
 		"\t[-b bytes] [-i device] [-P channel] [-U uuid]\n"
@@ -590,7 +660,9 @@ static void usage(void)
 		"\t[-E] request encryption\n"
 		"\t[-S] secure connection\n"
 		"\t[-M] become master\n"
-		"\t[-T] enable timestamps\n");
+		"\t[-T] enable timestamps\n"
+		"\t[-J num] number of channels to send on (default = 4)\n"
+		"\t[-K format] report format: text, csv or json (default = text)\n");
 }
 
 int main(int argc, char *argv[])
@@ -600,7 +672,7 @@ int main(int argc, char *argv[])
 
 	bacpy(&bdaddr, BDADDR_ANY);
 
-	while ((opt=getopt(argc,argv,"rdscuwmnb:i:P:U:B:N:MAESL:W:C:D:T")) != EOF) {
+	while ((opt=getopt(argc,argv,"rdscuwmnelgb:i:P:U:B:N:MAESL:W:C:D:TJ:K:")) != EOF) {
 		switch (opt) {
 		case 'r':
 			mode = RECV;
@@ -639,6 +711,20 @@ int main(int argc, char *argv[])
 			need_addr = 1;
 			break;
 
+		case 'e':
+			mode = LECHO;
+			break;
+
+		case 'l':
+			mode = LATENCY;
+			need_addr = 1;
+			break;
+
+		case 'g':
+			mode = MULTISEND;
+			need_addr = 1;
+			break;
+
 		case 'b':
 			data_size = atoi(optarg);
 			break;
@@ -707,6 +793,20 @@ int main(int argc, char *argv[])
 			timestamp = 1;
 			break;
 
+		case 'J':
+			channels = atoi(optarg);
+			if (channels < 1)
+				channels = 1;
+			break;
+
+		case 'K':
+			format = stats_format(optarg);
+			if (format < 0) {
+				usage();
+				exit(1);
+			}
+			break;
+
 		default:
 			usage();
 			exit(1);
@@ -771,6 +871,24 @@ int main(int argc, char *argv[])
 				exit(1);
 			dump_mode(sk);
 			break;
+
+		case LECHO:
+			do_listen(echo_mode);
+			break;
+
+		case LATENCY:
+			sk = do_connect(argv[optind]);
+			if (sk < 0)
+				exit(1);
+			traffic_catch_term();
+			latency_mode(sk);
+			close(sk);
+			break;
+
+		case MULTISEND:
+			traffic_catch_term();
+			multi_send_mode(argv[optind]);
+			break;
 	}
 
 	syslog(LOG_INFO, "Exit");
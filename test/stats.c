@@ -0,0 +1,239 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2002-2010  Marcel Holtmann <marcel@holtmann.org>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <syslog.h>
+#include <time.h>
+
+#include "stats.h"
+
+static const double percentiles[] = { 50.0, 90.0, 99.0, 99.9, 99.99 };
+
+static int latency_header = 0;
+static int throughput_header = 0;
+
+uint64_t stats_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int stats_format(const char *str)
+{
+	if (!strcasecmp(str, "text"))
+		return STATS_TEXT;
+
+	if (!strcasecmp(str, "csv"))
+		return STATS_CSV;
+
+	if (!strcasecmp(str, "json"))
+		return STATS_JSON;
+
+	return -1;
+}
+
+void stats_hist_init(struct stats_hist *hist)
+{
+	memset(hist, 0, sizeof(*hist));
+}
+
+static unsigned int bucket_index(uint64_t value)
+{
+	unsigned int mag = 0;
+
+	if (value < 2 * STATS_SUB_BUCKETS)
+		return value;
+
+	while ((value >> mag) >= 2 * STATS_SUB_BUCKETS)
+		mag++;
+
+	if (mag >= STATS_MAGNITUDES)
+		return STATS_BUCKETS - 1;
+
+	return 2 * STATS_SUB_BUCKETS + (mag - 1) * STATS_SUB_BUCKETS +
+				(value >> mag) - STATS_SUB_BUCKETS;
+}
+
+/* Middle of the range of values counted by a bucket */
+static uint64_t bucket_value(unsigned int index)
+{
+	unsigned int mag;
+	uint64_t sub;
+
+	if (index < 2 * STATS_SUB_BUCKETS)
+		return index;
+
+	index -= 2 * STATS_SUB_BUCKETS;
+	mag = index / STATS_SUB_BUCKETS + 1;
+	sub = index % STATS_SUB_BUCKETS + STATS_SUB_BUCKETS;
+
+	return (sub << mag) + ((uint64_t) 1 << (mag - 1));
+}
+
+void stats_hist_add(struct stats_hist *hist, uint64_t usec)
+{
+	if (!hist->count || usec < hist->min)
+		hist->min = usec;
+
+	if (usec > hist->max)
+		hist->max = usec;
+
+	hist->count++;
+	hist->total += usec;
+	hist->bucket[bucket_index(usec)]++;
+}
+
+uint64_t stats_hist_percentile(struct stats_hist *hist, double percent)
+{
+	uint64_t rank, seen = 0;
+	unsigned int i;
+
+	if (!hist->count)
+		return 0;
+
+	rank = (uint64_t) (hist->count * percent / 100.0 + 0.5);
+	if (rank < 1)
+		rank = 1;
+
+	for (i = 0; i < STATS_BUCKETS; i++) {
+		seen += hist->bucket[i];
+		if (seen < rank)
+			continue;
+
+		/* Don't report more than was actually measured */
+		if (bucket_value(i) > hist->max)
+			return hist->max;
+
+		return bucket_value(i);
+	}
+
+	return hist->max;
+}
+
+void stats_report_latency(int format, const char *name,
+						struct stats_hist *hist)
+{
+	uint64_t pct[sizeof(percentiles) / sizeof(percentiles[0])];
+	uint64_t mean;
+	unsigned int i;
+
+	mean = hist->count ? hist->total / hist->count : 0;
+
+	for (i = 0; i < sizeof(pct) / sizeof(pct[0]); i++)
+		pct[i] = stats_hist_percentile(hist, percentiles[i]);
+
+	switch (format) {
+	case STATS_CSV:
+		if (!latency_header) {
+			printf("name,count,min,mean,p50,p90,p99,p99.9,p99.99,"
+								"max\n");
+			latency_header = 1;
+		}
+
+		printf("%s,%llu,%llu,%llu", name,
+				(unsigned long long) hist->count,
+				(unsigned long long) hist->min,
+				(unsigned long long) mean);
+		for (i = 0; i < sizeof(pct) / sizeof(pct[0]); i++)
+			printf(",%llu", (unsigned long long) pct[i]);
+		printf(",%llu\n", (unsigned long long) hist->max);
+		break;
+
+	case STATS_JSON:
+		printf("{\"name\":\"%s\",\"count\":%llu,\"min\":%llu,"
+				"\"mean\":%llu", name,
+				(unsigned long long) hist->count,
+				(unsigned long long) hist->min,
+				(unsigned long long) mean);
+		for (i = 0; i < sizeof(pct) / sizeof(pct[0]); i++)
+			printf(",\"p%g\":%llu", percentiles[i],
+					(unsigned long long) pct[i]);
+		printf(",\"max\":%llu}\n", (unsigned long long) hist->max);
+		break;
+
+	default:
+		syslog(LOG_INFO, "%s: %llu samples, min %llu, mean %llu, "
+				"max %llu usec", name,
+				(unsigned long long) hist->count,
+				(unsigned long long) hist->min,
+				(unsigned long long) mean,
+				(unsigned long long) hist->max);
+		for (i = 0; i < sizeof(pct) / sizeof(pct[0]); i++)
+			syslog(LOG_INFO, "%s: %6g%% %10llu usec", name,
+					percentiles[i],
+					(unsigned long long) pct[i]);
+		return;
+	}
+
+	fflush(stdout);
+}
+
+void stats_report_throughput(int format, const char *name, int channel,
+					uint64_t bytes, uint64_t usec)
+{
+	double kbps = usec ? bytes * 1000000.0 / usec / 1024.0 : 0.0;
+
+	switch (format) {
+	case STATS_CSV:
+		if (!throughput_header) {
+			printf("name,channel,bytes,usec,kBps\n");
+			throughput_header = 1;
+		}
+
+		printf("%s,%d,%llu,%llu,%.2f\n", name, channel,
+				(unsigned long long) bytes,
+				(unsigned long long) usec, kbps);
+		break;
+
+	case STATS_JSON:
+		printf("{\"name\":\"%s\",\"channel\":%d,\"bytes\":%llu,"
+				"\"usec\":%llu,\"kBps\":%.2f}\n", name, channel,
+				(unsigned long long) bytes,
+				(unsigned long long) usec, kbps);
+		break;
+
+	default:
+		if (channel < 0)
+			syslog(LOG_INFO, "%s: %llu bytes in %.2f sec, "
+					"%.2f kB/s", name,
+					(unsigned long long) bytes,
+					usec / 1000000.0, kbps);
+		else
+			syslog(LOG_INFO, "%s %d: %llu bytes in %.2f sec, "
+					"%.2f kB/s", name, channel,
+					(unsigned long long) bytes,
+					usec / 1000000.0, kbps);
+		return;
+	}
+
+	fflush(stdout);
+}
@@ -0,0 +1,67 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2002-2010  Marcel Holtmann <marcel@holtmann.org>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __STATS_H
+#define __STATS_H
+
+#include <stdint.h>
+
+/* Report formats */
+enum {
+	STATS_TEXT,
+	STATS_CSV,
+	STATS_JSON,
+};
+
+/*
+ * Latency histogram with a fixed relative precision: values below 64 are
+ * counted exactly, larger values in 32 sub-buckets per power of two.
+ */
+#define STATS_SUB_BUCKETS	32
+#define STATS_MAGNITUDES	36
+#define STATS_BUCKETS		(2 * STATS_SUB_BUCKETS + \
+				(STATS_MAGNITUDES - 1) * STATS_SUB_BUCKETS)
+
+struct stats_hist {
+	uint64_t count;
+	uint64_t total;
+	uint64_t min;
+	uint64_t max;
+	uint64_t bucket[STATS_BUCKETS];
+};
+
+/* Microseconds of CLOCK_MONOTONIC */
+uint64_t stats_now(void);
+
+int stats_format(const char *str);
+
+void stats_hist_init(struct stats_hist *hist);
+void stats_hist_add(struct stats_hist *hist, uint64_t usec);
+uint64_t stats_hist_percentile(struct stats_hist *hist, double percent);
+
+void stats_report_latency(int format, const char *name,
+						struct stats_hist *hist);
+void stats_report_throughput(int format, const char *name, int channel,
+					uint64_t bytes, uint64_t usec);
+
+#endif /* __STATS_H */
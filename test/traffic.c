@@ -0,0 +1,328 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2002-2010  Marcel Holtmann <marcel@holtmann.org>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include <bluetooth/bluetooth.h>
+
+#include "stats.h"
+#include "traffic.h"
+
+struct channel {
+	int sk;
+	uint32_t seq;
+	long frames;
+	uint64_t sent;
+	uint64_t received;
+};
+
+static volatile sig_atomic_t terminate = 0;
+
+static void sig_term(int sig)
+{
+	terminate = 1;
+}
+
+void traffic_catch_term(void)
+{
+	struct sigaction sa;
+
+	/* No SA_RESTART, blocking calls have to return early */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sig_term;
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGINT,  &sa, NULL);
+}
+
+void traffic_echo(const struct traffic_opts *opts, int sk)
+{
+	unsigned char *buf = opts->buf;
+	int len, sent, n;
+
+	syslog(LOG_INFO, "Echoing ...");
+
+	while (1) {
+		len = recv(sk, buf, opts->buffer_size, 0);
+		if (len <= 0) {
+			if (len < 0)
+				syslog(LOG_ERR, "Read failed: %s (%d)",
+							strerror(errno), errno);
+			return;
+		}
+
+		for (sent = 0; sent < len; sent += n) {
+			n = send(sk, buf + sent, len - sent, 0);
+			if (n < 0) {
+				syslog(LOG_ERR, "Send failed: %s (%d)",
+							strerror(errno), errno);
+				return;
+			}
+		}
+	}
+}
+
+void traffic_latency(const struct traffic_opts *opts, int sk)
+{
+	unsigned char *buf = opts->buf;
+	long data_size = opts->data_size;
+	long num_frames = opts->num_frames;
+	struct stats_hist hist;
+	uint64_t start;
+	uint32_t seq;
+	int i, len, size;
+
+	if (data_size < 6) {
+		syslog(LOG_ERR, "Frames need at least 6 bytes");
+		return;
+	}
+
+	for (i = 6; i < data_size; i++)
+		buf[i] = 0x7f;
+
+	stats_hist_init(&hist);
+
+	syslog(LOG_INFO, "Measuring round trip time ...");
+
+	for (seq = 0; !terminate; seq++) {
+		if (num_frames != -1 && num_frames-- <= 0)
+			break;
+
+		*(uint32_t *) buf = htobl(seq);
+		*(uint16_t *) (buf + 4) = htobs(data_size);
+
+		start = stats_now();
+
+		if (send(sk, buf, data_size, 0) != data_size) {
+			if (!terminate)
+				syslog(LOG_ERR, "Send failed: %s (%d)",
+							strerror(errno), errno);
+			break;
+		}
+
+		/* The echo may come back in pieces on stream sockets */
+		for (size = 0; size < data_size; size += len) {
+			len = recv(sk, buf + size, data_size - size, 0);
+			if (len <= 0)
+				break;
+		}
+
+		if (size < data_size) {
+			if (len < 0 && !terminate)
+				syslog(LOG_ERR, "Read failed: %s (%d)",
+							strerror(errno), errno);
+			break;
+		}
+
+		stats_hist_add(&hist, stats_now() - start);
+
+		if (btohl(*(uint32_t *) buf) != seq)
+			syslog(LOG_INFO, "seq missmatch: %d -> %d",
+						seq, btohl(*(uint32_t *) buf));
+
+		if (opts->format == STATS_TEXT && !((seq + 1) % 1000))
+			stats_report_latency(opts->format, "rtt", &hist);
+
+		if (opts->delay && opts->count && !((seq + 1) % opts->count))
+			usleep(opts->delay);
+	}
+
+	stats_report_latency(opts->format, "rtt", &hist);
+}
+
+static void channel_close(int epfd, struct channel *chan)
+{
+	epoll_ctl(epfd, EPOLL_CTL_DEL, chan->sk, NULL);
+
+	shutdown(chan->sk, SHUT_RDWR);
+	close(chan->sk);
+
+	chan->sk = -1;
+}
+
+/* A few frames per wakeup, so one channel can't starve the others */
+static int channel_send(const struct traffic_opts *opts, struct channel *chan)
+{
+	unsigned char *buf = opts->buf;
+	int i, len;
+
+	for (i = 0; i < 8 && chan->frames != 0; i++) {
+		*(uint32_t *) buf = htobl(chan->seq);
+		*(uint16_t *) (buf + 4) = htobs(opts->data_size);
+
+		len = send(chan->sk, buf, opts->data_size, MSG_DONTWAIT);
+		if (len < 0)
+			return (errno == EAGAIN || errno == EINTR) ? 0 : -errno;
+
+		chan->seq++;
+		chan->sent += len;
+
+		if (chan->frames > 0)
+			chan->frames--;
+	}
+
+	return 0;
+}
+
+void traffic_multi_send(const struct traffic_opts *opts, const int *sk,
+								int channels)
+{
+	struct epoll_event ev, events[16];
+	struct channel *chan;
+	uint64_t start, last, now, sent, last_sent;
+	unsigned char *rbuf;
+	int epfd, i, n, active, timeout;
+
+	chan = calloc(channels, sizeof(*chan));
+	rbuf = malloc(opts->buffer_size);
+	if (!chan || !rbuf) {
+		syslog(LOG_ERR, "Can't allocate channels");
+		exit(1);
+	}
+
+	epfd = epoll_create(channels);
+	if (epfd < 0) {
+		syslog(LOG_ERR, "Can't create epoll descriptor: %s (%d)",
+							strerror(errno), errno);
+		exit(1);
+	}
+
+	for (i = 0; i < channels; i++) {
+		chan[i].sk = sk[i];
+		chan[i].frames = opts->num_frames;
+
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN | EPOLLOUT;
+		ev.data.ptr = &chan[i];
+
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, chan[i].sk, &ev) < 0) {
+			syslog(LOG_ERR, "Can't add channel: %s (%d)",
+							strerror(errno), errno);
+			exit(1);
+		}
+	}
+
+	for (i = 6; i < opts->data_size; i++)
+		opts->buf[i] = 0x7f;
+
+	syslog(LOG_INFO, "Sending on %d channels ...", channels);
+
+	active = channels;
+	start = last = stats_now();
+	last_sent = 0;
+
+	while (active > 0 && !terminate) {
+		now = stats_now();
+		timeout = now - last < 1000000 ?
+				(1000000 - (now - last)) / 1000 + 1 : 0;
+
+		n = epoll_wait(epfd, events, 16, timeout);
+		if (n < 0 && errno != EINTR) {
+			syslog(LOG_ERR, "Wait failed: %s (%d)",
+							strerror(errno), errno);
+			break;
+		}
+
+		for (i = 0; i < n; i++) {
+			struct channel *c = events[i].data.ptr;
+			int len;
+
+			if (c->sk < 0)
+				continue;
+
+			if (events[i].events & EPOLLIN) {
+				len = recv(c->sk, rbuf, opts->buffer_size,
+								MSG_DONTWAIT);
+				if (len > 0)
+					c->received += len;
+			}
+
+			if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+				syslog(LOG_INFO, "Channel %d disconnected",
+								(int) (c - chan));
+				channel_close(epfd, c);
+				active--;
+				continue;
+			}
+
+			if (!(events[i].events & EPOLLOUT))
+				continue;
+
+			if (channel_send(opts, c) < 0) {
+				syslog(LOG_ERR, "Send failed: %s (%d)",
+							strerror(errno), errno);
+				channel_close(epfd, c);
+				active--;
+			} else if (c->frames == 0) {
+				channel_close(epfd, c);
+				active--;
+			}
+		}
+
+		now = stats_now();
+		if (now - last < 1000000)
+			continue;
+
+		for (sent = 0, i = 0; i < channels; i++)
+			sent += chan[i].sent;
+
+		stats_report_throughput(opts->format, "send", -1,
+					sent - last_sent, now - last);
+
+		last = now;
+		last_sent = sent;
+	}
+
+	now = stats_now();
+
+	for (sent = 0, i = 0; i < channels; i++) {
+		if (chan[i].sk >= 0)
+			channel_close(epfd, &chan[i]);
+
+		stats_report_throughput(opts->format, "total send", i,
+						chan[i].sent, now - start);
+		if (chan[i].received)
+			stats_report_throughput(opts->format, "total recv", i,
+						chan[i].received, now - start);
+
+		sent += chan[i].sent;
+	}
+
+	stats_report_throughput(opts->format, "total send", -1, sent,
+								now - start);
+
+	close(epfd);
+	free(rbuf);
+	free(chan);
+}
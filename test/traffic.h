@@ -0,0 +1,46 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2002-2010  Marcel Holtmann <marcel@holtmann.org>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __TRAFFIC_H
+#define __TRAFFIC_H
+
+/* Socket independent test modes shared by l2test and rctest */
+struct traffic_opts {
+	unsigned char *buf;	/* Frame buffer of at least data_size */
+	long data_size;		/* Bytes per frame */
+	long buffer_size;	/* Bytes per receive */
+	long num_frames;	/* Frames to send, -1 = infinite */
+	int count;		/* Consecutive frames before the delay */
+	unsigned long delay;	/* Delay in usec */
+	int format;		/* Report format */
+};
+
+/* SIGTERM and SIGINT end the latency and multi send modes */
+void traffic_catch_term(void);
+
+void traffic_echo(const struct traffic_opts *opts, int sk);
+void traffic_latency(const struct traffic_opts *opts, int sk);
+void traffic_multi_send(const struct traffic_opts *opts, const int *sk,
+								int channels);
+
+#endif /* __TRAFFIC_H */
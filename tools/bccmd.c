@@ -59,6 +59,12 @@
 #define CSR_TYPE_ARRAY		CSR_TYPE_COMPLEX
 #define CSR_TYPE_BDADDR		CSR_TYPE_COMPLEX
 
+#define CSR_COMMAND_GETREQ	0x0000
+#define CSR_COMMAND_SETREQ	0x0002
+
+#define CSR_MAX_PIPELINE	16
+#define CSR_RETRIES		2
+
 static inline int transport_open(int transport, char *device)
 {
 	switch (transport) {
@@ -122,6 +128,38 @@ static inline int transport_write(int transport, uint16_t varid, uint8_t *value,
 	}
 }
 
+static inline int transport_pipelined(int transport)
+{
+	switch (transport) {
+	case CSR_TRANSPORT_HCI:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static inline int transport_send(int transport, uint16_t command, uint16_t varid, uint8_t *value, uint16_t length)
+{
+	switch (transport) {
+	case CSR_TRANSPORT_HCI:
+		return csr_send_hci(command, varid, value, length);
+	default:
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+}
+
+static inline int transport_recv(int transport, uint16_t *seqnum, uint16_t *status, uint8_t *value, uint16_t length)
+{
+	switch (transport) {
+	case CSR_TRANSPORT_HCI:
+		return csr_recv_hci(seqnum, status, value, length, 2000);
+	default:
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+}
+
 static inline void transport_close(int transport)
 {
 	switch (transport) {
@@ -608,15 +646,18 @@ static int cmd_memtypes(int transport, int argc, char *argv[])
 static struct option pskey_options[] = {
 	{ "stores",	1, 0, 's' },
 	{ "reset",	0, 0, 'r' },
+	{ "pipeline",	1, 0, 'p' },
+	{ "diff",	0, 0, 'd' },
 	{ "help",	0, 0, 'h' },
 	{ 0, 0, 0, 0 }
 };
 
-static int opt_pskey(int argc, char *argv[], uint16_t *stores, int *reset, int *help)
+static int opt_pskey(int argc, char *argv[], uint16_t *stores, int *reset,
+					int *pipeline, int *diff, int *help)
 {
 	int opt;
 
-	while ((opt=getopt_long(argc, argv, "+s:rh", pskey_options, NULL)) != EOF) {
+	while ((opt=getopt_long(argc, argv, "+s:rp:dh", pskey_options, NULL)) != EOF) {
 		switch (opt) {
 		case 's':
 			if (!stores)
@@ -650,6 +691,21 @@ static int opt_pskey(int argc, char *argv[], uint16_t *stores, int *reset, int *
 				*reset = 1;
 			break;
 
+		case 'p':
+			if (!pipeline)
+				break;
+			*pipeline = atoi(optarg);
+			if (*pipeline < 1)
+				*pipeline = 1;
+			else if (*pipeline > CSR_MAX_PIPELINE)
+				*pipeline = CSR_MAX_PIPELINE;
+			break;
+
+		case 'd':
+			if (diff)
+				*diff = 1;
+			break;
+
 		case 'h':
 			if (help)
 				*help = 1;
@@ -661,10 +717,173 @@ static int opt_pskey(int argc, char *argv[], uint16_t *stores, int *reset, int *
 }
 
 #define OPT_PSKEY(min, max, stores, reset, help) \
-		opt_pskey(argc, argv, (stores), (reset), (help)); \
+		opt_pskey(argc, argv, (stores), (reset), NULL, NULL, (help)); \
+		argc -= optind; argv += optind; optind = 0; \
+		OPT_RANGE((min), (max))
+
+#define OPT_PSBATCH(min, max, stores, reset, pipeline, diff) \
+		opt_pskey(argc, argv, (stores), (reset), (pipeline), (diff), NULL); \
 		argc -= optind; argv += optind; optind = 0; \
 		OPT_RANGE((min), (max))
 
+/*
+ * A PS key transaction of a batch.  The array holds the varid payload,
+ * which the response overwrites.  Skipped transactions are left out
+ * when the batch is run.
+ */
+struct psop {
+	uint16_t pskey;
+	uint16_t command;
+	uint16_t varid;
+	uint16_t size;
+	uint8_t array[256];
+	int seqnum;
+	int skip;
+	int err;
+};
+
+static void psop_setup(struct psop *op, uint16_t command, uint16_t varid,
+			uint16_t pskey, uint16_t length, uint16_t stores)
+{
+	memset(op->array, 0, sizeof(op->array));
+	op->array[0] = pskey & 0xff;
+	op->array[1] = pskey >> 8;
+
+	if (varid == CSR_VARID_PS) {
+		op->array[2] = length & 0xff;
+		op->array[3] = length >> 8;
+		op->array[4] = stores & 0xff;
+		op->array[5] = stores >> 8;
+		op->size = (length + 3) * 2;
+	} else {
+		op->array[2] = stores & 0xff;
+		op->array[3] = stores >> 8;
+		op->size = 8;
+	}
+
+	op->pskey = pskey;
+	op->command = command;
+	op->varid = varid;
+	op->skip = 0;
+	op->err = -EINPROGRESS;
+}
+
+static struct psop *psop_grow(struct psop *ops, int count)
+{
+	struct psop *tmp;
+
+	if (count % 64)
+		return ops;
+
+	tmp = realloc(ops, (count + 64) * sizeof(*ops));
+	if (!tmp)
+		free(ops);
+
+	return tmp;
+}
+
+static void psop_run_one(int transport, struct psop *op)
+{
+	int err;
+
+	if (op->command == CSR_COMMAND_SETREQ)
+		err = transport_write(transport, op->varid, op->array, op->size);
+	else
+		err = transport_read(transport, op->varid, op->array, op->size);
+
+	op->err = err < 0 ? -errno : 0;
+}
+
+/* Keeps up to window transactions outstanding and matches the
+ * responses to them by sequence number */
+static void psop_pipeline(int transport, struct psop *ops, int count,
+								int window)
+{
+	struct psop *pending[CSR_MAX_PIPELINE];
+	uint8_t value[256];
+	uint16_t seqnum, status;
+	int i, next = 0, outstanding = 0;
+
+	while (next < count || outstanding > 0) {
+		while (next < count && outstanding < window) {
+			struct psop *op = &ops[next++];
+
+			if (op->skip)
+				continue;
+
+			op->seqnum = transport_send(transport, op->command,
+						op->varid, op->array, op->size);
+			if (op->seqnum < 0) {
+				op->err = -errno;
+				continue;
+			}
+
+			pending[outstanding++] = op;
+		}
+
+		if (outstanding == 0)
+			break;
+
+		if (transport_recv(transport, &seqnum, &status,
+						value, sizeof(value)) < 0) {
+			/* Whatever is outstanding now is lost */
+			for (i = 0; i < outstanding; i++)
+				pending[i]->err = -errno;
+			outstanding = 0;
+			continue;
+		}
+
+		for (i = 0; i < outstanding; i++)
+			if (pending[i]->seqnum == seqnum)
+				break;
+
+		/* Late response to a transaction given up on before */
+		if (i == outstanding)
+			continue;
+
+		if (status == 0) {
+			memcpy(pending[i]->array, value, pending[i]->size);
+			pending[i]->err = 0;
+		} else
+			pending[i]->err = -ENXIO;
+
+		pending[i] = pending[--outstanding];
+	}
+}
+
+/*
+ * Runs a batch of transactions and then retries the ones that failed
+ * because of the transport, one at a time.  A failure reported by the
+ * chip is final.  Returns the number of failed transactions.
+ */
+static int psop_run(int transport, struct psop *ops, int count, int window)
+{
+	int i, n, failed = 0;
+
+	if (window > 1 && transport_pipelined(transport))
+		psop_pipeline(transport, ops, count, window);
+	else
+		for (i = 0; i < count; i++)
+			if (!ops[i].skip)
+				psop_run_one(transport, &ops[i]);
+
+	for (n = 0; n < CSR_RETRIES; n++) {
+		for (i = 0; i < count; i++) {
+			if (ops[i].skip || ops[i].err == 0 ||
+						ops[i].err == -ENXIO)
+				continue;
+
+			psop_run_one(transport, &ops[i]);
+		}
+	}
+
+	for (i = 0; i < count; i++)
+		if (!ops[i].skip && ops[i].err < 0)
+			failed++;
+
+	return failed;
+}
+
 static int cmd_psget(int transport, int argc, char *argv[])
 {
 	uint8_t array[128];
@@ -930,13 +1149,15 @@ static int cmd_pslist(int transport, int argc, char *argv[])
 
 static int cmd_psread(int transport, int argc, char *argv[])
 {
-	uint8_t array[256];
+	struct psop *ops = NULL;
+	uint8_t array[8];
 	uint16_t pskey = 0x0000, length, stores = CSR_STORES_DEFAULT;
 	char *str, val[7];
-	int i, err, reset = 0;
+	int i, j, err, count = 0, reset = 0, pipeline = 1;
 
-	OPT_PSKEY(0, 0, &stores, &reset, NULL);
+	OPT_PSBATCH(0, 0, &stores, &reset, &pipeline, NULL);
 
+	/* Every key is only known once the previous one is */
 	while (1) {
 		memset(array, 0, sizeof(array));
 		array[0] = pskey & 0xff;
@@ -952,32 +1173,39 @@ static int cmd_psread(int transport, int argc, char *argv[])
 		if (pskey == 0x0000)
 			break;
 
-		memset(array, 0, sizeof(array));
-		array[0] = pskey & 0xff;
-		array[1] = pskey >> 8;
-		array[2] = stores & 0xff;
-		array[3] = stores >> 8;
+		ops = psop_grow(ops, count);
+		if (!ops)
+			return -1;
 
-		err = transport_read(transport, CSR_VARID_PS_SIZE, array, 8);
-		if (err < 0)
-			continue;
+		psop_setup(&ops[count++], CSR_COMMAND_GETREQ,
+					CSR_VARID_PS_SIZE, pskey, 0, stores);
+	}
 
-		length = array[2] + (array[3] << 8);
-		if (length + 6 > (int) sizeof(array) / 2)
+	psop_run(transport, ops, count, pipeline);
+
+	/* Then read the keys whose size is known, in place */
+	for (i = 0; i < count; i++) {
+		pskey = ops[i].pskey;
+		length = ops[i].array[2] + (ops[i].array[3] << 8);
+
+		if (ops[i].err < 0 || length + 6 > (int) sizeof(ops[i].array) / 2) {
+			ops[i].skip = 1;
 			continue;
+		}
 
-		memset(array, 0, sizeof(array));
-		array[0] = pskey & 0xff;
-		array[1] = pskey >> 8;
-		array[2] = length & 0xff;
-		array[3] = length >> 8;
-		array[4] = stores & 0xff;
-		array[5] = stores >> 8;
+		psop_setup(&ops[i], CSR_COMMAND_GETREQ,
+					CSR_VARID_PS, pskey, length, stores);
+	}
 
-		err = transport_read(transport, CSR_VARID_PS, array, (length + 3) * 2);
-		if (err < 0)
+	psop_run(transport, ops, count, pipeline);
+
+	for (i = 0; i < count; i++) {
+		if (ops[i].skip || ops[i].err < 0)
 			continue;
 
+		pskey = ops[i].pskey;
+		length = ops[i].size / 2 - 3;
+
 		str = csr_pskeytoval(pskey);
 		if (!strcasecmp(str, "UNKNOWN")) {
 			sprintf(val, "0x%04x", pskey);
@@ -986,25 +1214,73 @@ static int cmd_psread(int transport, int argc, char *argv[])
 
 		printf("// %s%s\n&%04x =", str ? "PSKEY_" : "",
 						str ? str : val, pskey);
-		for (i = 0; i < length; i++)
-			printf(" %02x%02x", array[(i * 2) + 7], array[(i * 2) + 6]);
+		for (j = 0; j < length; j++)
+			printf(" %02x%02x", ops[i].array[(j * 2) + 7],
+						ops[i].array[(j * 2) + 6]);
 		printf("\n");
 	}
 
+	free(ops);
+
 	if (reset)
 		transport_write(transport, CSR_VARID_WARM_RESET, NULL, 0);
 
 	return 0;
 }
 
+/* Skips writing the keys that already hold the value to be written */
+static void psload_diff(int transport, struct psop *ops, int count,
+					uint16_t stores, int pipeline)
+{
+	struct psop *checks;
+	uint16_t length;
+	int i;
+
+	checks = malloc(count * sizeof(*checks));
+	if (!checks)
+		return;
+
+	for (i = 0; i < count; i++)
+		psop_setup(&checks[i], CSR_COMMAND_GETREQ,
+				CSR_VARID_PS_SIZE, ops[i].pskey, 0, stores);
+
+	psop_run(transport, checks, count, pipeline);
+
+	for (i = 0; i < count; i++) {
+		length = checks[i].array[2] + (checks[i].array[3] << 8);
+
+		if (checks[i].err < 0 || length != ops[i].size / 2 - 3) {
+			checks[i].skip = 1;
+			continue;
+		}
+
+		psop_setup(&checks[i], CSR_COMMAND_GETREQ,
+				CSR_VARID_PS, ops[i].pskey, length, stores);
+	}
+
+	psop_run(transport, checks, count, pipeline);
+
+	for (i = 0; i < count; i++) {
+		if (checks[i].skip || checks[i].err < 0)
+			continue;
+
+		if (memcmp(checks[i].array + 6, ops[i].array + 6,
+						ops[i].size - 6) == 0)
+			ops[i].skip = 1;
+	}
+
+	free(checks);
+}
+
 static int cmd_psload(int transport, int argc, char *argv[])
 {
+	struct psop *ops = NULL;
 	uint8_t array[256];
-	uint16_t pskey, length, size, stores = CSR_STORES_PSRAM;
+	uint16_t pskey, size, stores = CSR_STORES_PSRAM;
 	char *str, val[7];
-	int err, reset = 0;
+	int i, count = 0, reset = 0, pipeline = 1, diff = 0;
 
-	OPT_PSKEY(1, 1, &stores, &reset, NULL);
+	OPT_PSBATCH(1, 1, &stores, &reset, &pipeline, &diff);
 
 	psr_read(argv[0]);
 
@@ -1012,33 +1288,40 @@ static int cmd_psload(int transport, int argc, char *argv[])
 	size = sizeof(array) - 6;
 
 	while (psr_get(&pskey, array + 6, &size) == 0) {
-		str = csr_pskeytoval(pskey);
-		if (!strcasecmp(str, "UNKNOWN")) {
-			sprintf(val, "0x%04x", pskey);
-			str = NULL;
-		}
+		ops = psop_grow(ops, count);
+		if (!ops)
+			return -1;
 
-		printf("Loading %s%s ... ", str ? "PSKEY_" : "",
-							str ? str : val);
-		fflush(stdout);
+		psop_setup(&ops[count], CSR_COMMAND_SETREQ,
+					CSR_VARID_PS, pskey, size / 2, stores);
+		memcpy(ops[count].array + 6, array + 6, size);
+		ops[count].size = size + 6;
+		count++;
 
-		length = size / 2;
+		memset(array, 0, sizeof(array));
+		size = sizeof(array) - 6;
+	}
 
-		array[0] = pskey & 0xff;
-		array[1] = pskey >> 8;
-		array[2] = length & 0xff;
-		array[3] = length >> 8;
-		array[4] = stores & 0xff;
-		array[5] = stores >> 8;
+	if (diff && count > 0)
+		psload_diff(transport, ops, count, stores, pipeline);
 
-		err = transport_write(transport, CSR_VARID_PS, array, size + 6);
+	psop_run(transport, ops, count, pipeline);
 
-		printf("%s\n", err < 0 ? "failed" : "done");
+	for (i = 0; i < count; i++) {
+		str = csr_pskeytoval(ops[i].pskey);
+		if (!strcasecmp(str, "UNKNOWN")) {
+			sprintf(val, "0x%04x", ops[i].pskey);
+			str = NULL;
+		}
 
-		memset(array, 0, sizeof(array));
-		size = sizeof(array) - 6;
+		printf("Loading %s%s ... %s\n", str ? "PSKEY_" : "",
+					str ? str : val, ops[i].skip ?
+					"unchanged" : ops[i].err < 0 ?
+					"failed" : "done");
 	}
 
+	free(ops);
+
 	if (reset)
 		transport_write(transport, CSR_VARID_WARM_RESET, NULL, 0);
 
@@ -512,6 +512,8 @@ char *csr_pskeytoval(uint16_t pskey);
 int csr_open_hci(char *device);
 int csr_read_hci(uint16_t varid, uint8_t *value, uint16_t length);
 int csr_write_hci(uint16_t varid, uint8_t *value, uint16_t length);
+int csr_send_hci(uint16_t command, uint16_t varid, uint8_t *value, uint16_t length);
+int csr_recv_hci(uint16_t *seqnum, uint16_t *status, uint8_t *value, uint16_t length, int timeout);
 void csr_close_hci(void);
 
 int csr_open_usb(char *device);
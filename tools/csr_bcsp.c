@@ -32,6 +32,7 @@
 #include <string.h>
 #include <stdint.h>
 #include <termios.h>
+#include <sys/poll.h>
 
 #include "csr.h"
 #include "ubcsp.h"
@@ -134,15 +135,37 @@ int csr_open_bcsp(char *device)
 	return 0;
 }
 
-void put_uart(uint8_t ch)
+void put_uart_block(const uint8_t *data, uint32_t len)
 {
-	if (write(fd, &ch, 1) < 0)
-		fprintf(stderr, "UART write error\n");
+	while (len > 0) {
+		struct pollfd p;
+		ssize_t written;
+
+		written = write(fd, data, len);
+		if (written > 0) {
+			data += written;
+			len -= written;
+			continue;
+		}
+
+		if (written < 0 && errno != EAGAIN && errno != EINTR) {
+			fprintf(stderr, "UART write error\n");
+			return;
+		}
+
+		/* The port is non blocking, wait for room in the queue */
+		p.fd = fd;
+		p.events = POLLOUT;
+		if (poll(&p, 1, 1000) <= 0) {
+			fprintf(stderr, "UART write timeout\n");
+			return;
+		}
+	}
 }
 
-uint8_t get_uart(uint8_t *ch)
+uint32_t get_uart_block(uint8_t *data, uint32_t len)
 {
-	int res = read(fd, ch, 1);
+	ssize_t res = read(fd, data, len);
 	return res > 0 ? res : 0;
 }
 
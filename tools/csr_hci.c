@@ -28,6 +28,8 @@
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/poll.h>
 #include <sys/socket.h>
 
 #include <bluetooth/bluetooth.h>
@@ -84,10 +86,8 @@ int csr_open_hci(char *device)
 	return 0;
 }
 
-static int do_command(uint16_t command, uint16_t seqnum, uint16_t varid, uint8_t *value, uint16_t length)
+static uint16_t build_command(unsigned char *cp, uint16_t command, uint16_t seqnum, uint16_t varid, uint8_t *value, uint16_t length)
 {
-	unsigned char cp[254], rp[254];
-	struct hci_request rq;
 	uint8_t cmd[10];
 	uint16_t size;
 
@@ -104,11 +104,36 @@ static int do_command(uint16_t command, uint16_t seqnum, uint16_t varid, uint8_t
 	cmd[8] = 0x00;
 	cmd[9] = 0x00;
 
-	memset(cp, 0, sizeof(cp));
+	memset(cp, 0, 254);
 	cp[0] = 0xc2;
 	memcpy(cp + 1, cmd, sizeof(cmd));
 	memcpy(cp + 11, value, length);
 
+	return size;
+}
+
+static int send_command(unsigned char *cp, uint16_t size)
+{
+	struct hci_filter nf;
+
+	/* Responses only reach the socket while the filter lets them in */
+	hci_filter_clear(&nf);
+	hci_filter_set_ptype(HCI_EVENT_PKT, &nf);
+	hci_filter_set_event(EVT_VENDOR, &nf);
+
+	if (setsockopt(dd, SOL_HCI, HCI_FILTER, &nf, sizeof(nf)) < 0)
+		return -1;
+
+	return hci_send_cmd(dd, OGF_VENDOR_CMD, 0x00, (size * 2) + 1, cp);
+}
+
+static int do_command(uint16_t command, uint16_t seqnum, uint16_t varid, uint8_t *value, uint16_t length)
+{
+	unsigned char cp[254];
+	uint16_t size, num, status;
+
+	size = build_command(cp, command, seqnum, varid, value, length);
+
 	switch (varid) {
 	case CSR_VARID_COLD_RESET:
 	case CSR_VARID_WARM_RESET:
@@ -117,30 +142,20 @@ static int do_command(uint16_t command, uint16_t seqnum, uint16_t varid, uint8_t
 		return hci_send_cmd(dd, OGF_VENDOR_CMD, 0x00, (size * 2) + 1, cp);
 	}
 
-	memset(&rq, 0, sizeof(rq));
-	rq.ogf    = OGF_VENDOR_CMD;
-	rq.ocf    = 0x00;
-	rq.event  = EVT_VENDOR;
-	rq.cparam = cp;
-	rq.clen   = (size * 2) + 1;
-	rq.rparam = rp;
-	rq.rlen   = sizeof(rp);
-
-	if (hci_send_req(dd, &rq, 2000) < 0)
+	if (send_command(cp, size) < 0)
 		return -1;
 
-	if (rp[0] != 0xc2) {
-		errno = EIO;
-		return -1;
-	}
+	/* Late responses to pipelined commands given up on come first */
+	do {
+		if (csr_recv_hci(&num, &status, value, length, 2000) < 0)
+			return -1;
+	} while (num != seqnum);
 
-	if ((rp[9] + (rp[10] << 8)) != 0) {
+	if (status != 0) {
 		errno = ENXIO;
 		return -1;
 	}
 
-	memcpy(value, rp + 11, length);
-
 	return 0;
 }
 
@@ -154,6 +169,78 @@ int csr_write_hci(uint16_t varid, uint8_t *value, uint16_t length)
 	return do_command(0x0002, seqnum++, varid, value, length);
 }
 
+/*
+ * Sends a command without waiting for its response, so that several can
+ * be outstanding at a time.  Returns the sequence number its response
+ * will carry.
+ */
+int csr_send_hci(uint16_t command, uint16_t varid, uint8_t *value, uint16_t length)
+{
+	unsigned char cp[254];
+	uint16_t size, num = seqnum++;
+
+	size = build_command(cp, command, num, varid, value, length);
+
+	if (send_command(cp, size) < 0)
+		return -1;
+
+	return num;
+}
+
+/*
+ * Waits for the next BCCMD response.  The status of the response is
+ * returned in status, since a failed command is still a response.
+ */
+int csr_recv_hci(uint16_t *seqnum, uint16_t *status, uint8_t *value, uint16_t length, int timeout)
+{
+	unsigned char buf[HCI_MAX_EVENT_SIZE], *rp;
+	hci_event_hdr *hdr;
+	struct pollfd p;
+	int len;
+
+	while (1) {
+		p.fd = dd;
+		p.events = POLLIN;
+		p.revents = 0;
+
+		len = poll(&p, 1, timeout);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		if (len == 0) {
+			errno = ETIMEDOUT;
+			return -1;
+		}
+
+		len = read(dd, buf, sizeof(buf));
+		if (len < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		hdr = (void *) (buf + 1);
+		rp = buf + 1 + HCI_EVENT_HDR_SIZE;
+		len -= 1 + HCI_EVENT_HDR_SIZE;
+
+		if (hdr->evt != EVT_VENDOR || len < 11 || rp[0] != 0xc2)
+			continue;
+
+		break;
+	}
+
+	*seqnum = rp[5] + (rp[6] << 8);
+	*status = rp[9] + (rp[10] << 8);
+
+	len -= 11;
+	memcpy(value, rp + 11, length < len ? length : len);
+
+	return 0;
+}
+
 void csr_close_hci(void)
 {
 	hci_close_dev(dd);
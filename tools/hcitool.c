@@ -509,7 +509,8 @@ static void cmd_scan(int dev_id, int argc, char **argv)
 	uint8_t lap[3] = { 0x33, 0x8b, 0x9e };
 	int num_rsp, length, flags;
 	uint8_t cls[3], features[8];
-	char addr[18], name[249], oui[9], *comp, *tmp;
+	char addr[18], name[249], oui[9], *tmp;
+	const char *comp;
 	struct hci_version version;
 	struct hci_dev_info di;
 	struct hci_conn_info_req *cr;
@@ -654,11 +655,9 @@ static void cmd_scan(int dev_id, int argc, char **argv)
 
 		if (extoui) {
 			ba2oui(&(info+i)->bdaddr, oui);
-			comp = ouitocomp(oui);
-			if (comp) {
+			comp = ouilookup(oui);
+			if (comp)
 				printf("OUI company:\t%s (%s)\n", comp, oui);
-				free(comp);
-			}
 		}
 
 		cc = 0;
@@ -831,7 +830,8 @@ static void cmd_info(int dev_id, int argc, char **argv)
 	bdaddr_t bdaddr;
 	uint16_t handle;
 	uint8_t features[8], max_page = 0;
-	char name[249], oui[9], *comp, *tmp;
+	char name[249], oui[9], *tmp;
+	const char *comp;
 	struct hci_version version;
 	struct hci_dev_info di;
 	struct hci_conn_info_req *cr;
@@ -903,11 +903,9 @@ static void cmd_info(int dev_id, int argc, char **argv)
 	printf("\tBD Address:  %s\n", argv[0]);
 
 	ba2oui(&bdaddr, oui);
-	comp = ouitocomp(oui);
-	if (comp) {
+	comp = ouilookup(oui);
+	if (comp)
 		printf("\tOUI Company: %s (%s)\n", comp, oui);
-		free(comp);
-	}
 
 	if (hci_read_remote_name(dd, &bdaddr, sizeof(name), name, 25000) == 0)
 		printf("\tDevice Name: %s\n", name);
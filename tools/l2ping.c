@@ -29,6 +29,7 @@
 
 #include <stdio.h>
 #include <errno.h>
+#include <time.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
@@ -52,50 +53,116 @@ static int count   = -1;
 static int timeout = 10;
 static int reverse = 0;
 static int verify = 0;
+static int window = 1;
+
+/* Payload size sweep */
+static int size_max  = 0;
+static int size_step = 0;
 
 /* Stats */
 static int sent_pkt = 0;
 static int recv_pkt = 0;
 
-static float tv2fl(struct timeval tv)
+static unsigned int *rtt = NULL;
+static int rtt_cnt = 0;
+static int rtt_max = 0;
+
+static unsigned char *send_buf;
+static unsigned char *recv_buf;
+
+/* Outstanding echo requests of the flood mode, indexed by identifier */
+static struct {
+	int pending;
+	uint64_t sent;
+} slot[256];
+
+static uint64_t now_usec(void)
 {
-	return (float)(tv.tv_sec*1000.0) + (float)(tv.tv_usec/1000.0);
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
 }
 
-static void stat(int sig)
+static void rtt_add(unsigned int usec)
+{
+	if (rtt_cnt == rtt_max) {
+		unsigned int *tmp;
+
+		rtt_max = rtt_max ? rtt_max * 2 : 1024;
+
+		tmp = realloc(rtt, rtt_max * sizeof(*rtt));
+		if (!tmp) {
+			perror("Can't allocate statistics");
+			exit(1);
+		}
+
+		rtt = tmp;
+	}
+
+	rtt[rtt_cnt++] = usec;
+}
+
+static int rtt_cmp(const void *a, const void *b)
+{
+	unsigned int x = *(const unsigned int *) a;
+	unsigned int y = *(const unsigned int *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static float rtt_percentile(float percent)
+{
+	int i = (rtt_cnt * percent + 99.0) / 100.0;
+
+	if (i < 1)
+		i = 1;
+
+	return rtt[i - 1] / 1000.0;
+}
+
+static void report(void)
 {
 	int loss = sent_pkt ? (float)((sent_pkt-recv_pkt)/(sent_pkt/100.0)) : 0;
+	unsigned long long total = 0;
+	int i;
+
 	printf("%d sent, %d received, %d%% loss\n", sent_pkt, recv_pkt, loss);
+
+	if (!rtt_cnt)
+		return;
+
+	qsort(rtt, rtt_cnt, sizeof(*rtt), rtt_cmp);
+
+	for (i = 0; i < rtt_cnt; i++)
+		total += rtt[i];
+
+	printf("rtt min/avg/max %.2f/%.2f/%.2f ms, "
+			"p50 %.2f ms, p99 %.2f ms, p99.9 %.2f ms\n",
+			rtt[0] / 1000.0, total / 1000.0 / rtt_cnt,
+			rtt[rtt_cnt - 1] / 1000.0, rtt_percentile(50.0),
+			rtt_percentile(99.0), rtt_percentile(99.9));
+}
+
+static void stat(int sig)
+{
+	report();
 	exit(0);
 }
 
-static void ping(char *svr)
+static int ping_connect(char *svr)
 {
-	struct sigaction sa;
 	struct sockaddr_l2 addr;
 	socklen_t optlen;
-	unsigned char *send_buf;
-	unsigned char *recv_buf;
 	char str[18];
-	int i, sk, lost;
-	uint8_t id;
-
-	memset(&sa, 0, sizeof(sa));
-	sa.sa_handler = stat;
-	sigaction(SIGINT, &sa, NULL);
-
-	send_buf = malloc(L2CAP_CMD_HDR_SIZE + size);
-	recv_buf = malloc(L2CAP_CMD_HDR_SIZE + size);
-	if (!send_buf || !recv_buf) {
-		perror("Can't allocate buffer");
-		exit(1);
-	}
+	int sk;
 
 	/* Create socket */
 	sk = socket(PF_BLUETOOTH, SOCK_RAW, BTPROTO_L2CAP);
 	if (sk < 0) {
 		perror("Can't create socket");
-		goto error;
+		return -1;
 	}
 
 	/* Bind to local address */
@@ -130,14 +197,26 @@ static void ping(char *svr)
 	ba2str(&addr.l2_bdaddr, str);
 	printf("Ping: %s from %s (data size %d) ...\n", svr, str, size);
 
+	return sk;
+
+error:
+	close(sk);
+	return -1;
+}
+
+static int ping(int sk, char *svr)
+{
+	int i, lost, num = count;
+	uint8_t id;
+
 	/* Initialize send buffer */
 	for (i = 0; i < size; i++)
 		send_buf[L2CAP_CMD_HDR_SIZE + i] = (i % 40) + 'A';
 
 	id = ident;
 
-	while (count == -1 || count-- > 0) {
-		struct timeval tv_send, tv_recv, tv_diff;
+	while (num == -1 || num-- > 0) {
+		uint64_t send_time, diff;
 		l2cap_cmd_hdr *send_cmd = (l2cap_cmd_hdr *) send_buf;
 		l2cap_cmd_hdr *recv_cmd = (l2cap_cmd_hdr *) recv_buf;
 
@@ -150,12 +229,12 @@ static void ping(char *svr)
 		else
 			send_cmd->code = L2CAP_ECHO_REQ;
 
-		gettimeofday(&tv_send, NULL);
+		send_time = now_usec();
 
 		/* Send Echo Command */
 		if (send(sk, send_buf, L2CAP_CMD_HDR_SIZE + size, 0) <= 0) {
 			perror("Send failed");
-			goto error;
+			return -1;
 		}
 
 		/* Wait for Echo Response */
@@ -169,7 +248,7 @@ static void ping(char *svr)
 
 			if ((err = poll(pf, 1, timeout * 1000)) < 0) {
 				perror("Poll failed");
-				goto error;
+				return -1;
 			}
 
 			if (!err) {
@@ -179,12 +258,12 @@ static void ping(char *svr)
 
 			if ((err = recv(sk, recv_buf, L2CAP_CMD_HDR_SIZE + size, 0)) < 0) {
 				perror("Recv failed");
-				goto error;
+				return -1;
 			}
 
 			if (!err){
 				printf("Disconnected\n");
-				goto error;
+				return -1;
 			}
 
 			recv_cmd->len = btohs(recv_cmd->len);
@@ -199,7 +278,7 @@ static void ping(char *svr)
 
 			if (recv_cmd->code == L2CAP_COMMAND_REJ) {
 				printf("Peer doesn't support Echo packets\n");
-				goto error;
+				return -1;
 			}
 
 		}
@@ -208,27 +287,27 @@ static void ping(char *svr)
 		if (!lost) {
 			recv_pkt++;
 
-			gettimeofday(&tv_recv, NULL);
-			timersub(&tv_recv, &tv_send, &tv_diff);
+			diff = now_usec() - send_time;
+			rtt_add(diff);
 
 			if (verify) {
 				/* Check payload length */
 				if (recv_cmd->len != size) {
 					fprintf(stderr, "Received %d bytes, expected %d\n",
 						   recv_cmd->len, size);
-					goto error;
+					return -1;
 				}
 
 				/* Check payload */
 				if (memcmp(&send_buf[L2CAP_CMD_HDR_SIZE],
 						   &recv_buf[L2CAP_CMD_HDR_SIZE], size)) {
 					fprintf(stderr, "Response payload different.\n");
-					goto error;
+					return -1;
 				}
 			}
 
 			printf("%d bytes from %s id %d time %.2fms\n", recv_cmd->len, svr,
-				   id - ident, tv2fl(tv_diff));
+				   id - ident, diff / 1000.0);
 
 			if (delay)
 				sleep(delay);
@@ -239,36 +318,149 @@ static void ping(char *svr)
 		if (++id > 254)
 			id = ident;
 	}
-	stat(0);
-	free(send_buf);
-	free(recv_buf);
-	return;
 
-error:
-	close(sk);
-	free(send_buf);
-	free(recv_buf);
-	exit(1);
+	return 0;
+}
+
+/*
+ * Keeps window echo requests in flight and matches the responses by
+ * their identifier, so the link stays saturated.  Requests without a
+ * response within the timeout are counted as lost.
+ */
+static int flood(int sk, char *svr)
+{
+	l2cap_cmd_hdr *send_cmd = (l2cap_cmd_hdr *) send_buf;
+	l2cap_cmd_hdr *recv_cmd = (l2cap_cmd_hdr *) recv_buf;
+	int i, err, outstanding = 0, num = count;
+	uint64_t now, oldest;
+	uint8_t id = 0;
+
+	for (i = 0; i < size; i++)
+		send_buf[L2CAP_CMD_HDR_SIZE + i] = (i % 40) + 'A';
+
+	memset(slot, 0, sizeof(slot));
+
+	while (num != 0 || outstanding > 0) {
+		struct pollfd pf[1];
+
+		while (outstanding < window && num != 0) {
+			/* Identifier 0 is invalid, skip the ones in use */
+			do {
+				id = id == 255 ? 1 : id + 1;
+			} while (slot[id].pending);
+
+			send_cmd->ident = id;
+			send_cmd->len   = htobs(size);
+			send_cmd->code  = L2CAP_ECHO_REQ;
+
+			if (send(sk, send_buf, L2CAP_CMD_HDR_SIZE + size, 0) <= 0) {
+				perror("Send failed");
+				return -1;
+			}
+
+			slot[id].pending = 1;
+			slot[id].sent = now_usec();
+
+			outstanding++;
+			sent_pkt++;
+
+			if (num > 0)
+				num--;
+		}
+
+		/* Expire requests that have been waiting for too long */
+		now = now_usec();
+		oldest = now;
+
+		for (i = 1; i < 256; i++) {
+			if (!slot[i].pending)
+				continue;
+
+			if (now - slot[i].sent >= timeout * 1000000ULL) {
+				slot[i].pending = 0;
+				outstanding--;
+				continue;
+			}
+
+			if (slot[i].sent < oldest)
+				oldest = slot[i].sent;
+		}
+
+		if (!outstanding)
+			continue;
+
+		pf[0].fd = sk;
+		pf[0].events = POLLIN;
+
+		err = poll(pf, 1, (oldest + timeout * 1000000ULL - now) / 1000 + 1);
+		if (err < 0) {
+			perror("Poll failed");
+			return -1;
+		}
+
+		if (!err)
+			continue;
+
+		err = recv(sk, recv_buf, L2CAP_CMD_HDR_SIZE + size, 0);
+		if (err < 0) {
+			perror("Recv failed");
+			return -1;
+		}
+
+		if (!err) {
+			printf("Disconnected\n");
+			return -1;
+		}
+
+		if (recv_cmd->code == L2CAP_COMMAND_REJ &&
+					slot[recv_cmd->ident].pending) {
+			printf("Peer doesn't support Echo packets\n");
+			return -1;
+		}
+
+		if (recv_cmd->code != L2CAP_ECHO_RSP ||
+					!slot[recv_cmd->ident].pending)
+			continue;
+
+		if (verify && (btohs(recv_cmd->len) != size ||
+				memcmp(&send_buf[L2CAP_CMD_HDR_SIZE],
+					&recv_buf[L2CAP_CMD_HDR_SIZE], size))) {
+			fprintf(stderr, "Response payload different.\n");
+			return -1;
+		}
+
+		rtt_add(now_usec() - slot[recv_cmd->ident].sent);
+
+		slot[recv_cmd->ident].pending = 0;
+		outstanding--;
+		recv_pkt++;
+	}
+
+	return 0;
 }
 
 static void usage(void)
 {
 	printf("l2ping - L2CAP ping\n");
 	printf("Usage:\n");
-	printf("\tl2ping [-i device] [-s size] [-c count] [-t timeout] [-d delay] [-f] [-r] [-v] <bdaddr>\n");
+	printf("\tl2ping [-i device] [-s size] [-c count] [-t timeout] [-d delay] [-f] [-r] [-v]\n"
+		"\t       [-l window] [-S max:step] <bdaddr>\n");
 	printf("\t-f  Flood ping (delay = 0)\n");
+	printf("\t-l  Keep window echo requests in flight (implies -f)\n");
+	printf("\t-S  Repeat with payload sizes up to max (-c pings each)\n");
 	printf("\t-r  Reverse ping\n");
 	printf("\t-v  Verify request and response payload\n");
 }
 
 int main(int argc, char *argv[])
 {
-	int opt;
+	struct sigaction sa;
+	int opt, sk, err;
 
 	/* Default options */
 	bacpy(&bdaddr, BDADDR_ANY);
 
-	while ((opt=getopt(argc,argv,"i:d:s:c:t:frv")) != EOF) {
+	while ((opt=getopt(argc,argv,"i:d:s:c:t:l:S:frv")) != EOF) {
 		switch(opt) {
 		case 'i':
 			if (!strncasecmp(optarg, "hci", 3))
@@ -286,6 +478,23 @@ int main(int argc, char *argv[])
 			delay = 0;
 			break;
 
+		case 'l':
+			/* Real flood ping */
+			window = atoi(optarg);
+			if (window < 1)
+				window = 1;
+			else if (window > 254)
+				window = 254;
+			delay = 0;
+			break;
+
+		case 'S':
+			if (sscanf(optarg, "%d:%d", &size_max, &size_step) < 1) {
+				usage();
+				exit(1);
+			}
+			break;
+
 		case 'r':
 			/* Use responses instead of requests */
 			reverse = 1;
@@ -318,7 +527,55 @@ int main(int argc, char *argv[])
 		exit(1);
 	}
 
-	ping(argv[optind]);
+	if (size_max < size)
+		size_max = size;
+
+	if (size_step < 1)
+		size_step = size_max - size > 0 ? size_max - size : 1;
+
+	/* Every size of a sweep needs an end */
+	if (size_max > size && count == -1)
+		count = 100;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = stat;
+	sigaction(SIGINT, &sa, NULL);
+
+	send_buf = malloc(L2CAP_CMD_HDR_SIZE + size_max);
+	recv_buf = malloc(L2CAP_CMD_HDR_SIZE + size_max);
+	if (!send_buf || !recv_buf) {
+		perror("Can't allocate buffer");
+		exit(1);
+	}
+
+	sk = ping_connect(argv[optind]);
+	if (sk < 0)
+		exit(1);
+
+	for (; size <= size_max; size += size_step) {
+		if (sent_pkt) {
+			printf("Ping: %s (data size %d) ...\n",
+							argv[optind], size);
+			sent_pkt = recv_pkt = rtt_cnt = 0;
+		}
+
+		if (window > 1 && !reverse)
+			err = flood(sk, argv[optind]);
+		else
+			err = ping(sk, argv[optind]);
+
+		if (err < 0) {
+			close(sk);
+			exit(1);
+		}
+
+		report();
+	}
+
+	close(sk);
+	free(send_buf);
+	free(recv_buf);
+	free(rtt);
 
 	return 0;
 }
@@ -42,13 +42,21 @@
 
 #include "ubcsp.h"
 
+#if UBCSP_BLOCK_UART
+#include <string.h>
+#endif
+
 #if SHOW_PACKET_ERRORS || SHOW_LE_STATES
 #include <stdio.h>
 #include <windows.h>
 #endif
 
+#if !UBCSP_BLOCK_UART
 static uint16 ubcsp_calc_crc (uint8 ch, uint16 crc);
+#endif
+static uint16 ubcsp_calc_crc_block (const uint8 *data, int32 len, uint16 crc);
 static uint16 ubcsp_crc_reverse (uint16);
+static uint8 ubcsp_sent_packet (void);
 
 /*****************************************************************************/
 /**                                                                         **/
@@ -133,6 +141,17 @@ static uint8 ubcsp_send_crc[2];
 
 static uint8 ubcsp_receive_header[4];
 
+#if UBCSP_BLOCK_UART
+/* These are the staging buffers for talking to the UART a block at a time */
+
+static uint8 ubcsp_uart_tx_buffer[UBCSP_UART_BUFFER_SIZE];
+static uint32 ubcsp_uart_tx_size;
+
+static uint8 ubcsp_uart_rx_buffer[UBCSP_UART_BUFFER_SIZE];
+static uint32 ubcsp_uart_rx_ptr;
+static uint32 ubcsp_uart_rx_size;
+#endif
+
 /*****************************************************************************/
 /**                                                                         **/
 /** Code - ROM or RAM                                                       **/
@@ -157,6 +176,12 @@ void ubcsp_initialize (void)
 
 	ubcsp_config.delay = 0;
 
+#if UBCSP_BLOCK_UART
+	ubcsp_uart_tx_size = 0;
+	ubcsp_uart_rx_ptr = 0;
+	ubcsp_uart_rx_size = 0;
+#endif
+
 #if SHOW_LE_STATES
 	printf ("Hello Link Uninitialized\n");
 #endif
@@ -214,28 +239,72 @@ void ubcsp_receive_packet (struct ubcsp_packet *receive_packet)
 /** ubcsp_calc_crc                                                          **/
 /**                                                                         **/
 /** Takes the next 8 bit value ch, and updates the crc with this value      **/
+/** Uses a 256 entry table, so there is one lookup per octet                **/
 /**                                                                         **/
 /*****************************************************************************/
 
 
 #ifdef UBCSP_CRC
 
-static uint16 ubcsp_calc_crc (uint8 ch, uint16 crc)
-{
-	/* Calculate the CRC using the above 16 entry lookup table */
+/* Table for the CCITT CRC, reflected - a whole octet per lookup */
 
-	static const uint16 crc_table[] =
+static const uint16 ubcsp_crc_table[256] =
 		{
-			0x0000, 0x1081, 0x2102, 0x3183,
-			0x4204, 0x5285, 0x6306, 0x7387,
-			0x8408, 0x9489, 0xa50a, 0xb58b,
-			0xc60c, 0xd68d, 0xe70e, 0xf78f
+			0x0000, 0x1189, 0x2312, 0x329b, 0x4624, 0x57ad, 0x6536, 0x74bf,
+			0x8c48, 0x9dc1, 0xaf5a, 0xbed3, 0xca6c, 0xdbe5, 0xe97e, 0xf8f7,
+			0x1081, 0x0108, 0x3393, 0x221a, 0x56a5, 0x472c, 0x75b7, 0x643e,
+			0x9cc9, 0x8d40, 0xbfdb, 0xae52, 0xdaed, 0xcb64, 0xf9ff, 0xe876,
+			0x2102, 0x308b, 0x0210, 0x1399, 0x6726, 0x76af, 0x4434, 0x55bd,
+			0xad4a, 0xbcc3, 0x8e58, 0x9fd1, 0xeb6e, 0xfae7, 0xc87c, 0xd9f5,
+			0x3183, 0x200a, 0x1291, 0x0318, 0x77a7, 0x662e, 0x54b5, 0x453c,
+			0xbdcb, 0xac42, 0x9ed9, 0x8f50, 0xfbef, 0xea66, 0xd8fd, 0xc974,
+			0x4204, 0x538d, 0x6116, 0x709f, 0x0420, 0x15a9, 0x2732, 0x36bb,
+			0xce4c, 0xdfc5, 0xed5e, 0xfcd7, 0x8868, 0x99e1, 0xab7a, 0xbaf3,
+			0x5285, 0x430c, 0x7197, 0x601e, 0x14a1, 0x0528, 0x37b3, 0x263a,
+			0xdecd, 0xcf44, 0xfddf, 0xec56, 0x98e9, 0x8960, 0xbbfb, 0xaa72,
+			0x6306, 0x728f, 0x4014, 0x519d, 0x2522, 0x34ab, 0x0630, 0x17b9,
+			0xef4e, 0xfec7, 0xcc5c, 0xddd5, 0xa96a, 0xb8e3, 0x8a78, 0x9bf1,
+			0x7387, 0x620e, 0x5095, 0x411c, 0x35a3, 0x242a, 0x16b1, 0x0738,
+			0xffcf, 0xee46, 0xdcdd, 0xcd54, 0xb9eb, 0xa862, 0x9af9, 0x8b70,
+			0x8408, 0x9581, 0xa71a, 0xb693, 0xc22c, 0xd3a5, 0xe13e, 0xf0b7,
+			0x0840, 0x19c9, 0x2b52, 0x3adb, 0x4e64, 0x5fed, 0x6d76, 0x7cff,
+			0x9489, 0x8500, 0xb79b, 0xa612, 0xd2ad, 0xc324, 0xf1bf, 0xe036,
+			0x18c1, 0x0948, 0x3bd3, 0x2a5a, 0x5ee5, 0x4f6c, 0x7df7, 0x6c7e,
+			0xa50a, 0xb483, 0x8618, 0x9791, 0xe32e, 0xf2a7, 0xc03c, 0xd1b5,
+			0x2942, 0x38cb, 0x0a50, 0x1bd9, 0x6f66, 0x7eef, 0x4c74, 0x5dfd,
+			0xb58b, 0xa402, 0x9699, 0x8710, 0xf3af, 0xe226, 0xd0bd, 0xc134,
+			0x39c3, 0x284a, 0x1ad1, 0x0b58, 0x7fe7, 0x6e6e, 0x5cf5, 0x4d7c,
+			0xc60c, 0xd785, 0xe51e, 0xf497, 0x8028, 0x91a1, 0xa33a, 0xb2b3,
+			0x4a44, 0x5bcd, 0x6956, 0x78df, 0x0c60, 0x1de9, 0x2f72, 0x3efb,
+			0xd68d, 0xc704, 0xf59f, 0xe416, 0x90a9, 0x8120, 0xb3bb, 0xa232,
+			0x5ac5, 0x4b4c, 0x79d7, 0x685e, 0x1ce1, 0x0d68, 0x3ff3, 0x2e7a,
+			0xe70e, 0xf687, 0xc41c, 0xd595, 0xa12a, 0xb0a3, 0x8238, 0x93b1,
+			0x6b46, 0x7acf, 0x4854, 0x59dd, 0x2d62, 0x3ceb, 0x0e70, 0x1ff9,
+			0xf78f, 0xe606, 0xd49d, 0xc514, 0xb1ab, 0xa022, 0x92b9, 0x8330,
+			0x7bc7, 0x6a4e, 0x58d5, 0x495c, 0x3de3, 0x2c6a, 0x1ef1, 0x0f78
 		};
 
-	/* Do this four bits at a time - more code, less space */
+#if !UBCSP_BLOCK_UART
+static uint16 ubcsp_calc_crc (uint8 ch, uint16 crc)
+{
+	return (crc >> 8) ^ ubcsp_crc_table[(crc ^ ch) & 0xff];
+}
+#endif
+
+/*****************************************************************************/
+/**                                                                         **/
+/** ubcsp_calc_crc_block                                                    **/
+/**                                                                         **/
+/** Updates the crc with len octets from data                               **/
+/**                                                                         **/
+/*****************************************************************************/
 
-    crc = (crc >> 4) ^ crc_table[(crc ^ ch) & 0x000f];
-    crc = (crc >> 4) ^ crc_table[(crc ^ (ch >> 4)) & 0x000f];
+static uint16 ubcsp_calc_crc_block (const uint8 *data, int32 len, uint16 crc)
+{
+	while (len --)
+	{
+		crc = (crc >> 8) ^ ubcsp_crc_table[(crc ^ *data ++) & 0xff];
+	}
 
 	return crc;
 }
@@ -268,6 +337,185 @@ static uint16 ubcsp_crc_reverse (uint16 crc)
 
 #endif
 
+/*****************************************************************************/
+/**                                                                         **/
+/** ubcsp_put_uart, ubcsp_flush_uart and ubcsp_get_uart                     **/
+/**                                                                         **/
+/** With UBCSP_BLOCK_UART octets are collected in a buffer and handed to    **/
+/** the UART a block at a time, and likewise read from it a block at a time **/
+/**                                                                         **/
+/*****************************************************************************/
+
+#if UBCSP_BLOCK_UART
+
+static void ubcsp_flush_uart (void)
+{
+	if (ubcsp_uart_tx_size)
+	{
+		put_uart_block (ubcsp_uart_tx_buffer, ubcsp_uart_tx_size);
+
+		ubcsp_uart_tx_size = 0;
+	}
+}
+
+static void ubcsp_put_uart (uint8 ch)
+{
+	if (ubcsp_uart_tx_size == UBCSP_UART_BUFFER_SIZE)
+	{
+		ubcsp_flush_uart ();
+	}
+
+	ubcsp_uart_tx_buffer[ubcsp_uart_tx_size ++] = ch;
+}
+
+static uint8 ubcsp_get_uart (uint8 *ch)
+{
+	/* Only go to the UART once everything read before is used up */
+
+	if (ubcsp_uart_rx_ptr == ubcsp_uart_rx_size)
+	{
+		ubcsp_uart_rx_ptr = 0;
+		ubcsp_uart_rx_size = get_uart_block (ubcsp_uart_rx_buffer, UBCSP_UART_BUFFER_SIZE);
+
+		if (!ubcsp_uart_rx_size)
+		{
+			return 0;
+		}
+	}
+
+	*ch = ubcsp_uart_rx_buffer[ubcsp_uart_rx_ptr ++];
+
+	return 1;
+}
+
+/*****************************************************************************/
+/**                                                                         **/
+/** ubcsp_put_slip_block                                                    **/
+/**                                                                         **/
+/** Outputs len octets from data, escaping them as required                 **/
+/** Runs of octets which need no escaping are copied in one go              **/
+/**                                                                         **/
+/*****************************************************************************/
+
+static void ubcsp_put_slip_block (const uint8 *data, int32 len)
+{
+	int32
+		run;
+
+	while (len > 0)
+	{
+		/* Find how many octets can be copied as they are */
+
+		for (run = 0; run < len; run ++)
+		{
+			if ((data[run] == SLIP_FRAME) || (data[run] == SLIP_ESCAPE))
+			{
+				break;
+			}
+		}
+
+		while (run > 0)
+		{
+			int32
+				space = UBCSP_UART_BUFFER_SIZE - ubcsp_uart_tx_size;
+
+			if (!space)
+			{
+				ubcsp_flush_uart ();
+				continue;
+			}
+
+			if (space > run)
+			{
+				space = run;
+			}
+
+			memcpy (ubcsp_uart_tx_buffer + ubcsp_uart_tx_size, data, space);
+
+			ubcsp_uart_tx_size += space;
+			data += space;
+			len -= space;
+			run -= space;
+		}
+
+		if (len > 0)
+		{
+			/* The next octet needs both escape octets */
+
+			ubcsp_put_uart (SLIP_ESCAPE);
+			ubcsp_put_uart (*data == SLIP_FRAME ? SLIP_ESCAPE_FRAME : SLIP_ESCAPE_ESCAPE);
+
+			data ++;
+			len --;
+		}
+	}
+}
+
+/*****************************************************************************/
+/**                                                                         **/
+/** ubcsp_send_block                                                        **/
+/**                                                                         **/
+/** Outputs the rest of the packet being sent, its CRC and the end of       **/
+/** FRAME marker, then hands everything to the UART                         **/
+/**                                                                         **/
+/*****************************************************************************/
+
+static uint8 ubcsp_send_block (void)
+{
+	while (ubcsp_config.send_ptr)
+	{
+#if UBCSP_CRC
+		ubcsp_config.send_crc = ubcsp_calc_crc_block (ubcsp_config.send_ptr, ubcsp_config.send_size, ubcsp_config.send_crc);
+#endif
+
+		ubcsp_put_slip_block (ubcsp_config.send_ptr, ubcsp_config.send_size);
+
+		/* setup the next block */
+
+		ubcsp_config.send_ptr = ubcsp_config.next_send_ptr;
+		ubcsp_config.send_size = ubcsp_config.next_send_size;
+		ubcsp_config.next_send_ptr = 0;
+		ubcsp_config.next_send_size = 0;
+	}
+
+#if UBCSP_CRC
+	if (ubcsp_config.need_send_crc)
+	{
+		/* reverse the CRC from what we computed along the way */
+
+		ubcsp_config.need_send_crc = 0;
+
+		ubcsp_config.send_crc = ubcsp_crc_reverse (ubcsp_config.send_crc);
+
+		ubcsp_send_crc[0] = (uint8) (ubcsp_config.send_crc >> 8);
+		ubcsp_send_crc[1] = (uint8) ubcsp_config.send_crc;
+
+		ubcsp_put_slip_block (ubcsp_send_crc, 2);
+	}
+#endif
+
+	/* Output the end of FRAME marker */
+
+	ubcsp_put_uart (SLIP_FRAME);
+
+	ubcsp_flush_uart ();
+
+	ubcsp_config.send_size = 0;
+
+	/* Check if this is an unreliable packet */
+
+	return ubcsp_sent_packet ();
+}
+
+#else
+
+#define ubcsp_put_uart(ch)	put_uart (ch)
+#define ubcsp_get_uart(ch)	get_uart (ch)
+
+#endif
+
+#if !UBCSP_BLOCK_UART
+
 /*****************************************************************************/
 /**                                                                         **/
 /** ubcsp_put_slip_uart                                                     **/
@@ -289,22 +537,24 @@ static void ubcsp_put_slip_uart (uint8 ch)
 
 	if (ch == SLIP_FRAME)
 	{
-		put_uart (SLIP_ESCAPE);
+		ubcsp_put_uart (SLIP_ESCAPE);
 		ubcsp_config.send_slip_escape = SLIP_ESCAPE_FRAME;
 	}
 	else if (ch == SLIP_ESCAPE)
 	{
-		put_uart (SLIP_ESCAPE);
+		ubcsp_put_uart (SLIP_ESCAPE);
 		ubcsp_config.send_slip_escape = SLIP_ESCAPE_ESCAPE;
 	}
 	else
 	{
 		/* Not escaped, so just output octet */
 
-		put_uart (ch);
+		ubcsp_put_uart (ch);
 	}
 }
 
+#endif
+
 /*****************************************************************************/
 /**                                                                         **/
 /** ubcsp_which_le_payload                                                  **/
@@ -367,9 +617,6 @@ static uint8 ubcsp_recevied_packet (void)
 		activity;
 
 #if UBCSP_CRC
-	static int32
-		loop;
-
 	static uint16
 		crc;
 #endif
@@ -468,17 +715,11 @@ static uint8 ubcsp_recevied_packet (void)
 
 		/* CRC the packet header */
 
-		for (loop = 0; loop < 4; loop ++)
-		{
-			crc = ubcsp_calc_crc (ubcsp_receive_header[loop], crc);
-		}
+		crc = ubcsp_calc_crc_block (ubcsp_receive_header, 4, crc);
 
 		/* CRC the packet payload - without the CRC bytes */
 
-		for (loop = 0; loop < ubcsp_config.receive_index; loop ++)
-		{
-			crc = ubcsp_calc_crc (ubcsp_config.receive_packet->payload[loop], crc);
-		}
+		crc = ubcsp_calc_crc_block (ubcsp_config.receive_packet->payload, ubcsp_config.receive_index, crc);
 
 		/* Reverse the CRC */
 
@@ -846,6 +1087,15 @@ uint8 ubcsp_poll (uint8 *activity)
 
 		if (ubcsp_config.send_size)
 		{
+#if UBCSP_BLOCK_UART
+			/* We have something to send so send all of it */
+
+			*activity |= ubcsp_send_block ();
+
+			/* We've sent the packet, so don't need to have be called quickly soon */
+
+			delay = UBCSP_POLL_TIME_DELAY;
+#else
 			/* We have something to send so send it */
 
 			if (ubcsp_config.send_slip_escape)
@@ -853,7 +1103,7 @@ uint8 ubcsp_poll (uint8 *activity)
 				/* Last time we send a SLIP_ESCAPE octet
 				   this time send the second escape code */
 
-				put_uart (ubcsp_config.send_slip_escape);
+				ubcsp_put_uart (ubcsp_config.send_slip_escape);
 
 				ubcsp_config.send_slip_escape = 0;
 			}
@@ -920,7 +1170,7 @@ uint8 ubcsp_poll (uint8 *activity)
 
 						/* Output the end of FRAME marker */
 
-						put_uart (SLIP_FRAME);
+						ubcsp_put_uart (SLIP_FRAME);
 
 						/* Check if this is an unreliable packet */
 
@@ -939,7 +1189,7 @@ uint8 ubcsp_poll (uint8 *activity)
 				{
 					/* Output the end of FRAME marker */
 
-					put_uart (SLIP_FRAME);
+					ubcsp_put_uart (SLIP_FRAME);
 
 					/* Check if this is an unreliable packet */
 
@@ -951,6 +1201,7 @@ uint8 ubcsp_poll (uint8 *activity)
 				}
 #endif
 			}
+#endif
 		}
 		else if (ubcsp_config.link_establishment_packet == ubcsp_le_none)
 		{
@@ -961,7 +1212,7 @@ uint8 ubcsp_poll (uint8 *activity)
 			{
 				/* Send the start of FRAME packet */
 
-				put_uart (SLIP_FRAME);
+				ubcsp_put_uart (SLIP_FRAME);
 
 				/* We did require a RESP packet - so setup the send */
 
@@ -977,7 +1228,7 @@ uint8 ubcsp_poll (uint8 *activity)
 
 				/* Send the start of FRAME packet */
 
-				put_uart (SLIP_FRAME);
+				ubcsp_put_uart (SLIP_FRAME);
 
 				/* Encode up the packet header using ACK and SEQ numbers */
 
@@ -1016,7 +1267,7 @@ uint8 ubcsp_poll (uint8 *activity)
 			{
 				/* Send the start of FRAME packet */
 
-				put_uart (SLIP_FRAME);
+				ubcsp_put_uart (SLIP_FRAME);
 
 #if SHOW_PACKET_ERRORS
 				printf (" : %10d Send ACK %d\n",
@@ -1058,7 +1309,7 @@ uint8 ubcsp_poll (uint8 *activity)
 
 			/* Send A Link Establishment Message */
 
-			put_uart (SLIP_FRAME);
+			ubcsp_put_uart (SLIP_FRAME);
 
 			/* Send the Link Establishment header followed by the 
 			   Link Establishment packet */
@@ -1083,7 +1334,7 @@ uint8 ubcsp_poll (uint8 *activity)
 
 	/* We now need to receive any octets from the UART */
 
-	while ((ubcsp_config.receive_packet) && (get_uart (&value)))
+	while ((ubcsp_config.receive_packet) && (ubcsp_get_uart (&value)))
 	{
 		/* If the last octet was SLIP_ESCAPE, then special processing is required */
 
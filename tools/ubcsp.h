@@ -42,6 +42,14 @@
 /* If we wish to use CRC's, then change 0 to 1 in the next line */
 #define UBCSP_CRC 1
 
+/* If the UART should be driven a block at a time through put_uart_block
+   and get_uart_block instead of put_uart and get_uart, then change 0 to 1
+   in the next line */
+#define UBCSP_BLOCK_UART 1
+
+/* This is the size of the staging buffers used for block UART access */
+#define UBCSP_UART_BUFFER_SIZE 512
+
 /* Define some basic types - change these for your architecture */
 typedef unsigned char uint8;
 typedef unsigned short uint16;
@@ -174,6 +182,27 @@ uint8 ubcsp_poll (uint8 *activity);
 /**                                                                         **/
 /*****************************************************************************/
 
+#if UBCSP_BLOCK_UART
+
+/*****************************************************************************/
+/**                                                                         **/
+/** put_uart_block outputs all of the len octets over the UART Tx line      **/
+/**                                                                         **/
+/*****************************************************************************/
+
+extern void put_uart_block (const uint8 *, uint32);
+
+/*****************************************************************************/
+/**                                                                         **/
+/** get_uart_block receives up to len octets over the UART Rx line          **/
+/** and returns how many were read, or 0 if no octet is available           **/
+/**                                                                         **/
+/*****************************************************************************/
+
+extern uint32 get_uart_block (uint8 *, uint32);
+
+#else
+
 /*****************************************************************************/
 /**                                                                         **/
 /** put_uart outputs a single octet over the UART Tx line                   **/
@@ -193,6 +222,8 @@ extern void put_uart (uint8);
 
 extern uint8 get_uart (uint8 *);
 
+#endif
+
 /*****************************************************************************/
 /**                                                                         **/
 /** These defines should be changed to your systems concept of 100ms        **/